@@ -7,7 +7,7 @@
  * @details 核心功能：
  * - KV存储：键值对存储，支持默认值回退
  * - TLV存储：类型-长度-值存储，支持历史记录和保留策略
- * - LFU缓存：加速热点数据读取，可配置缓存大小
+ * - 读缓存：哈希表 + 值内存池，LFU衰减或TinyLFU准入淘汰，加速热点数据读取
  * - 增量GC：分摊垃圾回收开销，避免长时间阻塞
  * - 掉电安全：WRITING→VALID状态机保护数据完整性
  * - 多扇区环形：充分利用Flash空间，自动磨损均衡
@@ -18,48 +18,134 @@
 #include <string.h>
 
 /* ==================== 内部实例与辅助宏 ==================== */
-static nkv_instance_t g_nkv = {0};
-static void           nkv_sync_version(void);
-static nkv_err_t      update_entry_state(uint32_t addr, uint16_t state);
+static nkv_instance_t g_nkv = {0}; /* 默认实例(兼容旧API) */
+static void           nkv_sync_version(nkv_instance_t* db);
+static nkv_err_t      update_entry_state(nkv_instance_t* db, uint32_t addr, uint16_t state);
+static uint8_t        is_sector_valid_locked(nkv_instance_t* db, uint8_t idx);
+static nkv_err_t      format_locked(nkv_instance_t* db);
+static nkv_err_t      tlv_set_locked(nkv_instance_t* db, uint8_t type, const void* value, uint8_t len);
+static uint8_t        tlv_exists_locked(nkv_instance_t* db, uint8_t type);
+static nkv_err_t      tlv_get_history_locked(nkv_instance_t* db, uint8_t type, nkv_tlv_history_t* history,
+                                             uint8_t max, uint8_t* count);
+static nkv_err_t      write_batch(nkv_instance_t* db, const nkv_batch_item_t* items, uint8_t count);
+static uint32_t       find_tlv(nkv_instance_t* db, uint8_t type, nkv_entry_t* out);
+#if NKV_WRITE_BUFFER
+static void wbuf_clear(nkv_instance_t* db);
+#endif
 
 #define NKV_VER_KEY "__nkv_ver__"
 
-#define SECTOR_ADDR(i)    (g_nkv.flash.base + (i) * g_nkv.flash.sector_size)            // 扇区地址
-#define ALIGN(x)          (((x) + (g_nkv.flash.align - 1)) & ~(g_nkv.flash.align - 1))  // 对齐
-#define ALIGNED_HDR_SIZE  ALIGN(NKV_SECTOR_HDR_SIZE)
-#define PREV_SECTOR(c, o) (((c) + g_nkv.flash.sector_count - (o)) % g_nkv.flash.sector_count)
+/* 以下宏均作用于当前函数的实例指针 db */
+#define SECTOR_ADDR(i)    (db->flash.base + (i) * db->flash.sector_size)            // 扇区地址
+#define ALIGN(x)          (((x) + (db->flash.align - 1)) & ~(db->flash.align - 1))  // 对齐
+#define ALIGNED_HDR_SIZE  ALIGN(NKV_SECTOR_HDR_SIZE)                                 // 最大扇区头(容量检查)
+#define HDR_SIZE(f)       ALIGN((f) == NKV_FORMAT_V3 ? NKV_SECTOR_HDR_SIZE : NKV_SECTOR_HDR_V1) // 格式f的扇区头
+#define SECTOR_DATA(i)    HDR_SIZE(db->sectors[i].format)                           // 扇区内第一个条目的偏移
+#define SECTOR_OF(addr)   (((addr) - db->flash.base) / db->flash.sector_size)       // 地址所在扇区
 #define ENTRY_SIZE(e)     ALIGN(NKV_HEADER_SIZE + (e).key_len + (e).val_len + NKV_CRC_SIZE)
-#define MAX_ENTRY_SIZE    (NKV_HEADER_SIZE + NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN + NKV_CRC_SIZE + 32)
 
-/* ==================== TLV保留策略 ==================== */
-#if NKV_TLV_RETENTION_ENABLE
-typedef struct
+/* 条目头字段（两种存储格式通用） */
+#define ENTRY_FLAG(e)      ((uint8_t) ((e).reserved | 0xFC))                          // 条目标志：格式2只用低2位
+#define ENTRY_HASH14(e)    ((uint16_t) ((e).key_hash | (((e).reserved & 0xFC) << 6))) // 格式2的14位键哈希
+#define FORMAT_MAGIC(f)    (((f) == NKV_FORMAT_V1) ? NKV_MAGIC_V1 : ((f) == NKV_FORMAT_V2) ? NKV_MAGIC_V2 : NKV_MAGIC)
+#define MAGIC_FORMAT(m)    (((m) == NKV_MAGIC_V1) ? NKV_FORMAT_V1 : ((m) == NKV_MAGIC_V2) ? NKV_FORMAT_V2 : NKV_FORMAT_V3)
+#define MAGIC_VALID(m)     ((m) == NKV_MAGIC || (m) == NKV_MAGIC_V2 || (m) == NKV_MAGIC_V1)
+#define IS_CHUNK(e)        ((e).key_len == 0 && ENTRY_FLAG(e) == NKV_ENTRY_FLAG_LARGE) // 大值分块
+#define IS_LARGE_HEAD(e)   ((e).key_len > 0 && ENTRY_FLAG(e) == NKV_ENTRY_FLAG_LARGE)  // 大值头条目
+
+/* ==================== 线程安全 ==================== */
+/*
+ * 写操作持锁执行，并在前后各递增一次实例写序号(seqlock)：序号为奇数表示写入进行中。
+ * RAM缓存命中的读取不加锁，读取前后序号一致才采用结果，否则回退到加锁路径；
+ * 需要访问Flash的读取一律持锁，flash.read 不会与 write/erase 并发执行。
+ */
+#if NKV_THREAD_SAFE
+    #if defined(__GNUC__) || defined(__clang__)
+        #define SEQ_LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+        #define SEQ_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+        #define SEQ_FENCE()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+        #define STAT_INC(p)     ((void) __atomic_fetch_add((p), 1, __ATOMIC_RELAXED))
+        #define STAT_ADD(p, n)  ((void) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED))
+        #define SEQ_LOCKFREE    1
+    #else
+        /*
+         * 其他编译器：缓存值的复制不是 volatile 访问，可能被移到序号读取之外，
+         * 无锁读取需要 NanoKV_cfg.h 中提供的 NKV_MEMORY_BARRIER()，未提供时读取一律加锁
+         */
+        #define SEQ_LOAD(p)     (*(p))
+        #define SEQ_STORE(p, v) (*(p) = (v))
+        #define STAT_INC(p)     ((void) (*(p))++)
+        #define STAT_ADD(p, n)  ((void) (*(p) += (n)))
+        #ifdef NKV_MEMORY_BARRIER
+            #define SEQ_FENCE()  NKV_MEMORY_BARRIER()
+            #define SEQ_LOCKFREE 1
+        #else
+            #define SEQ_FENCE()  ((void) 0)
+            #define SEQ_LOCKFREE 0
+        #endif
+    #endif
+
+static void write_begin(nkv_instance_t* db)
+{
+    if (!db)
+        return;
+    if (db->flash.lock)
+        db->flash.lock(db->flash.lock_ctx);
+    SEQ_STORE(&db->seq, db->seq + 1);
+    SEQ_FENCE();
+}
+
+static void write_end(nkv_instance_t* db)
+{
+    if (!db)
+        return;
+    SEQ_FENCE();
+    SEQ_STORE(&db->seq, db->seq + 1);
+    if (db->flash.unlock)
+        db->flash.unlock(db->flash.lock_ctx);
+}
+
+static void read_begin(nkv_instance_t* db)
 {
-    uint8_t  type;
-    uint16_t keep_count;
-} tlv_retention_t;
+    if (db && db->flash.lock)
+        db->flash.lock(db->flash.lock_ctx);
+}
 
-typedef struct
+static void read_end(nkv_instance_t* db)
 {
-    uint8_t  type;
-    uint32_t threshold;
-} tlv_keep_info_t;
+    if (db && db->flash.unlock)
+        db->flash.unlock(db->flash.lock_ctx);
+}
+
+    #define WRITE_BEGIN(db) write_begin(db)
+    #define WRITE_END(db)   write_end(db)
+    #define READ_BEGIN(db)  read_begin(db)
+    #define READ_END(db)    read_end(db)
+#else
+    #define WRITE_BEGIN(db) ((void) 0)
+    #define WRITE_END(db)   ((void) 0)
+    #define READ_BEGIN(db)  ((void) 0)
+    #define READ_END(db)    ((void) 0)
+    #define STAT_INC(p)     ((void) (*(p))++)
+    #define STAT_ADD(p, n)  ((void) (*(p) += (n)))
+#endif
 
-static tlv_retention_t g_tlv_retention[NKV_TLV_RETENTION_MAX];
-static uint8_t         g_tlv_retention_count = 0;
-static tlv_keep_info_t g_tlv_keep_info[NKV_TLV_RETENTION_MAX];
-static uint8_t         g_tlv_keep_info_count = 0;
+#if NKV_OP_STATS
+    #define OP_COUNT(db, field, n) STAT_ADD(&(db)->op_stats.field, (n)) /* 无锁读取路径也会计数 */
+#else
+    #define OP_COUNT(db, field, n) ((void) 0)
 #endif
 
-/* TLV默认值表 */
-static const nkv_tlv_default_t* g_tlv_defaults      = NULL;
-static uint16_t                 g_tlv_default_count = 0;
+#if NKV_ASYNC_FLASH
+    #define ASYNC_BUSY(db) ((db) && (db)->async.kind != 0) /* 异步作业进行中，其他写操作返回 NKV_ERR_BUSY */
+#else
+    #define ASYNC_BUSY(db) 0
+#endif
 
 /* ==================== CRC16计算 ==================== */
-/* 计算MODBUS CRC16校验值 */
-static uint16_t calc_crc16(const uint8_t* data, uint32_t len)
+/* MODBUS CRC16 逐位计算（无表，代码最小） */
+uint16_t nkv_crc16_bitwise(uint16_t crc, const uint8_t* data, uint32_t len)
 {
-    uint16_t crc = 0xFFFF;
     for (uint32_t i = 0; i < len; i++)
     {
         crc ^= data[i];
@@ -69,8 +155,196 @@ static uint16_t calc_crc16(const uint8_t* data, uint32_t len)
     return crc;
 }
 
+#if NKV_CRC_ENGINE >= 1
+/* 查表：[0]为单字节表，[1..3]为 slice-by-4 的后续字节表 */
+static const uint16_t crc16_table[NKV_CRC_ENGINE >= 2 ? 4 : 1][256] = {
+    {
+        0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+        0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+        0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+        0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+        0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+        0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+        0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+        0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+        0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+        0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+        0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+        0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+        0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+        0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+        0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+        0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+        0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+        0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+        0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+        0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+        0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+        0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+        0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+        0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+        0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+        0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+        0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+        0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+        0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+        0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+        0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+        0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+    },
+    #if NKV_CRC_ENGINE >= 2
+    {
+        0x0000, 0x9001, 0x6001, 0xF000, 0xC002, 0x5003, 0xA003, 0x3002,
+        0xC007, 0x5006, 0xA006, 0x3007, 0x0005, 0x9004, 0x6004, 0xF005,
+        0xC00D, 0x500C, 0xA00C, 0x300D, 0x000F, 0x900E, 0x600E, 0xF00F,
+        0x000A, 0x900B, 0x600B, 0xF00A, 0xC008, 0x5009, 0xA009, 0x3008,
+        0xC019, 0x5018, 0xA018, 0x3019, 0x001B, 0x901A, 0x601A, 0xF01B,
+        0x001E, 0x901F, 0x601F, 0xF01E, 0xC01C, 0x501D, 0xA01D, 0x301C,
+        0x0014, 0x9015, 0x6015, 0xF014, 0xC016, 0x5017, 0xA017, 0x3016,
+        0xC013, 0x5012, 0xA012, 0x3013, 0x0011, 0x9010, 0x6010, 0xF011,
+        0xC031, 0x5030, 0xA030, 0x3031, 0x0033, 0x9032, 0x6032, 0xF033,
+        0x0036, 0x9037, 0x6037, 0xF036, 0xC034, 0x5035, 0xA035, 0x3034,
+        0x003C, 0x903D, 0x603D, 0xF03C, 0xC03E, 0x503F, 0xA03F, 0x303E,
+        0xC03B, 0x503A, 0xA03A, 0x303B, 0x0039, 0x9038, 0x6038, 0xF039,
+        0x0028, 0x9029, 0x6029, 0xF028, 0xC02A, 0x502B, 0xA02B, 0x302A,
+        0xC02F, 0x502E, 0xA02E, 0x302F, 0x002D, 0x902C, 0x602C, 0xF02D,
+        0xC025, 0x5024, 0xA024, 0x3025, 0x0027, 0x9026, 0x6026, 0xF027,
+        0x0022, 0x9023, 0x6023, 0xF022, 0xC020, 0x5021, 0xA021, 0x3020,
+        0xC061, 0x5060, 0xA060, 0x3061, 0x0063, 0x9062, 0x6062, 0xF063,
+        0x0066, 0x9067, 0x6067, 0xF066, 0xC064, 0x5065, 0xA065, 0x3064,
+        0x006C, 0x906D, 0x606D, 0xF06C, 0xC06E, 0x506F, 0xA06F, 0x306E,
+        0xC06B, 0x506A, 0xA06A, 0x306B, 0x0069, 0x9068, 0x6068, 0xF069,
+        0x0078, 0x9079, 0x6079, 0xF078, 0xC07A, 0x507B, 0xA07B, 0x307A,
+        0xC07F, 0x507E, 0xA07E, 0x307F, 0x007D, 0x907C, 0x607C, 0xF07D,
+        0xC075, 0x5074, 0xA074, 0x3075, 0x0077, 0x9076, 0x6076, 0xF077,
+        0x0072, 0x9073, 0x6073, 0xF072, 0xC070, 0x5071, 0xA071, 0x3070,
+        0x0050, 0x9051, 0x6051, 0xF050, 0xC052, 0x5053, 0xA053, 0x3052,
+        0xC057, 0x5056, 0xA056, 0x3057, 0x0055, 0x9054, 0x6054, 0xF055,
+        0xC05D, 0x505C, 0xA05C, 0x305D, 0x005F, 0x905E, 0x605E, 0xF05F,
+        0x005A, 0x905B, 0x605B, 0xF05A, 0xC058, 0x5059, 0xA059, 0x3058,
+        0xC049, 0x5048, 0xA048, 0x3049, 0x004B, 0x904A, 0x604A, 0xF04B,
+        0x004E, 0x904F, 0x604F, 0xF04E, 0xC04C, 0x504D, 0xA04D, 0x304C,
+        0x0044, 0x9045, 0x6045, 0xF044, 0xC046, 0x5047, 0xA047, 0x3046,
+        0xC043, 0x5042, 0xA042, 0x3043, 0x0041, 0x9040, 0x6040, 0xF041,
+    },
+    {
+        0x0000, 0xC051, 0xC0A1, 0x00F0, 0xC141, 0x0110, 0x01E0, 0xC1B1,
+        0xC281, 0x02D0, 0x0220, 0xC271, 0x03C0, 0xC391, 0xC361, 0x0330,
+        0xC501, 0x0550, 0x05A0, 0xC5F1, 0x0440, 0xC411, 0xC4E1, 0x04B0,
+        0x0780, 0xC7D1, 0xC721, 0x0770, 0xC6C1, 0x0690, 0x0660, 0xC631,
+        0xCA01, 0x0A50, 0x0AA0, 0xCAF1, 0x0B40, 0xCB11, 0xCBE1, 0x0BB0,
+        0x0880, 0xC8D1, 0xC821, 0x0870, 0xC9C1, 0x0990, 0x0960, 0xC931,
+        0x0F00, 0xCF51, 0xCFA1, 0x0FF0, 0xCE41, 0x0E10, 0x0EE0, 0xCEB1,
+        0xCD81, 0x0DD0, 0x0D20, 0xCD71, 0x0CC0, 0xCC91, 0xCC61, 0x0C30,
+        0xD401, 0x1450, 0x14A0, 0xD4F1, 0x1540, 0xD511, 0xD5E1, 0x15B0,
+        0x1680, 0xD6D1, 0xD621, 0x1670, 0xD7C1, 0x1790, 0x1760, 0xD731,
+        0x1100, 0xD151, 0xD1A1, 0x11F0, 0xD041, 0x1010, 0x10E0, 0xD0B1,
+        0xD381, 0x13D0, 0x1320, 0xD371, 0x12C0, 0xD291, 0xD261, 0x1230,
+        0x1E00, 0xDE51, 0xDEA1, 0x1EF0, 0xDF41, 0x1F10, 0x1FE0, 0xDFB1,
+        0xDC81, 0x1CD0, 0x1C20, 0xDC71, 0x1DC0, 0xDD91, 0xDD61, 0x1D30,
+        0xDB01, 0x1B50, 0x1BA0, 0xDBF1, 0x1A40, 0xDA11, 0xDAE1, 0x1AB0,
+        0x1980, 0xD9D1, 0xD921, 0x1970, 0xD8C1, 0x1890, 0x1860, 0xD831,
+        0xE801, 0x2850, 0x28A0, 0xE8F1, 0x2940, 0xE911, 0xE9E1, 0x29B0,
+        0x2A80, 0xEAD1, 0xEA21, 0x2A70, 0xEBC1, 0x2B90, 0x2B60, 0xEB31,
+        0x2D00, 0xED51, 0xEDA1, 0x2DF0, 0xEC41, 0x2C10, 0x2CE0, 0xECB1,
+        0xEF81, 0x2FD0, 0x2F20, 0xEF71, 0x2EC0, 0xEE91, 0xEE61, 0x2E30,
+        0x2200, 0xE251, 0xE2A1, 0x22F0, 0xE341, 0x2310, 0x23E0, 0xE3B1,
+        0xE081, 0x20D0, 0x2020, 0xE071, 0x21C0, 0xE191, 0xE161, 0x2130,
+        0xE701, 0x2750, 0x27A0, 0xE7F1, 0x2640, 0xE611, 0xE6E1, 0x26B0,
+        0x2580, 0xE5D1, 0xE521, 0x2570, 0xE4C1, 0x2490, 0x2460, 0xE431,
+        0x3C00, 0xFC51, 0xFCA1, 0x3CF0, 0xFD41, 0x3D10, 0x3DE0, 0xFDB1,
+        0xFE81, 0x3ED0, 0x3E20, 0xFE71, 0x3FC0, 0xFF91, 0xFF61, 0x3F30,
+        0xF901, 0x3950, 0x39A0, 0xF9F1, 0x3840, 0xF811, 0xF8E1, 0x38B0,
+        0x3B80, 0xFBD1, 0xFB21, 0x3B70, 0xFAC1, 0x3A90, 0x3A60, 0xFA31,
+        0xF601, 0x3650, 0x36A0, 0xF6F1, 0x3740, 0xF711, 0xF7E1, 0x37B0,
+        0x3480, 0xF4D1, 0xF421, 0x3470, 0xF5C1, 0x3590, 0x3560, 0xF531,
+        0x3300, 0xF351, 0xF3A1, 0x33F0, 0xF241, 0x3210, 0x32E0, 0xF2B1,
+        0xF181, 0x31D0, 0x3120, 0xF171, 0x30C0, 0xF091, 0xF061, 0x3030,
+    },
+    {
+        0x0000, 0xFC01, 0xB801, 0x4400, 0x3001, 0xCC00, 0x8800, 0x7401,
+        0x6002, 0x9C03, 0xD803, 0x2402, 0x5003, 0xAC02, 0xE802, 0x1403,
+        0xC004, 0x3C05, 0x7805, 0x8404, 0xF005, 0x0C04, 0x4804, 0xB405,
+        0xA006, 0x5C07, 0x1807, 0xE406, 0x9007, 0x6C06, 0x2806, 0xD407,
+        0xC00B, 0x3C0A, 0x780A, 0x840B, 0xF00A, 0x0C0B, 0x480B, 0xB40A,
+        0xA009, 0x5C08, 0x1808, 0xE409, 0x9008, 0x6C09, 0x2809, 0xD408,
+        0x000F, 0xFC0E, 0xB80E, 0x440F, 0x300E, 0xCC0F, 0x880F, 0x740E,
+        0x600D, 0x9C0C, 0xD80C, 0x240D, 0x500C, 0xAC0D, 0xE80D, 0x140C,
+        0xC015, 0x3C14, 0x7814, 0x8415, 0xF014, 0x0C15, 0x4815, 0xB414,
+        0xA017, 0x5C16, 0x1816, 0xE417, 0x9016, 0x6C17, 0x2817, 0xD416,
+        0x0011, 0xFC10, 0xB810, 0x4411, 0x3010, 0xCC11, 0x8811, 0x7410,
+        0x6013, 0x9C12, 0xD812, 0x2413, 0x5012, 0xAC13, 0xE813, 0x1412,
+        0x001E, 0xFC1F, 0xB81F, 0x441E, 0x301F, 0xCC1E, 0x881E, 0x741F,
+        0x601C, 0x9C1D, 0xD81D, 0x241C, 0x501D, 0xAC1C, 0xE81C, 0x141D,
+        0xC01A, 0x3C1B, 0x781B, 0x841A, 0xF01B, 0x0C1A, 0x481A, 0xB41B,
+        0xA018, 0x5C19, 0x1819, 0xE418, 0x9019, 0x6C18, 0x2818, 0xD419,
+        0xC029, 0x3C28, 0x7828, 0x8429, 0xF028, 0x0C29, 0x4829, 0xB428,
+        0xA02B, 0x5C2A, 0x182A, 0xE42B, 0x902A, 0x6C2B, 0x282B, 0xD42A,
+        0x002D, 0xFC2C, 0xB82C, 0x442D, 0x302C, 0xCC2D, 0x882D, 0x742C,
+        0x602F, 0x9C2E, 0xD82E, 0x242F, 0x502E, 0xAC2F, 0xE82F, 0x142E,
+        0x0022, 0xFC23, 0xB823, 0x4422, 0x3023, 0xCC22, 0x8822, 0x7423,
+        0x6020, 0x9C21, 0xD821, 0x2420, 0x5021, 0xAC20, 0xE820, 0x1421,
+        0xC026, 0x3C27, 0x7827, 0x8426, 0xF027, 0x0C26, 0x4826, 0xB427,
+        0xA024, 0x5C25, 0x1825, 0xE424, 0x9025, 0x6C24, 0x2824, 0xD425,
+        0x003C, 0xFC3D, 0xB83D, 0x443C, 0x303D, 0xCC3C, 0x883C, 0x743D,
+        0x603E, 0x9C3F, 0xD83F, 0x243E, 0x503F, 0xAC3E, 0xE83E, 0x143F,
+        0xC038, 0x3C39, 0x7839, 0x8438, 0xF039, 0x0C38, 0x4838, 0xB439,
+        0xA03A, 0x5C3B, 0x183B, 0xE43A, 0x903B, 0x6C3A, 0x283A, 0xD43B,
+        0xC037, 0x3C36, 0x7836, 0x8437, 0xF036, 0x0C37, 0x4837, 0xB436,
+        0xA035, 0x5C34, 0x1834, 0xE435, 0x9034, 0x6C35, 0x2835, 0xD434,
+        0x0033, 0xFC32, 0xB832, 0x4433, 0x3032, 0xCC33, 0x8833, 0x7432,
+        0x6031, 0x9C30, 0xD830, 0x2431, 0x5030, 0xAC31, 0xE831, 0x1430,
+    },
+    #endif
+};
+
+/* MODBUS CRC16 查表计算（每字节一次查表） */
+uint16_t nkv_crc16_table(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+        crc = (crc >> 8) ^ crc16_table[0][(crc ^ data[i]) & 0xFF];
+    return crc;
+}
+#endif
+
+#if NKV_CRC_ENGINE >= 2
+/* MODBUS CRC16 slice-by-4 计算（每4字节四次并行查表） */
+uint16_t nkv_crc16_slice4(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+    while (len >= 4)
+    {
+        uint16_t x = crc ^ (uint16_t) (data[0] | (data[1] << 8));
+        crc        = crc16_table[3][x & 0xFF] ^ crc16_table[2][x >> 8] ^ crc16_table[1][data[2]] ^
+              crc16_table[0][data[3]];
+        data += 4;
+        len -= 4;
+    }
+    return nkv_crc16_table(crc, data, len);
+}
+#endif
+
+/* 按配置选择的软件CRC引擎 */
+uint16_t nkv_crc16(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+#if NKV_CRC_ENGINE >= 2
+    return nkv_crc16_slice4(crc, data, len);
+#elif NKV_CRC_ENGINE == 1
+    return nkv_crc16_table(crc, data, len);
+#else
+    return nkv_crc16_bitwise(crc, data, len);
+#endif
+}
+
+/* 计算MODBUS CRC16校验值（优先使用移植层提供的硬件CRC） */
+static uint16_t calc_crc16(nkv_instance_t* db, const uint8_t* data, uint32_t len)
+{
+    if (db->flash.crc16)
+        return db->flash.crc16(0xFFFF, data, len);
+    return nkv_crc16(0xFFFF, data, len);
+}
+
 /* ==================== 位图操作 ==================== */
-/* 计算键哈希值(用于GC加速) */
+/* 计算键哈希值(存于条目头，用于查找时快速过滤) */
 static uint8_t hash_key(const char* key, uint8_t len)
 {
     uint16_t hash = 0;
@@ -79,20 +353,55 @@ static uint8_t hash_key(const char* key, uint8_t len)
     return (uint8_t) (hash & 0xFF);
 }
 
+/* 计算32位标识哈希(FNV-1a，供索引与缓存使用)：KV以键名标识，TLV(key_len=0)以类型字节标识 */
+static uint32_t id_hash(const uint8_t* id, uint8_t key_len)
+{
+    uint8_t  len = key_len ? key_len : 1;
+    uint32_t h   = (0x811C9DC5u ^ key_len) * 0x01000193u;
+    for (uint8_t i = 0; i < len; i++)
+        h = (h ^ id[i]) * 0x01000193u;
+    return h;
+}
+
+/* 在条目头写入键哈希与标志（id 为键名，TLV 为类型字节）：
+ * 格式1存8位哈希，标志占整个 reserved；格式2存 id_hash 的低14位，标志只占 reserved 低2位 */
+static void entry_stamp(nkv_entry_t* entry, uint8_t format, uint8_t flag, const uint8_t* id)
+{
+    if (format == NKV_FORMAT_V1)
+    {
+        entry->key_hash = hash_key((const char*) id, entry->key_len);
+        entry->reserved = flag;
+    }
+    else
+    {
+        uint32_t h      = id_hash(id, entry->key_len);
+        entry->key_hash = (uint8_t) h;
+        entry->reserved = (uint8_t) (((h >> 6) & 0xFC) | (flag & 0x03));
+    }
+}
+
+/* 读取Flash(计入操作统计) */
+static int flash_read(nkv_instance_t* db, uint32_t addr, uint8_t* buf, uint32_t len)
+{
+    OP_COUNT(db, read_calls, 1);
+    OP_COUNT(db, read_bytes, len);
+    return db->flash.read(addr, buf, len);
+}
+
 /**
  * @brief 快速探测 Flash 范围是否全为 0xFF
  * @param addr 起始地址
  * @param size 大小
  * @return 1=全为 0xFF, 0=存在非 0xFF 字节
  */
-static uint8_t nkv_is_erased(uint32_t addr, uint32_t size)
+static uint8_t nkv_is_erased(nkv_instance_t* db, uint32_t addr, uint32_t size)
 {
     uint32_t buf[16]; /* 每次读取 64 字节 */
     uint32_t len;
     while (size > 0)
     {
         len = (size > sizeof(buf)) ? sizeof(buf) : size;
-        if (g_nkv.flash.read(addr, (uint8_t*) buf, len) != 0)
+        if (flash_read(db, addr, (uint8_t*) buf, len) != 0)
             return 0;
 
         uint32_t words = len / 4;
@@ -122,1483 +431,5066 @@ static inline uint8_t bitmap_test(const uint8_t* bmp, uint8_t idx)
     return (bmp[idx >> 3] >> (idx & 7)) & 1;
 }
 
-/* ==================== 缓存实现 ==================== */
-#if NKV_CACHE_ENABLE
-/* 查找缓存中的键 */
-static nkv_cache_entry_t* cache_find(const char* key)
+/* ==================== 布隆过滤器与负缓存 ==================== */
+/*
+ * 每个扇区一个布隆过滤器，挂载扫描时建立、追加条目时更新、擦除扇区时清空。
+ * 只有覆盖扇区全部条目的过滤器(ready)才用于跳过扇区；旧路径挂载后过滤器未就绪，照常扫描。
+ * 负缓存记录最近一次全扫描仍未找到的标识，写入该标识时移除。
+ */
+#if NKV_BLOOM_ENABLE
+    #define BLOOM_MASK (NKV_BLOOM_BITS - 1)
+    #define BLOOM_K    3 /* 每个标识置位数 */
+
+/* 双重哈希生成第 i 个位位置 */
+static inline uint32_t bloom_bit(uint32_t h, uint8_t i)
 {
-    uint8_t klen = strlen(key);
-    for (uint8_t i = 0; i < NKV_CACHE_SIZE; i++)
-    {
-        nkv_cache_entry_t* e = &g_nkv.cache.entries[i];
-        if (e->valid && e->key_len == klen && memcmp(e->key, key, klen) == 0)
-        {
-            e->access_count++;
-            g_nkv.cache.hit_count++;
-            return e;
-        }
-    }
-    g_nkv.cache.miss_count++;
-    return NULL;
+    return (h + i * ((h >> 16) | 1u)) & BLOOM_MASK;
 }
 
-/* 查找LFU替换候选 */
-static uint8_t cache_find_lfu(void)
+static void bloom_reset(nkv_instance_t* db, uint8_t idx)
 {
-    uint8_t  idx = 0;
-    uint32_t min = 0xFFFFFFFF;
-    for (uint8_t i = 0; i < NKV_CACHE_SIZE; i++)
-    {
-        if (!g_nkv.cache.entries[i].valid)
-            return i;
-        if (g_nkv.cache.entries[i].access_count < min)
-        {
-            min = g_nkv.cache.entries[i].access_count;
-            idx = i;
-        }
-    }
-    return idx;
+    if (idx >= NKV_BLOOM_SECTORS)
+        return;
+    memset(db->bloom.bits[idx], 0, sizeof(db->bloom.bits[idx]));
+    db->bloom.ready |= 1u << idx;
 }
 
-/* 更新缓存 */
-static void cache_update(const char* key, const void* val, uint8_t len)
+static void bloom_add(nkv_instance_t* db, uint8_t idx, uint32_t h)
 {
-    uint8_t            klen = strlen(key);
-    nkv_cache_entry_t* e    = NULL;
-
-    /* 查找现有条目 */
-    for (uint8_t i = 0; i < NKV_CACHE_SIZE; i++)
+    if (idx >= NKV_BLOOM_SECTORS)
+        return;
+    for (uint8_t i = 0; i < BLOOM_K; i++)
     {
-        if (g_nkv.cache.entries[i].valid && g_nkv.cache.entries[i].key_len == klen &&
-            memcmp(g_nkv.cache.entries[i].key, key, klen) == 0)
-        {
-            e = &g_nkv.cache.entries[i];
-            break;
-        }
+        uint32_t bit = bloom_bit(h, i);
+        db->bloom.bits[idx][bit >> 3] |= (uint8_t) (1u << (bit & 7));
     }
+}
 
-    /* 未找到则使用LFU替换 */
-    if (!e)
+/* 扇区可能包含该标识时返回1（过滤器未就绪时总是返回1） */
+static uint8_t bloom_may_contain(nkv_instance_t* db, uint8_t idx, uint32_t h)
+{
+    if (idx >= NKV_BLOOM_SECTORS || !(db->bloom.ready & (1u << idx)))
+        return 1;
+    for (uint8_t i = 0; i < BLOOM_K; i++)
     {
-        e          = &g_nkv.cache.entries[cache_find_lfu()];
-        e->key_len = klen;
-        memcpy(e->key, key, klen);
-        e->access_count = 1;
+        uint32_t bit = bloom_bit(h, i);
+        if (!(db->bloom.bits[idx][bit >> 3] & (1u << (bit & 7))))
+            return 0;
     }
-
-    e->val_len = len;
-    memcpy(e->value, val, len);
-    e->valid = 1;
+    return 1;
 }
 
-/* 移除缓存项 */
-static void cache_remove(const char* key)
+/* 在负缓存中查找标识，返回槽位或-1 */
+static int16_t neg_find(nkv_instance_t* db, const uint8_t* id, uint8_t key_len)
 {
-    uint8_t klen = strlen(key);
-    for (uint8_t i = 0; i < NKV_CACHE_SIZE; i++)
+    uint8_t id_len = key_len ? key_len : 1;
+    for (uint8_t i = 0; i < NKV_NEG_CACHE_SIZE; i++)
     {
-        if (g_nkv.cache.entries[i].valid && g_nkv.cache.entries[i].key_len == klen &&
-            memcmp(g_nkv.cache.entries[i].key, key, klen) == 0)
-        {
-            g_nkv.cache.entries[i].valid = 0;
-            break;
-        }
+        if (db->bloom.neg_len[i] == key_len + 1 && memcmp(db->bloom.neg_id[i], id, id_len) == 0)
+            return i;
     }
+    return -1;
 }
-#endif
-
-/* ==================== 条目匹配器 ==================== */
-typedef struct
-{
-    const char* key;
-    uint8_t     key_len;
-    uint8_t     key_hash; /* 预计算的哈希值 */
-} kv_match_ctx_t;
-
-typedef struct
-{
-    uint8_t type;
-} tlv_match_ctx_t;
 
-/* KV键匹配器（哈希加速） */
-static uint8_t kv_matcher(const nkv_entry_t* entry, uint32_t addr, void* ctx)
+static void neg_insert(nkv_instance_t* db, const uint8_t* id, uint8_t key_len)
 {
-    /* 仅匹配 VALID 或 PRE_DEL 状态 (PRE_DEL 在掉电恢复期间被视为有效) */
-    if (entry->state != NKV_STATE_VALID && entry->state != NKV_STATE_PRE_DEL)
-        return 0;
-    kv_match_ctx_t* c = (kv_match_ctx_t*) ctx;
-    if (entry->key_len != c->key_len)
-        return 0;
-
-    /* 哈希快速过滤：哈希不匹配则直接跳过 */
-    if (entry->key_hash != c->key_hash)
-        return 0;
-
-    /* 哈希匹配，需要精确比较键 */
-    char tmp[NKV_MAX_KEY_LEN];
-    g_nkv.flash.read(addr + NKV_HEADER_SIZE, (uint8_t*) tmp, c->key_len);
-    return (memcmp(tmp, c->key, c->key_len) == 0);
+    uint8_t slot = db->bloom.neg_next;
+    memcpy(db->bloom.neg_id[slot], id, key_len ? key_len : 1);
+    db->bloom.neg_len[slot] = key_len + 1;
+    db->bloom.neg_next      = (slot + 1) % NKV_NEG_CACHE_SIZE;
 }
 
-/* TLV类型匹配器 */
-static uint8_t tlv_matcher(const nkv_entry_t* entry, uint32_t addr, void* ctx)
+/* 新条目写入后登记：加入所在扇区的过滤器并移出负缓存 */
+static void bloom_note(nkv_instance_t* db, uint32_t addr, const uint8_t* id, uint8_t key_len)
 {
-    if ((entry->state != NKV_STATE_VALID && entry->state != NKV_STATE_PRE_DEL) || entry->key_len != 0 ||
-        entry->val_len == 0)
-        return 0;
+    bloom_add(db, (addr - db->flash.base) / db->flash.sector_size, id_hash(id, key_len));
 
-    tlv_match_ctx_t* c = (tlv_match_ctx_t*) ctx;
-    uint8_t          type;
-    if (g_nkv.flash.read(addr + NKV_HEADER_SIZE, &type, 1) != 0)
-        return 0;
-    return (type == c->type);
+    int16_t slot = neg_find(db, id, key_len);
+    if (slot >= 0)
+        db->bloom.neg_len[slot] = 0;
 }
+#endif
 
-/* ==================== 扇区操作 ==================== */
-/* 读取扇区头 */
-static int read_sector_hdr(uint8_t idx, nkv_sector_hdr_t* hdr)
+/* ==================== Flash写入封装 ==================== */
+/* 写入/擦除前递增修改代数，跨API调用保存的读取窗口据此失效 */
+static int flash_write(nkv_instance_t* db, uint32_t addr, const uint8_t* buf, uint32_t len)
 {
-    return g_nkv.flash.read(SECTOR_ADDR(idx), (uint8_t*) hdr, sizeof(nkv_sector_hdr_t));
+    db->flash_gen++;
+    db->gc_stats.flash_bytes += len;
+    OP_COUNT(db, write_calls, 1);
+    OP_COUNT(db, write_bytes, len);
+    return db->flash.write(addr, buf, len);
 }
 
-/* 检查扇区是否有效 */
-uint8_t nkv_is_sector_valid(uint8_t idx)
+/* 清空扇区状态(擦除次数除外) */
+static void sector_reset(nkv_instance_t* db, uint8_t idx)
 {
-    nkv_sector_hdr_t hdr;
-    if (read_sector_hdr(idx, &hdr) != 0)
-        return 0;
-    return (hdr.magic == NKV_MAGIC);
+    uint32_t erases = db->sectors[idx].erase_count;
+    memset(&db->sectors[idx], 0, sizeof(nkv_sector_info_t));
+    db->sectors[idx].erase_count = erases;
 }
 
-/* 扫描扇区写入偏移，并清理异常状态 */
-static uint32_t scan_write_offset(uint8_t idx)
+/* 擦除前的计数与扇区状态维护(同步/异步擦除共用) */
+static void erase_note(nkv_instance_t* db, uint8_t idx)
 {
-    uint32_t sector      = SECTOR_ADDR(idx);
-    uint32_t sector_size = g_nkv.flash.sector_size;
-    uint32_t low         = ALIGNED_HDR_SIZE;
-    uint32_t high        = sector_size;
-
-    /*
-     * 快速探测：二分查找第一个连续 0xFF 的区域 (约 256 字节)
-     * 这可以帮助我们快速跳过大部分已写区域，定位到空闲区边界。
-     */
-    const uint32_t probe_size = 256;
-    while (high - low > probe_size)
-    {
-        uint32_t mid = low + ((high - low) / 2);
-        mid          = ALIGN(mid);
-        if (nkv_is_erased(sector + mid, probe_size))
-        {
-            high = mid;
-        }
-        else
-        {
-            low = mid + probe_size;
-        }
-    }
-
-    /*
-     * 线性扫描以精确确定写偏移。
-     * 由于 KV 是变长链接且没有 Sync Word，必须从头扫描以保证正确性。
-     */
-    uint32_t offset = ALIGNED_HDR_SIZE;
-    while (offset <= sector_size - ALIGN(NKV_HEADER_SIZE))
-    {
-        nkv_entry_t entry;
-        if (g_nkv.flash.read(sector + offset, (uint8_t*) &entry, NKV_HEADER_SIZE) != 0)
-            break;
-
-        if (entry.state == NKV_STATE_ERASED)
-        {
-            /* 发现 0xFFFF，进一步确认后面是否全是 0xFF */
-            if (nkv_is_erased(sector + offset, (sector_size - offset > 32) ? 32 : (sector_size - offset)))
-            {
-                break;
-            }
-        }
-
-#if NKV_CLEAN_DIRTY_ON_BOOT
-        /* 掉电恢复：清理 WRITING 状态的脏数据（写入中掉电的不完整条目） */
-        if (entry.state == NKV_STATE_WRITING)
-        {
-            update_entry_state(sector + offset, NKV_STATE_DELETED);
-        }
+    db->flash_gen++;
+#if NKV_ZERO_COPY
+    db->map_epoch++;
+#endif
+    db->gc_stats.erases++;
+    sector_reset(db, idx);
+    db->sectors[idx].erase_count++;
+#if NKV_BLOOM_ENABLE
+    bloom_reset(db, idx);
 #endif
+}
 
-        uint32_t entry_sz = ENTRY_SIZE(entry);
-        if (entry_sz < ALIGN(NKV_HEADER_SIZE + NKV_CRC_SIZE)) /* 异常条目大小 */
-            break;
+/*
+ * 格式3擦除后立即把擦除次数写入扇区头(魔数与序号保持擦除状态，扇区仍是空闲扇区)，
+ * 启用扇区时再写入魔数与序号，空闲期间掉电也不会丢失擦除次数
+ */
+static int erase_stamp(nkv_instance_t* db, uint8_t idx)
+{
+    if (db->format != NKV_FORMAT_V3)
+        return 0;
 
-        offset += entry_sz;
-    }
+    nkv_sector_hdr_t hdr = {.magic = 0xFFFF, .seq = 0xFFFF, .erase_count = db->sectors[idx].erase_count};
+    uint8_t          buf[32]; /* 足够容纳对齐后的头 */
 
-    return offset;
+    memset(buf, 0xFF, sizeof(buf));
+    memcpy(buf, &hdr, sizeof(hdr));
+    return flash_write(db, SECTOR_ADDR(idx), buf, HDR_SIZE(NKV_FORMAT_V3));
 }
 
-/* 通用扇区查找 */
-static uint32_t find_in_sector(uint8_t idx, uint8_t (*matcher)(const nkv_entry_t*, uint32_t, void*), void* ctx,
-                               nkv_entry_t* out)
+static int flash_erase(nkv_instance_t* db, uint32_t addr)
 {
-    uint32_t sector = SECTOR_ADDR(idx);
-    uint32_t found = 0, offset = ALIGNED_HDR_SIZE;
+    uint8_t idx = SECTOR_OF(addr);
+    erase_note(db, idx);
+    OP_COUNT(db, erase_calls, 1);
+    int ret                 = db->flash.erase(addr);
+    db->sectors[idx].erased = (ret == 0);
+    if (ret == 0)
+        erase_stamp(db, idx);
+    return ret;
+}
 
-    while (offset <= g_nkv.flash.sector_size - ALIGN(NKV_HEADER_SIZE))
-    {
-        nkv_entry_t entry;
-        if (g_nkv.flash.read(sector + offset, (uint8_t*) &entry, NKV_HEADER_SIZE) != 0)
-            break;
-        if (entry.state == NKV_STATE_ERASED)
-            break;
+/* 空闲扇区是否无需擦除即可启用(格式3允许扇区头中已记录擦除次数) */
+static uint8_t sector_blank(nkv_instance_t* db, uint8_t idx)
+{
+    uint32_t addr = SECTOR_ADDR(idx);
 
-        uint32_t addr = sector + offset;
-        if (matcher(&entry, addr, ctx))
-        {
-            found = addr;
-            if (out)
-                *out = entry;
-        }
-        offset += ENTRY_SIZE(entry);
-    }
-    return found;
+    if (db->format != NKV_FORMAT_V3)
+        return nkv_is_erased(db, addr, db->flash.sector_size);
+    return nkv_is_erased(db, addr, NKV_SECTOR_HDR_V1) &&
+           nkv_is_erased(db, addr + ALIGNED_HDR_SIZE, db->flash.sector_size - ALIGNED_HDR_SIZE);
 }
 
-/* 在扇区中查找键 */
-static uint32_t find_key_in_sector(uint8_t idx, const char* key, nkv_entry_t* out)
+/* 写入扇区头，格式3同时写入擦除次数 */
+static int write_sector_hdr(nkv_instance_t* db, uint8_t idx, uint16_t seq)
 {
-    uint8_t        key_len = strlen(key);
-    kv_match_ctx_t ctx     = {.key = key, .key_len = key_len, .key_hash = hash_key(key, key_len)};
-    return find_in_sector(idx, kv_matcher, &ctx, out);
+    nkv_sector_hdr_t hdr = {.magic = FORMAT_MAGIC(db->format), .seq = seq, .erase_count = db->sectors[idx].erase_count};
+    uint8_t          buf[32]; /* 足够容纳对齐后的头 */
+
+    memset(buf, 0xFF, sizeof(buf));
+    memcpy(buf, &hdr, (db->format == NKV_FORMAT_V3) ? sizeof(hdr) : NKV_SECTOR_HDR_V1);
+    return flash_write(db, SECTOR_ADDR(idx), buf, HDR_SIZE(db->format));
 }
 
-/* 在所有扇区中查找键 */
-static uint32_t find_key(const char* key, nkv_entry_t* out)
+/* 扇区头中记录的擦除次数：格式3的有效扇区、作废扇区(魔数清零、序号保留)与已记录次数的空闲扇区，其他返回 UINT32_MAX */
+static uint32_t hdr_erase_count(const nkv_sector_hdr_t* hdr)
 {
-    for (uint8_t i = 0; i < g_nkv.flash.sector_count; i++)
-    {
-        uint8_t idx = PREV_SECTOR(g_nkv.active_sector, i);
-        if (!nkv_is_sector_valid(idx))
-            continue;
-        uint32_t addr = find_key_in_sector(idx, key, out);
-        if (addr != 0)
-            return addr;
-    }
-    return 0;
+    if (hdr->magic == NKV_MAGIC || (hdr->magic == 0 && hdr->seq != 0) || (hdr->magic == 0xFFFF && hdr->seq == 0xFFFF))
+        return hdr->erase_count;
+    return UINT32_MAX;
 }
 
-/* 切换到指定扇区 */
-static nkv_err_t switch_to_sector(uint8_t idx)
+#if NKV_BACKGROUND_GC
+/*
+ * 作废扇区：清零魔数，此后(含重新挂载)即视为空闲扇区；整扇区擦除留给后台预擦除，不占用写入路径。
+ * 格式3保留序号与擦除次数(序号非0即表示擦除次数有效)，旧格式整个扇区头清零。
+ */
+static int sector_retire(nkv_instance_t* db, uint8_t idx)
 {
-    uint32_t addr = SECTOR_ADDR(idx);
-
-    /* 快速探测：如果扇区已经是干净的，则跳过擦除 */
-    if (!nkv_is_erased(addr, g_nkv.flash.sector_size))
-    {
-        if (g_nkv.flash.erase(addr) != 0)
-            return NKV_ERR_FLASH;
-    }
-
-    nkv_sector_hdr_t hdr     = {.magic = NKV_MAGIC, .seq = g_nkv.sector_seq + 1};
-    uint32_t         hdr_len = ALIGN(sizeof(nkv_sector_hdr_t));
+    nkv_sector_hdr_t hdr = {.magic = 0, .seq = 0, .erase_count = db->sectors[idx].erase_count};
     uint8_t          buf[32]; /* 足够容纳对齐后的头 */
 
+    if (db->sectors[idx].format == NKV_FORMAT_V3)
+        hdr.seq = db->sectors[idx].seq;
     memset(buf, 0xFF, sizeof(buf));
     memcpy(buf, &hdr, sizeof(hdr));
-
-    if (g_nkv.flash.write(addr, buf, hdr_len) != 0)
-        return NKV_ERR_FLASH;
-
-    g_nkv.active_sector = idx;
-    g_nkv.sector_seq    = hdr.seq;
-    g_nkv.write_offset  = ALIGNED_HDR_SIZE;
-    return NKV_OK;
+    sector_reset(db, idx);
+    #if NKV_BLOOM_ENABLE
+    bloom_reset(db, idx);
+    #endif
+    return flash_write(db, SECTOR_ADDR(idx), buf, ALIGN(NKV_SECTOR_HDR_V1));
 }
+#endif
 
-/* 查找空闲扇区 */
-static int8_t find_free_sector(void)
+/* ==================== 扇区统计 ==================== */
+/* 扇区头写入后开始统计 */
+static void sector_open(nkv_instance_t* db, uint8_t idx, uint16_t seq, uint8_t format)
 {
-    for (uint8_t i = 1; i < g_nkv.flash.sector_count; i++)
-    {
-        uint8_t idx = (g_nkv.active_sector + i) % g_nkv.flash.sector_count;
-        if (!nkv_is_sector_valid(idx))
-            return idx;
-    }
-    return -1;
+    sector_reset(db, idx);
+    db->sectors[idx].seq    = seq;
+    db->sectors[idx].valid  = 1;
+    db->sectors[idx].format = format;
 }
 
-/* 切换到下一扇区 */
-static nkv_err_t switch_to_next_sector(void)
+/* 追加条目：计入所在扇区的有效字节 */
+static inline void sector_note_live(nkv_instance_t* db, uint32_t addr, uint32_t size)
 {
-    return switch_to_sector((g_nkv.active_sector + 1) % g_nkv.flash.sector_count);
+    db->sectors[SECTOR_OF(addr)].live += size;
 }
 
-/* ==================== 条目迁移 ==================== */
-#if NKV_TLV_RETENTION_ENABLE
-static void clear_tlv_keep_info(void)
+/* 条目被删除：有效字节转为垃圾字节（未计入有效字节的条目不会下溢） */
+static void sector_note_dead(nkv_instance_t* db, uint32_t addr, uint32_t size)
 {
-    g_tlv_keep_info_count = 0;
+    nkv_sector_info_t* s = &db->sectors[SECTOR_OF(addr)];
+    s->live -= (size < s->live) ? size : s->live;
+    s->dead += size;
 }
 
-/* 计算TLV保留阈值 */
-static uint32_t find_tlv_keep_threshold(uint8_t type, uint16_t keep)
+/* 挂载扫描到的条目按当前状态计入，须在清理/回滚等状态改写之前调用 */
+static void sector_note_entry(nkv_instance_t* db, uint32_t addr, const nkv_entry_t* entry)
 {
-    nkv_tlv_history_t hist[32];
-    uint8_t           count = 0;
-
-    nkv_tlv_get_history(type, hist, 32, &count);
-    if (count == 0 || count <= keep)
-        return 0;
-
-    return hist[keep].flash_addr - NKV_HEADER_SIZE - 1;
+    if (entry->state == NKV_STATE_DELETED)
+        db->sectors[SECTOR_OF(addr)].dead += ENTRY_SIZE(*entry);
+    else
+        sector_note_live(db, addr, ENTRY_SIZE(*entry));
 }
 
-/* 准备所有TLV保留阈值 */
-static void prepare_tlv_keep_info(void)
+/* 按序号从旧到新列出有效扇区（回收扇区不按环形顺序选择，物理位置不代表新旧），返回扇区数 */
+static uint8_t sector_order(nkv_instance_t* db, uint8_t* order)
 {
-    clear_tlv_keep_info();
-    for (uint8_t i = 0; i < g_tlv_retention_count && g_tlv_keep_info_count < NKV_TLV_RETENTION_MAX; i++)
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
     {
-        if (g_tlv_retention[i].keep_count == 0)
+        if (!db->sectors[i].valid)
             continue;
-        g_tlv_keep_info[g_tlv_keep_info_count].type = g_tlv_retention[i].type;
-        g_tlv_keep_info[g_tlv_keep_info_count].threshold =
-            find_tlv_keep_threshold(g_tlv_retention[i].type, g_tlv_retention[i].keep_count);
-        g_tlv_keep_info_count++;
+
+        uint16_t age = db->sector_seq - db->sectors[i].seq;
+        uint8_t  j   = n++;
+        for (; j > 0 && (uint16_t) (db->sector_seq - db->sectors[order[j - 1]].seq) < age; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
     }
+    return n;
 }
 
-/* 检查TLV是否应迁移 */
-static uint8_t should_migrate_tlv(uint8_t type, uint32_t addr)
+/* ==================== 扇区游标 ==================== */
+static void cursor_open(nkv_instance_t* db, nkv_cursor_t* c, uint8_t idx, uint32_t offset)
 {
-    for (uint8_t i = 0; i < g_tlv_keep_info_count; i++)
-    {
-        if (g_tlv_keep_info[i].type == type)
-        {
-            if (g_tlv_keep_info[i].threshold == 0)
-                return 1;
-            return (addr >= g_tlv_keep_info[i].threshold);
-        }
-    }
-    return 1;
-}
+    c->flash   = &db->flash;
+#if NKV_OP_STATS
+    c->stats = &db->op_stats;
 #endif
+    c->format  = db->sectors[idx].format;
+    c->sector  = SECTOR_ADDR(idx);
+    c->offset  = offset;
+    c->win_off = 0;
+    c->win_len = 0;
+}
 
-/* 迁移条目 */
-static nkv_err_t migrate_entry(uint32_t src, const nkv_entry_t* entry)
+/* 获取扇区内 [off, off+len) 的数据，不在窗口内时从 off 处重新填充 */
+static const uint8_t* cursor_peek(nkv_cursor_t* c, uint32_t off, uint32_t len)
 {
-    static uint8_t buf[MAX_ENTRY_SIZE];
-    uint32_t       size = ENTRY_SIZE(*entry);
+    if (len > NKV_READ_WINDOW || off + len > c->flash->sector_size)
+        return NULL;
 
-    if (g_nkv.write_offset + size > g_nkv.flash.sector_size)
-        return NKV_ERR_NO_SPACE;
-    if (g_nkv.flash.read(src, buf, size) != 0)
-        return NKV_ERR_FLASH;
+    if (off < c->win_off || off + len > c->win_off + c->win_len)
+    {
+        uint32_t fill = c->flash->sector_size - off;
+        if (fill > NKV_READ_WINDOW)
+            fill = NKV_READ_WINDOW;
+#if NKV_OP_STATS
+        STAT_INC(&c->stats->read_calls);
+        STAT_ADD(&c->stats->read_bytes, fill);
+#endif
+        if (c->flash->read(c->sector + off, c->win, fill) != 0)
+        {
+            c->win_len = 0;
+            return NULL;
+        }
+        c->win_off = off;
+        c->win_len = fill;
+    }
+    return c->win + (off - c->win_off);
+}
 
-    uint32_t dest = SECTOR_ADDR(g_nkv.active_sector) + g_nkv.write_offset;
-    if (g_nkv.flash.write(dest, buf, size) != 0)
-        return NKV_ERR_FLASH;
+/*
+ * 读取当前条目头，返回0表示已到扇区末尾或读取失败。
+ * 所有扇区遍历都经过这里，损坏的条目头在此统一处理(每个条目O(1))：
+ * - 声明的长度越过扇区末尾：无法定位下一条目，游标移到扇区末尾并返回0，其余数据不可解析
+ * - 状态字非法或键长超出 NKV_MAX_KEY_LEN：长度仍可用，按已删除条目返回，调用者整体跳过
+ * 擦除态(0xFFFF)原样返回，由调用者判断空闲区。
+ */
+static uint8_t cursor_entry(nkv_cursor_t* c, nkv_entry_t* entry)
+{
+    uint32_t align = c->flash->align;
+    if (c->offset > c->flash->sector_size - ((NKV_HEADER_SIZE + align - 1) & ~(align - 1)))
+        return 0;
+    const uint8_t* p = cursor_peek(c, c->offset, NKV_HEADER_SIZE);
+    if (!p)
+        return 0;
+    memcpy(entry, p, NKV_HEADER_SIZE);
+    if (entry->state == NKV_STATE_ERASED)
+        return 1;
 
-    g_nkv.write_offset += size;
-    return NKV_OK;
+    uint32_t size = (NKV_HEADER_SIZE + entry->key_len + entry->val_len + NKV_CRC_SIZE + align - 1) & ~(align - 1);
+    if (size > c->flash->sector_size - c->offset)
+    {
+        c->offset = c->flash->sector_size;
+        return 0;
+    }
+    if ((entry->state != NKV_STATE_WRITING && entry->state != NKV_STATE_VALID && entry->state != NKV_STATE_PRE_DEL &&
+         entry->state != NKV_STATE_DELETED) ||
+        entry->key_len >= NKV_MAX_KEY_LEN)
+        entry->state = NKV_STATE_DELETED;
+    return 1;
 }
 
-/* ==================== 全量GC ==================== */
-static nkv_err_t do_compact(void)
+/* 检查游标位置之后的区域是否已擦除 */
+static uint8_t cursor_erased(nkv_cursor_t* c, uint32_t off, uint32_t len)
 {
-#if NKV_TLV_RETENTION_ENABLE
-    prepare_tlv_keep_info();
-#endif
-
-    nkv_err_t err = switch_to_next_sector();
-    if (err != NKV_OK)
-        return err;
+    if (len > c->flash->sector_size - off)
+        len = c->flash->sector_size - off;
+    const uint8_t* p = cursor_peek(c, off, len);
+    if (!p)
+        return 0;
+    for (uint32_t i = 0; i < len; i++)
+        if (p[i] != 0xFF)
+            return 0;
+    return 1;
+}
 
-    uint8_t bitmap[32] = {0};
+/* ==================== 缓存实现 ==================== */
+/*
+ * 哈希表(拉链) + 值存储区：
+ * - 按键哈希定位桶后沿链表比较键，查找期望 O(1)
+ * - 值按实际长度从存储区顺序分配，空间不足时先淘汰再整理(有效块前移)
+ * - 淘汰从 hand 开始采样 CACHE_SAMPLES 个有效项，选择访问频率最低者(近似LFU)
+ * - 频率每 CACHE_DECAY_OPS 次访问整体减半，过时的热点会逐渐被替换
+ * - NKV_CACHE_POLICY=1 时缓存已满后，新键须在频率草图中比淘汰对象更热才被准入
+ * 所有修改都在写锁内进行；无锁读取只读且遍历有界，结果由写序号校验。
+ */
+#if NKV_CACHE_ENABLE
+    #define CACHE_MASK      (NKV_CACHE_SIZE - 1)
+    #define CACHE_NO_BLOCK  0xFFFF
+    #define CACHE_BLOCK_HDR 3                    /* 值块头：容量(1B) + 所属项下标(2B) */
+    #define CACHE_SAMPLES   8                    /* 淘汰时采样的有效项数 */
+    #define CACHE_DECAY_OPS (NKV_CACHE_SIZE * 8) /* 衰减周期(访问次数) */
+    #define CACHE_FREQ_MAX  0xFF00               /* 计数上限，为并发自增留出余量 */
+    #if NKV_CACHE_POLICY == 1
+        #define SKETCH_MASK (NKV_CACHE_SIZE * 2 - 1)
+    #endif
 
-    for (uint8_t s = 1; s < g_nkv.flash.sector_count; s++)
+/* 查找缓存项（只读，可用于无锁读取） */
+static nkv_cache_entry_t* cache_lookup(nkv_cache_t* c, const char* key, uint8_t klen, uint32_t h)
+{
+    uint16_t link = c->buckets[h & CACHE_MASK];
+    for (uint16_t n = 0; link != 0 && link <= NKV_CACHE_SIZE && n < NKV_CACHE_SIZE; n++)
     {
-        uint8_t idx = PREV_SECTOR(g_nkv.active_sector, s);
-        if (!nkv_is_sector_valid(idx))
-            continue;
-
-        uint32_t sector = SECTOR_ADDR(idx);
-        uint32_t offset = ALIGNED_HDR_SIZE;
+        nkv_cache_entry_t* e = &c->entries[link - 1];
+        if (e->valid && e->key_len == klen && memcmp(e->key, key, klen) == 0)
+            return e;
+        link = e->next;
+    }
+    return NULL;
+}
 
-        while (offset <= g_nkv.flash.sector_size - ALIGN(NKV_HEADER_SIZE))
-        {
-            nkv_entry_t entry;
-            if (g_nkv.flash.read(sector + offset, (uint8_t*) &entry, NKV_HEADER_SIZE) != 0)
-                break;
-            if (entry.state == NKV_STATE_ERASED)
-                break;
+static inline const uint8_t* cache_value(const nkv_cache_t* c, const nkv_cache_entry_t* e)
+{
+    return &c->arena[e->val_off + CACHE_BLOCK_HDR];
+}
 
-            uint32_t entry_size = ENTRY_SIZE(entry);
+static inline void freq_inc(uint16_t* f)
+{
+    if (*f < CACHE_FREQ_MAX)
+        STAT_INC(f);
+}
 
-            /* 仅迁移 VALID 状态的数据。
-             * PRE_DEL 状态的数据在 GC 时被视为旧数据，不予迁移（因为新键一定已存在或系统处于异常态）。
-             * DELETED 和 WRITING 状态的数据直接跳过。
-             */
-            if (entry.state == NKV_STATE_VALID && entry.val_len > 0)
-            {
-#if NKV_TLV_RETENTION_ENABLE
-                /* TLV保留检查 */
-                if (entry.key_len == 0)
-                {
-                    uint8_t type;
-                    g_nkv.flash.read(sector + offset + NKV_HEADER_SIZE, &type, 1);
-                    if (!should_migrate_tlv(type, sector + offset))
-                    {
-                        offset += entry_size;
-                        continue;
-                    }
-                }
-#endif
-                /* 读取键并检查是否需要迁移 */
-                char key[NKV_MAX_KEY_LEN] = {0};
-                g_nkv.flash.read(sector + offset + NKV_HEADER_SIZE, (uint8_t*) key, entry.key_len);
+    #if NKV_CACHE_POLICY == 1
+/* 草图第 row 行的计数器位置 */
+static inline uint32_t sketch_pos(uint32_t h, uint8_t row)
+{
+    return ((h * (0x9E3779B1u + 2u * row)) >> 16) & SKETCH_MASK;
+}
 
-                uint8_t hash      = hash_key(key, entry.key_len);
-                uint8_t need_copy = 0;
+/* 估计键的访问频率(各行计数最小值) */
+static uint16_t sketch_freq(const nkv_cache_t* c, uint32_t h)
+{
+    uint16_t f = 0xFFFF;
+    for (uint8_t r = 0; r < 4; r++)
+    {
+        uint16_t v = c->sketch[r][sketch_pos(h, r)];
+        if (v < f)
+            f = v;
+    }
+    return f;
+}
+    #endif
 
-                if (!bitmap_test(bitmap, hash))
-                {
-                    need_copy = 1;
-                }
-                else
-                {
-                    nkv_entry_t existing;
-                    if (find_key_in_sector(g_nkv.active_sector, key, &existing) == 0)
-                        need_copy = 1;
-                }
+/* 记录一次访问（命中时 e 非空），无锁读取路径也会调用，只做原子自增 */
+static void cache_touch(nkv_cache_t* c, nkv_cache_entry_t* e, uint32_t h)
+{
+    if (e)
+        freq_inc(&e->freq);
+    #if NKV_CACHE_POLICY == 1
+    for (uint8_t r = 0; r < 4; r++)
+        freq_inc(&c->sketch[r][sketch_pos(h, r)]);
+    #else
+    (void) h;
+    #endif
+    STAT_INC(&c->ops);
+}
 
-                if (need_copy)
-                {
-                    nkv_err_t ret = migrate_entry(sector + offset, &entry);
-                    if (ret == NKV_ERR_NO_SPACE)
-                    {
-                        err = switch_to_next_sector();
-                        if (err != NKV_OK)
-                            return err;
-                        memset(bitmap, 0, sizeof(bitmap));
-                        ret = migrate_entry(sector + offset, &entry);
-                        if (ret != NKV_OK)
-                            return ret;
-                    }
-                    else if (ret != NKV_OK)
-                    {
-                        return ret;
-                    }
-                    bitmap_set(bitmap, hash);
-                }
-            }
-            offset += entry_size;
-        }
+/* 周期衰减：访问次数达到周期后所有频率减半（均摊 O(1)） */
+static void cache_age(nkv_cache_t* c)
+{
+    if (c->ops < CACHE_DECAY_OPS)
+        return;
+    c->ops = 0;
+    for (uint16_t i = 0; i < c->used; i++)
+        c->entries[i].freq >>= 1;
+    #if NKV_CACHE_POLICY == 1
+    for (uint8_t r = 0; r < 4; r++)
+    {
+        for (uint16_t i = 0; i <= SKETCH_MASK; i++)
+            c->sketch[r][i] >>= 1;
     }
-    return NKV_OK;
+    #endif
 }
 
-/* ==================== 增量GC ==================== */
-#if NKV_INCREMENTAL_GC
-/* 统计空闲扇区数 */
-static uint8_t count_free_sectors(void)
+/* 采样选择淘汰对象（跳过 keep），没有可淘汰项时返回NULL */
+static nkv_cache_entry_t* cache_victim(nkv_cache_t* c, const nkv_cache_entry_t* keep)
 {
-    uint8_t count = 0;
-    for (uint8_t i = 0; i < g_nkv.flash.sector_count; i++)
-        if (!nkv_is_sector_valid(i))
-            count++;
-    return count;
+    nkv_cache_entry_t* victim = NULL;
+    uint8_t            seen   = 0;
+
+    for (uint16_t n = 0; n < c->used && seen < CACHE_SAMPLES; n++)
+    {
+        if (c->hand >= c->used)
+            c->hand = 0;
+        nkv_cache_entry_t* e = &c->entries[c->hand++];
+        if (!e->valid || e == keep)
+            continue;
+        seen++;
+        if (!victim || e->freq < victim->freq)
+            victim = e;
+    }
+    return victim;
 }
 
-/* 检查是否需要启动GC */
-static uint8_t should_start_gc(void)
+/* 释放值块 */
+static void cache_free_value(nkv_cache_t* c, nkv_cache_entry_t* e)
 {
-    if (g_nkv.gc_active)
-        return 0;
-    return (count_free_sectors() < 1);
+    if (e->val_off == CACHE_NO_BLOCK)
+        return;
+    c->arena_live -= CACHE_BLOCK_HDR + c->arena[e->val_off];
+    e->val_off = CACHE_NO_BLOCK;
 }
 
-/* 启动增量GC */
-static uint8_t start_incremental_gc(void)
+/* 从哈希桶摘除缓存项，释放值块并放回空闲表 */
+static void cache_drop(nkv_cache_t* c, nkv_cache_entry_t* e)
 {
-    #if NKV_TLV_RETENTION_ENABLE
-    prepare_tlv_keep_info();
-    #endif
-
-    uint8_t  oldest_idx = 0;
-    uint16_t oldest_seq = 0xFFFF;
+    uint16_t  self = (uint16_t) (e - c->entries) + 1;
+    uint16_t* link = &c->buckets[id_hash((const uint8_t*) e->key, e->key_len) & CACHE_MASK];
+
+    while (*link != 0 && *link != self)
+        link = &c->entries[*link - 1].next;
+    if (*link == self)
+        *link = e->next;
+
+    cache_free_value(c, e);
+    e->valid     = 0;
+    e->next      = c->free_head;
+    c->free_head = self;
+    c->count--;
+}
 
-    for (uint8_t i = 0; i < g_nkv.flash.sector_count; i++)
+/* 整理存储区：有效块依次前移，回收已释放块的空间 */
+static void cache_compact(nkv_cache_t* c)
+{
+    uint16_t dst = 0;
+    for (uint16_t off = 0; off < c->arena_top;)
     {
-        if (i == g_nkv.active_sector)
-            continue;
-        nkv_sector_hdr_t hdr;
-        if (read_sector_hdr(i, &hdr) == 0 && hdr.magic == NKV_MAGIC)
+        uint16_t owner;
+        uint16_t size = CACHE_BLOCK_HDR + c->arena[off];
+        memcpy(&owner, &c->arena[off + 1], sizeof(owner));
+
+        nkv_cache_entry_t* e = &c->entries[owner];
+        if (owner < NKV_CACHE_SIZE && e->valid && e->val_off == off)
         {
-            /*
-             * 序号回绕处理：使用带符号差值比较
-             * 当 seq 从 0xFFFF 溢出到 0x0000 时，普通比较会失败。
-             * 例如：oldest_seq=0xFFFE, hdr.seq=0x0001
-             *   普通比较: 0xFFFE > 0x0001 → 错误地认为旧扇区更新
-             *   带符号差值: (int16_t)(0xFFFE - 0x0001) = -3 < 0 → 正确识别新扇区
-             */
-            if ((int16_t) (oldest_seq - hdr.seq) > 0)
-            {
-                oldest_seq = hdr.seq;
-                oldest_idx = i;
-            }
+            if (dst != off)
+                memmove(&c->arena[dst], &c->arena[off], size);
+            e->val_off = dst;
+            dst += size;
         }
+        off += size;
     }
+    c->arena_top = dst;
+}
 
-    if (oldest_seq == 0xFFFF)
-        return 0;
+/* 分配可容纳 len 字节的值块，空间不足时淘汰其他项(不淘汰 keep)并整理 */
+static uint16_t cache_alloc_value(nkv_cache_t* c, uint8_t len, nkv_cache_entry_t* keep)
+{
+    uint16_t size  = CACHE_BLOCK_HDR + len;
+    uint16_t owner = (uint16_t) (keep - c->entries);
 
-    g_nkv.gc_src_sector = oldest_idx;
-    g_nkv.gc_src_offset = ALIGNED_HDR_SIZE;
-    g_nkv.gc_active     = 1;
-    memset(g_nkv.gc_bitmap, 0, sizeof(g_nkv.gc_bitmap));
-    return 1;
+    while (c->arena_live + size > NKV_CACHE_ARENA)
+    {
+        nkv_cache_entry_t* victim = cache_victim(c, keep);
+        if (!victim)
+            return CACHE_NO_BLOCK;
+        cache_drop(c, victim);
+    }
+    if (c->arena_top + size > NKV_CACHE_ARENA)
+        cache_compact(c);
+
+    uint16_t off  = c->arena_top;
+    c->arena[off] = len;
+    memcpy(&c->arena[off + 1], &owner, sizeof(owner));
+    c->arena_top += size;
+    c->arena_live += size;
+    return off;
 }
 
-/* 执行一步增量GC */
-static uint8_t incremental_gc_step(void)
+/* 取得空闲项：空闲表 → 未使用过的项 → 淘汰 */
+static nkv_cache_entry_t* cache_alloc_entry(nkv_cache_t* c)
 {
-    if (!g_nkv.gc_active)
-        return 0;
+    if (!c->free_head)
+    {
+        if (c->used < NKV_CACHE_SIZE)
+            return &c->entries[c->used++];
 
-    uint32_t sector = SECTOR_ADDR(g_nkv.gc_src_sector);
+        nkv_cache_entry_t* victim = cache_victim(c, NULL);
+        if (!victim)
+            return NULL;
+        cache_drop(c, victim);
+    }
 
-    while (g_nkv.gc_src_offset <= g_nkv.flash.sector_size - ALIGN(NKV_HEADER_SIZE))
-    {
-        nkv_entry_t entry;
-        if (g_nkv.flash.read(sector + g_nkv.gc_src_offset, (uint8_t*) &entry, NKV_HEADER_SIZE) != 0)
-            break;
-        if (entry.state == NKV_STATE_ERASED)
-            break;
+    nkv_cache_entry_t* e = &c->entries[c->free_head - 1];
+    c->free_head         = e->next;
+    return e;
+}
 
-        uint32_t entry_size = ENTRY_SIZE(entry);
+/* 查找缓存中的键并记录访问 */
+static nkv_cache_entry_t* cache_find(nkv_instance_t* db, const char* key)
+{
+    nkv_cache_t*       c    = &db->cache;
+    uint8_t            klen = strlen(key);
+    uint32_t           h    = id_hash((const uint8_t*) key, klen);
+    nkv_cache_entry_t* e    = cache_lookup(c, key, klen, h);
+
+    cache_age(c);
+    cache_touch(c, e, h);
+    STAT_INC(e ? &c->hit_count : &c->miss_count);
+    return e;
+}
+
+/* 更新缓存 */
+static void cache_update(nkv_instance_t* db, const char* key, const void* val, uint8_t len)
+{
+    nkv_cache_t*       c    = &db->cache;
+    uint8_t            klen = strlen(key);
+    uint32_t           h    = id_hash((const uint8_t*) key, klen);
+    nkv_cache_entry_t* e    = cache_lookup(c, key, klen, h);
 
-        /* 增量 GC 同样只迁移 VALID 状态的数据 */
-        if (entry.state != NKV_STATE_VALID || entry.val_len == 0)
+    cache_age(c);
+    if (e)
+    {
+        /* 块容量足够时原地更新 */
+        if (len <= c->arena[e->val_off])
         {
-            g_nkv.gc_src_offset += entry_size;
-            continue;
+            memcpy(&c->arena[e->val_off + CACHE_BLOCK_HDR], val, len);
+            e->val_len = len;
+            return;
         }
-
-    #if NKV_TLV_RETENTION_ENABLE
-        if (entry.key_len == 0)
+        cache_free_value(c, e);
+    }
+    else
+    {
+    #if NKV_CACHE_POLICY == 1
+        /* TinyLFU准入：缓存已满时，新键须比淘汰对象访问更频繁 */
+        if (c->count == NKV_CACHE_SIZE)
         {
-            uint8_t type;
-            g_nkv.flash.read(sector + g_nkv.gc_src_offset + NKV_HEADER_SIZE, &type, 1);
-            if (!should_migrate_tlv(type, sector + g_nkv.gc_src_offset))
-            {
-                g_nkv.gc_src_offset += entry_size;
-                continue;
-            }
+            nkv_cache_entry_t* victim = cache_victim(c, NULL);
+            if (victim &&
+                sketch_freq(c, h) <= sketch_freq(c, id_hash((const uint8_t*) victim->key, victim->key_len)))
+                return;
+            if (victim)
+                cache_drop(c, victim);
         }
     #endif
+        e = cache_alloc_entry(c);
+        if (!e)
+            return;
+        memcpy(e->key, key, klen);
+        e->key_len = klen;
+        e->val_off = CACHE_NO_BLOCK;
+        e->freq    = 1;
+    }
 
-        char key[NKV_MAX_KEY_LEN] = {0};
-        g_nkv.flash.read(sector + g_nkv.gc_src_offset + NKV_HEADER_SIZE, (uint8_t*) key, entry.key_len);
-
-        uint8_t hash = hash_key(key, entry.key_len);
-
-        if (!bitmap_test(g_nkv.gc_bitmap, hash))
+    uint16_t off = cache_alloc_value(c, len, e);
+    if (off == CACHE_NO_BLOCK)
+    {
+        if (e->valid)
         {
-            nkv_entry_t new_entry;
-            if (find_key_in_sector(g_nkv.active_sector, key, &new_entry) == 0)
-            {
-                migrate_entry(sector + g_nkv.gc_src_offset, &entry);
-            }
-            bitmap_set(g_nkv.gc_bitmap, hash);
+            cache_drop(c, e);
         }
-
-        g_nkv.gc_src_offset += entry_size;
-        return 1;
+        else
+        {
+            e->next      = c->free_head;
+            c->free_head = (uint16_t) (e - c->entries) + 1;
+        }
+        return;
     }
 
-    /* 扫描完成，擦除源扇区 */
-    g_nkv.flash.erase(SECTOR_ADDR(g_nkv.gc_src_sector));
-    g_nkv.gc_active = 0;
-
-    if (count_free_sectors() < 1)
-        start_incremental_gc();
-    return 0;
+    memcpy(&c->arena[off + CACHE_BLOCK_HDR], val, len);
+    e->val_off = off;
+    e->val_len = len;
+    if (!e->valid)
+    {
+        uint16_t* head = &c->buckets[h & CACHE_MASK];
+        e->next        = *head;
+        *head          = (uint16_t) (e - c->entries) + 1;
+        e->valid       = 1;
+        c->count++;
+    }
 }
 
-/* 执行增量GC */
-static void do_incremental_gc(void)
+/* 移除缓存项 */
+static void cache_remove(nkv_instance_t* db, const char* key)
 {
-    if (!g_nkv.gc_active && should_start_gc())
-    {
-        if (!start_incremental_gc())
-            return;
-    }
-    if (g_nkv.gc_active)
-    {
-        for (uint8_t i = 0; i < NKV_GC_ENTRIES_PER_WRITE; i++)
-            if (!incremental_gc_step())
-                break;
-    }
+    uint8_t            klen = strlen(key);
+    nkv_cache_entry_t* e    = cache_lookup(&db->cache, key, klen, id_hash((const uint8_t*) key, klen));
+    if (e)
+        cache_drop(&db->cache, e);
 }
 #endif
 
-/* ==================== 公共API ==================== */
+/* ==================== 条目匹配器 ==================== */
+typedef struct
+{
+    const char* key;
+    uint8_t     key_len;
+    uint8_t     key_hash;   /* 预计算的哈希值(格式1) */
+    uint16_t    key_hash14; /* 预计算的哈希值(格式2) */
+    uint16_t    compares;   /* 哈希命中后比较键名的次数 */
+} kv_match_ctx_t;
 
-nkv_err_t nkv_internal_init(const nkv_flash_ops_t* ops)
+typedef struct
 {
-    if (!ops || !ops->read || !ops->write || !ops->erase)
-        return NKV_ERR_INVALID;
-    if (ops->sector_count < 2)
-        return NKV_ERR_INVALID;
-    if (ops->align == 0 || (ops->align & (ops->align - 1)) != 0)
-        return NKV_ERR_INVALID;
+    uint8_t type;
+} tlv_match_ctx_t;
 
-    /* 写入原子性断言：对齐值必须 >= 2 字节（状态字段大小），以保证状态更新的原子性 */
-    NKV_ASSERT(ops->align >= sizeof(uint16_t) && "align < sizeof(state), atomic write not guaranteed");
+/* KV键匹配器（哈希加速） */
+static uint8_t kv_matcher(const nkv_entry_t* entry, nkv_cursor_t* cur, void* ctx)
+{
+    /* 仅匹配 VALID 或 PRE_DEL 状态 (PRE_DEL 在掉电恢复期间被视为有效) */
+    if (entry->state != NKV_STATE_VALID && entry->state != NKV_STATE_PRE_DEL)
+        return 0;
+    kv_match_ctx_t* c = (kv_match_ctx_t*) ctx;
+    if (entry->key_len != c->key_len)
+        return 0;
 
-    /* 断言：最大条目大小不能超过扇区大小的一半（确保 GC 迁移空间） */
-    uint32_t max_entry = NKV_HEADER_SIZE + NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN + NKV_CRC_SIZE + ops->align;
-    NKV_ASSERT(max_entry <= ops->sector_size / 2 && "max_entry > sector_size/2, config invalid");
+    /* 哈希快速过滤：哈希不匹配则直接跳过（格式2比较14位哈希） */
+    if ((cur->format == NKV_FORMAT_V1) ? (entry->key_hash != c->key_hash) : (ENTRY_HASH14(*entry) != c->key_hash14))
+        return 0;
 
-    memset(&g_nkv, 0, sizeof(nkv_instance_t));
-    g_nkv.flash = *ops;
-    return NKV_OK;
+    /* 哈希匹配，从窗口中精确比较键 */
+    c->compares++;
+    const uint8_t* key = cursor_peek(cur, cur->offset + NKV_HEADER_SIZE, c->key_len);
+    return (key && memcmp(key, c->key, c->key_len) == 0);
 }
 
-nkv_err_t nkv_scan(void)
+/* TLV类型匹配器 */
+static uint8_t tlv_matcher(const nkv_entry_t* entry, nkv_cursor_t* cur, void* ctx)
 {
-    if (g_nkv.initialized)
-        return NKV_OK;
+    if ((entry->state != NKV_STATE_VALID && entry->state != NKV_STATE_PRE_DEL) || entry->key_len != 0 ||
+        entry->val_len == 0)
+        return 0;
 
-    uint8_t  found = 0, active_idx = 0;
-    uint16_t max_seq = 0;
+    tlv_match_ctx_t* c    = (tlv_match_ctx_t*) ctx;
+    const uint8_t*   type = cursor_peek(cur, cur->offset + NKV_HEADER_SIZE, 1);
+    return (type && *type == c->type);
+}
 
-    for (uint8_t i = 0; i < g_nkv.flash.sector_count; i++)
-    {
-        nkv_sector_hdr_t hdr;
-        if (read_sector_hdr(i, &hdr) != 0)
-            continue;
-        if (hdr.magic == NKV_MAGIC)
-        {
-            /*
-             * 序号回绕处理：使用带符号差值比较
-             * 当 seq 从 0xFFFF 溢出到 0x0000 时，差值的最高位会正确反映新旧关系。
-             * 例如：max_seq=0xFFFE, hdr.seq=0x0001
-             *   (int16_t)(0x0001 - 0xFFFE) = 3 > 0 → 正确识别新扇区
-             */
-            if (!found || (int16_t) (hdr.seq - max_seq) > 0)
-            {
-                max_seq    = hdr.seq;
-                active_idx = i;
-                found      = 1;
-            }
-        }
-    }
+/* 读取Flash中的条目并比较标识（不检查状态） */
+static uint8_t entry_id_match(nkv_instance_t* db, uint32_t addr, const uint8_t* id, uint8_t key_len,
+                              nkv_entry_t* out)
+{
+    uint8_t     tmp[NKV_HEADER_SIZE + NKV_MAX_KEY_LEN];
+    uint8_t     id_len = key_len ? key_len : 1;
+    nkv_entry_t entry;
 
-    if (!found)
-        return nkv_format();
+    if (flash_read(db, addr, tmp, NKV_HEADER_SIZE + id_len) != 0)
+        return 0;
+    memcpy(&entry, tmp, NKV_HEADER_SIZE);
+    if (entry.key_len != key_len || (key_len == 0 && entry.val_len == 0))
+        return 0;
+    if (memcmp(tmp + NKV_HEADER_SIZE, id, id_len) != 0)
+        return 0;
+    if (out)
+        *out = entry;
+    return 1;
+}
 
-    g_nkv.active_sector = active_idx;
-    g_nkv.sector_seq    = max_seq;
-    g_nkv.write_offset  = scan_write_offset(active_idx);
-    g_nkv.initialized   = 1;
+/* ==================== RAM哈希索引 ==================== */
+#if NKV_INDEX_ENABLE
+    #define INDEX_MASK  (NKV_INDEX_SIZE - 1)
+    #define INDEX_LIMIT (NKV_INDEX_SIZE * 3 / 4)
 
-    /* 扫描完成后检查并同步默认值 */
-    nkv_sync_version();
+/* 查找标识所在槽位（hint为已知旧地址，可免去一次Flash校验），未找到返回-1 */
+static int32_t index_find_slot(nkv_instance_t* db, const uint8_t* id, uint8_t key_len, uint32_t hint, nkv_entry_t* out)
+{
+    uint32_t h   = id_hash(id, key_len);
+    uint32_t pos = h & INDEX_MASK;
 
-    return NKV_OK;
+    for (uint32_t n = 0; n < NKV_INDEX_SIZE; n++, pos = (pos + 1) & INDEX_MASK)
+    {
+        nkv_index_slot_t* s = &db->index.slots[pos];
+        if (s->addr == 0)
+            break;
+        if (s->hash != h)
+            continue;
+        if ((hint != 0 && s->addr == hint && !out) || entry_id_match(db, s->addr, id, key_len, out))
+            return (int32_t) pos;
+    }
+    return -1;
 }
 
-nkv_err_t nkv_format(void)
+/* 删除槽位（线性探测回移删除，无需墓碑） */
+static void index_remove_at(nkv_instance_t* db, uint32_t pos)
 {
-    for (uint8_t i = 0; i < g_nkv.flash.sector_count; i++)
+    uint32_t next = pos;
+    for (;;)
     {
-        uint32_t addr = SECTOR_ADDR(i);
-        if (!nkv_is_erased(addr, g_nkv.flash.sector_size))
+        next                = (next + 1) & INDEX_MASK;
+        nkv_index_slot_t* s = &db->index.slots[next];
+        if (s->addr == 0)
+            break;
+        /* 若槽位的起始位置不在 (pos, next] 区间内，则可前移填补空洞 */
+        uint32_t home = s->hash & INDEX_MASK;
+        if (((next - home) & INDEX_MASK) >= ((next - pos) & INDEX_MASK))
         {
-            if (g_nkv.flash.erase(addr) != 0)
-                return NKV_ERR_FLASH;
+            db->index.slots[pos] = *s;
+            pos                  = next;
         }
     }
-
-    nkv_sector_hdr_t hdr     = {.magic = NKV_MAGIC, .seq = 1};
-    uint32_t         hdr_len = ALIGN(sizeof(hdr));
-    uint8_t          buf[32];
-
-    memset(buf, 0xFF, sizeof(buf));
-    memcpy(buf, &hdr, sizeof(hdr));
-
-    if (g_nkv.flash.write(SECTOR_ADDR(0), buf, hdr_len) != 0)
-        return NKV_ERR_FLASH;
-
-    g_nkv.active_sector = 0;
-    g_nkv.sector_seq    = 1;
-    g_nkv.write_offset  = ALIGNED_HDR_SIZE;
-    g_nkv.initialized   = 1;
-    return NKV_OK;
+    db->index.slots[pos].addr = 0;
+    db->index.used--;
 }
 
-/* 更新条目状态（保留 key_len 和 val_len） */
-static nkv_err_t update_entry_state(uint32_t addr, uint16_t state)
+/* 插入或更新标识对应的地址，索引已满时标记溢出 */
+static void index_put(nkv_instance_t* db, const uint8_t* id, uint8_t key_len, uint32_t addr, uint32_t hint)
 {
-    static uint8_t buf[32];
-
-    /* 先读取原有数据，保留 key_len 和 val_len */
-    if (g_nkv.flash.read(addr, buf, g_nkv.flash.align) != 0)
-        return NKV_ERR_FLASH;
-
+    int32_t found = index_find_slot(db, id, key_len, hint, NULL);
+    if (found >= 0)
+    {
+        db->index.slots[found].addr = addr;
+        return;
+    }
+    if (db->index.used >= INDEX_LIMIT)
+    {
+        db->index.overflow = 1;
+        return;
+    }
+
+    uint32_t h   = id_hash(id, key_len);
+    uint32_t pos = h & INDEX_MASK;
+    while (db->index.slots[pos].addr != 0)
+        pos = (pos + 1) & INDEX_MASK;
+    db->index.slots[pos].addr = addr;
+    db->index.slots[pos].hash = h;
+    db->index.used++;
+}
+
+/* 移除标识对应的槽位 */
+static void index_drop(nkv_instance_t* db, const uint8_t* id, uint8_t key_len, uint32_t hint)
+{
+    int32_t found = index_find_slot(db, id, key_len, hint, NULL);
+    if (found >= 0)
+        index_remove_at(db, (uint32_t) found);
+}
+
+/* 条目迁移后更新地址（仅当索引指向源地址时） */
+static void index_relocate(nkv_instance_t* db, const uint8_t* id, uint8_t key_len, uint32_t src, uint32_t dest)
+{
+    uint32_t h   = id_hash(id, key_len);
+    uint32_t pos = h & INDEX_MASK;
+
+    for (uint32_t n = 0; n < NKV_INDEX_SIZE; n++, pos = (pos + 1) & INDEX_MASK)
+    {
+        nkv_index_slot_t* s = &db->index.slots[pos];
+        if (s->addr == 0)
+            return;
+        if (s->hash == h && s->addr == src)
+        {
+            s->addr = dest;
+            return;
+        }
+    }
+}
+
+/* 擦除扇区前移除指向该扇区的所有槽位 */
+static void index_purge_sector(nkv_instance_t* db, uint8_t idx)
+{
+    uint32_t start = db->flash.base + idx * db->flash.sector_size;
+    uint32_t end   = start + db->flash.sector_size;
+
+    for (uint32_t pos = 0; pos < NKV_INDEX_SIZE; pos++)
+    {
+        /* 删除后会有后续槽位前移到当前位置，需重复检查 */
+        while (db->index.slots[pos].addr != 0 && db->index.slots[pos].addr >= start &&
+               db->index.slots[pos].addr < end)
+            index_remove_at(db, pos);
+    }
+}
+
+/**
+ * @brief 索引查找
+ * @param definitive 输出：1=结果可信(命中或确定不存在), 0=索引不完整需回退扫描
+ * @return 有效条目(VALID/PRE_DEL)地址，0=未找到
+ */
+static uint32_t index_lookup(nkv_instance_t* db, const uint8_t* id, uint8_t key_len, nkv_entry_t* out,
+                             uint8_t* definitive)
+{
+    nkv_entry_t entry;
+    int32_t     found = index_find_slot(db, id, key_len, 0, &entry);
+
+    if (found < 0)
+    {
+        *definitive = !db->index.overflow;
+        return 0;
+    }
+
+    /* 索引始终指向该键最新的条目，最新条目已失效即视为不存在 */
+    *definitive = 1;
+    if (entry.state != NKV_STATE_VALID && entry.state != NKV_STATE_PRE_DEL)
+        return 0;
+    if (out)
+        *out = entry;
+    return db->index.slots[found].addr;
+}
+
+/* 重建索引：按从旧到新的扇区顺序回放有效条目，后写入者覆盖先写入者 */
+static void index_rebuild(nkv_instance_t* db)
+{
+    memset(&db->index, 0, sizeof(db->index));
+
+    uint8_t order[NKV_MAX_SECTORS];
+    uint8_t n = sector_order(db, order);
+    for (uint8_t i = 0; i < n; i++)
+    {
+        uint8_t      idx = order[i];
+        nkv_cursor_t cur;
+        nkv_entry_t  entry;
+        cursor_open(db, &cur, idx, SECTOR_DATA(idx));
+
+        while (cursor_entry(&cur, &entry))
+        {
+            if (entry.state == NKV_STATE_ERASED)
+                break;
+
+            if ((entry.state == NKV_STATE_VALID || entry.state == NKV_STATE_PRE_DEL) &&
+                entry.key_len < NKV_MAX_KEY_LEN && (entry.key_len > 0 || entry.val_len > 0) &&
+                ENTRY_FLAG(entry) != NKV_ENTRY_FLAG_COMMIT && !IS_CHUNK(entry))
+            {
+                const uint8_t* id =
+                    cursor_peek(&cur, cur.offset + NKV_HEADER_SIZE, entry.key_len ? entry.key_len : 1);
+                if (id)
+                    index_put(db, id, entry.key_len, cur.sector + cur.offset, 0);
+            }
+            cur.offset += ENTRY_SIZE(entry);
+        }
+    }
+}
+#endif
+
+/* ==================== 大值分块 ==================== */
+/*
+ * 大值布局：分块(VALID + LARGE标志, key_len=0) ... 头条目(LARGE标志, 键名 + 分块描述)，整体位于同一扇区。
+ * 分块只通过头条目访问：头条目删除时一并删除分块；挂载时未紧跟匹配头条目的分块是掉电残留，直接删除。
+ */
+typedef struct
+{
+    uint32_t total; /* 值总长度 */
+    uint32_t first; /* 首个分块地址，其后连续 count 个分块，紧接头条目 */
+    uint8_t  count; /* 分块数 */
+} NKV_PACKED large_desc_t;
+
+/* 读取头条目中的分块描述，并检查分块范围位于头条目之前的同一扇区内 */
+static uint8_t large_desc_read(nkv_instance_t* db, uint32_t addr, const nkv_entry_t* entry, large_desc_t* desc)
+{
+    if (entry->val_len != sizeof(large_desc_t) ||
+        flash_read(db, addr + NKV_HEADER_SIZE + entry->key_len, (uint8_t*) desc, sizeof(large_desc_t)) != 0)
+        return 0;
+    return (desc->count > 0 && desc->first >= SECTOR_ADDR(SECTOR_OF(addr)) + SECTOR_DATA(SECTOR_OF(addr)) && desc->first < addr);
+}
+
+/* 头条目已删除：删除其全部分块，使分块字节计入垃圾 */
+static void large_release(nkv_instance_t* db, uint32_t addr)
+{
+    nkv_entry_t  head;
+    large_desc_t desc;
+
+    if (flash_read(db, addr, (uint8_t*) &head, NKV_HEADER_SIZE) != 0 || !IS_LARGE_HEAD(head) ||
+        !large_desc_read(db, addr, &head, &desc))
+        return;
+
+    uint32_t a = desc.first;
+    for (uint8_t i = 0; i < desc.count && a < addr; i++)
+    {
+        nkv_entry_t chunk;
+        if (flash_read(db, a, (uint8_t*) &chunk, NKV_HEADER_SIZE) != 0 || !IS_CHUNK(chunk))
+            break;
+        if (chunk.state != NKV_STATE_DELETED)
+            update_entry_state(db, a, NKV_STATE_DELETED);
+        a += ENTRY_SIZE(chunk);
+    }
+}
+
+/**
+ * @brief 按顺序读出大值数据交给回调（逐个分块校验，只占用一个分块大小的栈缓冲区）
+ * @param limit   最多读出的字节数
+ * @param out_len 输出已读出的字节数
+ */
+static nkv_err_t large_read(nkv_instance_t* db, uint32_t addr, const nkv_entry_t* entry, nkv_stream_fn cb,
+                            void* ctx, uint32_t limit, uint32_t* out_len)
+{
+    large_desc_t desc;
+    if (!large_desc_read(db, addr, entry, &desc))
+        return NKV_ERR_CRC;
+    if (limit > desc.total)
+        limit = desc.total;
+
+    uint8_t  buf[NKV_MAX_VALUE_LEN + NKV_CRC_SIZE];
+    uint32_t done = 0;
+    uint32_t a    = desc.first;
+    for (uint8_t i = 0; i < desc.count && done < limit; i++)
+    {
+        nkv_entry_t chunk;
+        if (flash_read(db, a, (uint8_t*) &chunk, NKV_HEADER_SIZE) != 0)
+            return NKV_ERR_FLASH;
+        if (!IS_CHUNK(chunk) || chunk.state != NKV_STATE_VALID || chunk.val_len < 2 || a >= addr)
+            return NKV_ERR_CRC;
+        if (flash_read(db, a + NKV_HEADER_SIZE, buf, chunk.val_len + NKV_CRC_SIZE) != 0)
+            return NKV_ERR_FLASH;
+#if NKV_VERIFY_ON_READ
+        uint16_t stored_crc;
+        memcpy(&stored_crc, buf + chunk.val_len, NKV_CRC_SIZE);
+        if (calc_crc16(db, buf, chunk.val_len) != stored_crc)
+        {
+            OP_COUNT(db, crc_errors, 1);
+            return NKV_ERR_CRC;
+        }
+#endif
+        uint32_t n = chunk.val_len - 1;
+        if (n > limit - done)
+            n = limit - done;
+        if (cb(ctx, done, buf + 1, (uint16_t) n) != 0)
+            return NKV_ERR_INVALID;
+        done += n;
+        a += ENTRY_SIZE(chunk);
+    }
+    if (done != limit)
+        return NKV_ERR_CRC; /* 分块少于描述的长度 */
+    if (out_len)
+        *out_len = done;
+    return NKV_OK;
+}
+
+/* 复制回调：ctx 为目标缓冲区 */
+static int large_copy(void* ctx, uint32_t offset, uint8_t* buf, uint16_t len)
+{
+    memcpy((uint8_t*) ctx + offset, buf, len);
+    return 0;
+}
+
+/* ==================== 批量写入恢复 ==================== */
+/*
+ * 批量写入布局：成员条目(VALID + BATCH标志) ... 提交记录(COMMIT标志)，整批位于同一扇区。
+ * 挂载时成员在遇到校验通过的提交记录后才生效；缺少提交记录的成员是掉电残留，直接删除。
+ * 提交记录仍为 VALID 表示旧版本失效尚未完成，挂载结束后由 batch_finish 补做。
+ */
+typedef struct
+{
+    uint32_t first;       /* 当前批次首个成员地址 */
+    uint16_t count;       /* 当前批次已扫描成员数 */
+    uint32_t lo;          /* 待完成批次首个成员地址 */
+    uint32_t commit;      /* 待完成批次提交记录地址，0=无 */
+    uint32_t chunk_first; /* 当前大值分块序列首个分块地址 */
+    uint16_t chunks;      /* 当前大值分块序列已扫描分块数 */
+} batch_track_t;
+
+static void batch_finish(nkv_instance_t* db, const batch_track_t* bt);
+
+/* 校验提交记录：类型为保留类型、成员数不超过已扫描成员数且CRC正确，返回成员数(0=无效) */
+static uint8_t batch_commit_ok(nkv_instance_t* db, nkv_cursor_t* cur, const nkv_entry_t* entry, uint16_t count)
+{
+    if (entry->key_len != 0 || entry->val_len != 2 || count == 0)
+        return 0;
+
+    const uint8_t* p = cursor_peek(cur, cur->offset + NKV_HEADER_SIZE, 2 + NKV_CRC_SIZE);
+    if (!p || p[0] != TLV_TYPE_RESERVED || p[1] == 0 || p[1] > count)
+        return 0;
+
+    uint16_t crc;
+    memcpy(&crc, p + 2, NKV_CRC_SIZE);
+    return (calc_crc16(db, p, 2) == crc) ? p[1] : 0;
+}
+
+/* 处理当前批次成员：commit=1 时建立索引，commit=0 时标记删除（游标位置保持不变） */
+static void batch_apply(nkv_instance_t* db, nkv_cursor_t* cur, const batch_track_t* bt, uint8_t commit)
+{
+    uint32_t    saved = cur->offset;
+    nkv_entry_t entry;
+
+    cur->offset = bt->first - cur->sector;
+    for (uint16_t i = 0; i < bt->count && cursor_entry(cur, &entry); i++)
+    {
+        uint32_t addr = cur->sector + cur->offset;
+        if (!commit)
+        {
+            if (entry.state != NKV_STATE_DELETED)
+                update_entry_state(db, addr, NKV_STATE_DELETED);
+        }
+#if NKV_INDEX_ENABLE || NKV_BLOOM_ENABLE
+        else if ((entry.state == NKV_STATE_VALID || entry.state == NKV_STATE_PRE_DEL) && entry.key_len > 0 &&
+                 entry.key_len < NKV_MAX_KEY_LEN)
+        {
+            const uint8_t* id = cursor_peek(cur, cur->offset + NKV_HEADER_SIZE, entry.key_len);
+            if (id)
+            {
+    #if NKV_INDEX_ENABLE
+                index_put(db, id, entry.key_len, addr, 0);
+    #endif
+    #if NKV_BLOOM_ENABLE
+                bloom_add(db, (addr - db->flash.base) / db->flash.sector_size, id_hash(id, entry.key_len));
+    #endif
+            }
+        }
+#endif
+        cur->offset += ENTRY_SIZE(entry);
+    }
+    cur->offset = saved;
+}
+
+/* 大值分块序列没有紧跟匹配的头条目：删除这些分块（游标位置保持不变） */
+static void chunk_abort(nkv_instance_t* db, nkv_cursor_t* cur, batch_track_t* bt)
+{
+    uint32_t    saved = cur->offset;
+    nkv_entry_t entry;
+
+    cur->offset = bt->chunk_first - cur->sector;
+    for (uint16_t i = 0; i < bt->chunks && cursor_entry(cur, &entry); i++)
+    {
+        if (entry.state != NKV_STATE_DELETED)
+            update_entry_state(db, cur->sector + cur->offset, NKV_STATE_DELETED);
+        cur->offset += ENTRY_SIZE(entry);
+    }
+    cur->offset = saved;
+    bt->chunks  = 0;
+}
+
+/* 条目是否为当前分块序列的有效头条目 */
+static uint8_t chunk_head_ok(nkv_cursor_t* cur, const nkv_entry_t* entry, const batch_track_t* bt)
+{
+    if (!IS_LARGE_HEAD(*entry) || (entry->state != NKV_STATE_VALID && entry->state != NKV_STATE_PRE_DEL) ||
+        entry->val_len != sizeof(large_desc_t))
+        return 0;
+
+    large_desc_t   desc;
+    const uint8_t* p = cursor_peek(cur, cur->offset + NKV_HEADER_SIZE + entry->key_len, sizeof(desc));
+    if (!p)
+        return 0;
+    memcpy(&desc, p, sizeof(desc));
+    return (desc.first == bt->chunk_first && desc.count == bt->chunks);
+}
+
+/* 当前批次没有提交记录：删除已扫描的成员；扇区结束时未完成的分块序列同样删除 */
+static void batch_abort(nkv_instance_t* db, nkv_cursor_t* cur, batch_track_t* bt)
+{
+    if (bt->chunks > 0)
+        chunk_abort(db, cur, bt);
+    if (bt->count == 0)
+        return;
+    batch_apply(db, cur, bt, 0);
+    bt->count = 0;
+}
+
+/**
+ * @brief 挂载扫描中跟踪批量写入与大值分块
+ * @return 1=成员、提交记录或分块（已处理，不再按普通条目处理），0=普通条目（含大值头条目）
+ */
+static uint8_t batch_track(nkv_instance_t* db, batch_track_t* bt, nkv_cursor_t* cur, const nkv_entry_t* entry)
+{
+    if (IS_CHUNK(*entry))
+    {
+        if (bt->chunks == 0)
+            bt->chunk_first = cur->sector + cur->offset;
+        bt->chunks++;
+        return 1;
+    }
+    if (bt->chunks > 0)
+    {
+        if (chunk_head_ok(cur, entry, bt))
+            bt->chunks = 0;
+        else
+            chunk_abort(db, cur, bt);
+    }
+
+    if (ENTRY_FLAG(*entry) == NKV_ENTRY_FLAG_BATCH)
+    {
+        if (bt->count == 0)
+            bt->first = cur->sector + cur->offset;
+        bt->count++;
+        return 1;
+    }
+
+    if (ENTRY_FLAG(*entry) == NKV_ENTRY_FLAG_COMMIT)
+    {
+        uint8_t n = batch_commit_ok(db, cur, entry, bt->count);
+        if (n > 0)
+        {
+            /* 提交记录只覆盖最后 n 个成员，之前的是紧邻的失败批次残留：删除并跳过 */
+            if (bt->count > n)
+            {
+                uint32_t    saved = cur->offset;
+                nkv_entry_t stale;
+                bt->count -= n;
+                batch_apply(db, cur, bt, 0);
+                cur->offset = bt->first - cur->sector;
+                for (uint16_t i = 0; i < bt->count && cursor_entry(cur, &stale); i++)
+                    cur->offset += ENTRY_SIZE(stale);
+                bt->first   = cur->sector + cur->offset;
+                bt->count   = n;
+                cur->offset = saved;
+            }
+            batch_apply(db, cur, bt, 1);
+            if (entry->state == NKV_STATE_VALID)
+            {
+                bt->lo     = bt->first;
+                bt->commit = cur->sector + cur->offset;
+            }
+            bt->count = 0;
+        }
+        else
+        {
+            batch_abort(db, cur, bt);
+        }
+        return 1;
+    }
+
+    batch_abort(db, cur, bt);
+    return 0;
+}
+
+/* ==================== 扇区操作 ==================== */
+/* 读取扇区头 */
+static int read_sector_hdr(nkv_instance_t* db, uint8_t idx, nkv_sector_hdr_t* hdr)
+{
+    return flash_read(db, SECTOR_ADDR(idx), (uint8_t*) hdr, sizeof(nkv_sector_hdr_t));
+}
+
+/* 检查扇区是否有效 */
+static uint8_t is_sector_valid_locked(nkv_instance_t* db, uint8_t idx)
+{
+    nkv_sector_hdr_t hdr;
+    if (read_sector_hdr(db, idx, &hdr) != 0)
+        return 0;
+    return MAGIC_VALID(hdr.magic);
+}
+
+/* 扫描扇区写入偏移，并清理异常状态 */
+static uint32_t scan_write_offset(nkv_instance_t* db, uint8_t idx, batch_track_t* bt)
+{
+    uint32_t sector      = SECTOR_ADDR(idx);
+    uint32_t sector_size = db->flash.sector_size;
+    uint32_t low         = SECTOR_DATA(idx);
+    uint32_t high        = sector_size;
+
+    /*
+     * 快速探测：二分查找第一个连续 0xFF 的区域 (约 256 字节)
+     * 这可以帮助我们快速跳过大部分已写区域，定位到空闲区边界。
+     */
+    const uint32_t probe_size = 256;
+    while (high - low > probe_size)
+    {
+        uint32_t mid = low + ((high - low) / 2);
+        mid          = ALIGN(mid);
+        if (nkv_is_erased(db, sector + mid, probe_size))
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + probe_size;
+        }
+    }
+
+    /*
+     * 线性扫描以精确确定写偏移。
+     * 由于 KV 是变长链接且没有 Sync Word，必须从头扫描以保证正确性。
+     */
+    nkv_cursor_t cur;
+    nkv_entry_t  entry;
+    cursor_open(db, &cur, idx, SECTOR_DATA(idx));
+
+    while (cursor_entry(&cur, &entry))
+    {
+        if (entry.state == NKV_STATE_ERASED)
+        {
+            /* 发现 0xFFFF，进一步确认后面是否全是 0xFF */
+            if (cursor_erased(&cur, cur.offset, 32))
+            {
+                break;
+            }
+        }
+        else if (batch_track(db, bt, &cur, &entry))
+        {
+            /* 批量写入成员与提交记录已处理 */
+        }
+#if NKV_CLEAN_DIRTY_ON_BOOT
+        /* 掉电恢复：清理 WRITING 状态的脏数据（写入中掉电的不完整条目） */
+        else if (entry.state == NKV_STATE_WRITING)
+        {
+            update_entry_state(db, sector + cur.offset, NKV_STATE_DELETED);
+        }
+#endif
+
+        uint32_t entry_sz = ENTRY_SIZE(entry);
+        if (entry_sz < ALIGN(NKV_HEADER_SIZE + NKV_CRC_SIZE)) /* 异常条目大小 */
+            break;
+
+        cur.offset += entry_sz;
+    }
+    batch_abort(db, &cur, bt);
+
+    return cur.offset;
+}
+
+/* 重新统计扇区的有效/垃圾字节（逐扇区挂载路径在状态清理完成后调用） */
+static void sector_recount(nkv_instance_t* db, uint8_t idx)
+{
+    nkv_cursor_t cur;
+    nkv_entry_t  entry;
+
+    db->sectors[idx].live = 0;
+    db->sectors[idx].dead = 0;
+    cursor_open(db, &cur, idx, SECTOR_DATA(idx));
+    while (cursor_entry(&cur, &entry) && entry.state != NKV_STATE_ERASED)
+    {
+        sector_note_entry(db, cur.sector + cur.offset, &entry);
+        cur.offset += ENTRY_SIZE(entry);
+    }
+}
+
+/**
+ * @brief 单遍挂载扫描
+ * @details 按从旧到新的顺序流式读取每个有效扇区一次，同时完成：
+ *          计算活动扇区写偏移、清理 WRITING 脏条目、恢复批量写入、建立键的最新版本索引。
+ * @param bt 输出：待完成的批量写入
+ * @return 活动扇区写偏移
+ */
+static uint32_t mount_scan(nkv_instance_t* db, batch_track_t* bt)
+{
+    nkv_cursor_t cur;
+    uint32_t     write_offset = SECTOR_DATA(db->active_sector);
+
+#if NKV_INDEX_ENABLE
+    memset(&db->index, 0, sizeof(db->index));
+#endif
+
+    uint8_t order[NKV_MAX_SECTORS];
+    uint8_t n = sector_order(db, order);
+    for (uint8_t i = 0; i < n; i++)
+    {
+        uint8_t     idx       = order[i];
+        uint8_t     is_active = (idx == db->active_sector);
+        nkv_entry_t entry;
+        cursor_open(db, &cur, idx, SECTOR_DATA(idx));
+#if NKV_BLOOM_ENABLE
+        bloom_reset(db, idx);
+#endif
+
+        while (cursor_entry(&cur, &entry))
+        {
+            uint32_t addr = cur.sector + cur.offset;
+
+            if (entry.state != NKV_STATE_ERASED)
+                sector_note_entry(db, addr, &entry);
+
+            if (entry.state == NKV_STATE_ERASED)
+            {
+                /* 非活动扇区与查找路径一致，直接结束；活动扇区需确认后续已擦除 */
+                if (!is_active || cursor_erased(&cur, cur.offset, 32))
+                    break;
+            }
+            else if (batch_track(db, bt, &cur, &entry))
+            {
+                /* 批量写入成员在提交记录处统一建立索引 */
+            }
+#if NKV_CLEAN_DIRTY_ON_BOOT
+            else if (entry.state == NKV_STATE_WRITING)
+            {
+                /* 掉电恢复：清理写入中掉电的不完整条目 */
+                update_entry_state(db, addr, NKV_STATE_DELETED);
+            }
+#endif
+#if NKV_INDEX_ENABLE || NKV_BLOOM_ENABLE
+            else if ((entry.state == NKV_STATE_VALID || entry.state == NKV_STATE_PRE_DEL) &&
+                     entry.key_len < NKV_MAX_KEY_LEN && (entry.key_len > 0 || entry.val_len > 0))
+            {
+                const uint8_t* id =
+                    cursor_peek(&cur, cur.offset + NKV_HEADER_SIZE, entry.key_len ? entry.key_len : 1);
+                if (id)
+                {
+    #if NKV_INDEX_ENABLE
+                    index_put(db, id, entry.key_len, addr, 0);
+    #endif
+    #if NKV_BLOOM_ENABLE
+                    bloom_add(db, idx, id_hash(id, entry.key_len));
+    #endif
+                }
+            }
+#endif
+
+            uint32_t entry_sz = ENTRY_SIZE(entry);
+            if (entry_sz < ALIGN(NKV_HEADER_SIZE + NKV_CRC_SIZE)) /* 异常条目大小 */
+                break;
+            cur.offset += entry_sz;
+        }
+        batch_abort(db, &cur, bt);
+
+        if (is_active)
+            write_offset = cur.offset;
+    }
+    return write_offset;
+}
+
+/* 通用扇区查找 */
+static uint32_t find_in_sector(nkv_instance_t* db, uint8_t idx,
+                               uint8_t (*matcher)(const nkv_entry_t*, nkv_cursor_t*, void*), void* ctx,
+                               nkv_entry_t* out)
+{
+    nkv_cursor_t cur;
+    nkv_entry_t  entry;
+    uint32_t     found = 0;
+
+    cursor_open(db, &cur, idx, SECTOR_DATA(idx));
+    while (cursor_entry(&cur, &entry))
+    {
+        if (entry.state == NKV_STATE_ERASED)
+            break;
+
+        if (matcher(&entry, &cur, ctx))
+        {
+            found = cur.sector + cur.offset;
+            if (out)
+                *out = entry;
+        }
+        cur.offset += ENTRY_SIZE(entry);
+    }
+    return found;
+}
+
+/**
+ * @brief 按从新到旧的顺序扫描所有扇区查找标识（索引无法给出确定结果时使用）
+ * @details 启用布隆过滤器时先查负缓存，再跳过过滤器判定不含该标识的扇区。
+ */
+static uint32_t scan_for_id(nkv_instance_t* db, const uint8_t* id, uint8_t key_len,
+                            uint8_t (*matcher)(const nkv_entry_t*, nkv_cursor_t*, void*), void* ctx,
+                            nkv_entry_t* out)
+{
+#if NKV_BLOOM_ENABLE
+    if (neg_find(db, id, key_len) >= 0)
+    {
+        db->bloom.neg_hits++;
+        return 0;
+    }
+    uint32_t h = id_hash(id, key_len);
+#endif
+
+    uint8_t order[NKV_MAX_SECTORS];
+    uint8_t n = sector_order(db, order);
+    for (uint8_t i = n; i > 0; i--)
+    {
+        uint8_t idx = order[i - 1];
+#if NKV_BLOOM_ENABLE
+        if (!bloom_may_contain(db, idx, h))
+        {
+            db->bloom.skipped++;
+            continue;
+        }
+        db->bloom.probed++;
+#endif
+        uint32_t addr = find_in_sector(db, idx, matcher, ctx, out);
+        if (addr != 0)
+            return addr;
+#if NKV_BLOOM_ENABLE
+        db->bloom.false_pos++;
+#endif
+    }
+
+#if NKV_BLOOM_ENABLE
+    neg_insert(db, id, key_len);
+#endif
+    return 0;
+}
+
+/* 在所有扇区中查找键 */
+static uint32_t find_key(nkv_instance_t* db, const char* key, nkv_entry_t* out)
+{
+    uint8_t key_len = strlen(key);
+#if NKV_INDEX_ENABLE
+    uint8_t  definitive;
+    uint32_t addr = index_lookup(db, (const uint8_t*) key, key_len, out, &definitive);
+    if (definitive)
+        return addr;
+#endif
+
+    kv_match_ctx_t ctx   = {.key        = key,
+                            .key_len    = key_len,
+                            .key_hash   = hash_key(key, key_len),
+                            .key_hash14 = id_hash((const uint8_t*) key, key_len) & 0x3FFF};
+    uint32_t       found = scan_for_id(db, (const uint8_t*) key, key_len, kv_matcher, &ctx, out);
+    db->key_reads += ctx.compares;
+    return found;
+}
+
+/* 切换到指定扇区 */
+static nkv_err_t switch_to_sector(nkv_instance_t* db, uint8_t idx)
+{
+    uint32_t addr = SECTOR_ADDR(idx);
+
+    /* 已确认擦除(回收/后台预擦除)或探测为干净的扇区，跳过擦除 */
+    if (!db->sectors[idx].erased && !sector_blank(db, idx))
+    {
+#if NKV_INDEX_ENABLE
+        index_purge_sector(db, idx);
+#endif
+        if (flash_erase(db, addr) != 0)
+            return NKV_ERR_FLASH;
+    }
+#if NKV_BLOOM_ENABLE
+    else
+    {
+        bloom_reset(db, idx); /* 已擦除的扇区不含任何条目 */
+    }
+#endif
+
+    uint16_t seq = db->sector_seq + 1;
+    if (write_sector_hdr(db, idx, seq) != 0)
+        return NKV_ERR_FLASH;
+
+    sector_open(db, idx, seq, db->format);
+    db->active_sector = idx;
+    db->sector_seq    = seq;
+    OP_COUNT(db, sector_switches, 1);
+    db->write_offset  = HDR_SIZE(db->format);
+    return NKV_OK;
+}
+
+/*
+ * 查找空闲扇区：优先选择已确认擦除的扇区(切换时只需写入扇区头)，
+ * 其次选择擦除次数最少的扇区，次数相同时按环形顺序
+ */
+static int8_t find_free_sector(nkv_instance_t* db)
+{
+    int8_t best = -1;
+    for (uint8_t i = 1; i < db->flash.sector_count; i++)
+    {
+        uint8_t idx = (db->active_sector + i) % db->flash.sector_count;
+        if (is_sector_valid_locked(db, idx))
+            continue;
+        if (best < 0)
+        {
+            best = idx;
+            continue;
+        }
+
+        const nkv_sector_info_t* s = &db->sectors[idx];
+        const nkv_sector_info_t* b = &db->sectors[best];
+        if (s->erased != b->erased ? s->erased : s->erase_count < b->erase_count)
+            best = idx;
+    }
+    return best;
+}
+
+/* ==================== 条目迁移 ==================== */
+#if NKV_TLV_RETENTION_ENABLE
+static void clear_tlv_keep_info(nkv_instance_t* db)
+{
+    db->tlv_keep_info_count = 0;
+}
+
+/* 计算TLV保留阈值 */
+static uint32_t find_tlv_keep_threshold(nkv_instance_t* db, uint8_t type, uint16_t keep)
+{
+    nkv_tlv_history_t hist[32];
+    uint8_t           count = 0;
+
+    tlv_get_history_locked(db, type, hist, 32, &count);
+    if (count == 0 || count <= keep)
+        return 0;
+
+    return hist[keep].flash_addr - NKV_HEADER_SIZE - 1;
+}
+
+/* 准备所有TLV保留阈值 */
+static void prepare_tlv_keep_info(nkv_instance_t* db)
+{
+    clear_tlv_keep_info(db);
+    for (uint8_t i = 0; i < db->tlv_retention_count && db->tlv_keep_info_count < NKV_TLV_RETENTION_MAX; i++)
+    {
+        if (db->tlv_retention[i].keep_count == 0)
+            continue;
+        db->tlv_keep_info[db->tlv_keep_info_count].type = db->tlv_retention[i].type;
+        db->tlv_keep_info[db->tlv_keep_info_count].threshold =
+            find_tlv_keep_threshold(db, db->tlv_retention[i].type, db->tlv_retention[i].keep_count);
+        db->tlv_keep_info_count++;
+    }
+}
+
+/* 检查TLV是否应迁移 */
+static uint8_t should_migrate_tlv(nkv_instance_t* db, uint8_t type, uint32_t addr)
+{
+    for (uint8_t i = 0; i < db->tlv_keep_info_count; i++)
+    {
+        if (db->tlv_keep_info[i].type == type)
+        {
+            if (db->tlv_keep_info[i].threshold == 0)
+                return 1;
+            return (addr >= db->tlv_keep_info[i].threshold);
+        }
+    }
+    return 1;
+}
+#endif
+
+/* 将刚以 WRITING 状态写入的迁移副本标记为 VALID：buf 仍为写入时的条目内容，直接重新编程首个对齐单元，
+ * 不像 update_entry_state 那样回读条目头 */
+static nkv_err_t mark_copy_valid(nkv_instance_t* db, uint32_t addr, uint8_t* buf)
+{
+    ((nkv_entry_t*) buf)->state = NKV_STATE_VALID;
+    OP_COUNT(db, state_writes, 1);
+    return (flash_write(db, addr, buf, db->flash.align) != 0) ? NKV_ERR_FLASH : NKV_OK;
+}
+
+/* 迁移条目（条目完整位于游标窗口内时直接从窗口复制）：与 set_locked 相同先写入 WRITING 状态的副本再标记为 VALID，
+ * 迁移中掉电时副本不完整也不会取代源条目 */
+static nkv_err_t migrate_entry(nkv_instance_t* db, nkv_cursor_t* cur, const nkv_entry_t* entry)
+{
+    uint8_t* buf  = db->scratch;
+    uint32_t size = ENTRY_SIZE(*entry);
+    uint32_t src  = cur->sector + cur->offset;
+
+    if (db->write_offset + size > db->flash.sector_size)
+        return NKV_ERR_NO_SPACE;
+
+    const uint8_t* data = cursor_peek(cur, cur->offset, size);
+    if (!data)
+    {
+        if (flash_read(db, src, buf, size) != 0)
+            return NKV_ERR_FLASH;
+        data = buf;
+    }
+
+    if (data != buf)
+        memcpy(buf, data, size);
+    ((nkv_entry_t*) buf)->state = NKV_STATE_WRITING;
+
+    /* 已提交的批量写入成员迁移后即为普通条目，清除批次标志；旧格式扇区的条目按活动扇区格式重写哈希 */
+    uint8_t format = db->sectors[db->active_sector].format;
+    if (ENTRY_FLAG(*entry) != NKV_ENTRY_FLAG_NONE || cur->format != format)
+        entry_stamp((nkv_entry_t*) buf, format, NKV_ENTRY_FLAG_NONE, buf + NKV_HEADER_SIZE);
+
+    uint32_t dest = SECTOR_ADDR(db->active_sector) + db->write_offset;
+    if (flash_write(db, dest, buf, size) != 0)
+        return NKV_ERR_FLASH;
+    sector_note_live(db, dest, size);
+    db->write_offset += size;
+    if (mark_copy_valid(db, dest, buf) != NKV_OK)
+        return NKV_ERR_FLASH;
+    db->gc_stats.gc_bytes += size;
+
+#if NKV_INDEX_ENABLE
+    index_relocate(db, buf + NKV_HEADER_SIZE, entry->key_len, src, dest);
+#endif
+#if NKV_BLOOM_ENABLE
+    bloom_note(db, dest, buf + NKV_HEADER_SIZE, entry->key_len);
+#endif
+    return NKV_OK;
+}
+
+/* 迁移大值：分块与头条目作为整体连续写入活动扇区，头条目中的分块地址随之更新；
+ * 头条目以 WRITING 状态写入，全部落盘后才标记为 VALID */
+static nkv_err_t migrate_large(nkv_instance_t* db, nkv_cursor_t* cur, const nkv_entry_t* entry)
+{
+    uint8_t*     buf  = db->scratch;
+    uint32_t     size = ENTRY_SIZE(*entry);
+    uint32_t     src  = cur->sector + cur->offset;
+    large_desc_t desc;
+    nkv_entry_t  e;
+
+    /* 先确认分块连续排列到头条目为止，结构损坏的大值已无法读取，不再迁移 */
+    if (!large_desc_read(db, src, entry, &desc))
+        return NKV_OK;
+    uint32_t first = desc.first;
+    uint32_t a     = first;
+    for (uint8_t i = 0; i < desc.count && a < src; i++)
+    {
+        if (flash_read(db, a, (uint8_t*) &e, NKV_HEADER_SIZE) != 0)
+            return NKV_ERR_FLASH;
+        if (!IS_CHUNK(e))
+            return NKV_OK;
+        a += ENTRY_SIZE(e);
+    }
+    if (a != src)
+        return NKV_OK;
+
+    uint32_t unit = src + size - first;
+    if (db->write_offset + unit > db->flash.sector_size)
+        return NKV_ERR_NO_SPACE;
+
+    uint8_t  format = db->sectors[db->active_sector].format;
+    uint32_t dest   = SECTOR_ADDR(db->active_sector) + db->write_offset;
+    for (a = first; a <= src;)
+    {
+        if (flash_read(db, a, (uint8_t*) &e, NKV_HEADER_SIZE) != 0)
+            return NKV_ERR_FLASH;
+        uint32_t n = ENTRY_SIZE(e);
+        if (flash_read(db, a, buf, n) != 0)
+            return NKV_ERR_FLASH;
+
+        if (a == src)
+        {
+            /* 头条目：改写首个分块地址并重新计算CRC，以 WRITING 状态写入 */
+            uint8_t* val = buf + NKV_HEADER_SIZE + e.key_len;
+            desc.first   = dest;
+            memcpy(val, &desc, sizeof(desc));
+            uint16_t crc = calc_crc16(db, buf + NKV_HEADER_SIZE, e.key_len + e.val_len);
+            memcpy(val + e.val_len, &crc, NKV_CRC_SIZE);
+            ((nkv_entry_t*) buf)->state = NKV_STATE_WRITING;
+        }
+        if (cur->format != format)
+            entry_stamp((nkv_entry_t*) buf, format, NKV_ENTRY_FLAG_LARGE, buf + NKV_HEADER_SIZE);
+
+        if (flash_write(db, dest + (a - first), buf, n) != 0)
+            return NKV_ERR_FLASH;
+        a += n;
+    }
+    sector_note_live(db, dest, unit);
+    db->write_offset += unit;
+
+    uint32_t head = dest + unit - size;
+    if (mark_copy_valid(db, head, buf) != NKV_OK)
+        return NKV_ERR_FLASH;
+    db->gc_stats.gc_bytes += unit;
+
+#if NKV_INDEX_ENABLE
+    index_relocate(db, buf + NKV_HEADER_SIZE, entry->key_len, src, head);
+#endif
+#if NKV_BLOOM_ENABLE
+    bloom_note(db, head, buf + NKV_HEADER_SIZE, entry->key_len);
+#endif
+    return NKV_OK;
+}
+
+/* ==================== 回收扇区选择 ==================== */
+/* 统计空闲扇区数 */
+static uint8_t count_free_sectors(nkv_instance_t* db)
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+        if (!is_sector_valid_locked(db, i))
+            count++;
+    return count;
+}
+
+/**
+ * @brief 按回收策略选择回收扇区
+ * @param exclude  不参与选择的扇区，0xFF=不排除
+ * @param min_gain 回收后至少腾出的字节数（有效数据之外的空间）
+ * @param max_live 有效字节上限（迁移目标的剩余空间）
+ * @param max_util 有效数据占比上限(%)，后台回收借此跳过几乎全是有效数据的扇区
+ * @return 扇区号，-1=没有满足条件的扇区
+ */
+static int16_t gc_pick_victim(nkv_instance_t* db, uint8_t exclude, uint32_t min_gain, uint32_t max_live,
+                              uint8_t max_util)
+{
+    uint32_t cap        = db->flash.sector_size - ALIGNED_HDR_SIZE;
+    int16_t  best       = -1;
+    uint64_t best_score = 0;
+
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+    {
+        const nkv_sector_info_t* s = &db->sectors[i];
+        if (!s->valid || i == exclude || s->live > max_live || s->live + min_gain > cap)
+            continue;
+        if ((uint64_t) s->live * 100 > (uint64_t) cap * max_util)
+            continue;
+
+        uint32_t gain = cap - s->live;                     /* 垃圾 + 未写满的尾部 */
+        uint32_t age  = (uint16_t) (db->sector_seq - s->seq) + 1;
+        uint64_t score;
+
+        if (db->gc_policy == NKV_GC_POLICY_OLDEST)
+            score = age;
+        else if (db->gc_policy == NKV_GC_POLICY_GREEDY)
+            score = gain;
+        else /* 成本收益：(1-u)*age/(1+u)，u=有效占比，放大 2^16 后取整 */
+            score = (((uint64_t) gain * age) << 16) / (cap + s->live);
+
+        /* 得分相同时回收擦除次数少的扇区 */
+        if (best < 0 || score > best_score ||
+            (score == best_score && s->erase_count < db->sectors[best].erase_count))
+        {
+            best       = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+#if NKV_INCREMENTAL_GC && NKV_WEAR_THRESHOLD
+/*
+ * 静态磨损均衡：长期不变的冷数据所在扇区很少被回收，擦除次数落后最多的次数超过阈值时，
+ * 选出该扇区整体搬迁，使其重新进入空闲扇区轮换
+ * @return 扇区号，-1=磨损差距未超过阈值
+ */
+static int16_t wear_pick_victim(nkv_instance_t* db)
+{
+    uint32_t max  = 0;
+    int16_t  cold = -1;
+
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+    {
+        const nkv_sector_info_t* s = &db->sectors[i];
+        if (s->erase_count > max)
+            max = s->erase_count;
+        if (s->valid && i != db->active_sector && (cold < 0 || s->erase_count < db->sectors[cold].erase_count))
+            cold = i;
+    }
+    if (cold < 0 || max - db->sectors[cold].erase_count <= NKV_WEAR_THRESHOLD)
+        return -1;
+    return cold;
+}
+#endif
+
+/* ==================== 扇区回收 ==================== */
+/*
+ * 回收一个扇区：逐条把有效条目迁移到活动扇区，扫描完成后擦除。
+ * 后台(增量)回收在每次写入后推进若干条；活动扇区写满时由前台回收切换到保留的空闲扇区一次完成。
+ */
+static void gc_begin(nkv_instance_t* db, uint8_t victim)
+{
+#if NKV_TLV_RETENTION_ENABLE
+    prepare_tlv_keep_info(db);
+#endif
+    db->gc_src_sector = victim;
+    db->gc_src_offset = SECTOR_DATA(victim);
+    db->gc_active     = 1;
+#if !NKV_INDEX_ENABLE
+    memset(db->gc_moved, 0, sizeof(db->gc_moved));
+    db->gc_moved_count = 0;
+#endif
+}
+
+/* 条目是否为该标识当前的最新版本（启用索引时为常数次访问） */
+static uint8_t gc_is_latest(nkv_instance_t* db, uint32_t src, const uint8_t* id, uint8_t key_len)
+{
+    nkv_entry_t entry;
+    uint32_t    addr = key_len ? find_key(db, (const char*) id, &entry) : find_tlv(db, id[0], &entry);
+    return (addr == src);
+}
+
+/**
+ * @brief 判断回收扇区中的有效条目是否需要迁移：每个键只迁移最新版本，且只迁移一次
+ * @details 启用索引时直接比较索引记录的最新地址；关闭索引时查本轮已迁移集合
+ *          （32位哈希过滤 + 回读迁移后的条目比较标识），集合装满后回退为完整查找。
+ *          每个条目的判断代价与扇区条目数无关，结果也不依赖哈希无碰撞。
+ */
+static uint8_t gc_need_migrate(nkv_instance_t* db, uint32_t src, const uint8_t* id, uint8_t key_len)
+{
+#if NKV_INDEX_ENABLE
+    return gc_is_latest(db, src, id, key_len);
+#else
+    uint32_t h   = id_hash(id, key_len);
+    uint32_t pos = h & (NKV_GC_MOVED_SIZE - 1);
+
+    for (uint32_t n = 0; n < NKV_GC_MOVED_SIZE; n++, pos = (pos + 1) & (NKV_GC_MOVED_SIZE - 1))
+    {
+        const nkv_index_slot_t* s = &db->gc_moved[pos];
+        if (s->addr == 0)
+            break;
+        if (s->hash == h && entry_id_match(db, s->addr, id, key_len, NULL))
+            return 0;
+    }
+    if (db->gc_moved_count >= NKV_GC_MOVED_SIZE * 3 / 4)
+        return gc_is_latest(db, src, id, key_len);
+    return 1;
+#endif
+}
+
+#if !NKV_INDEX_ENABLE
+/* 记录已迁移的键（集合装满后不再记录） */
+static void gc_note_moved(nkv_instance_t* db, const uint8_t* id, uint8_t key_len, uint32_t dest)
+{
+    if (db->gc_moved_count >= NKV_GC_MOVED_SIZE * 3 / 4)
+        return;
+
+    uint32_t h   = id_hash(id, key_len);
+    uint32_t pos = h & (NKV_GC_MOVED_SIZE - 1);
+    while (db->gc_moved[pos].addr != 0)
+        pos = (pos + 1) & (NKV_GC_MOVED_SIZE - 1);
+    db->gc_moved[pos].addr = dest;
+    db->gc_moved[pos].hash = h;
+    db->gc_moved_count++;
+}
+#endif
+
+/* 执行一步回收（cur 为源扇区游标，仅在一次调用的多个步骤间复用）：
+ * 返回1=已处理一个有效条目；0=回收完成，或活动扇区空间不足（保持进度，回收仍处于进行中） */
+static uint8_t gc_step(nkv_instance_t* db, nkv_cursor_t* cur)
+{
+    if (!db->gc_active)
+        return 0;
+
+    nkv_entry_t entry;
+    cur->offset = db->gc_src_offset;
+
+    while (cursor_entry(cur, &entry))
+    {
+        if (entry.state == NKV_STATE_ERASED)
+            break;
+
+        uint32_t entry_size = ENTRY_SIZE(entry);
+        OP_COUNT(db, gc_scanned, 1);
+
+        /* 仅迁移 VALID 状态的数据。
+         * PRE_DEL 状态的数据在 GC 时被视为旧数据，不予迁移（因为新键一定已存在或系统处于异常态）。
+         * DELETED 和 WRITING 状态的数据直接跳过；大值分块在遇到其头条目时整体迁移。
+         */
+        if (entry.state != NKV_STATE_VALID || entry.val_len == 0 || entry.key_len >= NKV_MAX_KEY_LEN ||
+            IS_CHUNK(entry))
+        {
+            OP_COUNT(db, gc_skipped, 1);
+            db->gc_src_offset = cur->offset += entry_size;
+            continue;
+        }
+
+#if NKV_TLV_RETENTION_ENABLE
+        if (entry.key_len == 0)
+        {
+            const uint8_t* type = cursor_peek(cur, cur->offset + NKV_HEADER_SIZE, 1);
+            if (type && !should_migrate_tlv(db, *type, cur->sector + cur->offset))
+            {
+                OP_COUNT(db, gc_skipped, 1);
+                db->gc_src_offset = cur->offset += entry_size;
+                continue;
+            }
+        }
+#endif
+
+        /* 读取标识：KV为键名，TLV为类型字节 */
+        uint8_t        id[NKV_MAX_KEY_LEN] = {0};
+        uint8_t        id_len              = entry.key_len ? entry.key_len : 1;
+        uint32_t       src                 = cur->sector + cur->offset;
+        const uint8_t* ip                  = cursor_peek(cur, cur->offset + NKV_HEADER_SIZE, id_len);
+        if (ip)
+            memcpy(id, ip, id_len);
+        else if (flash_read(db, src + NKV_HEADER_SIZE, id, id_len) != 0)
+            return 0;
+
+        if (gc_need_migrate(db, src, id, entry.key_len))
+        {
+            nkv_err_t err =
+                IS_LARGE_HEAD(entry) ? migrate_large(db, cur, &entry) : migrate_entry(db, cur, &entry);
+            if (err != NKV_OK)
+                return 0;
+            OP_COUNT(db, gc_migrated, 1);
+#if !NKV_INDEX_ENABLE
+            /* 迁移后的条目(大值为头条目)位于活动扇区末尾 */
+            gc_note_moved(db, id, entry.key_len, SECTOR_ADDR(db->active_sector) + db->write_offset - entry_size);
+#endif
+        }
+        else
+        {
+            OP_COUNT(db, gc_skipped, 1);
+        }
+
+        db->gc_src_offset = cur->offset += entry_size;
+        return 1;
+    }
+
+    /* 扫描完成，源扇区成为空闲扇区 */
+#if NKV_INDEX_ENABLE
+    index_purge_sector(db, db->gc_src_sector);
+#endif
+#if NKV_BACKGROUND_GC
+    sector_retire(db, db->gc_src_sector);
+#else
+    flash_erase(db, SECTOR_ADDR(db->gc_src_sector));
+#endif
+    db->gc_active = 0;
+    db->gc_stats.gc_runs++;
+    return 0;
+}
+
+/* 执行若干步回收，各步骤共享同一个源扇区读取窗口 */
+static uint8_t run_gc_steps(nkv_instance_t* db, uint8_t steps)
+{
+    nkv_cursor_t cur;
+    cursor_open(db, &cur, db->gc_src_sector, db->gc_src_offset);
+
+    for (uint8_t i = 0; i < steps; i++)
+        if (!gc_step(db, &cur))
+            return 0;
+    return 1;
+}
+
+/**
+ * @brief 前台回收：活动扇区放不下 need 字节且只剩保留的空闲扇区时调用
+ * @details 先选出回收扇区（可以是刚写满的活动扇区），再切换到空闲扇区并把其有效数据全部迁入，
+ *          最后擦除回收扇区，使其成为新的保留扇区。回收扇区在数据迁移完成前不会被擦除，
+ *          任一时刻掉电都不会丢失数据。没有空闲扇区时（旧布局）直接向活动扇区剩余空间迁移。
+ */
+static nkv_err_t do_compact(nkv_instance_t* db, uint32_t need)
+{
+    OP_COUNT(db, compactions, 1);
+    for (uint8_t round = 0; round < db->flash.sector_count; round++)
+    {
+        int8_t free_idx = find_free_sector(db);
+
+        if (!db->gc_active)
+        {
+            uint32_t room   = db->flash.sector_size - db->write_offset;
+            int16_t  victim = (free_idx >= 0) ? gc_pick_victim(db, 0xFF, need, UINT32_MAX, 100)
+                                              : gc_pick_victim(db, db->active_sector, 1, room, 100);
+            if (victim < 0)
+                return NKV_ERR_NO_SPACE;
+            gc_begin(db, (uint8_t) victim);
+        }
+
+        if (free_idx >= 0)
+        {
+            nkv_err_t err = switch_to_sector(db, (uint8_t) free_idx);
+            if (err != NKV_OK)
+                return err;
+        }
+
+        while (db->gc_active)
+        {
+            if (!run_gc_steps(db, 0xFF) && db->gc_active)
+                return NKV_ERR_NO_SPACE;
+        }
+
+        if (db->write_offset + need <= db->flash.sector_size)
+            return NKV_OK;
+    }
+    return NKV_ERR_NO_SPACE;
+}
+
+/* ==================== 增量GC ==================== */
+#if NKV_INCREMENTAL_GC
+/* 检查是否需要启动GC：只剩保留的空闲扇区时在后台提前回收 */
+static uint8_t should_start_gc(nkv_instance_t* db)
+{
+    if (db->gc_active)
+        return 0;
+    return (count_free_sectors(db) <= 1);
+}
+
+/* 启动增量GC */
+static uint8_t start_incremental_gc(nkv_instance_t* db)
+{
+    int16_t victim = -1;
+#if NKV_WEAR_THRESHOLD
+    victim = wear_pick_victim(db);
+    if (victim >= 0)
+        db->wear_moves++;
+#endif
+    if (victim < 0)
+        victim = gc_pick_victim(db, db->active_sector, 1, UINT32_MAX, NKV_GC_THRESHOLD_PERCENT);
+    if (victim < 0)
+        return 0;
+
+    gc_begin(db, (uint8_t) victim);
+    return 1;
+}
+
+/* 执行增量GC */
+static void do_incremental_gc(nkv_instance_t* db)
+{
+#if NKV_BACKGROUND_GC
+    /* 回收交给 nkv_background 在空闲时推进，活动扇区将写满时才在写入中推进 */
+    if ((db->flash.sector_size - db->write_offset) * 100 >= db->flash.sector_size * NKV_GC_INLINE_PERCENT)
+        return;
+#endif
+    if (!db->gc_active && should_start_gc(db))
+    {
+        if (!start_incremental_gc(db))
+            return;
+    }
+    if (db->gc_active)
+        run_gc_steps(db, NKV_GC_ENTRIES_PER_WRITE);
+}
+#endif
+
+/* ==================== 公共API ==================== */
+
+nkv_err_t nkv_internal_init_ex(nkv_instance_t* db, const nkv_flash_ops_t* ops)
+{
+    if (!db || !ops || !ops->read || !ops->write || !ops->erase)
+        return NKV_ERR_INVALID;
+    if (ops->sector_count < 2 || ops->sector_count > NKV_MAX_SECTORS)
+        return NKV_ERR_INVALID;
+    if (ops->align == 0 || (ops->align & (ops->align - 1)) != 0)
+        return NKV_ERR_INVALID;
+
+    /* 写入原子性断言：对齐值必须 >= 2 字节（状态字段大小），以保证状态更新的原子性 */
+    NKV_ASSERT(ops->align >= sizeof(uint16_t) && "align < sizeof(state), atomic write not guaranteed");
+
+    /* 断言：最大条目大小不能超过扇区大小的一半（确保 GC 迁移空间） */
+    uint32_t max_entry = NKV_HEADER_SIZE + NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN + NKV_CRC_SIZE + ops->align;
+    NKV_ASSERT(max_entry <= ops->sector_size / 2 && "max_entry > sector_size/2, config invalid");
+    (void) max_entry; /* 断言禁用时未使用 */
+
+    memset(db, 0, sizeof(nkv_instance_t));
+    db->flash     = *ops;
+    db->gc_policy = NKV_GC_POLICY;
+    db->format    = NKV_FORMAT_VERSION;
+    return NKV_OK;
+}
+
+/* 读取所有扇区头，定位序号最新的活动扇区，并记录各扇区的序号 */
+static uint8_t find_active_sector(nkv_instance_t* db, uint8_t* active_idx, uint16_t* max_seq)
+{
+    uint8_t  found  = 0;
+    uint32_t max_ec = 0;
+
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+    {
+        nkv_sector_hdr_t hdr;
+        memset(&db->sectors[i], 0, sizeof(nkv_sector_info_t));
+        db->sectors[i].erase_count = UINT32_MAX;
+        if (read_sector_hdr(db, i, &hdr) != 0)
+            continue;
+        db->sectors[i].erase_count = hdr_erase_count(&hdr);
+        if (db->sectors[i].erase_count != UINT32_MAX && db->sectors[i].erase_count > max_ec)
+            max_ec = db->sectors[i].erase_count;
+        if (MAGIC_VALID(hdr.magic))
+        {
+            sector_open(db, i, hdr.seq, MAGIC_FORMAT(hdr.magic));
+            /*
+             * 序号回绕处理：使用带符号差值比较
+             * 当 seq 从 0xFFFF 溢出到 0x0000 时，差值的最高位会正确反映新旧关系。
+             * 例如：max_seq=0xFFFE, hdr.seq=0x0001
+             *   (int16_t)(0x0001 - 0xFFFE) = 3 > 0 → 正确识别新扇区
+             */
+            if (!found || (int16_t) (hdr.seq - *max_seq) > 0)
+            {
+                *max_seq    = hdr.seq;
+                *active_idx = i;
+                found       = 1;
+            }
+        }
+    }
+
+    /* 没有记录擦除次数的扇区(旧格式、擦除后掉电)按已知最大值估计 */
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+        if (db->sectors[i].erase_count == UINT32_MAX)
+            db->sectors[i].erase_count = max_ec;
+    return found;
+}
+
+static nkv_err_t scan_locked(nkv_instance_t* db)
+{
+    if (db->initialized)
+        return NKV_OK;
+
+    uint8_t       active_idx = 0;
+    uint16_t      max_seq    = 0;
+    batch_track_t bt         = {0};
+
+    if (!find_active_sector(db, &active_idx, &max_seq))
+        return format_locked(db);
+
+    db->active_sector = active_idx;
+    db->sector_seq    = max_seq;
+    db->write_offset  = mount_scan(db, &bt);
+    db->initialized   = 1;
+    batch_finish(db, &bt);
+
+    /* 默认值同步直接使用扫描建立的索引，无需再次遍历扇区 */
+    nkv_sync_version(db);
+
+    return NKV_OK;
+}
+
+static nkv_err_t scan_legacy_locked(nkv_instance_t* db)
+{
+    if (db->initialized)
+        return NKV_OK;
+
+    uint8_t       active_idx = 0;
+    uint16_t      max_seq    = 0;
+    batch_track_t bt         = {0};
+
+    if (!find_active_sector(db, &active_idx, &max_seq))
+        return format_locked(db);
+
+    db->active_sector = active_idx;
+    db->sector_seq    = max_seq;
+    db->write_offset  = scan_write_offset(db, active_idx, &bt);
+    db->initialized   = 1;
+
+#if NKV_INDEX_ENABLE
+    index_rebuild(db);
+#endif
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+        if (db->sectors[i].valid)
+            sector_recount(db, i);
+    batch_finish(db, &bt);
+
+    /* 扫描完成后检查并同步默认值 */
+    nkv_sync_version(db);
+
+    return NKV_OK;
+}
+
+static nkv_err_t format_locked(nkv_instance_t* db)
+{
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+    {
+        uint32_t addr = SECTOR_ADDR(i);
+        if (!sector_blank(db, i))
+        {
+            if (flash_erase(db, addr) != 0)
+                return NKV_ERR_FLASH;
+        }
+        else
+        {
+            sector_reset(db, i);
+            db->sectors[i].erased = 1;
+#if NKV_BLOOM_ENABLE
+            bloom_reset(db, i);
+#endif
+        }
+    }
+
+    if (write_sector_hdr(db, 0, 1) != 0)
+        return NKV_ERR_FLASH;
+
+    sector_open(db, 0, 1, db->format);
+    db->active_sector = 0;
+    db->sector_seq    = 1;
+    db->write_offset  = HDR_SIZE(db->format);
+    db->initialized   = 1;
+
+#if NKV_INDEX_ENABLE
+    memset(&db->index, 0, sizeof(db->index));
+#endif
+#if NKV_WRITE_BUFFER
+    wbuf_clear(db);
+#endif
+    return NKV_OK;
+}
+
+/* 更新条目状态（保留 key_len 和 val_len） */
+static nkv_err_t update_entry_state(nkv_instance_t* db, uint32_t addr, uint16_t state)
+{
+    uint8_t buf[32];
+    uint8_t len = (db->flash.align < NKV_HEADER_SIZE) ? NKV_HEADER_SIZE : db->flash.align; /* 完整条目头用于扇区统计 */
+
+    /* 先读取原有数据，保留 key_len 和 val_len */
+    if (flash_read(db, addr, buf, len) != 0)
+        return NKV_ERR_FLASH;
+
     /* 只更新 state 字段 */
-    uint16_t* s = (uint16_t*) buf;
-    *s          = state;
+    nkv_entry_t* e   = (nkv_entry_t*) buf;
+    uint16_t     old = e->state;
+    e->state         = state;
+    OP_COUNT(db, state_writes, 1);
+
+    if (flash_write(db, addr, buf, db->flash.align) != 0)
+        return NKV_ERR_FLASH;
+    if (state == NKV_STATE_DELETED && old != NKV_STATE_DELETED)
+    {
+        sector_note_dead(db, addr, ALIGN(NKV_HEADER_SIZE + e->key_len + e->val_len + NKV_CRC_SIZE));
+        /* 写入中的头条目还没有生效的分块，由挂载扫描按分块序列处理 */
+        if (IS_LARGE_HEAD(*e) && (old == NKV_STATE_VALID || old == NKV_STATE_PRE_DEL))
+            large_release(db, addr);
+    }
+    return NKV_OK;
+}
+
+/* 确保活动扇区可容纳 size 字节：空闲扇区多于一个时直接切换，最后一个空闲扇区保留给前台回收 */
+static nkv_err_t reserve_space(nkv_instance_t* db, uint32_t size)
+{
+    if (db->write_offset + size <= db->flash.sector_size)
+        return NKV_OK;
+
+    nkv_err_t err = (count_free_sectors(db) > 1) ? switch_to_sector(db, (uint8_t) find_free_sector(db))
+                                                 : do_compact(db, size);
+    if (err != NKV_OK)
+        return err;
+    if (db->write_offset + size > db->flash.sector_size)
+        return NKV_ERR_NO_SPACE;
+    return NKV_OK;
+}
+
+/* 在 buf 中组装完整条目（头 + 键 + 值 + CRC + 对齐填充），返回条目大小 */
+static uint32_t pack_entry(nkv_instance_t* db, uint8_t* buf, uint16_t state, uint8_t flag, const char* key,
+                           uint8_t key_len, const void* value, uint8_t len)
+{
+    uint32_t     size  = ALIGN(NKV_HEADER_SIZE + key_len + len + NKV_CRC_SIZE);
+    nkv_entry_t* entry = (nkv_entry_t*) buf;
+
+    memset(buf, 0xFF, size);
+    entry->state    = state;
+    entry->key_len  = key_len;
+    entry->val_len  = len;
+    entry_stamp(entry, db->sectors[db->active_sector].format, flag,
+                key_len ? (const uint8_t*) key : (const uint8_t*) value); /* 存储键哈希 */
+
+    memcpy(buf + NKV_HEADER_SIZE, key, key_len);
+    if (len > 0)
+        memcpy(buf + NKV_HEADER_SIZE + key_len, value, len);
+
+    uint16_t crc = calc_crc16(db, buf + NKV_HEADER_SIZE, key_len + len);
+    memcpy(buf + NKV_HEADER_SIZE + key_len + len, &crc, NKV_CRC_SIZE);
+    return size;
+}
+
+/* ==================== 写缓冲 ==================== */
+#if NKV_WRITE_BUFFER
+/*
+ * 小条目先暂存在RAM中，凑满一个编程页后通过批量写入路径一次落盘：成员合并为一次编程，
+ * 提交记录保证整批原子生效，省去逐条写入的 WRITING->VALID 与 PRE_DEL/DELETED 状态改写。
+ */
+#define WBUF_ENTRY_SIZE(klen, vlen) ALIGN(NKV_HEADER_SIZE + (klen) + (vlen) + NKV_CRC_SIZE)
+
+static int16_t wbuf_find(nkv_instance_t* db, const char* key, uint8_t key_len)
+{
+    for (uint8_t i = 0; i < db->wbuf.count; i++)
+    {
+        const nkv_wbuf_item_t* it = &db->wbuf.items[i];
+        if (it->key_len == key_len && memcmp(it->key, key, key_len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void wbuf_clear(nkv_instance_t* db)
+{
+    db->wbuf.count    = 0;
+    db->wbuf.data_len = 0;
+    db->wbuf.bytes    = 0;
+    db->wbuf.age      = 0;
+}
+
+/* 移除第 i 项并压缩值数据 */
+static void wbuf_drop(nkv_instance_t* db, uint8_t i)
+{
+    nkv_wbuf_t*      w   = &db->wbuf;
+    nkv_wbuf_item_t* it  = &w->items[i];
+    uint16_t         off = it->val_off;
+    uint8_t          len = it->len;
+
+    memmove(w->data + off, w->data + off + len, w->data_len - off - len);
+    w->data_len -= len;
+    w->bytes -= WBUF_ENTRY_SIZE(it->key_len, len);
+    memmove(it, it + 1, (w->count - i - 1) * sizeof(nkv_wbuf_item_t));
+    w->count--;
+
+    for (uint8_t j = 0; j < w->count; j++)
+    {
+        if (w->items[j].val_off > off)
+            w->items[j].val_off -= len;
+    }
+}
+
+/* 暂存的写入作为一个原子批次落盘；失败时保留暂存数据，下次落盘重试 */
+static nkv_err_t wbuf_flush(nkv_instance_t* db)
+{
+    nkv_wbuf_t* w = &db->wbuf;
+    if (w->count == 0)
+        return NKV_OK;
+
+    nkv_batch_item_t items[NKV_BATCH_MAX];
+    for (uint8_t i = 0; i < w->count; i++)
+    {
+        items[i].key   = w->items[i].key;
+        items[i].value = w->data + w->items[i].val_off;
+        items[i].len   = w->items[i].len;
+    }
+
+    nkv_err_t err = write_batch(db, items, w->count);
+    if (err == NKV_OK)
+        wbuf_clear(db);
+    return err;
+}
+
+static nkv_err_t wbuf_stage(nkv_instance_t* db, const char* key, uint8_t key_len, const void* value, uint8_t len)
+{
+    nkv_wbuf_t* w    = &db->wbuf;
+    uint16_t    size = WBUF_ENTRY_SIZE(key_len, len);
+    int16_t     slot = wbuf_find(db, key, key_len);
+    uint16_t    prev = (slot >= 0) ? WBUF_ENTRY_SIZE(key_len, w->items[slot].len) : 0;
+
+    /* 放不下时先落盘已暂存的数据（含该键的旧暂存值） */
+    if (w->bytes - prev + size > NKV_WBUF_SIZE || (slot < 0 && w->count >= NKV_BATCH_MAX))
+    {
+        nkv_err_t err = wbuf_flush(db);
+        if (err != NKV_OK)
+            return err;
+        slot = -1;
+    }
+    if (slot >= 0)
+        wbuf_drop(db, (uint8_t) slot); /* 同一键只保留最新值 */
+
+    nkv_wbuf_item_t* it = &w->items[w->count++];
+    memcpy(it->key, key, key_len);
+    it->key[key_len] = '\0';
+    it->key_len      = key_len;
+    it->len          = len;
+    it->val_off      = w->data_len;
+    if (len > 0)
+        memcpy(w->data + w->data_len, value, len);
+    w->data_len += len;
+    w->bytes += size;
+    if (w->count == 1)
+        w->age = 0;
+
+#if NKV_CACHE_ENABLE
+    if (len > 0)
+        cache_update(db, key, value, len);
+    else
+        cache_remove(db, key);
+#endif
+
+    /* 剩余空间已放不下最小条目：页已写满，立即落盘 */
+    if (NKV_WBUF_SIZE - w->bytes < WBUF_ENTRY_SIZE(1, 0) || w->count >= NKV_BATCH_MAX)
+        return wbuf_flush(db);
+    return NKV_OK;
+}
+
+static nkv_err_t wbuf_enable_locked(nkv_instance_t* db, uint8_t enable)
+{
+    if (!db || !db->initialized)
+        return NKV_ERR_INVALID;
+    if (!enable)
+    {
+        nkv_err_t err = wbuf_flush(db);
+        if (err != NKV_OK)
+            return err;
+    }
+    db->wbuf.enabled = enable ? 1 : 0;
+    return NKV_OK;
+}
+
+static nkv_err_t flush_locked(nkv_instance_t* db)
+{
+    if (!db || !db->initialized)
+        return NKV_ERR_INVALID;
+    return wbuf_flush(db);
+}
+
+/* 周期调用：暂存数据经过 NKV_WBUF_FLUSH_TICKS 次调用仍未落盘时强制落盘 */
+static nkv_err_t wbuf_tick_locked(nkv_instance_t* db)
+{
+    if (!db || !db->initialized)
+        return NKV_ERR_INVALID;
+    if (db->wbuf.count == 0)
+        return NKV_OK;
+    if (++db->wbuf.age < NKV_WBUF_FLUSH_TICKS)
+        return NKV_OK;
+    return wbuf_flush(db);
+}
+#endif
+
+static nkv_err_t set_locked(nkv_instance_t* db, const char* key, const void* value, uint8_t len)
+{
+    if (!db || !db->initialized || !key || len > NKV_MAX_VALUE_LEN)
+        return NKV_ERR_INVALID;
+    if (len > 0 && !value)
+        return NKV_ERR_INVALID;
+
+    uint8_t key_len = strlen(key);
+    if (key_len >= NKV_MAX_KEY_LEN)
+        return NKV_ERR_INVALID;
+
+    db->gc_stats.user_bytes += key_len + len;
+
+#if NKV_WRITE_BUFFER
+    if (db->wbuf.enabled && key_len > 0 && WBUF_ENTRY_SIZE(key_len, len) <= NKV_WBUF_SIZE)
+        return wbuf_stage(db, key, key_len, value, len);
+
+    /* 不经缓冲的写入须排在已暂存的写入之后 */
+    nkv_err_t ferr = wbuf_flush(db);
+    if (ferr != NKV_OK)
+        return ferr;
+#endif
+
+    /* 1. 计算并检查条目大小 */
+    uint32_t entry_size = ALIGN(NKV_HEADER_SIZE + key_len + len + NKV_CRC_SIZE);
+
+    /* 断言：单个条目不能超过扇区有效空间 */
+    NKV_ASSERT(entry_size <= db->flash.sector_size - ALIGNED_HDR_SIZE && "entry_size exceeds sector capacity");
+
+    nkv_err_t err = reserve_space(db, entry_size);
+    if (err != NKV_OK)
+        return err;
+
+    /* 2. 查找旧条目（预留空间可能触发GC迁移，须在其后查找） */
+    nkv_entry_t old_entry;
+    uint32_t    old_addr  = find_key(db, key, &old_entry);
+    uint8_t     is_update = (old_addr != 0 && old_entry.val_len > 0);
+
+    /* 3. 二阶段提交：如果是更新，先标记旧键为 PRE_DEL */
+    if (is_update)
+    {
+        update_entry_state(db, old_addr, NKV_STATE_PRE_DEL);
+    }
+
+    /* 4. 构建并写入新条目 (WRITING 状态) */
+    uint8_t* buf = db->scratch;
+    pack_entry(db, buf, NKV_STATE_WRITING, NKV_ENTRY_FLAG_NONE, key, key_len, value, len);
+
+    uint32_t new_addr = SECTOR_ADDR(db->active_sector) + db->write_offset;
+    if (flash_write(db, new_addr, buf, entry_size) != 0)
+        return NKV_ERR_FLASH;
+    sector_note_live(db, new_addr, entry_size);
+
+    /* 5. 标记新键为 VALID */
+    update_entry_state(db, new_addr, NKV_STATE_VALID);
+#if NKV_BLOOM_ENABLE
+    bloom_note(db, new_addr, (const uint8_t*) key, key_len);
+#endif
+
+#if NKV_INDEX_ENABLE
+    index_put(db, (const uint8_t*) key, key_len, new_addr, old_addr);
+#endif
+
+    /* 6. 标记旧键为 DELETED */
+    if (is_update)
+    {
+        update_entry_state(db, old_addr, NKV_STATE_DELETED);
+    }
+
+    db->write_offset += entry_size;
+
+#if NKV_CACHE_ENABLE
+    if (len > 0)
+        cache_update(db, key, value, len);
+    else
+        cache_remove(db, key);
+#endif
+
+#if NKV_INCREMENTAL_GC
+    do_incremental_gc(db);
+#endif
+
+    return NKV_OK;
+}
+
+/* 读取条目值(可选CRC校验)，只读Flash不修改实例状态，校验缓冲区位于调用栈上 */
+#if NKV_ZERO_COPY
+/* 映射的Flash中条目值数据的地址，启用读取校验时原地校验CRC */
+static nkv_err_t map_value(nkv_instance_t* db, uint32_t addr, const nkv_entry_t* entry, const uint8_t** out)
+{
+    const uint8_t* data = db->flash.map + (addr - db->flash.base) + NKV_HEADER_SIZE;
+
+    #if NKV_VERIFY_ON_READ
+    uint16_t data_len = entry->key_len + entry->val_len;
+    uint16_t stored_crc;
+
+    memcpy(&stored_crc, data + data_len, NKV_CRC_SIZE);
+    if (calc_crc16(db, data, data_len) != stored_crc)
+    {
+        OP_COUNT(db, crc_errors, 1);
+        return NKV_ERR_CRC;
+    }
+    #endif
+
+    *out = data + entry->key_len;
+    return NKV_OK;
+}
+#endif
+
+static nkv_err_t read_value(nkv_instance_t* db, uint32_t addr, const nkv_entry_t* entry, void* buf, uint8_t size,
+                            uint8_t* out_len)
+{
+    uint8_t len = (entry->val_len < size) ? entry->val_len : size;
+
+#if NKV_ZERO_COPY
+    if (db->flash.map)
+    {
+        /* 可直接映射：原地校验后只复制一次值 */
+        const uint8_t* val;
+        nkv_err_t      err = map_value(db, addr, entry, &val);
+        if (err != NKV_OK)
+            return err;
+        memcpy(buf, val, len);
+        if (out_len)
+            *out_len = len;
+        return NKV_OK;
+    }
+#endif
+
+#if NKV_VERIFY_ON_READ
+    /* CRC 校验：读取完整的 Key+Value 并验证 */
+    uint8_t  verify_buf[NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN];
+    uint16_t data_len = entry->key_len + entry->val_len;
+    uint16_t stored_crc;
+
+    if (flash_read(db, addr + NKV_HEADER_SIZE, verify_buf, data_len) != 0)
+        return NKV_ERR_FLASH;
+    if (flash_read(db, addr + NKV_HEADER_SIZE + data_len, (uint8_t*) &stored_crc, NKV_CRC_SIZE) != 0)
+        return NKV_ERR_FLASH;
+    if (calc_crc16(db, verify_buf, data_len) != stored_crc)
+    {
+        OP_COUNT(db, crc_errors, 1);
+        return NKV_ERR_CRC;
+    }
+
+    /* CRC 通过，从 verify_buf 中复制值 */
+    memcpy(buf, verify_buf + entry->key_len, len);
+#else
+    if (flash_read(db, addr + NKV_HEADER_SIZE + entry->key_len, buf, len) != 0)
+        return NKV_ERR_FLASH;
+#endif
+
+    if (out_len)
+        *out_len = len;
+    return NKV_OK;
+}
+
+static nkv_err_t get_locked(nkv_instance_t* db, const char* key, void* buf, uint8_t size, uint8_t* out_len)
+{
+    if (!db || !db->initialized || !key || !buf)
+        return NKV_ERR_INVALID;
+
+#if NKV_CACHE_ENABLE
+    nkv_cache_entry_t* cached = cache_find(db, key);
+    if (cached)
+    {
+        uint8_t len = (cached->val_len < size) ? cached->val_len : size;
+        memcpy(buf, cache_value(&db->cache, cached), len);
+        if (out_len)
+            *out_len = len;
+        return NKV_OK;
+    }
+#endif
+
+#if NKV_WRITE_BUFFER
+    int16_t staged = wbuf_find(db, key, strlen(key));
+    if (staged >= 0)
+    {
+        const nkv_wbuf_item_t* it = &db->wbuf.items[staged];
+        if (it->len == 0)
+            return NKV_ERR_NOT_FOUND;
+        uint8_t len = (it->len < size) ? it->len : size;
+        memcpy(buf, db->wbuf.data + it->val_off, len);
+        if (out_len)
+            *out_len = len;
+        return NKV_OK;
+    }
+#endif
+
+    nkv_entry_t entry;
+    uint32_t    addr = find_key(db, key, &entry);
+    if (addr == 0 || entry.val_len == 0)
+        return NKV_ERR_NOT_FOUND;
+
+    if (IS_LARGE_HEAD(entry))
+    {
+        /* 大值只读出前 size 字节，不进入缓存 */
+        uint32_t  n   = 0;
+        nkv_err_t err = large_read(db, addr, &entry, large_copy, buf, size, &n);
+        if (err == NKV_OK && out_len)
+            *out_len = (uint8_t) n;
+        return err;
+    }
+
+    uint8_t   len = 0;
+    nkv_err_t err = read_value(db, addr, &entry, buf, size, &len);
+    if (err != NKV_OK)
+        return err;
+    if (out_len)
+        *out_len = len;
+
+#if NKV_CACHE_ENABLE
+    /* 缓冲区不足时只读到部分值，不能用于缓存 */
+    if (len == entry.val_len)
+        cache_update(db, key, buf, len);
+#endif
+
+    return NKV_OK;
+}
+
+#if NKV_THREAD_SAFE && SEQ_LOCKFREE && NKV_CACHE_ENABLE
+/* 无锁读取：只服务RAM缓存命中并返回1；未命中或期间发生写操作返回0，改走加锁路径(Flash读取须持锁) */
+static uint8_t get_lockfree(nkv_instance_t* db, const char* key, void* buf, uint8_t size, uint8_t* out_len,
+                            nkv_err_t* err)
+{
+    uint32_t seq = SEQ_LOAD(&db->seq);
+    if (seq & 1)
+        return 0;
+    SEQ_FENCE();
+
+    uint8_t klen = strlen(key);
+    if (klen >= NKV_MAX_KEY_LEN)
+        return 0;
+
+    uint32_t           h = id_hash((const uint8_t*) key, klen);
+    nkv_cache_entry_t* e = cache_lookup(&db->cache, key, klen, h);
+    if (!e)
+        return 0;
+
+    uint16_t off = e->val_off;
+    uint8_t  len = (e->val_len < size) ? e->val_len : size;
+    if (off > NKV_CACHE_ARENA - CACHE_BLOCK_HDR - len) /* 并发修改中的不一致状态，改走加锁路径 */
+        return 0;
+    memcpy(buf, &db->cache.arena[off + CACHE_BLOCK_HDR], len);
+    SEQ_FENCE();
+    if (SEQ_LOAD(&db->seq) != seq)
+        return 0;
+    cache_touch(&db->cache, e, h);
+    STAT_INC(&db->cache.hit_count);
+    if (out_len)
+        *out_len = len;
+    *err = NKV_OK;
+    return 1;
+}
+#endif
+
+static nkv_err_t del_locked(nkv_instance_t* db, const char* key)
+{
+#if NKV_CACHE_ENABLE
+    cache_remove(db, key);
+#endif
+    return set_locked(db, key, NULL, 0);
+}
+
+static uint8_t exists_locked(nkv_instance_t* db, const char* key)
+{
+    if (!db || !db->initialized || !key)
+        return 0;
+#if NKV_WRITE_BUFFER
+    int16_t staged = wbuf_find(db, key, strlen(key));
+    if (staged >= 0)
+        return db->wbuf.items[staged].len > 0;
+#endif
+    nkv_entry_t entry;
+    uint32_t    addr = find_key(db, key, &entry);
+    return (addr != 0 && entry.val_len > 0);
+}
+
+static void get_usage_locked(nkv_instance_t* db, uint32_t* used, uint32_t* total)
+{
+    if (used)
+        *used = db->write_offset;
+    if (total)
+        *total = db->flash.sector_size * db->flash.sector_count;
+}
+
+/* ==================== 后台维护 ==================== */
+#if NKV_BACKGROUND_GC
+/* 预算是否用尽 */
+static uint8_t budget_spent(nkv_instance_t* db, const nkv_budget_t* budget, uint16_t done, uint32_t start)
+{
+    if (!budget)
+        return 0;
+    if (budget->ops && done >= budget->ops)
+        return 1;
+    return (budget->us && db->flash.clock_us && (uint32_t) (db->flash.clock_us() - start) >= budget->us);
+}
+
+/* 查找尚未确认擦除的空闲扇区，-1=没有 */
+static int16_t find_unerased_sector(nkv_instance_t* db)
+{
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+        if (!db->sectors[i].erased && !is_sector_valid_locked(db, i))
+            return i;
+    return -1;
+}
+
+/* 预擦除一个空闲扇区：已是干净的只做标记，返回0=没有需要处理的扇区或擦除失败 */
+static uint8_t preerase_one(nkv_instance_t* db)
+{
+    int16_t idx = find_unerased_sector(db);
+    if (idx < 0)
+        return 0;
+
+    uint32_t addr = SECTOR_ADDR(idx);
+    if (sector_blank(db, (uint8_t) idx))
+    {
+        db->sectors[idx].erased = 1;
+        return 1;
+    }
+#if NKV_INDEX_ENABLE
+    index_purge_sector(db, (uint8_t) idx);
+#endif
+    return (flash_erase(db, addr) == 0);
+}
+
+/**
+ * @brief 按预算执行后台工作
+ * @details 写缓冲计时 -> 增量GC(每次调用最多启动一轮，逐条目检查预算) -> 空闲扇区预擦除。
+ *          迁移失败(活动扇区放不下)时停止回收，留给写入时的前台回收处理。
+ */
+static uint8_t background_locked(nkv_instance_t* db, const nkv_budget_t* budget)
+{
+    if (!db || !db->initialized)
+        return 0;
+
+    uint32_t start = db->flash.clock_us ? db->flash.clock_us() : 0;
+    uint16_t done  = 0;
+
+    #if NKV_WRITE_BUFFER
+    uint8_t pending = db->wbuf.count;
+    wbuf_tick_locked(db);
+    if (pending && db->wbuf.count == 0)
+        done++;
+    #endif
+
+    #if NKV_INCREMENTAL_GC
+    /* 空闲扇区(不含前台回收保留的一个)少于 NKV_SPARE_SECTORS 时提前回收，补充预擦除扇区池 */
+    if (!db->gc_active && !budget_spent(db, budget, done, start) && count_free_sectors(db) <= NKV_SPARE_SECTORS)
+        start_incremental_gc(db);
+    if (db->gc_active)
+    {
+        nkv_cursor_t cur;
+        cursor_open(db, &cur, db->gc_src_sector, db->gc_src_offset);
+        while (!budget_spent(db, budget, done, start))
+        {
+            done++;
+            if (!gc_step(db, &cur))
+                break;
+        }
+        if (db->gc_active)
+            return 1;
+    }
+    #endif
+
+    while (!budget_spent(db, budget, done, start))
+    {
+        if (!preerase_one(db))
+            return 0;
+        done++;
+    }
+    return (find_unerased_sector(db) >= 0);
+}
+#endif
+
+/* ==================== 异步Flash操作 ==================== */
+#if NKV_ASYNC_FLASH
+    #define JOB_SET 1 /* nkv_set_async */
+    #define JOB_GC  2 /* nkv_gc_async */
+
+    /* 作业步骤：写入与同步路径的编程顺序一致 */
+    #define ASTEP_PRE_DEL 0 /* 旧条目 -> PRE_DEL */
+    #define ASTEP_WRITE   1 /* 新条目(WRITING) */
+    #define ASTEP_VALID   2 /* 新条目 -> VALID */
+    #define ASTEP_DELETE  3 /* 旧条目 -> DELETED */
+    #define ASTEP_GC      4 /* 迁移一个条目或选择待擦除扇区 */
+    #define ASTEP_ERASE   5 /* 擦除空闲扇区 */
+    #define ASTEP_DONE    6
+
+/* 驱动完成回调：只记录结果，后续步骤由 nkv_async_poll 推进 */
+static void async_done(void* ctx, int result)
+{
+    nkv_async_t* job = &((nkv_instance_t*) ctx)->async;
+    job->result      = result;
+    job->busy        = 0;
+}
+
+/* 提交编程：未提供 write_async 时退化为阻塞写入并立即完成 */
+static int async_write(nkv_instance_t* db, uint32_t addr, const uint8_t* buf, uint32_t len)
+{
+    db->flash_gen++;
+    db->gc_stats.flash_bytes += len;
+    OP_COUNT(db, write_calls, 1);
+    OP_COUNT(db, write_bytes, len);
+    db->async.result = 0;
+    db->async.busy   = 1;
+    if (!db->flash.write_async)
+    {
+        async_done(db, db->flash.write(addr, buf, len));
+        return 0;
+    }
+    if (db->flash.write_async(addr, buf, len, async_done, db) != 0)
+    {
+        db->async.busy = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* 提交状态改写：读出完整条目头，只改写 state 后编程一个对齐单元(同 update_entry_state) */
+static int async_state(nkv_instance_t* db, uint32_t addr, uint16_t state)
+{
+    uint8_t len = (db->flash.align < NKV_HEADER_SIZE) ? NKV_HEADER_SIZE : db->flash.align;
+    if (flash_read(db, addr, db->async.state, len) != 0)
+        return -1;
+    ((nkv_entry_t*) db->async.state)->state = state;
+    OP_COUNT(db, state_writes, 1);
+    return async_write(db, addr, db->async.state, db->flash.align);
+}
+
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+/* 提交擦除：未提供 erase_async 时退化为阻塞擦除 */
+static int async_erase(nkv_instance_t* db, uint8_t idx)
+{
+    uint32_t addr = SECTOR_ADDR(idx);
+
+        #if NKV_INDEX_ENABLE
+    index_purge_sector(db, idx);
+        #endif
+    erase_note(db, idx);
+    OP_COUNT(db, erase_calls, 1);
+    db->async.erase_idx = idx;
+    db->async.result    = 0;
+    db->async.busy      = 1;
+    if (!db->flash.erase_async)
+    {
+        async_done(db, db->flash.erase(addr));
+        return 0;
+    }
+    if (db->flash.erase_async(addr, async_done, db) != 0)
+    {
+        db->async.busy = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* 回收作业的一步：有进行中的回收则迁移一个条目，否则逐个擦除未确认擦除的空闲扇区 */
+static nkv_err_t async_gc_next(nkv_instance_t* db)
+{
+    nkv_async_t* job = &db->async;
+
+    if (job->step == ASTEP_ERASE)
+    {
+        db->sectors[job->erase_idx].erased = 1;
+        erase_stamp(db, job->erase_idx);
+        job->step                          = ASTEP_GC;
+        return NKV_OK;
+    }
+    if (db->gc_active)
+    {
+        if (!run_gc_steps(db, 1) && db->gc_active)
+            return NKV_ERR_NO_SPACE;
+        return NKV_OK;
+    }
+
+    int16_t idx = find_unerased_sector(db);
+    if (idx < 0)
+    {
+        job->step = ASTEP_DONE;
+        return NKV_OK;
+    }
+    if (sector_blank(db, (uint8_t) idx))
+    {
+        db->sectors[idx].erased = 1;
+        return NKV_OK;
+    }
+    job->step = ASTEP_ERASE;
+    return async_erase(db, (uint8_t) idx) ? NKV_ERR_FLASH : NKV_OK;
+}
+    #endif
+
+/* 写入作业：上一步的编程已完成，做相应的内存状态维护并提交下一步 */
+static nkv_err_t async_set_next(nkv_instance_t* db)
+{
+    nkv_async_t*   job     = &db->async;
+    const uint8_t* key     = (const uint8_t*) job->key;
+    uint8_t        key_len = strlen(job->key);
+
+    switch (job->step)
+    {
+    case ASTEP_PRE_DEL:
+        job->step = ASTEP_WRITE;
+        return async_write(db, job->new_addr, job->entry, job->size) ? NKV_ERR_FLASH : NKV_OK;
+
+    case ASTEP_WRITE:
+        sector_note_live(db, job->new_addr, job->size);
+        db->write_offset += job->size;
+        job->step = ASTEP_VALID;
+        return async_state(db, job->new_addr, NKV_STATE_VALID) ? NKV_ERR_FLASH : NKV_OK;
+
+    case ASTEP_VALID:
+        /* 新值从此对读取可见：索引与缓存同时切换 */
+    #if NKV_BLOOM_ENABLE
+        bloom_note(db, job->new_addr, key, key_len);
+    #endif
+    #if NKV_INDEX_ENABLE
+        index_put(db, key, key_len, job->new_addr, job->old_addr);
+    #endif
+    #if NKV_CACHE_ENABLE
+        if (job->val_len > 0)
+            cache_update(db, job->key, job->entry + NKV_HEADER_SIZE + key_len, job->val_len);
+        else
+            cache_remove(db, job->key);
+    #endif
+        if (!job->old_addr)
+        {
+            job->step = ASTEP_DONE;
+            return NKV_OK;
+        }
+        job->step = ASTEP_DELETE;
+        return async_state(db, job->old_addr, NKV_STATE_DELETED) ? NKV_ERR_FLASH : NKV_OK;
+
+    case ASTEP_DELETE:
+    {
+        const nkv_entry_t* old = (const nkv_entry_t*) job->state;
+        sector_note_dead(db, job->old_addr, ENTRY_SIZE(*old));
+        if (IS_LARGE_HEAD(*old))
+            large_release(db, job->old_addr);
+        job->step = ASTEP_DONE;
+        return NKV_OK;
+    }
+    }
+    return NKV_ERR_INVALID;
+}
+
+/**
+ * @brief 推进异步作业
+ * @details 当前Flash操作完成后依次执行后续步骤，直到提交了新的异步操作或作业结束；
+ *          回收作业每次最多迁移一个条目后返回。作业结束时通过 done/ctx/err 交给调用者在释放锁后回调。
+ */
+static uint8_t async_poll_locked(nkv_instance_t* db, nkv_async_fn* done, void** ctx, nkv_err_t* err)
+{
+    if (!db)
+        return 0;
+
+    nkv_async_t* job = &db->async;
+    while (job->kind != 0 && !job->busy)
+    {
+        nkv_err_t e = NKV_ERR_FLASH;
+        if (job->result == 0)
+        {
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+            e = (job->kind == JOB_GC) ? async_gc_next(db) : async_set_next(db);
+    #else
+            e = async_set_next(db);
+    #endif
+        }
+
+        if (e != NKV_OK || job->step == ASTEP_DONE)
+        {
+            *done     = job->done;
+            *ctx      = job->ctx;
+            *err      = e;
+            job->kind = 0;
+            break;
+        }
+        if (job->kind == JOB_GC && !job->busy)
+            break;
+    }
+    return (job->kind != 0);
+}
+
+/* 提交异步写入：预留空间、查找旧版本并组装条目后提交第一步编程 */
+static nkv_err_t set_async_locked(nkv_instance_t* db, const char* key, const void* value, uint8_t len,
+                                  nkv_async_fn done, void* ctx)
+{
+    if (!db || !db->initialized || !key || len > NKV_MAX_VALUE_LEN)
+        return NKV_ERR_INVALID;
+    if (len > 0 && !value)
+        return NKV_ERR_INVALID;
+
+    uint8_t key_len = strlen(key);
+    if (key_len >= NKV_MAX_KEY_LEN)
+        return NKV_ERR_INVALID;
+
+    db->gc_stats.user_bytes += key_len + len;
+
+    #if NKV_WRITE_BUFFER
+    /* 异步写入不经缓冲，须排在已暂存的写入之后 */
+    nkv_err_t ferr = wbuf_flush(db);
+    if (ferr != NKV_OK)
+        return ferr;
+    #endif
+
+    nkv_async_t* job  = &db->async;
+    uint32_t     size = ALIGN(NKV_HEADER_SIZE + key_len + len + NKV_CRC_SIZE);
+
+    NKV_ASSERT(size <= db->flash.sector_size - ALIGNED_HDR_SIZE && "entry_size exceeds sector capacity");
+
+    nkv_err_t err = reserve_space(db, size);
+    if (err != NKV_OK)
+        return err;
+
+    nkv_entry_t old;
+    uint32_t    old_addr = find_key(db, key, &old);
+
+    memcpy(job->key, key, key_len + 1);
+    job->kind     = JOB_SET;
+    job->val_len  = len;
+    job->size     = size;
+    job->new_addr = SECTOR_ADDR(db->active_sector) + db->write_offset;
+    job->old_addr = (old_addr != 0 && old.val_len > 0) ? old_addr : 0;
+    job->done     = done;
+    job->ctx      = ctx;
+    pack_entry(db, job->entry, NKV_STATE_WRITING, NKV_ENTRY_FLAG_NONE, key, key_len, value, len);
+
+    int ret;
+    if (job->old_addr)
+    {
+        job->step = ASTEP_PRE_DEL;
+        ret       = async_state(db, job->old_addr, NKV_STATE_PRE_DEL);
+    }
+    else
+    {
+        job->step = ASTEP_WRITE;
+        ret       = async_write(db, job->new_addr, job->entry, size);
+    }
+    if (ret != 0)
+    {
+        job->kind = 0;
+        return NKV_ERR_FLASH;
+    }
+    return NKV_OK;
+}
+
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+/* 提交异步回收：没有进行中的回收时按后台阈值选择回收扇区，第一步在 nkv_async_poll 中执行 */
+static nkv_err_t gc_async_locked(nkv_instance_t* db, nkv_async_fn done, void* ctx)
+{
+    if (!db || !db->initialized)
+        return NKV_ERR_INVALID;
+
+    if (!db->gc_active)
+        start_incremental_gc(db);
+
+    nkv_async_t* job = &db->async;
+    job->kind        = JOB_GC;
+    job->step        = ASTEP_GC;
+    job->result      = 0;
+    job->busy        = 0;
+    job->done        = done;
+    job->ctx         = ctx;
+    return NKV_OK;
+}
+    #endif
+#endif
+
+#if NKV_INCREMENTAL_GC
+static uint8_t gc_step_locked(nkv_instance_t* db, uint8_t steps)
+{
+    if (!db || !db->initialized)
+        return 0;
+    if (!db->gc_active && should_start_gc(db))
+        start_incremental_gc(db);
+    if (!db->gc_active)
+        return 0;
+
+    return run_gc_steps(db, steps);
+}
+
+static uint8_t gc_active_locked(nkv_instance_t* db)
+{
+    return db->gc_active;
+}
+#endif
+
+#if NKV_LATENCY_STATS
+/* 记录一次耗时：桶号为耗时的二进制位数 */
+static void latency_note(nkv_latency_t* lat, uint32_t us)
+{
+    uint8_t b = 0;
+    for (uint32_t v = us; v && b < NKV_LATENCY_BUCKETS - 1; v >>= 1)
+        b++;
+    lat->hist[b]++;
+    lat->count++;
+    if (us > lat->max_us)
+        lat->max_us = us;
+}
+
+/* 百分位耗时：返回累计次数达到 percent% 的桶的上界，不超过最长耗时 */
+uint32_t nkv_latency_percentile(const nkv_latency_t* stats, uint8_t percent)
+{
+    if (!stats || stats->count == 0)
+        return 0;
+
+    uint32_t need = (uint32_t) (((uint64_t) stats->count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < NKV_LATENCY_BUCKETS - 1; i++)
+    {
+        seen += stats->hist[i];
+        if (seen >= need)
+            return ((1u << i) < stats->max_us) ? (1u << i) : stats->max_us;
+    }
+    return stats->max_us;
+}
+#endif
+
+static void gc_stats_locked(nkv_instance_t* db, nkv_gc_stats_t* stats)
+{
+    if (!stats)
+        return;
+    *stats           = db->gc_stats;
+    stats->write_amp = (stats->user_bytes > 0) ? ((float) stats->flash_bytes / stats->user_bytes) : 0.0f;
+}
+
+static void gc_stats_reset_locked(nkv_instance_t* db)
+{
+    memset(&db->gc_stats, 0, sizeof(db->gc_stats));
+}
+
+static void wear_stats_locked(nkv_instance_t* db, nkv_wear_t* stats)
+{
+    if (!stats)
+        return;
+    memset(stats, 0, sizeof(*stats));
+    stats->min_erases = UINT32_MAX;
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+    {
+        uint32_t n = db->sectors[i].erase_count;
+        if (n < stats->min_erases)
+            stats->min_erases = n;
+        if (n > stats->max_erases)
+            stats->max_erases = n;
+        stats->total_erases += n;
+    }
+    if (db->flash.sector_count == 0)
+        stats->min_erases = 0;
+    stats->relocations = db->wear_moves;
+}
+
+#if NKV_OP_STATS
+static void op_stats_locked(nkv_instance_t* db, nkv_op_stats_t* stats)
+{
+    if (!stats)
+        return;
+    *stats            = db->op_stats;
+    stats->live_bytes = 0;
+    stats->dead_bytes = 0;
+    for (uint8_t i = 0; i < db->flash.sector_count; i++)
+    {
+        if (!db->sectors[i].valid)
+            continue;
+        stats->live_bytes += db->sectors[i].live;
+        stats->dead_bytes += db->sectors[i].dead;
+    }
+}
+
+static void op_stats_reset_locked(nkv_instance_t* db)
+{
+    uint32_t scan_us = db->op_stats.scan_us;
+    memset(&db->op_stats, 0, sizeof(db->op_stats));
+    db->op_stats.scan_us = scan_us;
+}
+#endif
+
+static nkv_err_t gc_set_policy_locked(nkv_instance_t* db, uint8_t policy)
+{
+    if (policy > NKV_GC_POLICY_COST_BENEFIT)
+        return NKV_ERR_INVALID;
+    db->gc_policy = policy;
+    return NKV_OK;
+}
+
+#if NKV_CACHE_ENABLE
+static void cache_stats_locked(nkv_instance_t* db, nkv_cache_stats_t* stats)
+{
+    if (!stats)
+        return;
+    stats->hit_count  = db->cache.hit_count;
+    stats->miss_count = db->cache.miss_count;
+    uint32_t total    = stats->hit_count + stats->miss_count;
+    stats->hit_rate   = (total > 0) ? ((float) stats->hit_count / total * 100.0f) : 0.0f;
+}
+
+static void cache_clear_locked(nkv_instance_t* db)
+{
+    memset(&db->cache, 0, sizeof(db->cache));
+}
+#endif
+
+#if NKV_BLOOM_ENABLE
+static void bloom_stats_locked(nkv_instance_t* db, nkv_bloom_stats_t* stats)
+{
+    if (!stats)
+        return;
+    stats->skipped   = db->bloom.skipped;
+    stats->probed    = db->bloom.probed;
+    stats->false_pos = db->bloom.false_pos;
+    stats->neg_hits  = db->bloom.neg_hits;
+    stats->fp_rate   = (stats->probed > 0) ? ((float) stats->false_pos / stats->probed * 100.0f) : 0.0f;
+}
+#endif
+
+/* ==================== 大值流式读写 ==================== */
+#if NKV_LARGE_VALUE
+/**
+ * @brief 流式写入大值：分块逐个从回调取数并写入，最后写入头条目
+ * @details 整个值预留在同一扇区内，写入过程中不会触发回收；头条目按普通写入的二阶段提交替换旧版本，
+ *          旧版本为大值时其分块随旧头条目一并删除。
+ */
+static nkv_err_t set_stream_locked(nkv_instance_t* db, const char* key, uint32_t total, nkv_stream_fn read,
+                                   void* ctx)
+{
+    if (!db || !db->initialized || !key || !read || total == 0)
+        return NKV_ERR_INVALID;
+
+    size_t key_len = strlen(key);
+    if (key_len == 0 || key_len >= NKV_MAX_KEY_LEN)
+        return NKV_ERR_INVALID;
+
+    /* 1. 计算整体大小：分块 + 头条目须放入一个扇区 */
+    uint32_t count      = (total + NKV_LARGE_CHUNK - 1) / NKV_LARGE_CHUNK;
+    uint32_t last       = total - (count - 1) * NKV_LARGE_CHUNK;
+    uint32_t chunk_size = ALIGN(NKV_HEADER_SIZE + 1 + NKV_LARGE_CHUNK + NKV_CRC_SIZE);
+    uint32_t head_size  = ALIGN(NKV_HEADER_SIZE + key_len + sizeof(large_desc_t) + NKV_CRC_SIZE);
+    if (count > 255)
+        return NKV_ERR_NO_SPACE;
+    uint32_t unit = (count - 1) * chunk_size + ALIGN(NKV_HEADER_SIZE + 1 + last + NKV_CRC_SIZE) + head_size;
+    if (unit > db->flash.sector_size - ALIGNED_HDR_SIZE)
+        return NKV_ERR_NO_SPACE;
+
+    #if NKV_WRITE_BUFFER
+    /* 不经缓冲的写入须排在已暂存的写入之后 */
+    nkv_err_t ferr = wbuf_flush(db);
+    if (ferr != NKV_OK)
+        return ferr;
+    #endif
+
+    db->gc_stats.user_bytes += key_len + total;
+
+    nkv_err_t err = reserve_space(db, unit);
+    if (err != NKV_OK)
+        return err;
+
+    /* 2. 查找旧版本（预留空间可能触发GC迁移，须在其后查找） */
+    nkv_entry_t old_entry;
+    uint32_t    old_addr  = find_key(db, key, &old_entry);
+    uint8_t     is_update = (old_addr != 0 && old_entry.val_len > 0);
+
+    /* 3. 写入分块(VALID)，头条目写入前不生效 */
+    large_desc_t desc = {.total = total, .first = SECTOR_ADDR(db->active_sector) + db->write_offset, .count = count};
+    uint8_t      data[1 + NKV_LARGE_CHUNK];
+    data[0] = TLV_TYPE_RESERVED;
+    for (uint32_t i = 0; i < count && err == NKV_OK; i++)
+    {
+        uint8_t n = (i + 1 < count) ? NKV_LARGE_CHUNK : (uint8_t) last;
+        if (read(ctx, i * NKV_LARGE_CHUNK, data + 1, n) != 0)
+        {
+            err = NKV_ERR_INVALID;
+            break;
+        }
+
+        uint32_t size = pack_entry(db, db->scratch, NKV_STATE_VALID, NKV_ENTRY_FLAG_LARGE, "", 0, data, n + 1);
+        uint32_t addr = SECTOR_ADDR(db->active_sector) + db->write_offset;
+        if (flash_write(db, addr, db->scratch, size) != 0)
+            err = NKV_ERR_FLASH;
+        else
+        {
+            sector_note_live(db, addr, size);
+            db->write_offset += size;
+        }
+    }
+    if (err != NKV_OK)
+    {
+        /* 已写入的分块没有头条目，删除后不再占用有效空间 */
+        for (uint32_t a = desc.first; a < SECTOR_ADDR(db->active_sector) + db->write_offset; a += chunk_size)
+            update_entry_state(db, a, NKV_STATE_DELETED);
+        return err;
+    }
+
+    /* 4. 写入头条目：与 set_locked 相同的二阶段提交 */
+    if (is_update)
+        update_entry_state(db, old_addr, NKV_STATE_PRE_DEL);
+
+    uint32_t new_addr = SECTOR_ADDR(db->active_sector) + db->write_offset;
+    pack_entry(db, db->scratch, NKV_STATE_WRITING, NKV_ENTRY_FLAG_LARGE, key, key_len, &desc, sizeof(desc));
+    if (flash_write(db, new_addr, db->scratch, head_size) != 0)
+        return NKV_ERR_FLASH;
+    sector_note_live(db, new_addr, head_size);
+    update_entry_state(db, new_addr, NKV_STATE_VALID);
+    #if NKV_BLOOM_ENABLE
+    bloom_note(db, new_addr, (const uint8_t*) key, key_len);
+    #endif
+    #if NKV_INDEX_ENABLE
+    index_put(db, (const uint8_t*) key, key_len, new_addr, old_addr);
+    #endif
+
+    if (is_update)
+        update_entry_state(db, old_addr, NKV_STATE_DELETED);
+    db->write_offset += head_size;
+
+    #if NKV_CACHE_ENABLE
+    cache_remove(db, key);
+    #endif
+    #if NKV_INCREMENTAL_GC
+    do_incremental_gc(db);
+    #endif
+    return NKV_OK;
+}
+
+/* 流式读取：大值逐个分块交给回调，普通值一次交给回调；write 为 NULL 时只返回长度 */
+static nkv_err_t get_stream_locked(nkv_instance_t* db, const char* key, nkv_stream_fn write, void* ctx,
+                                   uint32_t* out_len)
+{
+    if (!db || !db->initialized || !key)
+        return NKV_ERR_INVALID;
+
+    uint8_t  buf[NKV_MAX_VALUE_LEN];
+    uint8_t  len = 0;
+    uint32_t n   = 0;
+
+    #if NKV_WRITE_BUFFER
+    int16_t staged = wbuf_find(db, key, strlen(key));
+    if (staged >= 0)
+    {
+        const nkv_wbuf_item_t* it = &db->wbuf.items[staged];
+        if (it->len == 0)
+            return NKV_ERR_NOT_FOUND;
+        memcpy(buf, db->wbuf.data + it->val_off, it->len);
+        len = it->len;
+    }
+    else
+    #endif
+    {
+        nkv_entry_t entry;
+        uint32_t    addr = find_key(db, key, &entry);
+        if (addr == 0 || entry.val_len == 0)
+            return NKV_ERR_NOT_FOUND;
+
+        if (IS_LARGE_HEAD(entry))
+        {
+            large_desc_t desc;
+            if (!large_desc_read(db, addr, &entry, &desc))
+                return NKV_ERR_CRC;
+            nkv_err_t err = write ? large_read(db, addr, &entry, write, ctx, desc.total, &n) : NKV_OK;
+            if (err == NKV_OK && out_len)
+                *out_len = desc.total;
+            return err;
+        }
+
+        nkv_err_t err = read_value(db, addr, &entry, buf, sizeof(buf), &len);
+        if (err != NKV_OK)
+            return err;
+    }
+
+    if (write && write(ctx, 0, buf, len) != 0)
+        return NKV_ERR_INVALID;
+    if (out_len)
+        *out_len = len;
+    return NKV_OK;
+}
+#endif
+
+/* ==================== 零拷贝读取 ==================== */
+#if NKV_ZERO_COPY
+/**
+ * @brief 返回指向映射Flash中值数据的引用
+ * @details 不经过缓存(命中缓存也要查找条目地址)；暂存在写缓冲中的键先落盘，保证引用总是指向Flash。
+ */
+static nkv_err_t get_ref_locked(nkv_instance_t* db, const char* key, nkv_ref_t* ref)
+{
+    if (!db || !db->initialized || !key || !ref || !db->flash.map)
+        return NKV_ERR_INVALID;
+
+    #if NKV_WRITE_BUFFER
+    if (wbuf_find(db, key, strlen(key)) >= 0)
+    {
+        nkv_err_t err = wbuf_flush(db);
+        if (err != NKV_OK)
+            return err;
+    }
+    #endif
+
+    nkv_entry_t entry;
+    uint32_t    addr = find_key(db, key, &entry);
+    if (addr == 0 || entry.val_len == 0)
+        return NKV_ERR_NOT_FOUND;
+    if (IS_LARGE_HEAD(entry))
+        return NKV_ERR_INVALID; /* 大值分块不连续，需用 nkv_get_stream */
+
+    const uint8_t* val;
+    nkv_err_t      err = map_value(db, addr, &entry, &val);
+    if (err != NKV_OK)
+        return err;
+
+    ref->data  = val;
+    ref->len   = entry.val_len;
+    ref->epoch = db->map_epoch;
+    return NKV_OK;
+}
+#endif
+
+/* ==================== 批量写入 ==================== */
+
+/**
+ * @brief 批量标记旧版本为 DELETED
+ * @details 按地址排序后，将同一扇区内可放入缓冲区的相邻条目合并为一次读取 + 一次编程：
+ *          区间内只把各旧条目的 state 清零，其余字节按原值重新编程（与 update_entry_state 一致）。
+ * @return NKV_OK=全部旧版本已失效，否则为首个编程错误
+ */
+static nkv_err_t batch_invalidate(nkv_instance_t* db, uint32_t* addr, uint16_t* size, uint8_t count)
+{
+    nkv_err_t err = NKV_OK;
+
+    /* 插入排序（count 不超过 NKV_BATCH_MAX） */
+    for (uint8_t i = 1; i < count; i++)
+    {
+        uint32_t a = addr[i];
+        uint16_t s = size[i];
+        uint8_t  j = i;
+        for (; j > 0 && addr[j - 1] > a; j--)
+        {
+            addr[j] = addr[j - 1];
+            size[j] = size[j - 1];
+        }
+        addr[j] = a;
+        size[j] = s;
+    }
+
+    uint8_t i = 0;
+    while (i < count)
+    {
+        if (addr[i] == 0)
+        {
+            i++;
+            continue;
+        }
+
+        uint32_t start  = addr[i];
+        uint32_t sector = (start - db->flash.base) / db->flash.sector_size;
+        uint32_t end    = start + size[i];
+        uint8_t  n      = i + 1;
+
+        while (n < count && (addr[n] - db->flash.base) / db->flash.sector_size == sector &&
+               addr[n] + size[n] - start <= NKV_SCRATCH_SIZE)
+        {
+            end = addr[n] + size[n];
+            n++;
+        }
+
+        if (n - i == 1 || flash_read(db, start, db->scratch, end - start) != 0)
+        {
+            for (; i < n; i++)
+            {
+                if (update_entry_state(db, addr[i], NKV_STATE_DELETED) != NKV_OK)
+                    err = NKV_ERR_FLASH;
+            }
+            continue;
+        }
+
+        uint32_t heads[NKV_BATCH_MAX]; /* 旧版本中的大值头条目，编程后删除其分块 */
+        uint8_t  nh = 0;
+        for (; i < n; i++)
+        {
+            uint8_t*    st = db->scratch + (addr[i] - start);
+            nkv_entry_t old;
+            memcpy(&old, st, NKV_HEADER_SIZE);
+            if (old.state != NKV_STATE_DELETED)
+            {
+                sector_note_dead(db, addr[i], size[i]);
+                if (IS_LARGE_HEAD(old))
+                    heads[nh++] = addr[i];
+            }
+            memset(st, 0, sizeof(uint16_t)); /* NKV_STATE_DELETED */
+        }
+        OP_COUNT(db, state_writes, 1);
+        if (flash_write(db, start, db->scratch, end - start) != 0)
+            err = NKV_ERR_FLASH;
+        while (nh > 0)
+            large_release(db, heads[--nh]);
+    }
+    return err;
+}
+
+static nkv_err_t write_batch(nkv_instance_t* db, const nkv_batch_item_t* items, uint8_t count)
+{
+    if (!db || !db->initialized || !items || count == 0 || count > NKV_BATCH_MAX)
+        return NKV_ERR_INVALID;
+
+    /* 1. 参数检查并计算整批大小（成员 + 提交记录） */
+    uint32_t commit_size = ALIGN(NKV_HEADER_SIZE + 2 + NKV_CRC_SIZE);
+    uint32_t total       = commit_size;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const nkv_batch_item_t* it = &items[i];
+        if (!it->key || it->len > NKV_MAX_VALUE_LEN || (it->len > 0 && !it->value))
+            return NKV_ERR_INVALID;
+
+        size_t key_len = strlen(it->key);
+        if (key_len == 0 || key_len >= NKV_MAX_KEY_LEN)
+            return NKV_ERR_INVALID;
+        for (uint8_t j = 0; j < i; j++)
+        {
+            if (strcmp(items[j].key, it->key) == 0)
+                return NKV_ERR_INVALID;
+        }
+        total += ALIGN(NKV_HEADER_SIZE + key_len + it->len + NKV_CRC_SIZE);
+    }
+    if (total > db->flash.sector_size - ALIGNED_HDR_SIZE)
+        return NKV_ERR_NO_SPACE;
+
+    /* 2. 预留空间：整批落在同一扇区 */
+    nkv_err_t err = reserve_space(db, total);
+    if (err != NKV_OK)
+        return err;
+
+    /* 3. 记录旧版本（预留空间可能触发GC迁移，须在其后查找） */
+    uint32_t old_addr[NKV_BATCH_MAX];
+    uint16_t old_size[NKV_BATCH_MAX];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        nkv_entry_t entry;
+        old_addr[i] = find_key(db, items[i].key, &entry);
+        old_size[i] = old_addr[i] ? ENTRY_SIZE(entry) : 0;
+    }
+
+    /* 4. 成员按缓冲区容量合并编程 */
+    uint32_t base = SECTOR_ADDR(db->active_sector) + db->write_offset;
+    uint32_t done = 0; /* 已编程字节数 */
+    uint32_t pos  = 0; /* 缓冲区内待编程字节数 */
+
+    for (uint8_t i = 0; i < count && err == NKV_OK; i++)
+    {
+        uint8_t  key_len = strlen(items[i].key);
+        uint32_t size    = ALIGN(NKV_HEADER_SIZE + key_len + items[i].len + NKV_CRC_SIZE);
+
+        if (pos + size > NKV_SCRATCH_SIZE)
+        {
+            if (flash_write(db, base + done, db->scratch, pos) != 0)
+                err = NKV_ERR_FLASH;
+            else
+                done += pos;
+            pos = 0;
+        }
+        if (err == NKV_OK)
+            pos += pack_entry(db, db->scratch + pos, NKV_STATE_VALID, NKV_ENTRY_FLAG_BATCH, items[i].key, key_len,
+                              items[i].value, items[i].len);
+    }
+    if (err == NKV_OK && pos > 0)
+    {
+        if (flash_write(db, base + done, db->scratch, pos) != 0)
+            err = NKV_ERR_FLASH;
+        else
+            done += pos;
+    }
+
+    /* 5. 成员全部落盘后单独写入提交记录，此后整批生效 */
+    uint32_t commit_addr = base + done;
+    if (err == NKV_OK)
+    {
+        uint8_t info[2] = {TLV_TYPE_RESERVED, count};
+        pack_entry(db, db->scratch, NKV_STATE_VALID, NKV_ENTRY_FLAG_COMMIT, "", 0, info, sizeof(info));
+        if (flash_write(db, commit_addr, db->scratch, commit_size) != 0)
+            err = NKV_ERR_FLASH;
+    }
+
+    if (err != NKV_OK)
+    {
+        sector_note_live(db, base, done);
+        /* 尽力删除已编程的成员，避免回退扫描时读到未提交的值 */
+        for (uint32_t off = 0; off < done;)
+        {
+            nkv_entry_t entry;
+            if (flash_read(db, base + off, (uint8_t*) &entry, NKV_HEADER_SIZE) != 0)
+                break;
+            update_entry_state(db, base + off, NKV_STATE_DELETED);
+            off += ENTRY_SIZE(entry);
+        }
+        db->write_offset += done;
+        return err;
+    }
+    sector_note_live(db, base, total);
+    db->write_offset += total;
+
+    /* 6. 更新索引与缓存 */
+    uint32_t addr = base;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const nkv_batch_item_t* it      = &items[i];
+        uint8_t                 key_len = strlen(it->key);
+#if NKV_INDEX_ENABLE
+        index_put(db, (const uint8_t*) it->key, key_len, addr, old_addr[i]);
+#endif
+#if NKV_BLOOM_ENABLE
+        bloom_note(db, addr, (const uint8_t*) it->key, key_len);
+#endif
+#if NKV_CACHE_ENABLE
+        if (it->len > 0)
+            cache_update(db, it->key, it->value, it->len);
+        else
+            cache_remove(db, it->key);
+#endif
+        addr += ALIGN(NKV_HEADER_SIZE + key_len + it->len + NKV_CRC_SIZE);
+    }
+
+    /* 7. 旧版本批量失效后注销提交记录；失效未完成时保留提交记录，由下次挂载的 batch_finish 补做 */
+    if (batch_invalidate(db, old_addr, old_size, count) == NKV_OK)
+        update_entry_state(db, commit_addr, NKV_STATE_DELETED);
+
+#if NKV_INCREMENTAL_GC
+    do_incremental_gc(db);
+#endif
+
+    return NKV_OK;
+}
+
+static nkv_err_t set_batch_locked(nkv_instance_t* db, const nkv_batch_item_t* items, uint8_t count)
+{
+#if NKV_WRITE_BUFFER
+    /* 先落盘已暂存的写入，保持写入顺序 */
+    if (db && db->initialized)
+    {
+        nkv_err_t err = wbuf_flush(db);
+        if (err != NKV_OK)
+            return err;
+    }
+#endif
+    nkv_err_t err = write_batch(db, items, count);
+    if (err == NKV_OK)
+    {
+        for (uint8_t i = 0; i < count; i++)
+            db->gc_stats.user_bytes += strlen(items[i].key) + items[i].len;
+    }
+    return err;
+}
+
+/* 挂载后补做上次批量写入的旧版本失效：成员键在批次之外仍有效的条目标记为 DELETED，最后注销提交记录 */
+static void batch_finish(nkv_instance_t* db, const batch_track_t* bt)
+{
+    if (bt->commit == 0)
+        return;
+
+    uint8_t      hashes[32] = {0};
+    nkv_cursor_t cur;
+    nkv_entry_t  entry;
+    uint8_t      idx = (bt->lo - db->flash.base) / db->flash.sector_size;
+
+    /* 收集成员键哈希，用于快速过滤（旧版本可能位于另一种格式的扇区，两种格式的低8位都加入） */
+    cursor_open(db, &cur, idx, bt->lo - SECTOR_ADDR(idx));
+    while (cur.sector + cur.offset < bt->commit && cursor_entry(&cur, &entry))
+    {
+        const uint8_t* kp = cursor_peek(&cur, cur.offset + NKV_HEADER_SIZE, entry.key_len);
+        bitmap_set(hashes, entry.key_hash);
+        if (kp)
+        {
+            bitmap_set(hashes, hash_key((const char*) kp, entry.key_len));
+            bitmap_set(hashes, (uint8_t) id_hash(kp, entry.key_len));
+        }
+        cur.offset += ENTRY_SIZE(entry);
+    }
+
+    for (uint8_t s = 0; s < db->flash.sector_count; s++)
+    {
+        if (!is_sector_valid_locked(db, s))
+            continue;
+
+        cursor_open(db, &cur, s, SECTOR_DATA(s));
+        while (cursor_entry(&cur, &entry))
+        {
+            if (entry.state == NKV_STATE_ERASED)
+                break;
+
+            uint32_t addr = cur.sector + cur.offset;
+            if ((entry.state == NKV_STATE_VALID || entry.state == NKV_STATE_PRE_DEL) && entry.key_len > 0 &&
+                entry.key_len < NKV_MAX_KEY_LEN && (addr < bt->lo || addr >= bt->commit) &&
+                bitmap_test(hashes, entry.key_hash))
+            {
+                char           key[NKV_MAX_KEY_LEN] = {0};
+                const uint8_t* kp = cursor_peek(&cur, cur.offset + NKV_HEADER_SIZE, entry.key_len);
+                if (kp)
+                {
+                    memcpy(key, kp, entry.key_len);
+                    uint32_t latest = find_key(db, key, NULL);
+                    if (latest >= bt->lo && latest < bt->commit)
+                        update_entry_state(db, addr, NKV_STATE_DELETED);
+                }
+            }
+            cur.offset += ENTRY_SIZE(entry);
+        }
+    }
+    update_entry_state(db, bt->commit, NKV_STATE_DELETED);
+}
+
+/* ==================== 默认值同步 ==================== */
+
+static void nkv_sync_version(nkv_instance_t* db)
+{
+    if (!db || !db->initialized)
+        return;
+
+    uint32_t  saved_ver = 0;
+    nkv_err_t err       = get_locked(db, NKV_VER_KEY, &saved_ver, sizeof(saved_ver), NULL);
+
+    if (err != NKV_OK || saved_ver != NKV_SETTING_VER)
+    {
+        NKV_LOG_I("Config version changed: %d -> %d, syncing defaults...", (int) saved_ver, NKV_SETTING_VER);
+
+        /* 同步 KV 默认值 */
+        if (db->defaults)
+        {
+            for (uint16_t i = 0; i < db->default_count; i++)
+            {
+                if (db->defaults[i].key && !exists_locked(db, db->defaults[i].key))
+                {
+                    set_locked(db, db->defaults[i].key, db->defaults[i].value, db->defaults[i].len);
+                }
+            }
+        }
+
+        /* 同步 TLV 默认值 */
+        if (db->tlv_defaults)
+        {
+            for (uint16_t i = 0; i < db->tlv_default_count; i++)
+            {
+                if (db->tlv_defaults[i].type != 0 && !tlv_exists_locked(db, db->tlv_defaults[i].type))
+                {
+                    tlv_set_locked(db, db->tlv_defaults[i].type, db->tlv_defaults[i].value, db->tlv_defaults[i].len);
+                }
+            }
+        }
+
+        uint32_t new_ver = NKV_SETTING_VER;
+        set_locked(db, NKV_VER_KEY, &new_ver, sizeof(new_ver));
+    }
+}
+
+/* ==================== 默认值API ==================== */
+
+static void set_defaults_locked(nkv_instance_t* db, const nkv_default_t* defs, uint16_t count)
+{
+    db->defaults      = defs;
+    db->default_count = count;
+
+    nkv_sync_version(db);
+}
+
+static const nkv_default_t* find_default_locked(nkv_instance_t* db, const char* key)
+{
+    if (!key || !db->defaults)
+        return NULL;
+    uint8_t klen = strlen(key);
+
+    for (uint16_t i = 0; i < db->default_count; i++)
+    {
+        const nkv_default_t* d = &db->defaults[i];
+        if (d->key && strlen(d->key) == klen && memcmp(d->key, key, klen) == 0)
+            return d;
+    }
+    return NULL;
+}
+
+static nkv_err_t get_default_locked(nkv_instance_t* db, const char* key, void* buf, uint8_t size, uint8_t* out_len)
+{
+    if (!key || !buf)
+        return NKV_ERR_INVALID;
+
+    if (get_locked(db, key, buf, size, out_len) == NKV_OK)
+        return NKV_OK;
+
+    const nkv_default_t* def = find_default_locked(db, key);
+    if (def)
+    {
+        uint8_t len = (def->len < size) ? def->len : size;
+        memcpy(buf, def->value, len);
+        if (out_len)
+            *out_len = len;
+        return NKV_OK;
+    }
+    return NKV_ERR_NOT_FOUND;
+}
+
+static nkv_err_t reset_key_locked(nkv_instance_t* db, const char* key)
+{
+    if (!key)
+        return NKV_ERR_INVALID;
+    const nkv_default_t* def = find_default_locked(db, key);
+    if (!def)
+        return NKV_ERR_NOT_FOUND;
+    return set_locked(db, key, def->value, def->len);
+}
+
+static nkv_err_t reset_all_locked(nkv_instance_t* db)
+{
+    if (!db->defaults)
+        return NKV_ERR_INVALID;
+
+    for (uint16_t i = 0; i < db->default_count; i++)
+    {
+        const nkv_default_t* d = &db->defaults[i];
+        if (d->key && d->value && d->len > 0)
+        {
+            nkv_err_t err = set_locked(db, d->key, d->value, d->len);
+            if (err != NKV_OK)
+                return err;
+        }
+    }
+    return NKV_OK;
+}
+
+nkv_instance_t* nkv_get_instance(void)
+{
+    return &g_nkv;
+}
+
+/* ==================== TLV实现 ==================== */
+
+/* 在所有扇区中查找TLV类型 */
+static uint32_t find_tlv(nkv_instance_t* db, uint8_t type, nkv_entry_t* out)
+{
+#if NKV_INDEX_ENABLE
+    uint8_t  definitive;
+    uint32_t addr = index_lookup(db, &type, 0, out, &definitive);
+    if (definitive)
+        return addr;
+#endif
+
+    tlv_match_ctx_t ctx = {.type = type};
+    return scan_for_id(db, &type, 0, tlv_matcher, &ctx, out);
+}
+
+/**
+ * @brief 内部函数：追加写入条目
+ * @note 键为空(TLV，value[0]为类型)时替换同类型的旧条目，二阶段提交同 set_locked：
+ *       旧条目 PRE_DEL -> 写入新条目并置 VALID -> 旧条目 DELETED，任一步掉电后都能读到旧值或新值
+ * @param key 键名
+ * @param value 值
+ * @param len 值长度
+ * @return 错误码
+ */
+static nkv_err_t nkv_append_entry(nkv_instance_t* db, const char* key, const void* value, uint8_t len)
+{
+    if (!db || !db->initialized || !key || len > NKV_MAX_VALUE_LEN)
+        return NKV_ERR_INVALID;
+    if (len > 0 && !value)
+        return NKV_ERR_INVALID;
+
+    uint8_t key_len = strlen(key);
+    if (key_len >= NKV_MAX_KEY_LEN)
+        return NKV_ERR_INVALID;
+
+    uint32_t entry_size = ALIGN(NKV_HEADER_SIZE + key_len + len + NKV_CRC_SIZE);
+    NKV_ASSERT(entry_size <= db->flash.sector_size - ALIGNED_HDR_SIZE && "entry_size exceeds sector capacity");
+
+    db->gc_stats.user_bytes += key_len + len;
+    nkv_err_t err = reserve_space(db, entry_size);
+    if (err != NKV_OK)
+        return err;
+
+    /* 预留空间可能触发GC迁移，须在其后查找旧条目 */
+    nkv_entry_t old_entry;
+    uint32_t    old_addr = 0;
+    if (key_len == 0 && len > 0)
+    {
+        old_addr = find_tlv(db, ((const uint8_t*) value)[0], &old_entry);
+        if (old_addr != 0 && old_entry.val_len <= 1)
+            old_addr = 0;
+        if (old_addr != 0)
+            update_entry_state(db, old_addr, NKV_STATE_PRE_DEL);
+    }
+
+    uint8_t* buf = db->scratch;
+    pack_entry(db, buf, NKV_STATE_WRITING, NKV_ENTRY_FLAG_NONE, key, key_len, value, len);
+
+    uint32_t new_addr = SECTOR_ADDR(db->active_sector) + db->write_offset;
+    if (flash_write(db, new_addr, buf, entry_size) != 0)
+        return NKV_ERR_FLASH;
+    sector_note_live(db, new_addr, entry_size);
+
+    update_entry_state(db, new_addr, NKV_STATE_VALID);
+    db->write_offset += entry_size;
+#if NKV_BLOOM_ENABLE
+    bloom_note(db, new_addr, key_len ? (const uint8_t*) key : (const uint8_t*) value, key_len);
+#endif
+
+#if NKV_INDEX_ENABLE
+    index_put(db, key_len ? (const uint8_t*) key : (const uint8_t*) value, key_len, new_addr, old_addr);
+#endif
+
+    /* 新条目生效后才删除旧条目 */
+    if (old_addr != 0)
+        update_entry_state(db, old_addr, NKV_STATE_DELETED);
+
+#if NKV_INCREMENTAL_GC
+    do_incremental_gc(db);
+#endif
+
+    return NKV_OK;
+}
+
+static nkv_err_t tlv_set_locked(nkv_instance_t* db, uint8_t type, const void* value, uint8_t len)
+{
+    if (type == 0 || !value || len == 0 || len > 254)
+        return NKV_ERR_INVALID;
+
+    /* 追加写入新 TLV，同类型的旧 TLV 在新条目生效后删除 */
+    uint8_t data[256];
+    data[0] = type;
+    memcpy(data + 1, value, len);
+    return nkv_append_entry(db, "", data, len + 1);
+}
+
+static nkv_err_t tlv_get_locked(nkv_instance_t* db, uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
+{
+    if (type == 0 || !buf || size == 0)
+        return NKV_ERR_INVALID;
+
+    nkv_entry_t entry;
+    uint32_t    addr = find_tlv(db, type, &entry);
+    if (addr == 0 || entry.val_len <= 1)
+        return NKV_ERR_NOT_FOUND;
+
+    uint8_t len      = entry.val_len - 1;
+    uint8_t read_len = (len < size) ? len : size;
+
+    if (flash_read(db, addr + NKV_HEADER_SIZE + 1, buf, read_len) != 0)
+        return NKV_ERR_FLASH;
+
+    if (out_len)
+        *out_len = read_len;
+    return NKV_OK;
+}
+
+static nkv_err_t tlv_del_locked(nkv_instance_t* db, uint8_t type)
+{
+    if (type == 0)
+        return NKV_ERR_INVALID;
+
+    /* 查找并删除相同类型的 TLV */
+    nkv_entry_t old_entry;
+    uint32_t    old_addr = find_tlv(db, type, &old_entry);
+    if (old_addr != 0 && old_entry.val_len > 1)
+    {
+        update_entry_state(db, old_addr, NKV_STATE_DELETED);
+#if NKV_INDEX_ENABLE
+        index_drop(db, &type, 0, old_addr);
+#endif
+        return NKV_OK;
+    }
+    return NKV_ERR_NOT_FOUND;
+}
+
+static uint8_t tlv_exists_locked(nkv_instance_t* db, uint8_t type)
+{
+    if (type == 0)
+        return 0;
+    nkv_entry_t entry;
+    uint32_t    addr = find_tlv(db, type, &entry);
+    return (addr != 0 && entry.val_len > 1);
+}
+
+/* TLV默认值 */
+static void tlv_set_defaults_locked(nkv_instance_t* db, const nkv_tlv_default_t* defs, uint16_t count)
+{
+    db->tlv_defaults      = defs;
+    db->tlv_default_count = count;
+
+    nkv_sync_version(db);
+}
 
-    return (g_nkv.flash.write(addr, buf, g_nkv.flash.align) == 0) ? NKV_OK : NKV_ERR_FLASH;
+static const nkv_tlv_default_t* find_tlv_default(nkv_instance_t* db, uint8_t type)
+{
+    if (!db->tlv_defaults)
+        return NULL;
+    for (uint16_t i = 0; i < db->tlv_default_count; i++)
+        if (db->tlv_defaults[i].type == type)
+            return &db->tlv_defaults[i];
+    return NULL;
 }
 
-nkv_err_t nkv_set(const char* key, const void* value, uint8_t len)
+static nkv_err_t tlv_get_default_locked(nkv_instance_t* db, uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
 {
-    if (!g_nkv.initialized || !key || len > NKV_MAX_VALUE_LEN)
-        return NKV_ERR_INVALID;
-    if (len > 0 && !value)
-        return NKV_ERR_INVALID;
+    if (tlv_get_locked(db, type, buf, size, out_len) == NKV_OK)
+        return NKV_OK;
 
-    uint8_t key_len = strlen(key);
-    if (key_len >= NKV_MAX_KEY_LEN)
-        return NKV_ERR_INVALID;
+    const nkv_tlv_default_t* def = find_tlv_default(db, type);
+    if (!def)
+        return NKV_ERR_NOT_FOUND;
 
-    /* 1. 查找旧条目 */
-    nkv_entry_t old_entry;
-    uint32_t    old_addr  = find_key(key, &old_entry);
-    uint8_t     is_update = (old_addr != 0 && old_entry.val_len > 0);
+    uint8_t len = (def->len < size) ? def->len : size;
+    memcpy(buf, def->value, len);
+    if (out_len)
+        *out_len = len;
+    return NKV_OK;
+}
 
-    /* 2. 计算并检查条目大小 */
-    uint32_t entry_size = ALIGN(NKV_HEADER_SIZE + key_len + len + NKV_CRC_SIZE);
+static nkv_err_t tlv_reset_type_locked(nkv_instance_t* db, uint8_t type)
+{
+    const nkv_tlv_default_t* def = find_tlv_default(db, type);
+    if (!def)
+        return NKV_ERR_NOT_FOUND;
+    return tlv_set_locked(db, type, def->value, def->len);
+}
 
-    /* 断言：单个条目不能超过扇区有效空间 */
-    NKV_ASSERT(entry_size <= g_nkv.flash.sector_size - ALIGNED_HDR_SIZE && "entry_size exceeds sector capacity");
+static nkv_err_t tlv_reset_all_locked(nkv_instance_t* db)
+{
+    if (!db->tlv_defaults)
+        return NKV_OK;
+    for (uint16_t i = 0; i < db->tlv_default_count; i++)
+    {
+        const nkv_tlv_default_t* d   = &db->tlv_defaults[i];
+        nkv_err_t                err = tlv_set_locked(db, d->type, d->value, d->len);
+        if (err != NKV_OK)
+            return err;
+    }
+    return NKV_OK;
+}
+
+/* TLV迭代器 */
+static void tlv_iter_init_locked(nkv_instance_t* db, nkv_tlv_iter_t* iter)
+{
+    if (!db || !iter)
+        return;
+    iter->db             = db;
+    iter->sector_idx     = 0;
+    iter->sector_offset  = 0; /* 0=扇区的第一个条目 */
+    iter->finished       = 0;
+    iter->gen            = db->flash_gen;
+    iter->cursor.win_len = 0;
+}
+
+static uint8_t tlv_iter_next_locked(nkv_tlv_iter_t* iter, nkv_tlv_entry_t* info)
+{
+    if (!iter || iter->finished || !info)
+        return 0;
+
+    nkv_instance_t* db = iter->db;
 
-    if (g_nkv.write_offset + entry_size > g_nkv.flash.sector_size)
+    /* 两次调用之间Flash被修改过（或窗口尚未建立），需重新确认扇区并读取 */
+    nkv_cursor_t* cur     = &iter->cursor;
+    uint8_t       recheck = (iter->gen != db->flash_gen || cur->win_len == 0);
+    iter->gen             = db->flash_gen;
+
+    while (iter->sector_idx < db->flash.sector_count)
     {
-        int8_t free_idx = find_free_sector();
-        if (free_idx >= 0)
+        if (recheck)
         {
-            nkv_err_t err = switch_to_sector((uint8_t) free_idx);
-            if (err != NKV_OK)
-                return err;
+            if (!is_sector_valid_locked(db, iter->sector_idx))
+            {
+                iter->sector_idx++;
+                iter->sector_offset = 0;
+                continue;
+            }
+            cursor_open(db, cur, iter->sector_idx,
+                        iter->sector_offset ? iter->sector_offset : SECTOR_DATA(iter->sector_idx));
+            recheck = 0;
         }
-        else
+
+        nkv_entry_t entry;
+        while (cursor_entry(cur, &entry))
         {
-            nkv_err_t err = do_compact();
-            if (err != NKV_OK)
-                return err;
+            if (entry.state == NKV_STATE_ERASED)
+                break;
+
+            uint32_t offset = cur->offset;
+            cur->offset += ENTRY_SIZE(entry);
+            iter->sector_offset = cur->offset;
+
+            if ((entry.state == NKV_STATE_VALID || entry.state == NKV_STATE_PRE_DEL) && entry.key_len == 0 &&
+                entry.val_len > 1)
+            {
+                const uint8_t* type = cursor_peek(cur, offset + NKV_HEADER_SIZE, 1);
+                if (type && *type != TLV_TYPE_RESERVED) /* 跳过提交记录与大值分块 */
+                {
+                    info->type       = *type;
+                    info->len        = entry.val_len - 1;
+                    info->flash_addr = cur->sector + offset + NKV_HEADER_SIZE + 1;
+                    return 1;
+                }
+            }
         }
-        if (g_nkv.write_offset + entry_size > g_nkv.flash.sector_size)
-            return NKV_ERR_NO_SPACE;
+        iter->sector_idx++;
+        iter->sector_offset = 0;
+        recheck             = 1;
     }
 
-    /* 3. 二阶段提交：如果是更新，先标记旧键为 PRE_DEL */
-    if (is_update)
+    iter->finished = 1;
+    return 0;
+}
+
+static nkv_err_t tlv_iter_read_locked(nkv_instance_t* db, const nkv_tlv_entry_t* info, void* buf, uint8_t size)
+{
+    if (!info || !buf || size == 0)
+        return NKV_ERR_INVALID;
+    uint8_t len = (info->len < size) ? info->len : size;
+    if (flash_read(db, info->flash_addr, buf, len) != 0)
+        return NKV_ERR_FLASH;
+    return NKV_OK;
+}
+
+/* TLV统计 */
+static void tlv_stats_locked(nkv_instance_t* db, uint16_t* count, uint32_t* used)
+{
+    uint16_t c = 0;
+    uint32_t u = 0;
+
+    nkv_tlv_iter_t  iter;
+    nkv_tlv_entry_t info;
+    tlv_iter_init_locked(db, &iter);
+
+    while (tlv_iter_next_locked(&iter, &info))
     {
-        update_entry_state(old_addr, NKV_STATE_PRE_DEL);
+        c++;
+        u += 7 + info.len; /* 头4B + 类型1B + 值NB + CRC2B */
     }
 
-    /* 4. 构建并写入新条目 (WRITING 状态) */
-    static uint8_t buf[MAX_ENTRY_SIZE];
-    nkv_entry_t*   entry = (nkv_entry_t*) buf;
+    if (count)
+        *count = c;
+    if (used)
+        *used = u;
+}
 
-    memset(buf, 0xFF, entry_size);
-    entry->state    = NKV_STATE_WRITING;
-    entry->key_len  = key_len;
-    entry->val_len  = len;
-    entry->key_hash = hash_key(key, key_len); /* 存储键哈希 */
-    entry->reserved = 0xFF;
+static uint8_t tlv_has_data_locked(nkv_instance_t* db)
+{
+    nkv_tlv_iter_t  iter;
+    nkv_tlv_entry_t info;
+    tlv_iter_init_locked(db, &iter);
+    return tlv_iter_next_locked(&iter, &info);
+}
 
-    memcpy(buf + NKV_HEADER_SIZE, key, key_len);
-    memcpy(buf + NKV_HEADER_SIZE + key_len, value, len);
+/* TLV历史记录 */
+static nkv_err_t tlv_get_history_locked(nkv_instance_t* db, uint8_t type, nkv_tlv_history_t* history, uint8_t max,
+                                        uint8_t* count)
+{
+    if (type == 0 || !history || max == 0)
+        return NKV_ERR_INVALID;
+
+    nkv_tlv_history_t tmp[32];
+    uint8_t           n = 0;
+
+    nkv_tlv_iter_t  iter;
+    nkv_tlv_entry_t info;
+    tlv_iter_init_locked(db, &iter);
+
+    while (tlv_iter_next_locked(&iter, &info) && n < 32)
+    {
+        if (info.type == type)
+        {
+            tmp[n].type        = type;
+            tmp[n].len         = info.len;
+            tmp[n].flash_addr  = info.flash_addr;
+            tmp[n].write_order = info.flash_addr;
+            n++;
+        }
+    }
+
+    /* 按写入顺序排序(最新在前) */
+    for (uint8_t i = 1; i < n; i++)
+    {
+        nkv_tlv_history_t t = tmp[i];
+        int8_t            j = i - 1;
+        while (j >= 0 && tmp[j].write_order < t.write_order)
+        {
+            tmp[j + 1] = tmp[j];
+            j--;
+        }
+        tmp[j + 1] = t;
+    }
+
+    uint8_t copy = (n < max) ? n : max;
+    for (uint8_t i = 0; i < copy; i++)
+        history[i] = tmp[i];
+    if (count)
+        *count = copy;
 
-    uint16_t crc = calc_crc16(buf + NKV_HEADER_SIZE, key_len + len);
-    memcpy(buf + NKV_HEADER_SIZE + key_len + len, &crc, 2);
+    return NKV_OK;
+}
 
-    uint32_t new_addr = SECTOR_ADDR(g_nkv.active_sector) + g_nkv.write_offset;
-    if (g_nkv.flash.write(new_addr, buf, entry_size) != 0)
+static nkv_err_t tlv_read_history_locked(nkv_instance_t* db, const nkv_tlv_history_t* entry, void* buf, uint8_t size)
+{
+    if (!entry || !buf || size == 0)
+        return NKV_ERR_INVALID;
+    uint8_t len = (entry->len < size) ? entry->len : size;
+    if (flash_read(db, entry->flash_addr, buf, len) != 0)
         return NKV_ERR_FLASH;
+    return NKV_OK;
+}
 
-    /* 5. 标记新键为 VALID */
-    update_entry_state(new_addr, NKV_STATE_VALID);
+/* TLV保留策略 */
+#if NKV_TLV_RETENTION_ENABLE
+static nkv_err_t tlv_set_retention_locked(nkv_instance_t* db, uint8_t type, uint16_t keep)
+{
+    if (type == 0)
+        return NKV_ERR_INVALID;
 
-    /* 6. 标记旧键为 DELETED */
-    if (is_update)
+    /* 查找并更新现有策略 */
+    for (uint8_t i = 0; i < db->tlv_retention_count; i++)
+    {
+        if (db->tlv_retention[i].type == type)
+        {
+            db->tlv_retention[i].keep_count = keep;
+            return NKV_OK;
+        }
+    }
+
+    /* 新增策略 */
+    if (db->tlv_retention_count >= NKV_TLV_RETENTION_MAX)
+        return NKV_ERR_INVALID;
+    db->tlv_retention[db->tlv_retention_count].type       = type;
+    db->tlv_retention[db->tlv_retention_count].keep_count = keep;
+    db->tlv_retention_count++;
+    return NKV_OK;
+}
+
+static void tlv_clear_retention_locked(nkv_instance_t* db, uint8_t type)
+{
+    for (uint8_t i = 0; i < db->tlv_retention_count; i++)
     {
-        update_entry_state(old_addr, NKV_STATE_DELETED);
+        if (db->tlv_retention[i].type == type)
+        {
+            for (uint8_t j = i; j < db->tlv_retention_count - 1; j++)
+                db->tlv_retention[j] = db->tlv_retention[j + 1];
+            db->tlv_retention_count--;
+            return;
+        }
     }
+}
+#endif
+
+/* ==================== 加锁接口 ==================== */
+/* 修改实例状态的操作在写区间内执行，其余操作仅持锁；nkv_get_ex 优先无锁读取缓存 */
+nkv_err_t nkv_get_ex(nkv_instance_t* db, const char* key, void* buf, uint8_t size, uint8_t* out_len)
+{
+#if NKV_THREAD_SAFE && SEQ_LOCKFREE && NKV_CACHE_ENABLE
+    nkv_err_t err;
+    if (db && db->initialized && key && buf && get_lockfree(db, key, buf, size, out_len, &err))
+        return err;
+#endif
+    WRITE_BEGIN(db);
+    nkv_err_t ret = get_locked(db, key, buf, size, out_len);
+    WRITE_END(db);
+    return ret;
+}
+
+uint8_t nkv_is_sector_valid_ex(nkv_instance_t* db, uint8_t idx)
+{
+    READ_BEGIN(db);
+    uint8_t ret = is_sector_valid_locked(db, idx);
+    READ_END(db);
+    return ret;
+}
+
+nkv_err_t nkv_scan_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+#if NKV_OP_STATS
+    uint32_t start = db->flash.clock_us ? db->flash.clock_us() : 0;
+#endif
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : scan_locked(db);
+#if NKV_OP_STATS
+    if (db->flash.clock_us)
+        db->op_stats.scan_us = db->flash.clock_us() - start;
+#endif
+    WRITE_END(db);
+    return err;
+}
+
+nkv_err_t nkv_scan_legacy_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+#if NKV_OP_STATS
+    uint32_t start = db->flash.clock_us ? db->flash.clock_us() : 0;
+#endif
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : scan_legacy_locked(db);
+#if NKV_OP_STATS
+    if (db->flash.clock_us)
+        db->op_stats.scan_us = db->flash.clock_us() - start;
+#endif
+    WRITE_END(db);
+    return err;
+}
+
+nkv_err_t nkv_format_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : format_locked(db);
+    WRITE_END(db);
+    return err;
+}
+
+nkv_err_t nkv_set_ex(nkv_instance_t* db, const char* key, const void* value, uint8_t len)
+{
+    WRITE_BEGIN(db);
+#if NKV_LATENCY_STATS
+    nkv_clock_fn clock = db ? db->flash.clock_us : NULL;
+    uint32_t     start = clock ? clock() : 0;
+#endif
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : set_locked(db, key, value, len);
+#if NKV_LATENCY_STATS
+    if (clock)
+        latency_note(&db->set_latency, clock() - start);
+#endif
+    WRITE_END(db);
+    return err;
+}
+
+nkv_err_t nkv_del_ex(nkv_instance_t* db, const char* key)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : del_locked(db, key);
+    WRITE_END(db);
+    return err;
+}
+
+nkv_err_t nkv_set_batch_ex(nkv_instance_t* db, const nkv_batch_item_t* items, uint8_t count)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : set_batch_locked(db, items, count);
+    WRITE_END(db);
+    return err;
+}
+
+uint8_t nkv_exists_ex(nkv_instance_t* db, const char* key)
+{
+    READ_BEGIN(db);
+    uint8_t ret = exists_locked(db, key);
+    READ_END(db);
+    return ret;
+}
+
+void nkv_get_usage_ex(nkv_instance_t* db, uint32_t* used, uint32_t* total)
+{
+    READ_BEGIN(db);
+    get_usage_locked(db, used, total);
+    READ_END(db);
+}
+
+#if NKV_INCREMENTAL_GC
+uint8_t nkv_gc_step_ex(nkv_instance_t* db, uint8_t steps)
+{
+    WRITE_BEGIN(db);
+    uint8_t ret = ASYNC_BUSY(db) ? 0 : gc_step_locked(db, steps);
+    WRITE_END(db);
+    return ret;
+}
+
+uint8_t nkv_gc_active_ex(nkv_instance_t* db)
+{
+    READ_BEGIN(db);
+    uint8_t ret = gc_active_locked(db);
+    READ_END(db);
+    return ret;
+}
+#endif
+
+#if NKV_BACKGROUND_GC
+uint8_t nkv_background_ex(nkv_instance_t* db, const nkv_budget_t* budget)
+{
+    WRITE_BEGIN(db);
+    uint8_t ret = ASYNC_BUSY(db) ? 1 : background_locked(db, budget);
+    WRITE_END(db);
+    return ret;
+}
+#endif
+
+#if NKV_ASYNC_FLASH
+nkv_err_t nkv_set_async_ex(nkv_instance_t* db, const char* key, const void* value, uint8_t len, nkv_async_fn done,
+                           void* ctx)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : set_async_locked(db, key, value, len, done, ctx);
+    WRITE_END(db);
+    return err;
+}
+
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+nkv_err_t nkv_gc_async_ex(nkv_instance_t* db, nkv_async_fn done, void* ctx)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : gc_async_locked(db, done, ctx);
+    WRITE_END(db);
+    return err;
+}
+    #endif
+
+uint8_t nkv_async_poll_ex(nkv_instance_t* db)
+{
+    nkv_async_fn done = NULL;
+    void*        ctx  = NULL;
+    nkv_err_t    err  = NKV_OK;
+
+    WRITE_BEGIN(db);
+    uint8_t ret = async_poll_locked(db, &done, &ctx, &err);
+    WRITE_END(db);
+    /* 回调在锁外调用，可在其中提交下一个异步操作 */
+    if (done)
+        done(ctx, err);
+    return ret;
+}
+#endif
+
+#if NKV_LATENCY_STATS
+void nkv_latency_stats_ex(nkv_instance_t* db, nkv_latency_t* stats)
+{
+    if (!db || !stats)
+        return;
+    READ_BEGIN(db);
+    *stats = db->set_latency;
+    READ_END(db);
+}
+
+void nkv_latency_reset_ex(nkv_instance_t* db)
+{
+    if (!db)
+        return;
+    WRITE_BEGIN(db);
+    memset(&db->set_latency, 0, sizeof(db->set_latency));
+    WRITE_END(db);
+}
+#endif
+
+void nkv_gc_stats_ex(nkv_instance_t* db, nkv_gc_stats_t* stats)
+{
+    READ_BEGIN(db);
+    gc_stats_locked(db, stats);
+    READ_END(db);
+}
 
-    g_nkv.write_offset += entry_size;
+void nkv_gc_stats_reset_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+    gc_stats_reset_locked(db);
+    WRITE_END(db);
+}
 
-#if NKV_CACHE_ENABLE
-    if (len > 0)
-        cache_update(key, value, len);
-    else
-        cache_remove(key);
-#endif
+nkv_err_t nkv_gc_set_policy_ex(nkv_instance_t* db, uint8_t policy)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = gc_set_policy_locked(db, policy);
+    WRITE_END(db);
+    return err;
+}
 
-#if NKV_INCREMENTAL_GC
-    do_incremental_gc();
-#endif
+void nkv_wear_stats_ex(nkv_instance_t* db, nkv_wear_t* stats)
+{
+    READ_BEGIN(db);
+    wear_stats_locked(db, stats);
+    READ_END(db);
+}
 
-    return NKV_OK;
+uint32_t nkv_sector_erase_count_ex(nkv_instance_t* db, uint8_t idx)
+{
+    if (!db || idx >= db->flash.sector_count)
+        return 0;
+    READ_BEGIN(db);
+    uint32_t n = db->sectors[idx].erase_count;
+    READ_END(db);
+    return n;
 }
 
-nkv_err_t nkv_get(const char* key, void* buf, uint8_t size, uint8_t* out_len)
+#if NKV_OP_STATS
+void nkv_op_stats_ex(nkv_instance_t* db, nkv_op_stats_t* stats)
 {
-    if (!g_nkv.initialized || !key || !buf)
-        return NKV_ERR_INVALID;
+    READ_BEGIN(db);
+    op_stats_locked(db, stats);
+    READ_END(db);
+}
+
+void nkv_op_stats_reset_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+    op_stats_reset_locked(db);
+    WRITE_END(db);
+}
+#endif
 
 #if NKV_CACHE_ENABLE
-    nkv_cache_entry_t* cached = cache_find(key);
-    if (cached)
-    {
-        uint8_t len = (cached->val_len < size) ? cached->val_len : size;
-        memcpy(buf, cached->value, len);
-        if (out_len)
-            *out_len = len;
-        return NKV_OK;
-    }
+void nkv_cache_stats_ex(nkv_instance_t* db, nkv_cache_stats_t* stats)
+{
+    READ_BEGIN(db);
+    cache_stats_locked(db, stats);
+    READ_END(db);
+}
+
+void nkv_cache_clear_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+    cache_clear_locked(db);
+    WRITE_END(db);
+}
 #endif
 
-    nkv_entry_t entry;
-    uint32_t    addr = find_key(key, &entry);
-    if (addr == 0 || entry.val_len == 0)
-        return NKV_ERR_NOT_FOUND;
+#if NKV_BLOOM_ENABLE
+void nkv_bloom_stats_ex(nkv_instance_t* db, nkv_bloom_stats_t* stats)
+{
+    READ_BEGIN(db);
+    bloom_stats_locked(db, stats);
+    READ_END(db);
+}
+#endif
 
-#if NKV_VERIFY_ON_READ
-    /* CRC 校验：读取完整的 Key+Value 并验证 */
-    {
-        static uint8_t verify_buf[NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN];
-        uint16_t       data_len = entry.key_len + entry.val_len;
-        uint16_t       stored_crc, calc_crc;
+nkv_err_t nkv_set_defaults_ex(nkv_instance_t* db, const nkv_default_t* defs, uint16_t count)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : NKV_OK;
+    if (err == NKV_OK)
+        set_defaults_locked(db, defs, count);
+    WRITE_END(db);
+    return err;
+}
 
-        if (g_nkv.flash.read(addr + NKV_HEADER_SIZE, verify_buf, data_len) != 0)
-            return NKV_ERR_FLASH;
-        if (g_nkv.flash.read(addr + NKV_HEADER_SIZE + data_len, (uint8_t*) &stored_crc, NKV_CRC_SIZE) != 0)
-            return NKV_ERR_FLASH;
+const nkv_default_t* nkv_find_default_ex(nkv_instance_t* db, const char* key)
+{
+    READ_BEGIN(db);
+    const nkv_default_t* def = find_default_locked(db, key);
+    READ_END(db);
+    return def;
+}
 
-        calc_crc = calc_crc16(verify_buf, data_len);
-        if (calc_crc != stored_crc)
-            return NKV_ERR_CRC;
+nkv_err_t nkv_get_default_ex(nkv_instance_t* db, const char* key, void* buf, uint8_t size, uint8_t* out_len)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = get_default_locked(db, key, buf, size, out_len);
+    WRITE_END(db);
+    return err;
+}
 
-        /* CRC 通过，从 verify_buf 中复制值 */
-        uint8_t len = (entry.val_len < size) ? entry.val_len : size;
-        memcpy(buf, verify_buf + entry.key_len, len);
-        if (out_len)
-            *out_len = len;
-    }
-#else
-    uint8_t len = (entry.val_len < size) ? entry.val_len : size;
-    if (g_nkv.flash.read(addr + NKV_HEADER_SIZE + entry.key_len, buf, len) != 0)
-        return NKV_ERR_FLASH;
-    if (out_len)
-        *out_len = len;
-#endif
+nkv_err_t nkv_reset_key_ex(nkv_instance_t* db, const char* key)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : reset_key_locked(db, key);
+    WRITE_END(db);
+    return err;
+}
 
-#if NKV_CACHE_ENABLE
-    cache_update(key, buf, (entry.val_len < size) ? entry.val_len : size);
-#endif
+nkv_err_t nkv_reset_all_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : reset_all_locked(db);
+    WRITE_END(db);
+    return err;
+}
 
-    return NKV_OK;
+#if NKV_LARGE_VALUE
+nkv_err_t nkv_set_stream_ex(nkv_instance_t* db, const char* key, uint32_t total, nkv_stream_fn read, void* ctx)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : set_stream_locked(db, key, total, read, ctx);
+    WRITE_END(db);
+    return err;
 }
 
-nkv_err_t nkv_del(const char* key)
+nkv_err_t nkv_get_stream_ex(nkv_instance_t* db, const char* key, nkv_stream_fn write, void* ctx, uint32_t* out_len)
 {
-#if NKV_CACHE_ENABLE
-    cache_remove(key);
+    READ_BEGIN(db);
+    nkv_err_t err = get_stream_locked(db, key, write, ctx, out_len);
+    READ_END(db);
+    return err;
+}
 #endif
-    return nkv_set(key, NULL, 0);
+
+#if NKV_ZERO_COPY
+nkv_err_t nkv_get_ref_ex(nkv_instance_t* db, const char* key, nkv_ref_t* ref)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : get_ref_locked(db, key, ref);
+    WRITE_END(db);
+    return err;
 }
 
-uint8_t nkv_exists(const char* key)
+uint8_t nkv_ref_valid_ex(nkv_instance_t* db, const nkv_ref_t* ref)
 {
-    if (!g_nkv.initialized || !key)
+    if (!db || !ref || !ref->data)
         return 0;
-    nkv_entry_t entry;
-    uint32_t    addr = find_key(key, &entry);
-    return (addr != 0 && entry.val_len > 0);
+    READ_BEGIN(db);
+    uint8_t valid = (ref->epoch == db->map_epoch);
+    READ_END(db);
+    return valid;
 }
+#endif
 
-void nkv_get_usage(uint32_t* used, uint32_t* total)
+#if NKV_WRITE_BUFFER
+nkv_err_t nkv_wbuf_enable_ex(nkv_instance_t* db, uint8_t enable)
 {
-    if (used)
-        *used = g_nkv.write_offset;
-    if (total)
-        *total = g_nkv.flash.sector_size * g_nkv.flash.sector_count;
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : wbuf_enable_locked(db, enable);
+    WRITE_END(db);
+    return err;
 }
 
-#if NKV_INCREMENTAL_GC
-uint8_t nkv_gc_step(uint8_t steps)
+nkv_err_t nkv_flush_ex(nkv_instance_t* db)
 {
-    if (!g_nkv.initialized)
-        return 0;
-    if (!g_nkv.gc_active && should_start_gc())
-        start_incremental_gc();
-    if (!g_nkv.gc_active)
-        return 0;
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : flush_locked(db);
+    WRITE_END(db);
+    return err;
+}
 
-    for (uint8_t i = 0; i < steps; i++)
-        if (!incremental_gc_step())
-            return 0;
-    return 1;
+nkv_err_t nkv_wbuf_tick_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : wbuf_tick_locked(db);
+    WRITE_END(db);
+    return err;
 }
 
-uint8_t nkv_gc_active(void)
+uint8_t nkv_wbuf_pending_ex(nkv_instance_t* db)
 {
-    return g_nkv.gc_active;
+    READ_BEGIN(db);
+    uint8_t count = db ? db->wbuf.count : 0;
+    READ_END(db);
+    return count;
 }
 #endif
 
-#if NKV_CACHE_ENABLE
-void nkv_cache_stats(nkv_cache_stats_t* stats)
+nkv_err_t nkv_tlv_set_ex(nkv_instance_t* db, uint8_t type, const void* value, uint8_t len)
 {
-    if (!stats)
-        return;
-    stats->hit_count  = g_nkv.cache.hit_count;
-    stats->miss_count = g_nkv.cache.miss_count;
-    uint32_t total    = stats->hit_count + stats->miss_count;
-    stats->hit_rate   = (total > 0) ? ((float) stats->hit_count / total * 100.0f) : 0.0f;
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : tlv_set_locked(db, type, value, len);
+    WRITE_END(db);
+    return err;
 }
 
-void nkv_cache_clear(void)
+nkv_err_t nkv_tlv_get_ex(nkv_instance_t* db, uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
 {
-    memset(&g_nkv.cache, 0, sizeof(g_nkv.cache));
+    READ_BEGIN(db);
+    nkv_err_t err = tlv_get_locked(db, type, buf, size, out_len);
+    READ_END(db);
+    return err;
 }
-#endif
 
-/* ==================== 默认值同步 ==================== */
+nkv_err_t nkv_tlv_del_ex(nkv_instance_t* db, uint8_t type)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : tlv_del_locked(db, type);
+    WRITE_END(db);
+    return err;
+}
 
-static void nkv_sync_version(void)
+uint8_t nkv_tlv_exists_ex(nkv_instance_t* db, uint8_t type)
 {
-    if (!g_nkv.initialized)
-        return;
+    READ_BEGIN(db);
+    uint8_t ret = tlv_exists_locked(db, type);
+    READ_END(db);
+    return ret;
+}
 
-    uint32_t  saved_ver = 0;
-    nkv_err_t err       = nkv_get(NKV_VER_KEY, &saved_ver, sizeof(saved_ver), NULL);
+nkv_err_t nkv_tlv_set_defaults_ex(nkv_instance_t* db, const nkv_tlv_default_t* defs, uint16_t count)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : NKV_OK;
+    if (err == NKV_OK)
+        tlv_set_defaults_locked(db, defs, count);
+    WRITE_END(db);
+    return err;
+}
 
-    if (err != NKV_OK || saved_ver != NKV_SETTING_VER)
-    {
-        NKV_LOG_I("Config version changed: %d -> %d, syncing defaults...", (int) saved_ver, NKV_SETTING_VER);
+nkv_err_t nkv_tlv_get_default_ex(nkv_instance_t* db, uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
+{
+    READ_BEGIN(db);
+    nkv_err_t err = tlv_get_default_locked(db, type, buf, size, out_len);
+    READ_END(db);
+    return err;
+}
 
-        /* 同步 KV 默认值 */
-        if (g_nkv.defaults)
-        {
-            for (uint16_t i = 0; i < g_nkv.default_count; i++)
-            {
-                if (g_nkv.defaults[i].key && !nkv_exists(g_nkv.defaults[i].key))
-                {
-                    nkv_set(g_nkv.defaults[i].key, g_nkv.defaults[i].value, g_nkv.defaults[i].len);
-                }
-            }
-        }
+nkv_err_t nkv_tlv_reset_type_ex(nkv_instance_t* db, uint8_t type)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : tlv_reset_type_locked(db, type);
+    WRITE_END(db);
+    return err;
+}
 
-        /* 同步 TLV 默认值 */
-        if (g_tlv_defaults)
-        {
-            for (uint16_t i = 0; i < g_tlv_default_count; i++)
-            {
-                if (g_tlv_defaults[i].type != 0 && !nkv_tlv_exists(g_tlv_defaults[i].type))
-                {
-                    nkv_tlv_set(g_tlv_defaults[i].type, g_tlv_defaults[i].value, g_tlv_defaults[i].len);
-                }
-            }
-        }
+nkv_err_t nkv_tlv_reset_all_ex(nkv_instance_t* db)
+{
+    WRITE_BEGIN(db);
+    nkv_err_t err = ASYNC_BUSY(db) ? NKV_ERR_BUSY : tlv_reset_all_locked(db);
+    WRITE_END(db);
+    return err;
+}
 
-        uint32_t new_ver = NKV_SETTING_VER;
-        nkv_set(NKV_VER_KEY, &new_ver, sizeof(new_ver));
-    }
+void nkv_tlv_iter_init_ex(nkv_instance_t* db, nkv_tlv_iter_t* iter)
+{
+    READ_BEGIN(db);
+    tlv_iter_init_locked(db, iter);
+    READ_END(db);
 }
 
-/* ==================== 默认值API ==================== */
+nkv_err_t nkv_tlv_iter_read_ex(nkv_instance_t* db, const nkv_tlv_entry_t* info, void* buf, uint8_t size)
+{
+    READ_BEGIN(db);
+    nkv_err_t err = tlv_iter_read_locked(db, info, buf, size);
+    READ_END(db);
+    return err;
+}
 
-void nkv_set_defaults(const nkv_default_t* defs, uint16_t count)
+void nkv_tlv_stats_ex(nkv_instance_t* db, uint16_t* count, uint32_t* used)
 {
-    g_nkv.defaults      = defs;
-    g_nkv.default_count = count;
+    READ_BEGIN(db);
+    tlv_stats_locked(db, count, used);
+    READ_END(db);
+}
 
-    nkv_sync_version();
+uint8_t nkv_tlv_has_data_ex(nkv_instance_t* db)
+{
+    READ_BEGIN(db);
+    uint8_t ret = tlv_has_data_locked(db);
+    READ_END(db);
+    return ret;
 }
 
-const nkv_default_t* nkv_find_default(const char* key)
+nkv_err_t nkv_tlv_get_history_ex(nkv_instance_t* db, uint8_t type, nkv_tlv_history_t* history, uint8_t max, uint8_t* count)
 {
-    if (!key || !g_nkv.defaults)
-        return NULL;
-    uint8_t klen = strlen(key);
+    READ_BEGIN(db);
+    nkv_err_t err = tlv_get_history_locked(db, type, history, max, count);
+    READ_END(db);
+    return err;
+}
 
-    for (uint16_t i = 0; i < g_nkv.default_count; i++)
-    {
-        const nkv_default_t* d = &g_nkv.defaults[i];
-        if (d->key && strlen(d->key) == klen && memcmp(d->key, key, klen) == 0)
-            return d;
-    }
-    return NULL;
+nkv_err_t nkv_tlv_read_history_ex(nkv_instance_t* db, const nkv_tlv_history_t* entry, void* buf, uint8_t size)
+{
+    READ_BEGIN(db);
+    nkv_err_t err = tlv_read_history_locked(db, entry, buf, size);
+    READ_END(db);
+    return err;
 }
 
-nkv_err_t nkv_get_default(const char* key, void* buf, uint8_t size, uint8_t* out_len)
+#if NKV_TLV_RETENTION_ENABLE
+nkv_err_t nkv_tlv_set_retention_ex(nkv_instance_t* db, uint8_t type, uint16_t keep)
 {
-    if (!key || !buf)
-        return NKV_ERR_INVALID;
+    WRITE_BEGIN(db);
+    nkv_err_t err = tlv_set_retention_locked(db, type, keep);
+    WRITE_END(db);
+    return err;
+}
 
-    if (nkv_get(key, buf, size, out_len) == NKV_OK)
-        return NKV_OK;
+void nkv_tlv_clear_retention_ex(nkv_instance_t* db, uint8_t type)
+{
+    WRITE_BEGIN(db);
+    tlv_clear_retention_locked(db, type);
+    WRITE_END(db);
+}
+#endif
 
-    const nkv_default_t* def = nkv_find_default(key);
-    if (def)
-    {
-        uint8_t len = (def->len < size) ? def->len : size;
-        memcpy(buf, def->value, len);
-        if (out_len)
-            *out_len = len;
-        return NKV_OK;
-    }
-    return NKV_ERR_NOT_FOUND;
+uint8_t nkv_tlv_iter_next(nkv_tlv_iter_t* iter, nkv_tlv_entry_t* info)
+{
+    if (!iter)
+        return 0;
+    READ_BEGIN(iter->db);
+    uint8_t ret = tlv_iter_next_locked(iter, info);
+    READ_END(iter->db);
+    return ret;
 }
 
-nkv_err_t nkv_reset_key(const char* key)
+/* ==================== 默认实例接口 ==================== */
+/* 单实例API：作用于内部默认实例，与多实例接口共用同一实现 */
+uint8_t nkv_is_sector_valid(uint8_t idx)
 {
-    if (!key)
-        return NKV_ERR_INVALID;
-    const nkv_default_t* def = nkv_find_default(key);
-    if (!def)
-        return NKV_ERR_NOT_FOUND;
-    return nkv_set(key, def->value, def->len);
+    return nkv_is_sector_valid_ex(&g_nkv, idx);
 }
 
-nkv_err_t nkv_reset_all(void)
+nkv_err_t nkv_internal_init(const nkv_flash_ops_t* ops)
 {
-    if (!g_nkv.defaults)
-        return NKV_ERR_INVALID;
+    return nkv_internal_init_ex(&g_nkv, ops);
+}
 
-    for (uint16_t i = 0; i < g_nkv.default_count; i++)
-    {
-        const nkv_default_t* d = &g_nkv.defaults[i];
-        if (d->key && d->value && d->len > 0)
-        {
-            nkv_err_t err = nkv_set(d->key, d->value, d->len);
-            if (err != NKV_OK)
-                return err;
-        }
-    }
-    return NKV_OK;
+nkv_err_t nkv_scan(void)
+{
+    return nkv_scan_ex(&g_nkv);
 }
 
-nkv_instance_t* nkv_get_instance(void)
+nkv_err_t nkv_scan_legacy(void)
 {
-    return &g_nkv;
+    return nkv_scan_legacy_ex(&g_nkv);
 }
 
-/* ==================== TLV实现 ==================== */
+nkv_err_t nkv_format(void)
+{
+    return nkv_format_ex(&g_nkv);
+}
 
-/* 在扇区中查找TLV类型 */
-static uint32_t find_tlv_in_sector(uint8_t idx, uint8_t type, nkv_entry_t* out)
+nkv_err_t nkv_set(const char* key, const void* value, uint8_t len)
 {
-    tlv_match_ctx_t ctx = {.type = type};
-    return find_in_sector(idx, tlv_matcher, &ctx, out);
+    return nkv_set_ex(&g_nkv, key, value, len);
 }
 
-/* 在所有扇区中查找TLV类型 */
-static uint32_t find_tlv(uint8_t type, nkv_entry_t* out)
+nkv_err_t nkv_get(const char* key, void* buf, uint8_t size, uint8_t* out_len)
 {
-    for (uint8_t i = 0; i < g_nkv.flash.sector_count; i++)
-    {
-        uint8_t idx = PREV_SECTOR(g_nkv.active_sector, i);
-        if (!nkv_is_sector_valid(idx))
-            continue;
-        uint32_t addr = find_tlv_in_sector(idx, type, out);
-        if (addr != 0)
-            return addr;
-    }
-    return 0;
+    return nkv_get_ex(&g_nkv, key, buf, size, out_len);
 }
 
-/**
- * @brief 内部函数：追加写入条目（不查找旧条目）
- * @param key 键名
- * @param value 值
- * @param len 值长度
- * @return 错误码
- */
-static nkv_err_t nkv_append_entry(const char* key, const void* value, uint8_t len)
+nkv_err_t nkv_del(const char* key)
 {
-    if (!g_nkv.initialized || !key || len > NKV_MAX_VALUE_LEN)
-        return NKV_ERR_INVALID;
-    if (len > 0 && !value)
-        return NKV_ERR_INVALID;
+    return nkv_del_ex(&g_nkv, key);
+}
 
-    uint8_t key_len = strlen(key);
-    if (key_len >= NKV_MAX_KEY_LEN)
-        return NKV_ERR_INVALID;
+nkv_err_t nkv_set_batch(const nkv_batch_item_t* items, uint8_t count)
+{
+    return nkv_set_batch_ex(&g_nkv, items, count);
+}
 
-    uint32_t entry_size = ALIGN(NKV_HEADER_SIZE + key_len + len + NKV_CRC_SIZE);
-    NKV_ASSERT(entry_size <= g_nkv.flash.sector_size - ALIGNED_HDR_SIZE && "entry_size exceeds sector capacity");
+uint8_t nkv_exists(const char* key)
+{
+    return nkv_exists_ex(&g_nkv, key);
+}
 
-    if (g_nkv.write_offset + entry_size > g_nkv.flash.sector_size)
-    {
-        int8_t free_idx = find_free_sector();
-        if (free_idx >= 0)
-        {
-            nkv_err_t err = switch_to_sector((uint8_t) free_idx);
-            if (err != NKV_OK)
-                return err;
-        }
-        else
-        {
-            nkv_err_t err = do_compact();
-            if (err != NKV_OK)
-                return err;
-        }
-        if (g_nkv.write_offset + entry_size > g_nkv.flash.sector_size)
-            return NKV_ERR_NO_SPACE;
-    }
+void nkv_get_usage(uint32_t* used, uint32_t* total)
+{
+    nkv_get_usage_ex(&g_nkv, used, total);
+}
 
-    static uint8_t buf[MAX_ENTRY_SIZE];
-    nkv_entry_t*   entry = (nkv_entry_t*) buf;
+#if NKV_INCREMENTAL_GC
+uint8_t nkv_gc_step(uint8_t steps)
+{
+    return nkv_gc_step_ex(&g_nkv, steps);
+}
 
-    memset(buf, 0xFF, entry_size);
-    entry->state    = NKV_STATE_WRITING;
-    entry->key_len  = key_len;
-    entry->val_len  = len;
-    entry->key_hash = hash_key(key, key_len); /* 存储键哈希 */
-    entry->reserved = 0xFF;
+uint8_t nkv_gc_active(void)
+{
+    return nkv_gc_active_ex(&g_nkv);
+}
+#endif
+
+#if NKV_BACKGROUND_GC
+uint8_t nkv_background(const nkv_budget_t* budget)
+{
+    return nkv_background_ex(&g_nkv, budget);
+}
+#endif
 
-    memcpy(buf + NKV_HEADER_SIZE, key, key_len);
-    memcpy(buf + NKV_HEADER_SIZE + key_len, value, len);
+#if NKV_ASYNC_FLASH
+nkv_err_t nkv_set_async(const char* key, const void* value, uint8_t len, nkv_async_fn done, void* ctx)
+{
+    return nkv_set_async_ex(&g_nkv, key, value, len, done, ctx);
+}
 
-    uint16_t crc = calc_crc16(buf + NKV_HEADER_SIZE, key_len + len);
-    memcpy(buf + NKV_HEADER_SIZE + key_len + len, &crc, 2);
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+nkv_err_t nkv_gc_async(nkv_async_fn done, void* ctx)
+{
+    return nkv_gc_async_ex(&g_nkv, done, ctx);
+}
+    #endif
 
-    uint32_t new_addr = SECTOR_ADDR(g_nkv.active_sector) + g_nkv.write_offset;
-    if (g_nkv.flash.write(new_addr, buf, entry_size) != 0)
-        return NKV_ERR_FLASH;
+uint8_t nkv_async_poll(void)
+{
+    return nkv_async_poll_ex(&g_nkv);
+}
+#endif
 
-    update_entry_state(new_addr, NKV_STATE_VALID);
-    g_nkv.write_offset += entry_size;
+#if NKV_LATENCY_STATS
+void nkv_latency_stats(nkv_latency_t* stats)
+{
+    nkv_latency_stats_ex(&g_nkv, stats);
+}
 
-#if NKV_INCREMENTAL_GC
-    do_incremental_gc();
+void nkv_latency_reset(void)
+{
+    nkv_latency_reset_ex(&g_nkv);
+}
 #endif
 
-    return NKV_OK;
+void nkv_gc_stats(nkv_gc_stats_t* stats)
+{
+    nkv_gc_stats_ex(&g_nkv, stats);
 }
 
-nkv_err_t nkv_tlv_set(uint8_t type, const void* value, uint8_t len)
+void nkv_gc_stats_reset(void)
 {
-    if (type == 0 || !value || len == 0 || len > 254)
-        return NKV_ERR_INVALID;
+    nkv_gc_stats_reset_ex(&g_nkv);
+}
 
-    /* 先查找并删除相同类型的旧 TLV */
-    nkv_entry_t old_entry;
-    uint32_t    old_addr = find_tlv(type, &old_entry);
-    if (old_addr != 0 && old_entry.val_len > 1)
-    {
-        update_entry_state(old_addr, NKV_STATE_DELETED);
-    }
+nkv_err_t nkv_gc_set_policy(uint8_t policy)
+{
+    return nkv_gc_set_policy_ex(&g_nkv, policy);
+}
 
-    /* 追加写入新 TLV */
-    uint8_t data[256];
-    data[0] = type;
-    memcpy(data + 1, value, len);
-    return nkv_append_entry("", data, len + 1);
+void nkv_wear_stats(nkv_wear_t* stats)
+{
+    nkv_wear_stats_ex(&g_nkv, stats);
 }
 
-nkv_err_t nkv_tlv_get(uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
+uint32_t nkv_sector_erase_count(uint8_t idx)
 {
-    if (type == 0 || !buf || size == 0)
-        return NKV_ERR_INVALID;
+    return nkv_sector_erase_count_ex(&g_nkv, idx);
+}
 
-    nkv_entry_t entry;
-    uint32_t    addr = find_tlv(type, &entry);
-    if (addr == 0 || entry.val_len <= 1)
-        return NKV_ERR_NOT_FOUND;
+#if NKV_OP_STATS
+void nkv_op_stats(nkv_op_stats_t* stats)
+{
+    nkv_op_stats_ex(&g_nkv, stats);
+}
 
-    uint8_t len      = entry.val_len - 1;
-    uint8_t read_len = (len < size) ? len : size;
+void nkv_op_stats_reset(void)
+{
+    nkv_op_stats_reset_ex(&g_nkv);
+}
+#endif
 
-    if (g_nkv.flash.read(addr + NKV_HEADER_SIZE + 1, buf, read_len) != 0)
-        return NKV_ERR_FLASH;
+#if NKV_CACHE_ENABLE
+void nkv_cache_stats(nkv_cache_stats_t* stats)
+{
+    nkv_cache_stats_ex(&g_nkv, stats);
+}
 
-    if (out_len)
-        *out_len = read_len;
-    return NKV_OK;
+void nkv_cache_clear(void)
+{
+    nkv_cache_clear_ex(&g_nkv);
 }
+#endif
 
-nkv_err_t nkv_tlv_del(uint8_t type)
+#if NKV_BLOOM_ENABLE
+void nkv_bloom_stats(nkv_bloom_stats_t* stats)
 {
-    if (type == 0)
-        return NKV_ERR_INVALID;
+    nkv_bloom_stats_ex(&g_nkv, stats);
+}
+#endif
 
-    /* 查找并删除相同类型的 TLV */
-    nkv_entry_t old_entry;
-    uint32_t    old_addr = find_tlv(type, &old_entry);
-    if (old_addr != 0 && old_entry.val_len > 1)
-    {
-        update_entry_state(old_addr, NKV_STATE_DELETED);
-        return NKV_OK;
-    }
-    return NKV_ERR_NOT_FOUND;
+#if NKV_LARGE_VALUE
+nkv_err_t nkv_set_stream(const char* key, uint32_t total, nkv_stream_fn read, void* ctx)
+{
+    return nkv_set_stream_ex(&g_nkv, key, total, read, ctx);
 }
 
-uint8_t nkv_tlv_exists(uint8_t type)
+nkv_err_t nkv_get_stream(const char* key, nkv_stream_fn write, void* ctx, uint32_t* out_len)
 {
-    if (type == 0)
-        return 0;
-    nkv_entry_t entry;
-    uint32_t    addr = find_tlv(type, &entry);
-    return (addr != 0 && entry.val_len > 1);
+    return nkv_get_stream_ex(&g_nkv, key, write, ctx, out_len);
 }
+#endif
 
-/* TLV默认值 */
-void nkv_tlv_set_defaults(const nkv_tlv_default_t* defs, uint16_t count)
+#if NKV_ZERO_COPY
+nkv_err_t nkv_get_ref(const char* key, nkv_ref_t* ref)
 {
-    g_tlv_defaults      = defs;
-    g_tlv_default_count = count;
+    return nkv_get_ref_ex(&g_nkv, key, ref);
+}
 
-    nkv_sync_version();
+uint8_t nkv_ref_valid(const nkv_ref_t* ref)
+{
+    return nkv_ref_valid_ex(&g_nkv, ref);
 }
+#endif
 
-static const nkv_tlv_default_t* find_tlv_default(uint8_t type)
+#if NKV_WRITE_BUFFER
+nkv_err_t nkv_wbuf_enable(uint8_t enable)
 {
-    if (!g_tlv_defaults)
-        return NULL;
-    for (uint16_t i = 0; i < g_tlv_default_count; i++)
-        if (g_tlv_defaults[i].type == type)
-            return &g_tlv_defaults[i];
-    return NULL;
+    return nkv_wbuf_enable_ex(&g_nkv, enable);
 }
 
-nkv_err_t nkv_tlv_get_default(uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
+nkv_err_t nkv_flush(void)
 {
-    if (nkv_tlv_get(type, buf, size, out_len) == NKV_OK)
-        return NKV_OK;
+    return nkv_flush_ex(&g_nkv);
+}
 
-    const nkv_tlv_default_t* def = find_tlv_default(type);
-    if (!def)
-        return NKV_ERR_NOT_FOUND;
+nkv_err_t nkv_wbuf_tick(void)
+{
+    return nkv_wbuf_tick_ex(&g_nkv);
+}
 
-    uint8_t len = (def->len < size) ? def->len : size;
-    memcpy(buf, def->value, len);
-    if (out_len)
-        *out_len = len;
-    return NKV_OK;
+uint8_t nkv_wbuf_pending(void)
+{
+    return nkv_wbuf_pending_ex(&g_nkv);
 }
+#endif
 
-nkv_err_t nkv_tlv_reset_type(uint8_t type)
+nkv_err_t nkv_set_defaults(const nkv_default_t* defs, uint16_t count)
 {
-    const nkv_tlv_default_t* def = find_tlv_default(type);
-    if (!def)
-        return NKV_ERR_NOT_FOUND;
-    return nkv_tlv_set(type, def->value, def->len);
+    return nkv_set_defaults_ex(&g_nkv, defs, count);
 }
 
-nkv_err_t nkv_tlv_reset_all(void)
+const nkv_default_t* nkv_find_default(const char* key)
 {
-    if (!g_tlv_defaults)
-        return NKV_OK;
-    for (uint16_t i = 0; i < g_tlv_default_count; i++)
-    {
-        nkv_err_t err = nkv_tlv_set(g_tlv_defaults[i].type, g_tlv_defaults[i].value, g_tlv_defaults[i].len);
-        if (err != NKV_OK)
-            return err;
-    }
-    return NKV_OK;
+    return nkv_find_default_ex(&g_nkv, key);
 }
 
-/* TLV迭代器 */
-void nkv_tlv_iter_init(nkv_tlv_iter_t* iter)
+nkv_err_t nkv_get_default(const char* key, void* buf, uint8_t size, uint8_t* out_len)
 {
-    if (!iter)
-        return;
-    iter->sector_idx    = 0;
-    iter->sector_offset = ALIGNED_HDR_SIZE;
-    iter->finished      = 0;
+    return nkv_get_default_ex(&g_nkv, key, buf, size, out_len);
 }
 
-uint8_t nkv_tlv_iter_next(nkv_tlv_iter_t* iter, nkv_tlv_entry_t* info)
+nkv_err_t nkv_reset_key(const char* key)
 {
-    if (!iter || iter->finished || !info)
-        return 0;
+    return nkv_reset_key_ex(&g_nkv, key);
+}
 
-    while (iter->sector_idx < g_nkv.flash.sector_count)
-    {
-        if (!nkv_is_sector_valid(iter->sector_idx))
-        {
-            iter->sector_idx++;
-            iter->sector_offset = ALIGNED_HDR_SIZE;
-            continue;
-        }
+nkv_err_t nkv_reset_all(void)
+{
+    return nkv_reset_all_ex(&g_nkv);
+}
 
-        uint32_t sector = g_nkv.flash.base + iter->sector_idx * g_nkv.flash.sector_size;
+nkv_err_t nkv_tlv_set(uint8_t type, const void* value, uint8_t len)
+{
+    return nkv_tlv_set_ex(&g_nkv, type, value, len);
+}
 
-        while (iter->sector_offset <= g_nkv.flash.sector_size - ALIGN(NKV_HEADER_SIZE))
-        {
-            uint32_t    addr = sector + iter->sector_offset;
-            nkv_entry_t entry;
+nkv_err_t nkv_tlv_get(uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
+{
+    return nkv_tlv_get_ex(&g_nkv, type, buf, size, out_len);
+}
 
-            if (g_nkv.flash.read(addr, (uint8_t*) &entry, sizeof(nkv_entry_t)) != 0)
-                break;
-            if (entry.state == NKV_STATE_ERASED)
-                break;
+nkv_err_t nkv_tlv_del(uint8_t type)
+{
+    return nkv_tlv_del_ex(&g_nkv, type);
+}
 
-            iter->sector_offset += ENTRY_SIZE(entry);
+uint8_t nkv_tlv_exists(uint8_t type)
+{
+    return nkv_tlv_exists_ex(&g_nkv, type);
+}
 
-            if ((entry.state == NKV_STATE_VALID || entry.state == NKV_STATE_PRE_DEL) && entry.key_len == 0 &&
-                entry.val_len > 1)
-            {
-                uint8_t type;
-                if (g_nkv.flash.read(addr + NKV_HEADER_SIZE, &type, 1) == 0)
-                {
-                    info->type       = type;
-                    info->len        = entry.val_len - 1;
-                    info->flash_addr = addr + NKV_HEADER_SIZE + 1;
-                    return 1;
-                }
-            }
-        }
-        iter->sector_idx++;
-        iter->sector_offset = ALIGNED_HDR_SIZE;
-    }
+nkv_err_t nkv_tlv_set_defaults(const nkv_tlv_default_t* defs, uint16_t count)
+{
+    return nkv_tlv_set_defaults_ex(&g_nkv, defs, count);
+}
 
-    iter->finished = 1;
-    return 0;
+nkv_err_t nkv_tlv_get_default(uint8_t type, void* buf, uint8_t size, uint8_t* out_len)
+{
+    return nkv_tlv_get_default_ex(&g_nkv, type, buf, size, out_len);
 }
 
-nkv_err_t nkv_tlv_iter_read(const nkv_tlv_entry_t* info, void* buf, uint8_t size)
+nkv_err_t nkv_tlv_reset_type(uint8_t type)
 {
-    if (!info || !buf || size == 0)
-        return NKV_ERR_INVALID;
-    uint8_t len = (info->len < size) ? info->len : size;
-    if (g_nkv.flash.read(info->flash_addr, buf, len) != 0)
-        return NKV_ERR_FLASH;
-    return NKV_OK;
+    return nkv_tlv_reset_type_ex(&g_nkv, type);
 }
 
-/* TLV统计 */
-void nkv_tlv_stats(uint16_t* count, uint32_t* used)
+nkv_err_t nkv_tlv_reset_all(void)
 {
-    uint16_t c = 0;
-    uint32_t u = 0;
+    return nkv_tlv_reset_all_ex(&g_nkv);
+}
 
-    nkv_tlv_iter_t  iter;
-    nkv_tlv_entry_t info;
-    nkv_tlv_iter_init(&iter);
+void nkv_tlv_iter_init(nkv_tlv_iter_t* iter)
+{
+    nkv_tlv_iter_init_ex(&g_nkv, iter);
+}
 
-    while (nkv_tlv_iter_next(&iter, &info))
-    {
-        c++;
-        u += 7 + info.len; /* 头4B + 类型1B + 值NB + CRC2B */
-    }
+nkv_err_t nkv_tlv_iter_read(const nkv_tlv_entry_t* info, void* buf, uint8_t size)
+{
+    return nkv_tlv_iter_read_ex(&g_nkv, info, buf, size);
+}
 
-    if (count)
-        *count = c;
-    if (used)
-        *used = u;
+void nkv_tlv_stats(uint16_t* count, uint32_t* used)
+{
+    nkv_tlv_stats_ex(&g_nkv, count, used);
 }
 
 uint8_t nkv_tlv_has_data(void)
 {
-    nkv_tlv_iter_t  iter;
-    nkv_tlv_entry_t info;
-    nkv_tlv_iter_init(&iter);
-    return nkv_tlv_iter_next(&iter, &info);
+    return nkv_tlv_has_data_ex(&g_nkv);
 }
 
-/* TLV历史记录 */
 nkv_err_t nkv_tlv_get_history(uint8_t type, nkv_tlv_history_t* history, uint8_t max, uint8_t* count)
 {
-    if (type == 0 || !history || max == 0)
-        return NKV_ERR_INVALID;
-
-    nkv_tlv_history_t tmp[32];
-    uint8_t           n = 0;
-
-    nkv_tlv_iter_t  iter;
-    nkv_tlv_entry_t info;
-    nkv_tlv_iter_init(&iter);
-
-    while (nkv_tlv_iter_next(&iter, &info) && n < 32)
-    {
-        if (info.type == type)
-        {
-            tmp[n].type        = type;
-            tmp[n].len         = info.len;
-            tmp[n].flash_addr  = info.flash_addr;
-            tmp[n].write_order = info.flash_addr;
-            n++;
-        }
-    }
-
-    /* 按写入顺序排序(最新在前) */
-    for (uint8_t i = 1; i < n; i++)
-    {
-        nkv_tlv_history_t t = tmp[i];
-        int8_t            j = i - 1;
-        while (j >= 0 && tmp[j].write_order < t.write_order)
-        {
-            tmp[j + 1] = tmp[j];
-            j--;
-        }
-        tmp[j + 1] = t;
-    }
-
-    uint8_t copy = (n < max) ? n : max;
-    for (uint8_t i = 0; i < copy; i++)
-        history[i] = tmp[i];
-    if (count)
-        *count = copy;
-
-    return NKV_OK;
+    return nkv_tlv_get_history_ex(&g_nkv, type, history, max, count);
 }
 
 nkv_err_t nkv_tlv_read_history(const nkv_tlv_history_t* entry, void* buf, uint8_t size)
 {
-    if (!entry || !buf || size == 0)
-        return NKV_ERR_INVALID;
-    uint8_t len = (entry->len < size) ? entry->len : size;
-    if (g_nkv.flash.read(entry->flash_addr, buf, len) != 0)
-        return NKV_ERR_FLASH;
-    return NKV_OK;
+    return nkv_tlv_read_history_ex(&g_nkv, entry, buf, size);
 }
 
-/* TLV保留策略 */
 #if NKV_TLV_RETENTION_ENABLE
 nkv_err_t nkv_tlv_set_retention(uint8_t type, uint16_t keep)
 {
-    if (type == 0)
-        return NKV_ERR_INVALID;
-
-    /* 查找并更新现有策略 */
-    for (uint8_t i = 0; i < g_tlv_retention_count; i++)
-    {
-        if (g_tlv_retention[i].type == type)
-        {
-            g_tlv_retention[i].keep_count = keep;
-            return NKV_OK;
-        }
-    }
-
-    /* 新增策略 */
-    if (g_tlv_retention_count >= NKV_TLV_RETENTION_MAX)
-        return NKV_ERR_INVALID;
-    g_tlv_retention[g_tlv_retention_count].type       = type;
-    g_tlv_retention[g_tlv_retention_count].keep_count = keep;
-    g_tlv_retention_count++;
-    return NKV_OK;
+    return nkv_tlv_set_retention_ex(&g_nkv, type, keep);
 }
 
 void nkv_tlv_clear_retention(uint8_t type)
 {
-    for (uint8_t i = 0; i < g_tlv_retention_count; i++)
-    {
-        if (g_tlv_retention[i].type == type)
-        {
-            for (uint8_t j = i; j < g_tlv_retention_count - 1; j++)
-                g_tlv_retention[j] = g_tlv_retention[j + 1];
-            g_tlv_retention_count--;
-            return;
-        }
-    }
+    nkv_tlv_clear_retention_ex(&g_nkv, type);
 }
 #endif
+
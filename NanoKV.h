@@ -6,11 +6,15 @@
  *
  * @details 特性介绍：
  * - 追加写入：无需擦除即可更新，减少Flash磨损
- * - 多扇区环形：自动磨损均衡，充分利用存储空间
+ * - 多扇区环形：按擦除次数选择扇区并搬迁冷数据，磨损均衡，充分利用存储空间
  * - 掉电安全：状态机 + CRC校验保障数据完整性
- * - LFU缓存：加速热点数据访问，提升读取性能
+ * - 读缓存：哈希表 + 值内存池，LFU衰减或TinyLFU准入淘汰，提升热点数据读取性能
  * - 增量GC：分摊垃圾回收开销，适合实时系统
  * - 默认值支持：配置项可回退到预设值
+ * - 大值支持：超过255字节的值分块存储，流式读写
+ * - 零拷贝读取：可直接寻址的Flash返回值数据指针
+ * - 后台维护：空闲时按预算回收与预擦除，写入延迟更平稳
+ * - 异步Flash：DMA编程/擦除期间不阻塞调用者
  */
 
 #ifndef __NANOKV_H
@@ -31,7 +35,9 @@
 #endif
 
 /* ==================== 常量定义 ==================== */
-#define NKV_MAGIC           0x4B56 /* 扇区魔数 "KV" */
+#define NKV_MAGIC           0x4B58 /* 扇区魔数(格式3) */
+#define NKV_MAGIC_V2        0x4B57 /* 扇区魔数(格式2)，仍可挂载读写 */
+#define NKV_MAGIC_V1        0x4B56 /* 扇区魔数 "KV"(格式1)，仍可挂载读写 */
 #define NKV_STATE_ERASED    0xFFFF /* 已擦除状态 (1111 1111 1111 1111) */
 #define NKV_STATE_WRITING   0xFFFE /* 写入中状态 (1111 1111 1111 1110) */
 #define NKV_STATE_VALID     0xFFFC /* 有效状态   (1111 1111 1111 1100) */
@@ -39,7 +45,37 @@
 #define NKV_STATE_DELETED   0x0000 /* 已删除状态 (0000 0000 0000 0000) */
 #define NKV_HEADER_SIZE     6      /* 条目头大小 (state + key_len + val_len + key_hash + reserved) */
 #define NKV_CRC_SIZE        2      /* CRC校验大小 */
-#define NKV_SECTOR_HDR_SIZE 4      /* 扇区头大小 */
+#define NKV_SECTOR_HDR_SIZE 8      /* 扇区头大小(格式3：魔数 + 序号 + 擦除次数) */
+#define NKV_SECTOR_HDR_V1   4      /* 格式1/2扇区头大小(魔数 + 序号) */
+
+/* 条目标志（条目头 reserved 字段；格式2只占低2位，高6位存放键哈希高位） */
+#define NKV_ENTRY_FLAG_NONE   0xFF /* 普通条目 */
+#define NKV_ENTRY_FLAG_BATCH  0xFE /* 批量写入成员，出现对应提交记录后才生效 */
+#define NKV_ENTRY_FLAG_COMMIT 0xFC /* 批量写入提交记录，值为 {TLV_TYPE_RESERVED, 成员数} */
+#define NKV_ENTRY_FLAG_LARGE  0xFD /* 大值：key_len=0 为分块(值为 {TLV_TYPE_RESERVED, 数据})，否则为头条目(值为分块描述) */
+
+/* 存储格式版本（由扇区魔数区分，条目头大小相同） */
+#define NKV_FORMAT_V1 1 /* 8位键哈希 */
+#define NKV_FORMAT_V2 2 /* 14位键哈希：key_hash 存低8位，reserved 高6位存高6位 */
+#define NKV_FORMAT_V3 3 /* 条目同格式2，扇区头增加擦除次数，条目从对齐后的8字节处开始 */
+#if NKV_FORMAT_VERSION < NKV_FORMAT_V1 || NKV_FORMAT_VERSION > NKV_FORMAT_V3
+    #error "NKV_FORMAT_VERSION must be 1, 2 or 3"
+#endif
+
+/* 单条目缓冲区大小(头 + 最长键 + 最长值 + CRC + 对齐余量) */
+#define NKV_SCRATCH_SIZE (NKV_HEADER_SIZE + NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN + NKV_CRC_SIZE + 32)
+
+#if NKV_READ_WINDOW < (NKV_HEADER_SIZE + NKV_MAX_KEY_LEN)
+    #error "NKV_READ_WINDOW must hold an entry header plus the longest key"
+#endif
+
+#if NKV_BATCH_MAX < 1 || NKV_BATCH_MAX > 255
+    #error "NKV_BATCH_MAX must be in 1..255 (member count is stored in one byte)"
+#endif
+
+#if NKV_LARGE_VALUE && (NKV_LARGE_CHUNK < 1 || NKV_LARGE_CHUNK > NKV_MAX_VALUE_LEN - 1)
+    #error "NKV_LARGE_CHUNK must be in 1..NKV_MAX_VALUE_LEN-1 (each chunk also stores a type byte)"
+#endif
 
 /* ==================== 错误码 ==================== */
 typedef enum
@@ -50,6 +86,7 @@ typedef enum
     NKV_ERR_INVALID,   /* 参数无效 */
     NKV_ERR_FLASH,     /* Flash操作失败 */
     NKV_ERR_CRC,       /* CRC校验失败 */
+    NKV_ERR_BUSY,      /* 异步操作进行中 */
 } nkv_err_t;
 
 /* ==================== 基础结构体 ==================== */
@@ -57,8 +94,9 @@ typedef enum
 /* 扇区头 */
 typedef struct
 {
-    uint16_t magic; /* 魔数 */
-    uint16_t seq;   /* 序号 */
+    uint16_t magic;       /* 魔数 */
+    uint16_t seq;         /* 序号 */
+    uint32_t erase_count; /* 擦除次数(仅格式3) */
 } NKV_PACKED nkv_sector_hdr_t;
 
 /* KV条目头 */
@@ -68,7 +106,7 @@ typedef struct
     uint8_t  key_len;  /* 键长度 */
     uint8_t  val_len;  /* 值长度 */
     uint8_t  key_hash; /* 键哈希（加速查找） */
-    uint8_t  reserved; /* 保留字段（对齐） */
+    uint8_t  reserved; /* 条目标志 NKV_ENTRY_FLAG_*（格式2高6位为键哈希高位） */
 } NKV_PACKED nkv_entry_t;
 
 /* 默认值条目 */
@@ -79,10 +117,50 @@ typedef struct
     uint8_t     len;
 } nkv_default_t;
 
+/* 批量写入项 */
+typedef struct
+{
+    const char* key;
+    const void* value;
+    uint8_t     len; /* 0 表示删除该键 */
+} nkv_batch_item_t;
+
+/* TLV默认值 */
+typedef struct
+{
+    uint8_t     type;
+    const void* value;
+    uint8_t     len;
+} nkv_tlv_default_t;
+
+#if NKV_TLV_RETENTION_ENABLE
+/* TLV保留策略 */
+typedef struct
+{
+    uint8_t  type;
+    uint16_t keep_count;
+} nkv_tlv_retention_t;
+
+/* GC期间各类型的保留阈值地址 */
+typedef struct
+{
+    uint8_t  type;
+    uint32_t threshold;
+} nkv_tlv_keep_info_t;
+#endif
+
 /* Flash操作回调 */
 typedef int (*nkv_read_fn)(uint32_t addr, uint8_t* buf, uint32_t len);
 typedef int (*nkv_write_fn)(uint32_t addr, const uint8_t* buf, uint32_t len);
 typedef int (*nkv_erase_fn)(uint32_t addr);
+typedef uint16_t (*nkv_crc_fn)(uint16_t crc, const uint8_t* data, uint32_t len);
+typedef void (*nkv_lock_fn)(void* ctx);
+typedef uint32_t (*nkv_clock_fn)(void); /* 微秒时钟，允许回绕 */
+typedef void (*nkv_flash_done_fn)(void* ctx, int result); /* 异步Flash操作完成，result 0=成功，可在中断中调用 */
+typedef int (*nkv_write_async_fn)(uint32_t addr, const uint8_t* buf, uint32_t len, nkv_flash_done_fn done, void* ctx);
+typedef int (*nkv_erase_async_fn)(uint32_t addr, nkv_flash_done_fn done, void* ctx);
+typedef void (*nkv_async_fn)(void* ctx, nkv_err_t err); /* 异步写入/回收完成 */
+typedef int (*nkv_stream_fn)(void* ctx, uint32_t offset, uint8_t* buf, uint16_t len); /* 返回非0中止 */
 
 /* Flash操作配置 */
 typedef struct
@@ -90,22 +168,83 @@ typedef struct
     nkv_read_fn  read;
     nkv_write_fn write;
     nkv_erase_fn erase;
+    nkv_crc_fn   crc16;        /* 硬件CRC(可选，NULL=软件引擎)，须输出MODBUS CRC16 */
+    nkv_clock_fn clock_us;     /* 微秒时钟(可选，NULL=后台预算只按操作数计，不统计耗时) */
+#if NKV_THREAD_SAFE
+    nkv_lock_fn  lock;         /* 加锁(可选，NULL=单线程)，写操作与未命中的读取在锁内串行执行 */
+    nkv_lock_fn  unlock;       /* 解锁 */
+    void*        lock_ctx;     /* 传给lock/unlock的参数(如互斥量句柄) */
+#endif
+#if NKV_ZERO_COPY
+    const uint8_t* map;        /* base 对应的CPU可寻址地址(可选，NULL=不可直接映射) */
+#endif
+#if NKV_ASYNC_FLASH
+    /* 提供异步接口时，作业进行中的读取仍会调用 read：read 须先等待进行中的异步编程/擦除完成(如轮询NOR忙状态位) */
+    nkv_write_async_fn write_async; /* 异步编程(可选，NULL=使用write)：提交即返回，buf 在完成回调前保持有效 */
+    nkv_erase_async_fn erase_async; /* 异步擦除(可选，NULL=使用erase) */
+#endif
     uint32_t     base;         /* Flash基地址 */
     uint32_t     sector_size;  /* 扇区大小 */
     uint8_t      sector_count; /* 扇区数量 */
     uint8_t      align;        /* 对齐字节数 */
 } nkv_flash_ops_t;
 
+/* 操作计数器：Flash调用/字节数、状态改写、GC扫描与迁移等，调整 NKV_GC_* 参数时作为依据 */
+#if NKV_OP_STATS
+typedef struct
+{
+    uint32_t read_calls;      /* flash.read 调用次数(含读取窗口填充) */
+    uint32_t read_bytes;      /* flash.read 读取字节数 */
+    uint32_t write_calls;     /* 编程操作次数 */
+    uint32_t write_bytes;     /* 编程字节数 */
+    uint32_t erase_calls;     /* 扇区擦除次数 */
+    uint32_t state_writes;    /* 条目状态改写(PRE_DEL/VALID/DELETED)的编程次数 */
+    uint32_t gc_scanned;      /* GC 扫描的条目数 */
+    uint32_t gc_migrated;     /* GC 迁移的条目数(大值计为一条) */
+    uint32_t gc_skipped;      /* GC 跳过的条目数(已删除、旧版本、保留策略淘汰) */
+    uint32_t sector_switches; /* 切换活动扇区次数 */
+    uint32_t compactions;     /* 前台回收(写入时空间不足)次数 */
+    uint32_t crc_errors;      /* 读取时CRC校验失败次数 */
+    uint32_t scan_us;         /* 最近一次挂载扫描耗时(us，需在flash ops中提供clock_us) */
+    uint32_t live_bytes;      /* 查询时各扇区有效条目字节数之和 */
+    uint32_t dead_bytes;      /* 查询时各扇区已删除条目字节数之和 */
+} nkv_op_stats_t;
+#endif
+
+/* 扇区游标：按窗口批量读取Flash，在RAM中连续解析条目 */
+typedef struct
+{
+    const nkv_flash_ops_t* flash;   /* 所属实例的Flash操作 */
+#if NKV_OP_STATS
+    nkv_op_stats_t* stats; /* 窗口填充计入所属实例的读取统计 */
+#endif
+    uint32_t               sector;  /* 扇区基地址 */
+    uint32_t               offset;  /* 当前条目在扇区内的偏移 */
+    uint32_t               win_off; /* 窗口在扇区内的起始偏移 */
+    uint32_t               win_len; /* 窗口有效字节数(0=无效) */
+    uint8_t                format;  /* 扇区格式版本 NKV_FORMAT_* */
+    uint8_t                win[NKV_READ_WINDOW];
+} nkv_cursor_t;
+
 /* ==================== 缓存结构 ==================== */
 #if NKV_CACHE_ENABLE
+    #if (NKV_CACHE_SIZE & (NKV_CACHE_SIZE - 1)) != 0 || NKV_CACHE_SIZE > 1024
+        #error "NKV_CACHE_SIZE must be a power of two no larger than 1024"
+    #endif
+    #if NKV_CACHE_ARENA < (NKV_MAX_VALUE_LEN + 3) || NKV_CACHE_ARENA > 65535
+        #error "NKV_CACHE_ARENA must hold the longest value plus its 3-byte block header (max 65535)"
+    #endif
+
+/* 缓存项：值存放在存储区中，链表与空闲表下标均为 项下标+1(0=空)，清零即为空缓存 */
 typedef struct
 {
     char     key[NKV_MAX_KEY_LEN];
-    uint8_t  value[NKV_MAX_VALUE_LEN];
+    uint16_t val_off; /* 值块在存储区中的偏移 */
+    uint16_t next;    /* 同一哈希桶(或空闲表)的下一项 */
+    uint16_t freq;    /* 访问频率，每个衰减周期减半 */
     uint8_t  key_len;
     uint8_t  val_len;
     uint8_t  valid;
-    uint32_t access_count;
 } nkv_cache_entry_t;
 
 typedef struct
@@ -118,11 +257,199 @@ typedef struct
 typedef struct
 {
     nkv_cache_entry_t entries[NKV_CACHE_SIZE];
-    uint32_t          hit_count;
-    uint32_t          miss_count;
+    uint16_t          buckets[NKV_CACHE_SIZE]; /* 哈希桶：链表首项 */
+    uint16_t          free_head;               /* 空闲项链表 */
+    uint16_t          used;                    /* 曾经分配过的项数(高水位) */
+    uint16_t          count;                   /* 有效项数 */
+    uint16_t          hand;                    /* 淘汰采样起点 */
+    uint32_t          ops;                     /* 本衰减周期内的访问次数 */
+    uint16_t          arena_top;               /* 存储区分配位置 */
+    uint16_t          arena_live;              /* 有效值块占用字节数 */
+    uint8_t           arena[NKV_CACHE_ARENA];  /* 值存储区：块 = 容量(1B) + 所属项(2B) + 数据 */
+    #if NKV_CACHE_POLICY == 1
+    uint16_t sketch[4][NKV_CACHE_SIZE * 2]; /* TinyLFU 频率草图(Count-Min) */
+    #endif
+    uint32_t hit_count;
+    uint32_t miss_count;
 } nkv_cache_t;
 #endif
 
+/* ==================== 索引结构 ==================== */
+typedef struct
+{
+    uint32_t addr; /* 条目Flash地址(0=空槽) */
+    uint32_t hash; /* 键哈希：低位定位槽位，整体用于过滤 */
+} nkv_index_slot_t;
+
+#if NKV_INDEX_ENABLE
+typedef struct
+{
+    nkv_index_slot_t slots[NKV_INDEX_SIZE];
+    uint16_t         used;     /* 已占用槽位数 */
+    uint8_t          overflow; /* 索引已满：未命中时需回退扇区扫描 */
+} nkv_index_t;
+#endif
+
+/* ==================== 布隆过滤器结构 ==================== */
+#if NKV_BLOOM_ENABLE
+    #if (NKV_BLOOM_BITS & (NKV_BLOOM_BITS - 1)) != 0 || NKV_BLOOM_BITS < 64
+        #error "NKV_BLOOM_BITS must be a power of two, at least 64"
+    #endif
+    #if NKV_BLOOM_SECTORS < 1 || NKV_BLOOM_SECTORS > 32
+        #error "NKV_BLOOM_SECTORS must be in 1..32"
+    #endif
+    #if NKV_NEG_CACHE_SIZE < 1 || NKV_NEG_CACHE_SIZE > 255
+        #error "NKV_NEG_CACHE_SIZE must be in 1..255"
+    #endif
+
+typedef struct
+{
+    uint32_t skipped;   /* 过滤器判定不含该键、直接跳过的扇区数 */
+    uint32_t probed;    /* 过滤器判定可能含该键、实际扫描的扇区数 */
+    uint32_t false_pos; /* 扫描后未找到有效条目的次数(假阳性，含仅剩已删除旧版本的扇区) */
+    uint32_t neg_hits;  /* 负缓存命中次数(无需扫描) */
+    float    fp_rate;   /* 假阳性率 false_pos / probed (%) */
+} nkv_bloom_stats_t;
+
+typedef struct
+{
+    uint8_t  bits[NKV_BLOOM_SECTORS][NKV_BLOOM_BITS / 8];
+    uint32_t ready;                                     /* 位i=1：扇区i的过滤器覆盖该扇区全部条目 */
+    uint8_t  neg_id[NKV_NEG_CACHE_SIZE][NKV_MAX_KEY_LEN]; /* 负缓存：最近确认不存在的标识 */
+    uint8_t  neg_len[NKV_NEG_CACHE_SIZE];               /* 标识长度+1(TLV为1)，0=空 */
+    uint8_t  neg_next;                                  /* 下一个替换位置(FIFO) */
+    uint32_t skipped;
+    uint32_t probed;
+    uint32_t false_pos;
+    uint32_t neg_hits;
+} nkv_bloom_t;
+#endif
+
+/* ==================== 写缓冲结构 ==================== */
+#if NKV_WRITE_BUFFER
+    #if NKV_WBUF_SIZE < 32 || NKV_WBUF_SIZE > 4096
+        #error "NKV_WBUF_SIZE must be in 32..4096"
+    #endif
+    #if NKV_WBUF_FLUSH_TICKS < 1
+        #error "NKV_WBUF_FLUSH_TICKS must be at least 1"
+    #endif
+
+/* 暂存项：值按写入顺序紧凑存放在 data 中 */
+typedef struct
+{
+    char     key[NKV_MAX_KEY_LEN];
+    uint16_t val_off; /* 值在 data 中的偏移 */
+    uint8_t  key_len;
+    uint8_t  len; /* 0 表示删除该键 */
+} nkv_wbuf_item_t;
+
+typedef struct
+{
+    nkv_wbuf_item_t items[NKV_BATCH_MAX];
+    uint8_t         data[NKV_WBUF_SIZE];
+    uint16_t        data_len; /* data 已用字节数 */
+    uint16_t        bytes;    /* 暂存项落盘后的条目总字节数(含对齐) */
+    uint8_t         count;    /* 暂存项数，同一键只保留最新值 */
+    uint8_t         enabled;  /* 运行时开关 */
+    uint16_t        age;      /* 最早的暂存项已经历的 tick 次数 */
+} nkv_wbuf_t;
+#endif
+
+/* ==================== GC统计结构 ==================== */
+#if NKV_MAX_SECTORS < 2 || NKV_MAX_SECTORS > 255
+    #error "NKV_MAX_SECTORS must be in 2..255"
+#endif
+#if NKV_GC_POLICY < 0 || NKV_GC_POLICY > 2
+    #error "NKV_GC_POLICY must be 0, 1 or 2"
+#endif
+#if NKV_BACKGROUND_GC && (NKV_GC_INLINE_PERCENT < 1 || NKV_GC_INLINE_PERCENT > 100)
+    #error "NKV_GC_INLINE_PERCENT must be in 1..100"
+#endif
+#if NKV_BACKGROUND_GC && NKV_SPARE_SECTORS < 1
+    #error "NKV_SPARE_SECTORS must be at least 1"
+#endif
+#if !NKV_INDEX_ENABLE && ((NKV_GC_MOVED_SIZE & (NKV_GC_MOVED_SIZE - 1)) != 0 || NKV_GC_MOVED_SIZE < 8)
+    #error "NKV_GC_MOVED_SIZE must be a power of 2 and at least 8"
+#endif
+
+/* 回收扇区选择策略 */
+#define NKV_GC_POLICY_OLDEST       0 /* 序号最旧的扇区(日志环形顺序) */
+#define NKV_GC_POLICY_GREEDY       1 /* 可回收字节最多的扇区 */
+#define NKV_GC_POLICY_COST_BENEFIT 2 /* 可回收比例 x 年龄 / (1 + 有效比例)，冷数据扇区更少被反复搬移 */
+
+/* 扇区统计：挂载时建立，追加/状态改写/迁移/擦除时增量维护 */
+typedef struct
+{
+    uint32_t live;  /* 未删除条目字节数(VALID/PRE_DEL/WRITING，含对齐) */
+    uint32_t dead;  /* 已删除条目字节数 */
+    uint32_t erase_count; /* 擦除次数(格式3持久化在扇区头，旧格式扇区挂载时按已知最大值估计) */
+    uint16_t seq;    /* 扇区序号(valid=1时有效) */
+    uint8_t  valid;  /* 扇区头有效 */
+    uint8_t  format; /* 扇区格式版本 NKV_FORMAT_* */
+    uint8_t  erased; /* 整扇区已确认为擦除状态(空闲扇区可直接启用) */
+} nkv_sector_info_t;
+
+/* 磨损统计 */
+typedef struct
+{
+    uint32_t min_erases;   /* 各扇区擦除次数最小值 */
+    uint32_t max_erases;   /* 各扇区擦除次数最大值 */
+    uint32_t total_erases; /* 各扇区擦除次数之和 */
+    uint32_t relocations;  /* 为均衡磨损搬迁冷数据扇区的次数(本次上电以来) */
+} nkv_wear_t;
+
+typedef struct
+{
+    uint32_t user_bytes;  /* 用户写入的键+值字节数 */
+    uint32_t flash_bytes; /* 实际编程字节数(条目、状态改写、扇区头、GC迁移) */
+    uint32_t gc_bytes;    /* GC迁移的条目字节数 */
+    uint32_t gc_runs;     /* 已回收的扇区数 */
+    uint32_t erases;      /* 扇区擦除次数 */
+    float    write_amp;   /* 写放大 flash_bytes / user_bytes */
+} nkv_gc_stats_t;
+
+/* 后台维护预算：两项均为0时不限，做完全部待处理工作 */
+typedef struct
+{
+    uint16_t ops; /* 工作单元数上限(GC检查一个条目、擦除一个扇区、一次写缓冲落盘各计1)，0=不限 */
+    uint32_t us;  /* 耗时上限(微秒，需 clock_us)，0=不限；按单元检查，可能超出一个单元的耗时 */
+} nkv_budget_t;
+
+#if NKV_LATENCY_STATS
+    #if NKV_LATENCY_BUCKETS < 2 || NKV_LATENCY_BUCKETS > 32
+        #error "NKV_LATENCY_BUCKETS must be in 2..32"
+    #endif
+/* 耗时直方图 */
+typedef struct
+{
+    uint32_t count;                     /* 统计次数 */
+    uint32_t max_us;                    /* 最长耗时 */
+    uint32_t hist[NKV_LATENCY_BUCKETS]; /* hist[0]: <1us, hist[i]: [2^(i-1), 2^i) us */
+} nkv_latency_t;
+#endif
+
+/* ==================== 异步作业结构 ==================== */
+#if NKV_ASYNC_FLASH
+/* 异步作业：同一时刻最多一个，每步提交一次Flash操作，完成后由 nkv_async_poll 推进下一步 */
+typedef struct
+{
+    volatile uint8_t busy;      /* Flash操作进行中(完成回调清零) */
+    volatile int     result;    /* 最近一次Flash操作的结果 */
+    uint8_t          kind;      /* 作业类型，0=空闲 */
+    uint8_t          step;      /* 当前步骤 */
+    uint8_t          erase_idx; /* 正在擦除的扇区 */
+    uint8_t          val_len;
+    uint32_t         new_addr;
+    uint32_t         old_addr; /* 被替换的旧条目，0=新键 */
+    uint32_t         size;     /* 新条目大小(含对齐) */
+    nkv_async_fn     done;
+    void*            ctx;
+    char             key[NKV_MAX_KEY_LEN];
+    uint8_t          state[32];                /* 状态改写缓冲(含完整条目头) */
+    uint8_t          entry[NKV_SCRATCH_SIZE]; /* 新条目镜像，编程完成前保持有效 */
+} nkv_async_t;
+#endif
+
 /* ==================== 主实例结构 ==================== */
 typedef struct
 {
@@ -131,24 +458,66 @@ typedef struct
     uint8_t         active_sector;
     uint16_t        sector_seq;
     uint32_t        write_offset;
-#if NKV_INCREMENTAL_GC
-    uint8_t  gc_src_sector;
-    uint32_t gc_src_offset;
-    uint8_t  gc_active;
-    uint8_t  gc_bitmap[32];
+    uint32_t        flash_gen; /* Flash修改代数(每次写入/擦除递增) */
+#if NKV_ZERO_COPY
+    uint32_t map_epoch; /* 擦除代数(每次擦除递增)，nkv_get_ref 返回的引用据此失效 */
+#endif
+#if NKV_THREAD_SAFE
+    volatile uint32_t seq; /* 写序号：奇数表示写操作进行中，无锁读取前后比较以检测并发修改 */
+#endif
+    uint8_t                  gc_src_sector; /* 正在回收的扇区 */
+    uint32_t                 gc_src_offset; /* 回收进度(扇区内偏移) */
+    uint8_t                  gc_active;
+    uint8_t                  gc_policy; /* NKV_GC_POLICY_* */
+    uint8_t                  format;    /* 新扇区写入的格式版本 NKV_FORMAT_* */
+    uint32_t                 key_reads; /* 查找时哈希命中后比较键名的次数 */
+#if !NKV_INDEX_ENABLE
+    nkv_index_slot_t         gc_moved[NKV_GC_MOVED_SIZE]; /* 本轮回收已迁移的键(迁移后地址) */
+    uint16_t                 gc_moved_count;
+#endif
+    nkv_sector_info_t        sectors[NKV_MAX_SECTORS];
+    nkv_gc_stats_t           gc_stats;
+    uint32_t                 wear_moves; /* 冷数据扇区搬迁次数 */
+#if NKV_OP_STATS
+    nkv_op_stats_t op_stats;
+#endif
+#if NKV_LATENCY_STATS
+    nkv_latency_t set_latency; /* nkv_set 耗时 */
+#endif
+    const nkv_default_t*     defaults;
+    uint16_t                 default_count;
+    const nkv_tlv_default_t* tlv_defaults;
+    uint16_t                 tlv_default_count;
+#if NKV_TLV_RETENTION_ENABLE
+    nkv_tlv_retention_t tlv_retention[NKV_TLV_RETENTION_MAX];
+    uint8_t             tlv_retention_count;
+    nkv_tlv_keep_info_t tlv_keep_info[NKV_TLV_RETENTION_MAX];
+    uint8_t             tlv_keep_info_count;
 #endif
-    const nkv_default_t* defaults;
-    uint16_t             default_count;
 #if NKV_CACHE_ENABLE
     nkv_cache_t cache;
 #endif
+#if NKV_INDEX_ENABLE
+    nkv_index_t index;
+#endif
+#if NKV_BLOOM_ENABLE
+    nkv_bloom_t bloom;
+#endif
+#if NKV_WRITE_BUFFER
+    nkv_wbuf_t wbuf;
+#endif
+#if NKV_ASYNC_FLASH
+    nkv_async_t async;
+#endif
+    uint8_t scratch[NKV_SCRATCH_SIZE]; /* 条目组装/迁移/校验缓冲区 */
 } nkv_instance_t;
 
 /* ==================== KV API ==================== */
 
 /* 初始化相关（由port层调用） */
 nkv_err_t nkv_internal_init(const nkv_flash_ops_t* ops); /* 内部初始化 */
-nkv_err_t nkv_scan(void);                                /* 扫描并恢复状态 */
+nkv_err_t nkv_scan(void);                                /* 扫描并恢复状态(单遍挂载) */
+nkv_err_t nkv_scan_legacy(void);                         /* 逐步扫描挂载(旧路径，用于对比基准) */
 nkv_err_t nkv_format(void);                              /* 格式化存储区 */
 
 /* 基础操作 */
@@ -158,29 +527,169 @@ nkv_err_t nkv_del(const char* key);                                            /
 uint8_t   nkv_exists(const char* key);                                         /* 检查键是否存在 */
 void      nkv_get_usage(uint32_t* used, uint32_t* total);                      /* 获取使用情况 */
 
-/* 默认值支持 */
-void                 nkv_set_defaults(const nkv_default_t* defs, uint16_t count);
+/**
+ * @brief 批量写入多个键（原子：掉电后要么全部生效，要么全部保持旧值）
+ * @details 所有成员连续写入同一扇区，最后写入一条提交记录；
+ *          成员合并为尽量少的编程操作，旧版本按连续区间批量失效。
+ * @param items 写入项数组，键不可重复，len 为 0 表示删除该键
+ * @param count 项数，不超过 NKV_BATCH_MAX
+ */
+nkv_err_t nkv_set_batch(const nkv_batch_item_t* items, uint8_t count);
+
+/* 默认值支持：设置默认值表时按需同步到Flash(写操作，异步作业进行中返回 NKV_ERR_BUSY，默认值表不变) */
+nkv_err_t            nkv_set_defaults(const nkv_default_t* defs, uint16_t count);
 nkv_err_t            nkv_get_default(const char* key, void* buf, uint8_t size, uint8_t* out_len);
 const nkv_default_t* nkv_find_default(const char* key);
 nkv_err_t            nkv_reset_key(const char* key);
 nkv_err_t            nkv_reset_all(void);
 
 /* 内部函数导出 */
-nkv_instance_t* nkv_get_instance(void);
+nkv_instance_t* nkv_get_instance(void); /* 默认实例 */
 uint8_t         nkv_is_sector_valid(uint8_t idx);
 
+/* CRC16(MODBUS)：crc初值0xFFFF，可分段连续计算 */
+uint16_t nkv_crc16(uint16_t crc, const uint8_t* data, uint32_t len); /* 配置选择的软件引擎 */
+uint16_t nkv_crc16_bitwise(uint16_t crc, const uint8_t* data, uint32_t len);
+#if NKV_CRC_ENGINE >= 1
+uint16_t nkv_crc16_table(uint16_t crc, const uint8_t* data, uint32_t len);
+#endif
+#if NKV_CRC_ENGINE >= 2
+uint16_t nkv_crc16_slice4(uint16_t crc, const uint8_t* data, uint32_t len);
+#endif
+
 /* ==================== 增量GC API ==================== */
 #if NKV_INCREMENTAL_GC
 uint8_t nkv_gc_step(uint8_t steps); /* 手动执行GC步骤 */
 uint8_t nkv_gc_active(void);        /* 获取GC状态 */
 #endif
 
+/* ==================== 后台维护API ==================== */
+/*
+ * 在空闲时(如 nkv_task)调用，按预算依次：推进一次写缓冲计时(同 nkv_wbuf_tick)、推进增量GC、
+ * 预擦除空闲扇区。启用后 nkv_set 只在活动扇区剩余空间低于 NKV_GC_INLINE_PERCENT 时才推进回收；
+ * 回收完成的扇区只清零扇区头，擦除由本函数完成，扇区切换优先使用已预擦除的扇区，
+ * 写入路径上不再出现整扇区擦除。从不调用时擦除推迟到切换扇区时进行。
+ */
+#if NKV_BACKGROUND_GC
+uint8_t nkv_background(const nkv_budget_t* budget); /* budget=NULL不限，返回1=仍有待处理工作 */
+#endif
+
+#if NKV_LATENCY_STATS
+void     nkv_latency_stats(nkv_latency_t* stats); /* nkv_set 耗时直方图 */
+void     nkv_latency_reset(void);
+uint32_t nkv_latency_percentile(const nkv_latency_t* stats, uint8_t percent); /* 百分位耗时上界(us) */
+#endif
+
+/* ==================== 异步API ==================== */
+/*
+ * 提交后立即返回，之后在主循环或 nkv_task 中调用 nkv_async_poll：驱动完成当前Flash操作后才提交下一步，
+ * 完成回调在 nkv_async_poll 中(释放锁之后)调用，可在其中提交下一个异步操作。
+ * - nkv_set_async 按同步写入的顺序编程：旧条目 PRE_DEL -> 新条目(WRITING) -> VALID -> 旧条目 DELETED，
+ *   掉电恢复与同步写入完全相同；新值在 VALID 编程完成后才对读取可见。
+ * - nkv_gc_async 每次推进迁移一个条目(迁移本身为阻塞编程)，回收完成的扇区与其他待擦除的空闲扇区异步擦除。
+ * - 作业进行中其他写操作(含设置默认值、重新挂载)返回 NKV_ERR_BUSY。读取不返回忙，但缓存未命中时会调用 flash ops 的 read，
+ *   read 须等待进行中的编程/擦除完成(片内Flash与SPI NOR在编程、擦除期间不能读取)。
+ * - 切换扇区写入扇区头、空间不足时的前台回收仍在提交时同步完成。
+ */
+#if NKV_ASYNC_FLASH
+nkv_err_t nkv_set_async(const char* key, const void* value, uint8_t len, nkv_async_fn done, void* ctx);
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+nkv_err_t nkv_gc_async(nkv_async_fn done, void* ctx); /* 异步回收一个扇区并擦除待擦除的空闲扇区 */
+    #endif
+uint8_t nkv_async_poll(void); /* 推进异步作业，返回1=仍在进行 */
+#endif
+
+/* ==================== GC统计API ==================== */
+void      nkv_gc_stats(nkv_gc_stats_t* stats); /* 写放大与回收统计 */
+void      nkv_gc_stats_reset(void);
+nkv_err_t nkv_gc_set_policy(uint8_t policy); /* 运行时切换回收策略 NKV_GC_POLICY_* */
+
+/* ==================== 磨损统计API ==================== */
+/*
+ * 擦除次数随格式3扇区头持久保存，可用于估算Flash剩余寿命(额定擦写次数 - max_erases)。
+ * 擦除完成到写入扇区头之间掉电、或旧格式扇区没有记录时，挂载时按已知最大值估计(偏保守)。
+ */
+void     nkv_wear_stats(nkv_wear_t* stats);
+uint32_t nkv_sector_erase_count(uint8_t idx); /* 单个扇区的擦除次数 */
+
+/* ==================== 操作统计API ==================== */
+#if NKV_OP_STATS
+void nkv_op_stats(nkv_op_stats_t* stats); /* Flash操作、状态改写与GC计数 */
+void nkv_op_stats_reset(void);            /* 清零计数(scan_us 保留) */
+#endif
+
 /* ==================== 缓存API ==================== */
 #if NKV_CACHE_ENABLE
 void nkv_cache_stats(nkv_cache_stats_t* stats);
 void nkv_cache_clear(void);
 #endif
 
+/* ==================== 布隆过滤器API ==================== */
+#if NKV_BLOOM_ENABLE
+void nkv_bloom_stats(nkv_bloom_stats_t* stats); /* 不存在键查找的过滤统计 */
+#endif
+
+/* ==================== 写缓冲API ==================== */
+/*
+ * 持久性约定(开启后)：
+ * - nkv_set/nkv_del 返回 NKV_OK 仅表示已暂存，此时掉电会丢失；读取立即可见暂存的新值。
+ * - 缓冲凑满一页、nkv_flush 返回 NKV_OK、或经过 NKV_WBUF_FLUSH_TICKS 次 nkv_wbuf_tick 后落盘。
+ * - 每次落盘是一次原子批量写入：掉电后这一批要么全部生效，要么全部保持旧值，不会出现部分写入。
+ * - 按写入顺序落盘：超出缓冲容量的写入、nkv_set_batch 以及关闭缓冲前都会先落盘已暂存的数据。
+ * - nkv_format 丢弃暂存数据；TLV 写入不经过缓冲。
+ */
+#if NKV_WRITE_BUFFER
+nkv_err_t nkv_wbuf_enable(uint8_t enable); /* 开启/关闭写缓冲，关闭前先落盘 */
+nkv_err_t nkv_flush(void);                 /* 立即落盘暂存的写入 */
+nkv_err_t nkv_wbuf_tick(void);             /* 周期调用，暂存超时后落盘 */
+uint8_t   nkv_wbuf_pending(void);          /* 暂存(尚未落盘)的键数 */
+#endif
+
+/* ==================== 大值API ==================== */
+/*
+ * 超过 NKV_MAX_VALUE_LEN 的值拆分为同一扇区内连续的分块条目，最后写入指向分块的头条目：
+ * - 头条目写入前掉电，已写入的分块在挂载时删除，键保持旧值；GC 把分块与头条目作为整体迁移。
+ * - 整个值(分块 + 头条目)须能放入一个扇区，否则返回 NKV_ERR_NO_SPACE。
+ * - 回调在持锁期间按偏移递增的顺序调用，每次最多 NKV_LARGE_CHUNK 字节，不得在回调中访问同一实例。
+ * - nkv_get 读取大值时返回前 size 字节；nkv_get_stream 也可读取普通值(一次回调)。
+ */
+#if NKV_LARGE_VALUE
+/**
+ * @brief 流式写入大值
+ * @param total 值总长度(字节)
+ * @param read  回调：向 buf 填入值中 [offset, offset+len) 的数据
+ */
+nkv_err_t nkv_set_stream(const char* key, uint32_t total, nkv_stream_fn read, void* ctx);
+
+/**
+ * @brief 流式读取值
+ * @param write   回调：依次收到值中 [offset, offset+len) 的数据，NULL=只查询长度
+ * @param out_len 输出值总长度(可为NULL)
+ */
+nkv_err_t nkv_get_stream(const char* key, nkv_stream_fn write, void* ctx, uint32_t* out_len);
+#endif
+
+/* ==================== 零拷贝API ==================== */
+/*
+ * Flash 可被 CPU 直接寻址(flash ops 中 map 非 NULL)时，nkv_get_ref 返回指向 Flash 中值数据的指针，
+ * 不经过 flash.read、校验缓冲区与缓存的复制：
+ * - 条目写入后内容不再改变，引用在其所在扇区被擦除(GC/格式化)前一直有效；之后写入新值不影响旧引用，
+ *   但旧引用看到的仍是读取时的值。
+ * - 使用引用后用 nkv_ref_valid 确认期间没有发生擦除，多线程下其他线程的写入可能随时触发回收。
+ * - 写缓冲中暂存的值先落盘；大值不连续存放，返回 NKV_ERR_INVALID，请使用 nkv_get_stream。
+ */
+#if NKV_ZERO_COPY
+typedef struct
+{
+    const uint8_t* data;  /* 值数据(指向映射的Flash) */
+    uint8_t        len;   /* 值长度 */
+    uint32_t       epoch; /* 读取时的擦除代数 */
+} nkv_ref_t;
+
+nkv_err_t nkv_get_ref(const char* key, nkv_ref_t* ref); /* 获取值引用(不复制) */
+uint8_t   nkv_ref_valid(const nkv_ref_t* ref);          /* 引用是否仍有效(期间未擦除) */
+#endif
+
 /* ==================== 默认值辅助宏 ==================== */
 #define NKV_DEFAULT_SIZE(t)   (sizeof(t) / sizeof((t)[0]))
 #define NKV_DEF_STR(k, v)     {.key = (k), .value = (v), .len = sizeof(v) - 1}
@@ -196,20 +705,15 @@ void nkv_cache_clear(void);
 #define TLV_TYPE_SYS_MIN  0x80
 #define TLV_TYPE_SYS_MAX  0xFF
 
-/* TLV默认值 */
-typedef struct
-{
-    uint8_t     type;
-    const void* value;
-    uint8_t     len;
-} nkv_tlv_default_t;
-
 /* TLV迭代器 */
 typedef struct
 {
-    uint8_t  sector_idx;
-    uint32_t sector_offset;
-    uint8_t  finished;
+    nkv_instance_t* db; /* 所属实例 */
+    uint8_t         sector_idx;
+    uint32_t        sector_offset;
+    uint8_t         finished;
+    uint32_t        gen;    /* 窗口对应的Flash修改代数，变化后重新读取 */
+    nkv_cursor_t    cursor; /* 批量读取窗口 */
 } nkv_tlv_iter_t;
 
 /* TLV条目信息 */
@@ -236,7 +740,7 @@ nkv_err_t nkv_tlv_del(uint8_t type);
 uint8_t   nkv_tlv_exists(uint8_t type);
 
 /* TLV默认值API */
-void      nkv_tlv_set_defaults(const nkv_tlv_default_t* defs, uint16_t count);
+nkv_err_t nkv_tlv_set_defaults(const nkv_tlv_default_t* defs, uint16_t count);
 nkv_err_t nkv_tlv_get_default(uint8_t type, void* buf, uint8_t size, uint8_t* out_len);
 nkv_err_t nkv_tlv_reset_type(uint8_t type);
 nkv_err_t nkv_tlv_reset_all(void);
@@ -267,4 +771,112 @@ void      nkv_tlv_clear_retention(uint8_t type);
 #define NKV_TLV_DEF_DATA(t, p, l) {.type = t, .value = p, .len = l}
 #define NKV_TLV_DEFAULT_SIZE(t)   (sizeof(t) / sizeof((t)[0]))
 
+/* ==================== 多实例API ==================== */
+/*
+ * 每个 nkv_instance_t 独立持有扇区状态、缓存、索引、默认值表和缓冲区，
+ * 可同时管理多个Flash分区（如片内Flash热数据 + 外部NOR冷数据）。
+ * 以下接口与同名单实例接口语义一致，单实例接口作用于 nkv_get_instance() 返回的默认实例。
+ * 不同实例之间互不影响；同一实例被多个线程访问时需启用 NKV_THREAD_SAFE 并提供 lock/unlock。
+ * nkv_internal_init_ex 不加锁，须在其他线程开始访问该实例之前完成。
+ */
+nkv_err_t nkv_internal_init_ex(nkv_instance_t* db, const nkv_flash_ops_t* ops);
+nkv_err_t nkv_scan_ex(nkv_instance_t* db);
+nkv_err_t nkv_scan_legacy_ex(nkv_instance_t* db);
+nkv_err_t nkv_format_ex(nkv_instance_t* db);
+uint8_t   nkv_is_sector_valid_ex(nkv_instance_t* db, uint8_t idx);
+
+nkv_err_t nkv_set_ex(nkv_instance_t* db, const char* key, const void* value, uint8_t len);
+nkv_err_t nkv_get_ex(nkv_instance_t* db, const char* key, void* buf, uint8_t size, uint8_t* out_len);
+nkv_err_t nkv_del_ex(nkv_instance_t* db, const char* key);
+nkv_err_t nkv_set_batch_ex(nkv_instance_t* db, const nkv_batch_item_t* items, uint8_t count);
+uint8_t   nkv_exists_ex(nkv_instance_t* db, const char* key);
+void      nkv_get_usage_ex(nkv_instance_t* db, uint32_t* used, uint32_t* total);
+
+nkv_err_t            nkv_set_defaults_ex(nkv_instance_t* db, const nkv_default_t* defs, uint16_t count);
+nkv_err_t            nkv_get_default_ex(nkv_instance_t* db, const char* key, void* buf, uint8_t size, uint8_t* out_len);
+const nkv_default_t* nkv_find_default_ex(nkv_instance_t* db, const char* key);
+nkv_err_t            nkv_reset_key_ex(nkv_instance_t* db, const char* key);
+nkv_err_t            nkv_reset_all_ex(nkv_instance_t* db);
+
+#if NKV_INCREMENTAL_GC
+uint8_t nkv_gc_step_ex(nkv_instance_t* db, uint8_t steps);
+uint8_t nkv_gc_active_ex(nkv_instance_t* db);
+#endif
+
+#if NKV_BACKGROUND_GC
+uint8_t nkv_background_ex(nkv_instance_t* db, const nkv_budget_t* budget);
+#endif
+#if NKV_ASYNC_FLASH
+nkv_err_t nkv_set_async_ex(nkv_instance_t* db, const char* key, const void* value, uint8_t len, nkv_async_fn done,
+                           void* ctx);
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+nkv_err_t nkv_gc_async_ex(nkv_instance_t* db, nkv_async_fn done, void* ctx);
+    #endif
+uint8_t nkv_async_poll_ex(nkv_instance_t* db);
+#endif
+#if NKV_LATENCY_STATS
+void nkv_latency_stats_ex(nkv_instance_t* db, nkv_latency_t* stats);
+void nkv_latency_reset_ex(nkv_instance_t* db);
+#endif
+
+void      nkv_gc_stats_ex(nkv_instance_t* db, nkv_gc_stats_t* stats);
+void      nkv_gc_stats_reset_ex(nkv_instance_t* db);
+nkv_err_t nkv_gc_set_policy_ex(nkv_instance_t* db, uint8_t policy);
+void      nkv_wear_stats_ex(nkv_instance_t* db, nkv_wear_t* stats);
+uint32_t  nkv_sector_erase_count_ex(nkv_instance_t* db, uint8_t idx);
+#if NKV_OP_STATS
+void nkv_op_stats_ex(nkv_instance_t* db, nkv_op_stats_t* stats);
+void nkv_op_stats_reset_ex(nkv_instance_t* db);
+#endif
+
+#if NKV_CACHE_ENABLE
+void nkv_cache_stats_ex(nkv_instance_t* db, nkv_cache_stats_t* stats);
+void nkv_cache_clear_ex(nkv_instance_t* db);
+#endif
+
+#if NKV_BLOOM_ENABLE
+void nkv_bloom_stats_ex(nkv_instance_t* db, nkv_bloom_stats_t* stats);
+#endif
+
+#if NKV_LARGE_VALUE
+nkv_err_t nkv_set_stream_ex(nkv_instance_t* db, const char* key, uint32_t total, nkv_stream_fn read, void* ctx);
+nkv_err_t nkv_get_stream_ex(nkv_instance_t* db, const char* key, nkv_stream_fn write, void* ctx, uint32_t* out_len);
+#endif
+
+#if NKV_ZERO_COPY
+nkv_err_t nkv_get_ref_ex(nkv_instance_t* db, const char* key, nkv_ref_t* ref);
+uint8_t   nkv_ref_valid_ex(nkv_instance_t* db, const nkv_ref_t* ref);
+#endif
+
+#if NKV_WRITE_BUFFER
+nkv_err_t nkv_wbuf_enable_ex(nkv_instance_t* db, uint8_t enable);
+nkv_err_t nkv_flush_ex(nkv_instance_t* db);
+nkv_err_t nkv_wbuf_tick_ex(nkv_instance_t* db);
+uint8_t   nkv_wbuf_pending_ex(nkv_instance_t* db);
+#endif
+
+nkv_err_t nkv_tlv_set_ex(nkv_instance_t* db, uint8_t type, const void* value, uint8_t len);
+nkv_err_t nkv_tlv_get_ex(nkv_instance_t* db, uint8_t type, void* buf, uint8_t size, uint8_t* out_len);
+nkv_err_t nkv_tlv_del_ex(nkv_instance_t* db, uint8_t type);
+uint8_t   nkv_tlv_exists_ex(nkv_instance_t* db, uint8_t type);
+
+nkv_err_t nkv_tlv_set_defaults_ex(nkv_instance_t* db, const nkv_tlv_default_t* defs, uint16_t count);
+nkv_err_t nkv_tlv_get_default_ex(nkv_instance_t* db, uint8_t type, void* buf, uint8_t size, uint8_t* out_len);
+nkv_err_t nkv_tlv_reset_type_ex(nkv_instance_t* db, uint8_t type);
+nkv_err_t nkv_tlv_reset_all_ex(nkv_instance_t* db);
+
+void      nkv_tlv_iter_init_ex(nkv_instance_t* db, nkv_tlv_iter_t* iter); /* 之后用 nkv_tlv_iter_next 遍历 */
+nkv_err_t nkv_tlv_iter_read_ex(nkv_instance_t* db, const nkv_tlv_entry_t* info, void* buf, uint8_t size);
+void      nkv_tlv_stats_ex(nkv_instance_t* db, uint16_t* count, uint32_t* used);
+uint8_t   nkv_tlv_has_data_ex(nkv_instance_t* db);
+
+nkv_err_t nkv_tlv_get_history_ex(nkv_instance_t* db, uint8_t type, nkv_tlv_history_t* history, uint8_t max,
+                                 uint8_t* count);
+nkv_err_t nkv_tlv_read_history_ex(nkv_instance_t* db, const nkv_tlv_history_t* entry, void* buf, uint8_t size);
+
+#if NKV_TLV_RETENTION_ENABLE
+nkv_err_t nkv_tlv_set_retention_ex(nkv_instance_t* db, uint8_t type, uint16_t keep_newest);
+void      nkv_tlv_clear_retention_ex(nkv_instance_t* db, uint8_t type);
+#endif
+
 #endif /* __NANOKV_H */
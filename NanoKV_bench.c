@@ -0,0 +1,387 @@
+/**
+ * @file NanoKV_bench.c
+ * @brief NanoKV 基准测试
+ * @note 在 Flash 模拟器上运行 YCSB 风格负载，输出每种负载的延迟分位数与每操作 Flash 开销(CSV/JSON)。
+ *       延迟按模拟器耗时模型计算，同一参数在任何主机上结果一致，可直接对比不同版本找出回归。
+ *
+ * 用法: NanoKV_bench [--json] [--out FILE] [--preset NAME] [--workload NAME] [--ops N] [--seed N] [--idle]
+ *   --json      输出JSON(默认CSV)
+ *   --out       结果写入文件(默认stdout；库的调试日志同样打印到stdout)
+ *   --preset    只运行指定器件预设(stm32f4 / spi-nor)
+ *   --workload  只运行指定负载
+ *   --ops       每个负载的计时操作数(默认20000)
+ *   --seed      随机种子(默认1)
+ *   --idle      每次操作后以1个工作单元的预算调用 nkv_background_ex(模拟空闲任务，不计入操作延迟)
+ */
+
+#include "NanoKV.h"
+#include "NanoKV_sim.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_OPS  200000 /* 单个负载计时操作数上限 */
+#define BENCH_MAX_KEYS 256    /* 键空间上限 */
+#define BENCH_TLV_BASE 0x40   /* TLV日志负载使用的类型起点 */
+
+/* ==================== 负载定义 ==================== */
+
+typedef enum
+{
+    BENCH_KV = 0, /* 键值读写 */
+    BENCH_MISS,   /* 读取不存在的键(索引/布隆过滤器未命中路径) */
+    BENCH_TLV,    /* TLV日志：追加写入并读取最近历史 */
+} bench_kind_t;
+
+typedef struct
+{
+    const char* name;
+    uint8_t     kind;     /* bench_kind_t */
+    uint16_t    keys;     /* 键空间大小(TLV为类型数) */
+    uint8_t     val_len;  /* 值长度 */
+    uint8_t     read_pct; /* 读操作比例(%)，其余为更新 */
+    uint8_t     zipf;     /* 1=Zipfian(s=1)选键, 0=均匀 */
+} bench_workload_t;
+
+static const bench_workload_t g_workloads[] = {
+    {"ycsb_a", BENCH_KV, 64, 32, 50, 1},           /* 更新密集 */
+    {"ycsb_b", BENCH_KV, 64, 32, 95, 1},           /* 读密集 */
+    {"ycsb_c", BENCH_KV, 64, 32, 100, 1},          /* 只读 */
+    {"read_uniform", BENCH_KV, 64, 32, 95, 0},     /* 读密集、均匀选键 */
+    {"update_uniform", BENCH_KV, 64, 32, 10, 0},   /* 更新密集、均匀选键 */
+    {"read_miss", BENCH_MISS, 64, 32, 100, 0},     /* 查找不存在的键 */
+    {"value_4", BENCH_KV, 32, 4, 0, 0},            /* 值长度扫描 */
+    {"value_16", BENCH_KV, 32, 16, 0, 0},
+    {"value_64", BENCH_KV, 32, 64, 0, 0},
+    {"value_128", BENCH_KV, 32, 128, 0, 0},
+    {"value_255", BENCH_KV, 32, 255, 0, 0},
+    {"steady_gc", BENCH_KV, 96, 255, 0, 0},        /* 大量有效数据下持续回收 */
+    {"tlv_log", BENCH_TLV, 8, 16, 10, 0},          /* 传感器日志 */
+};
+
+/* 单个负载的结果 */
+typedef struct
+{
+    uint32_t ops;
+    uint32_t p50_us, p99_us, p999_us, max_us;
+    double   mean_us;
+    double   reads, read_bytes, progs, prog_bytes, erases; /* 每操作Flash开销 */
+    double   host_ns;                                     /* 每操作主机CPU耗时(与主机相关，仅供参考) */
+    uint32_t errors;                                      /* 返回错误或读出数据不符的操作数 */
+} bench_result_t;
+
+static nkv_instance_t g_db;
+static uint8_t        g_mem[512 * 1024]; /* 容纳最大的器件预设 */
+static uint32_t       g_lat[BENCH_MAX_OPS];
+static double         g_zipf_cdf[BENCH_MAX_KEYS];
+static uint32_t       g_version[BENCH_MAX_KEYS]; /* 各键最后写入的版本，用于校验读出数据 */
+static uint32_t       g_rng;
+
+/* ==================== 工具 ==================== */
+
+static uint32_t rng_next(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+/* Zipfian(s=1)：第i个键的权重为 1/(i+1)，累积分布上二分查找 */
+static void zipf_init(uint16_t n)
+{
+    double sum = 0;
+    for (uint16_t i = 0; i < n; i++)
+        g_zipf_cdf[i] = (sum += 1.0 / (i + 1));
+    for (uint16_t i = 0; i < n; i++)
+        g_zipf_cdf[i] /= sum;
+}
+
+static uint16_t pick_key(const bench_workload_t* w)
+{
+    if (!w->zipf)
+        return (uint16_t) (rng_next() % w->keys);
+    double   u  = (rng_next() >> 8) / (double) (1u << 24);
+    uint16_t lo = 0, hi = w->keys - 1;
+    while (lo < hi)
+    {
+        uint16_t mid = (lo + hi) / 2;
+        if (g_zipf_cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* 值内容由键与版本决定：前4字节为版本，其余字节由版本派生 */
+static void fill_value(uint8_t* buf, uint8_t len, uint16_t key, uint32_t ver)
+{
+    for (uint8_t i = 0; i < len; i++)
+        buf[i] = (uint8_t) (ver * 131u + key * 7u + i);
+    if (len >= sizeof(ver))
+        memcpy(buf, &ver, sizeof(ver));
+}
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+/* 最近秩分位数，p 以千分比表示 */
+static uint32_t percentile(const uint32_t* sorted, uint32_t n, uint32_t permille)
+{
+    uint32_t rank = (uint32_t) (((uint64_t) n * permille + 999) / 1000);
+    return sorted[rank ? rank - 1 : 0];
+}
+
+/* ==================== 负载执行 ==================== */
+
+static uint32_t bench_write(const bench_workload_t* w, uint16_t k, uint32_t ver)
+{
+    char    key[8];
+    uint8_t val[NKV_MAX_VALUE_LEN];
+    fill_value(val, w->val_len, k, ver);
+    if (w->kind == BENCH_TLV)
+        return nkv_tlv_set_ex(&g_db, (uint8_t) (BENCH_TLV_BASE + k), val, w->val_len) != NKV_OK;
+    snprintf(key, sizeof(key), "b%03u", (unsigned) k);
+    return nkv_set_ex(&g_db, key, val, w->val_len) != NKV_OK;
+}
+
+static uint32_t bench_read(const bench_workload_t* w, uint16_t k)
+{
+    char    key[8];
+    uint8_t val[NKV_MAX_VALUE_LEN], expect[NKV_MAX_VALUE_LEN];
+    uint8_t len = 0;
+
+    if (w->kind == BENCH_MISS)
+    {
+        snprintf(key, sizeof(key), "m%03u", (unsigned) k);
+        return nkv_get_ex(&g_db, key, val, sizeof(val), &len) != NKV_ERR_NOT_FOUND;
+    }
+    if (w->kind == BENCH_TLV)
+    {
+        nkv_tlv_history_t hist[4];
+        uint8_t           count = 0;
+        if (nkv_tlv_get_history_ex(&g_db, (uint8_t) (BENCH_TLV_BASE + k), hist, 4, &count) != NKV_OK || count == 0)
+            return 1;
+        return nkv_tlv_read_history_ex(&g_db, &hist[0], val, sizeof(val)) != NKV_OK;
+    }
+    snprintf(key, sizeof(key), "b%03u", (unsigned) k);
+    if (nkv_get_ex(&g_db, key, val, sizeof(val), &len) != NKV_OK || len != w->val_len)
+        return 1;
+    fill_value(expect, w->val_len, k, g_version[k]);
+    return memcmp(val, expect, len) != 0;
+}
+
+static nkv_err_t bench_run(const nkv_sim_cfg_t* preset, const bench_workload_t* w, uint32_t ops, uint8_t idle,
+                           bench_result_t* res)
+{
+    nkv_flash_ops_t ops_cfg;
+    nkv_sim_stats_t st;
+    nkv_budget_t    budget = {1, 0};
+
+    memset(res, 0, sizeof(*res));
+    nkv_err_t err = nkv_sim_init(preset, g_mem);
+    if (err != NKV_OK)
+        return err;
+    nkv_sim_ops(&ops_cfg);
+    if ((err = nkv_internal_init_ex(&g_db, &ops_cfg)) != NKV_OK || (err = nkv_scan_ex(&g_db)) != NKV_OK)
+        return err;
+
+    /* 预加载全部键(不计时) */
+    zipf_init(w->keys);
+    for (uint16_t k = 0; k < w->keys; k++)
+    {
+        g_version[k] = 0;
+        res->errors += bench_write(w, k, 0);
+    }
+    nkv_sim_stats_reset();
+
+    clock_t host = clock();
+    for (uint32_t i = 0; i < ops; i++)
+    {
+        uint16_t k     = pick_key(w);
+        uint8_t  read  = (rng_next() % 100) < w->read_pct;
+        uint32_t start = nkv_sim_clock_us();
+        if (read)
+            res->errors += bench_read(w, k);
+        else
+            res->errors += bench_write(w, k, ++g_version[k]);
+        g_lat[i] = nkv_sim_clock_us() - start;
+#if NKV_BACKGROUND_GC
+        if (idle)
+            nkv_background_ex(&g_db, &budget);
+#else
+        (void) idle;
+        (void) budget;
+#endif
+    }
+    res->host_ns = (double) (clock() - host) * 1e9 / CLOCKS_PER_SEC / ops;
+
+    nkv_sim_stats(&st);
+    res->ops        = ops;
+    res->reads      = (double) st.read_ops / ops;
+    res->read_bytes = (double) st.read_bytes / ops;
+    res->progs      = (double) st.prog_ops / ops;
+    res->prog_bytes = (double) st.prog_bytes / ops;
+    res->erases     = (double) st.erases / ops;
+
+    /* --idle 时后台工作也计入Flash开销，但不计入操作延迟 */
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < ops; i++)
+        total += g_lat[i];
+    res->mean_us = (double) total / ops;
+    qsort(g_lat, ops, sizeof(g_lat[0]), cmp_u32);
+    res->p50_us  = percentile(g_lat, ops, 500);
+    res->p99_us  = percentile(g_lat, ops, 990);
+    res->p999_us = percentile(g_lat, ops, 999);
+    res->max_us  = g_lat[ops - 1];
+    return NKV_OK;
+}
+
+/* ==================== 输出 ==================== */
+
+static void print_row(FILE* out, uint8_t json, uint8_t first, const char* preset, const char* workload,
+                      const bench_result_t* r)
+{
+    if (json)
+    {
+        fprintf(out,
+                "%s\n  {\"preset\": \"%s\", \"workload\": \"%s\", \"ops\": %u, \"mean_us\": %.2f, \"p50_us\": %u, "
+                "\"p99_us\": %u, \"p999_us\": %u, \"max_us\": %u, \"reads_per_op\": %.3f, \"read_bytes_per_op\": %.1f, "
+                "\"progs_per_op\": %.3f, \"prog_bytes_per_op\": %.1f, \"erases_per_op\": %.5f, \"host_ns_per_op\": %.0f, "
+                "\"errors\": %u}",
+                first ? "" : ",",
+                preset,
+                workload,
+                (unsigned) r->ops,
+                r->mean_us,
+                (unsigned) r->p50_us,
+                (unsigned) r->p99_us,
+                (unsigned) r->p999_us,
+                (unsigned) r->max_us,
+                r->reads,
+                r->read_bytes,
+                r->progs,
+                r->prog_bytes,
+                r->erases,
+                r->host_ns,
+                (unsigned) r->errors);
+        return;
+    }
+    fprintf(out,
+            "%s,%s,%u,%.2f,%u,%u,%u,%u,%.3f,%.1f,%.3f,%.1f,%.5f,%.0f,%u\n",
+            preset,
+            workload,
+            (unsigned) r->ops,
+            r->mean_us,
+            (unsigned) r->p50_us,
+            (unsigned) r->p99_us,
+            (unsigned) r->p999_us,
+            (unsigned) r->max_us,
+            r->reads,
+            r->read_bytes,
+            r->progs,
+            r->prog_bytes,
+            r->erases,
+            r->host_ns,
+            (unsigned) r->errors);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: NanoKV_bench [--json] [--out FILE] [--preset NAME] [--workload NAME] [--ops N] [--seed N] "
+            "[--idle]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const nkv_sim_cfg_t* presets[] = {&nkv_sim_stm32f4, &nkv_sim_spi_nor};
+    const char*          only_preset   = NULL;
+    const char*          only_workload = NULL;
+    const char*          out_path      = NULL;
+    uint32_t             ops           = 20000;
+    uint32_t             seed          = 1;
+    uint8_t              json = 0, idle = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--json") == 0)
+            json = 1;
+        else if (strcmp(argv[i], "--idle") == 0)
+            idle = 1;
+        else if (strcmp(argv[i], "--preset") == 0 && val)
+            only_preset = argv[++i];
+        else if (strcmp(argv[i], "--workload") == 0 && val)
+            only_workload = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && val)
+            out_path = argv[++i];
+        else if (strcmp(argv[i], "--ops") == 0 && val)
+            ops = (uint32_t) strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--seed") == 0 && val)
+            seed = (uint32_t) strtoul(argv[++i], NULL, 0);
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (ops == 0 || ops > BENCH_MAX_OPS)
+    {
+        fprintf(stderr, "--ops must be in 1..%u\n", (unsigned) BENCH_MAX_OPS);
+        return 2;
+    }
+
+    FILE* out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "cannot open %s\n", out_path);
+        return 2;
+    }
+    if (json)
+        fprintf(out, "[");
+    else
+        fprintf(out,
+                "preset,workload,ops,mean_us,p50_us,p99_us,p999_us,max_us,reads_per_op,read_bytes_per_op,"
+                "progs_per_op,prog_bytes_per_op,erases_per_op,host_ns_per_op,errors\n");
+
+    uint32_t errors = 0, rows = 0;
+    for (uint8_t p = 0; p < sizeof(presets) / sizeof(presets[0]); p++)
+    {
+        if (only_preset && strcmp(only_preset, presets[p]->name) != 0)
+            continue;
+        for (uint8_t i = 0; i < sizeof(g_workloads) / sizeof(g_workloads[0]); i++)
+        {
+            const bench_workload_t* w = &g_workloads[i];
+            bench_result_t          r;
+            if (only_workload && strcmp(only_workload, w->name) != 0)
+                continue;
+            g_rng = seed ? seed : 1;
+            if (bench_run(presets[p], w, ops, idle, &r) != NKV_OK)
+            {
+                fprintf(stderr, "%s/%s: setup failed\n", presets[p]->name, w->name);
+                errors++;
+                continue;
+            }
+            print_row(out, json, rows++ == 0, presets[p]->name, w->name, &r);
+            errors += r.errors;
+        }
+    }
+    if (json)
+        fprintf(out, "\n]\n");
+    if (out != stdout)
+        fclose(out);
+    if (rows == 0)
+    {
+        fprintf(stderr, "no matching preset/workload\n");
+        return 2;
+    }
+    return errors ? 1 : 0;
+}
@@ -11,22 +11,80 @@
 #define NKV_MAX_KEY_LEN   16  /* 最大键名长度(字节)，建议8-16 */
 #define NKV_MAX_VALUE_LEN 255 /* 最大值长度(字节)，受限于uint8_t */
 
+/* 存储格式配置 */
+#define NKV_FORMAT_VERSION 3 /* 新扇区写入的格式：3=扇区头记录擦除次数, 2=14位键哈希, 1=旧格式(需回退到旧固件时使用)；各格式均可挂载 */
+
 /* 版本自动更新配置 */
 #define NKV_SETTING_VER 1 /* 配置版本号，增加新默认参数时需递增此值 */
 
 /* 缓存配置 */
-#define NKV_CACHE_ENABLE 1 /* 启用LFU缓存：0=禁用, 1=启用 */
-#define NKV_CACHE_SIZE   4 /* 缓存条目数量 */
+#define NKV_CACHE_ENABLE 1    /* 启用哈希缓存：0=禁用, 1=启用 */
+#define NKV_CACHE_SIZE   32   /* 缓存条目数量(须为2的幂，最大1024) */
+#define NKV_CACHE_ARENA  1024 /* 值存储区字节数，按实际值长度分配(每个值另占3字节块头) */
+#define NKV_CACHE_POLICY 0    /* 淘汰策略：0=LFU+周期衰减, 1=TinyLFU准入(频率草图过滤一次性访问) */
+
+/* RAM索引配置 */
+#define NKV_INDEX_ENABLE 1   /* 启用RAM哈希索引(键->Flash地址)：0=禁用, 1=启用 */
+#define NKV_INDEX_SIZE   128 /* 索引槽位数(须为2的幂)，装载率超过3/4后回退为扇区扫描 */
+
+/* 布隆过滤器配置(索引未命中回退扫描时，跳过不可能包含目标键的扇区) */
+#define NKV_BLOOM_ENABLE   1   /* 启用每扇区布隆过滤器与负缓存：0=禁用, 1=启用 */
+#define NKV_BLOOM_BITS     512 /* 每扇区过滤器位数(须为2的幂)，建议不少于扇区条目数的8倍 */
+#define NKV_BLOOM_SECTORS  8   /* 建立过滤器的扇区数上限(1-32)，超出的扇区始终扫描 */
+#define NKV_NEG_CACHE_SIZE 8   /* 负缓存条目数：记录最近确认不存在的键/TLV类型 */
 
 /* 增量GC配置 */
 #define NKV_INCREMENTAL_GC       1  /* 启用增量GC：0=禁用(全量GC), 1=启用 */
 #define NKV_GC_ENTRIES_PER_WRITE 2  /* 每次写入后迁移的条目数，建议1-4 */
-#define NKV_GC_THRESHOLD_PERCENT 70 /* GC触发阈值(使用率%)，建议60-80 */
+#define NKV_GC_THRESHOLD_PERCENT 70 /* 后台GC只回收有效数据占比不超过该值(%)的扇区，建议60-80 */
+
+/* 后台维护配置(nkv_background 在空闲时按预算推进回收、空闲扇区预擦除与写缓冲落盘) */
+#define NKV_BACKGROUND_GC     1  /* 后台维护：0=禁用(回收在写入后推进), 1=启用(写入中只在空间紧张时推进回收) */
+#define NKV_GC_INLINE_PERCENT 25 /* 启用后台维护时，活动扇区剩余空间低于该比例(%)才在写入中推进回收 */
+#define NKV_SPARE_SECTORS     1  /* 后台保持的预擦除空闲扇区数(不含前台回收保留的扇区)，扇区切换时只写扇区头 */
+#define NKV_LATENCY_STATS     1  /* nkv_set 耗时直方图(需在flash ops中提供clock_us)：0=禁用, 1=启用 */
+#define NKV_LATENCY_BUCKETS   20 /* 直方图桶数，第i桶统计 [2^(i-1), 2^i) 微秒，最后一桶包含更长的耗时 */
+#define NKV_OP_STATS          1  /* Flash操作与GC计数器(nkv_op_stats)，用于按实测数据调整GC参数：0=禁用, 1=启用 */
+
+/* 异步Flash配置(DMA控制器编程/擦除期间不占用CPU，写入与回收由 nkv_async_poll 逐步推进) */
+#define NKV_ASYNC_FLASH 0 /* 异步接口：0=禁用(默认，实例不含异步作业状态), 1=启用(flash ops中可提供 write_async/erase_async，NULL时退化为阻塞调用) */
+
+/* GC回收策略配置 */
+#define NKV_MAX_SECTORS   32 /* 扇区数量上限(每扇区有效/垃圾字节统计表大小)，sector_count 不得超过 */
+#define NKV_GC_POLICY     2  /* 回收扇区选择：0=最旧扇区, 1=贪心(可回收字节最多), 2=成本收益(可回收比例x年龄/迁移成本) */
+#define NKV_GC_MOVED_SIZE 64 /* 关闭索引时GC已迁移键集合的槽位数(须为2的幂)，装载率超过3/4后回退为完整查找 */
+#define NKV_WEAR_THRESHOLD 64 /* 扇区擦除次数差超过该值时，增量GC优先搬迁擦除次数最少的扇区(冷数据)，0=禁用 */
 
 /* TLV保留策略配置 */
 #define NKV_TLV_RETENTION_ENABLE 1 /* 启用TLV保留策略：0=禁用, 1=启用 */
 #define NKV_TLV_RETENTION_MAX    8 /* TLV保留策略表最大条目数 */
 
+/* CRC引擎配置(各引擎结果与MODBUS CRC16逐位一致) */
+#define NKV_CRC_ENGINE 1 /* 0=逐位计算(无表), 1=256项查表(512B), 2=slice-by-4(2KB表，适合主机/高速MCU) */
+
+/* 批量读取配置 */
+#define NKV_READ_WINDOW 256 /* 扇区遍历的批量读取窗口(字节)，建议256-4096，不小于条目头+最大键长 */
+
+/* 批量写入配置 */
+#define NKV_BATCH_MAX 32 /* nkv_set_batch 单次最多写入的键数(1-255)，整批须能放入一个扇区 */
+
+/* 写缓冲配置(小条目先暂存在RAM中，凑满一个编程页后合并为一次原子批量写入) */
+#define NKV_WRITE_BUFFER     1   /* 编译写缓冲支持：0=禁用, 1=启用(默认关闭，运行时调用 nkv_wbuf_enable 开启) */
+#define NKV_WBUF_SIZE        256 /* 缓冲容量(按落盘后的条目字节计)，建议等于Flash编程页大小(如NOR 256B) */
+#define NKV_WBUF_FLUSH_TICKS 10  /* 暂存数据经过多少次 nkv_wbuf_tick(由 nkv_task 周期调用)后强制落盘 */
+
+/* 大值配置(超过最大值长度的值拆分为同一扇区内连续的分块条目，通过流式接口读写) */
+#define NKV_LARGE_VALUE 1   /* 大值流式接口：0=禁用, 1=启用(已有的大值条目始终可挂载、回收与删除) */
+#define NKV_LARGE_CHUNK 240 /* 每个分块条目的数据字节数(1 ~ NKV_MAX_VALUE_LEN-1) */
+
+/* 零拷贝读取配置(Flash可被CPU直接寻址时，nkv_get_ref 返回指向Flash中值数据的指针) */
+#define NKV_ZERO_COPY 1 /* 零拷贝读取：0=禁用, 1=启用(需在flash ops中提供map，NULL时 nkv_get_ref 返回 NKV_ERR_INVALID) */
+
+/* 线程安全配置 */
+#define NKV_THREAD_SAFE 1 /* 多线程支持：0=禁用, 1=启用(需在flash ops中提供lock/unlock，缓存命中的读取无需加锁) */
+/* 非GCC/Clang编译器(IAR、ARMCC5等)上缓存命中的无锁读取需要编译器/内存屏障，未定义时读取一律加锁，例如：
+ * #define NKV_MEMORY_BARRIER() __DMB() */
+
 /* 可靠性增强配置 */
 #define NKV_VERIFY_ON_READ      1 /* 读取时CRC校验：0=禁用, 1=启用 */
 #define NKV_CLEAN_DIRTY_ON_BOOT 1 /* 启动时清理WRITING状态的脏数据：0=禁用, 1=启用 */
@@ -34,6 +92,12 @@
 /* 打印调试配置 */
 #define NKV_DEBUG_ENABLE 1
 
+/* 配置覆盖：NKV_CFG_OVERRIDE 定义为头文件名(如 -DNKV_CFG_OVERRIDE=\"my_cfg.h\")时在以上默认值之后包含，
+ * 其中可 #undef 后重新定义任意配置项，构建系统据此编译不同配置而无需修改本文件 */
+#ifdef NKV_CFG_OVERRIDE
+    #include NKV_CFG_OVERRIDE
+#endif
+
 #if NKV_DEBUG_ENABLE
     #include <stdio.h>
     #ifndef NKV_PRINTF
@@ -0,0 +1,389 @@
+/**
+ * @file NanoKV_fuzz.c
+ * @brief NanoKV 挂载/解析模糊测试
+ * @note 把任意字节作为Flash镜像挂载，再执行一段由输入决定的操作脚本(读写、删除、TLV、迭代、历史、大值、
+ *       批量写入、GC与重新挂载)，配合 AddressSanitizer/UndefinedBehaviorSanitizer 检查条目解析不越界、
+ *       不死循环。镜像按字节放入模拟器存储区，存储区为精确大小的堆内存，零拷贝读取越界同样会被发现。
+ *
+ * 输入格式: [flags][脚本长度 n][脚本 n 字节][镜像...]，镜像不足部分为擦除态(0xFF)
+ *   flags bit0  模拟器作为可直接寻址的片内Flash(零拷贝读取路径)
+ *   flags bit1  以旧扫描方式挂载(nkv_scan_legacy)
+ *   脚本每2字节一条操作 {opcode, arg}
+ *
+ * 两种构建方式:
+ *   - 定义 NKV_FUZZ_LIBFUZZER 并以 clang -fsanitize=fuzzer 链接，作为 libFuzzer 目标
+ *   - 否则为独立程序: NanoKV_fuzz [--runs N] [--seed N] [FILE...]
+ *       指定文件时逐个执行；否则先用正常负载生成种子镜像，再执行 N 轮确定性变异(默认2000)，
+ *       任何一轮触发越界或断言即由 sanitizer 终止进程，通过时打印执行轮数
+ */
+
+#include "NanoKV.h"
+#include "NanoKV_sim.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZ_SECTOR_SIZE  1024 /* 小扇区：GC、扇区切换与扇区尾部边界更容易被触发 */
+#define FUZZ_SECTOR_COUNT 4
+#define FUZZ_IMAGE_SIZE   (FUZZ_SECTOR_SIZE * FUZZ_SECTOR_COUNT)
+#define FUZZ_KEYS         8
+
+enum
+{
+    FUZZ_OP_SET = 0,
+    FUZZ_OP_GET,
+    FUZZ_OP_DEL,
+    FUZZ_OP_TLV_SET,
+    FUZZ_OP_TLV_GET,
+    FUZZ_OP_TLV_ITER,
+    FUZZ_OP_TLV_HISTORY,
+    FUZZ_OP_BATCH,
+    FUZZ_OP_STREAM,
+    FUZZ_OP_REF,
+    FUZZ_OP_GC,
+    FUZZ_OP_REMOUNT,
+    FUZZ_OP_COUNT,
+};
+
+static nkv_instance_t g_db;
+static uint8_t*       g_mem;
+
+static const char* fuzz_key(uint8_t arg)
+{
+    /* 最后一个键取最大长度，覆盖键长边界 */
+    static const char* keys[FUZZ_KEYS] = {"a", "k1", "key2", "cfg.3", "net.ip", "boot_cnt", "k6", "abcdefghijklmno"};
+    return keys[arg % FUZZ_KEYS];
+}
+
+static int fuzz_stream_sink(void* ctx, uint32_t offset, uint8_t* buf, uint16_t len)
+{
+    (void) ctx;
+    (void) offset;
+    volatile uint8_t sum = 0;
+    for (uint16_t i = 0; i < len; i++)
+        sum += buf[i];
+    return 0;
+}
+
+#if NKV_LARGE_VALUE
+static int fuzz_stream_src(void* ctx, uint32_t offset, uint8_t* buf, uint16_t len)
+{
+    (void) ctx;
+    for (uint16_t i = 0; i < len; i++)
+        buf[i] = (uint8_t) (offset + i);
+    return 0;
+}
+#endif
+
+static void fuzz_mount(uint8_t flags)
+{
+    nkv_flash_ops_t ops;
+    nkv_sim_ops(&ops);
+    nkv_internal_init_ex(&g_db, &ops);
+    if (flags & 0x02)
+        nkv_scan_legacy_ex(&g_db);
+    else
+        nkv_scan_ex(&g_db);
+}
+
+static void fuzz_op(uint8_t op, uint8_t arg, uint8_t flags)
+{
+    uint8_t buf[NKV_MAX_VALUE_LEN];
+    uint8_t len = 0;
+
+    switch (op % FUZZ_OP_COUNT)
+    {
+    case FUZZ_OP_SET:
+        memset(buf, arg, sizeof(buf));
+        nkv_set_ex(&g_db, fuzz_key(arg), buf, (uint8_t) (arg | 1));
+        break;
+
+    case FUZZ_OP_GET:
+        nkv_get_ex(&g_db, fuzz_key(arg), buf, (uint8_t) (arg & 0x80 ? sizeof(buf) : arg), &len);
+        nkv_exists_ex(&g_db, fuzz_key(arg));
+        break;
+
+    case FUZZ_OP_DEL:
+        nkv_del_ex(&g_db, fuzz_key(arg));
+        break;
+
+    case FUZZ_OP_TLV_SET:
+        memset(buf, ~arg, sizeof(buf));
+        nkv_tlv_set_ex(&g_db, (uint8_t) (arg | 1), buf, (uint8_t) ((arg >> 1) | 1));
+        break;
+
+    case FUZZ_OP_TLV_GET:
+        nkv_tlv_get_ex(&g_db, arg, buf, sizeof(buf), &len);
+        nkv_tlv_exists_ex(&g_db, arg);
+        break;
+
+    case FUZZ_OP_TLV_ITER:
+    {
+        nkv_tlv_iter_t  iter;
+        nkv_tlv_entry_t info;
+        uint16_t        count;
+        uint32_t        used;
+        nkv_tlv_iter_init_ex(&g_db, &iter);
+        while (nkv_tlv_iter_next(&iter, &info))
+            nkv_tlv_iter_read_ex(&g_db, &info, buf, sizeof(buf));
+        nkv_tlv_stats_ex(&g_db, &count, &used);
+        break;
+    }
+
+    case FUZZ_OP_TLV_HISTORY:
+    {
+        nkv_tlv_history_t hist[4];
+        uint8_t           n = 0;
+        if (nkv_tlv_get_history_ex(&g_db, arg, hist, 4, &n) == NKV_OK)
+            for (uint8_t i = 0; i < n; i++)
+                nkv_tlv_read_history_ex(&g_db, &hist[i], buf, sizeof(buf));
+        break;
+    }
+
+    case FUZZ_OP_BATCH:
+    {
+        memset(buf, arg ^ 0x5A, sizeof(buf));
+        nkv_batch_item_t items[3] = {
+            {fuzz_key(arg), buf, (uint8_t) (arg & 0x3F)},
+            {fuzz_key(arg + 1), buf, 7},
+            {fuzz_key(arg + 3), buf, 0},
+        };
+        nkv_set_batch_ex(&g_db, items, 1 + arg % 3);
+        break;
+    }
+
+    case FUZZ_OP_STREAM:
+#if NKV_LARGE_VALUE
+    {
+        uint32_t out = 0;
+        if (arg & 1)
+            nkv_set_stream_ex(&g_db, fuzz_key(arg >> 1), 300 + arg, fuzz_stream_src, NULL);
+        nkv_get_stream_ex(&g_db, fuzz_key(arg >> 1), fuzz_stream_sink, NULL, &out);
+    }
+#endif
+        break;
+
+    case FUZZ_OP_REF:
+#if NKV_ZERO_COPY
+    {
+        nkv_ref_t ref;
+        if (nkv_get_ref_ex(&g_db, fuzz_key(arg), &ref) == NKV_OK)
+            fuzz_stream_sink(NULL, 0, (uint8_t*) ref.data, ref.len);
+    }
+#endif
+        break;
+
+    case FUZZ_OP_GC:
+#if NKV_BACKGROUND_GC
+        if (arg & 0x80)
+        {
+            nkv_budget_t budget = {(uint16_t) (arg & 0x0F), 0};
+            nkv_background_ex(&g_db, &budget);
+            break;
+        }
+#endif
+#if NKV_INCREMENTAL_GC
+        nkv_gc_step_ex(&g_db, (uint8_t) (arg % 8 + 1));
+#else
+        /* 全量GC只在空间不足时由写入触发 */
+        memset(buf, arg, sizeof(buf));
+        for (uint8_t i = 0; i < 4; i++)
+            nkv_set_ex(&g_db, fuzz_key(arg + i), buf, sizeof(buf));
+#endif
+        break;
+
+    case FUZZ_OP_REMOUNT:
+        fuzz_mount((uint8_t) (flags ^ (arg & 0x02)));
+        break;
+    }
+}
+
+/* 执行一个输入：挂载镜像、运行脚本，最后重新挂载并读取全部键，检查写入后的镜像同样可被解析 */
+static void fuzz_one(const uint8_t* data, size_t size)
+{
+    nkv_sim_cfg_t cfg = nkv_sim_spi_nor;
+    cfg.name          = "fuzz";
+    cfg.sector_size   = FUZZ_SECTOR_SIZE;
+    cfg.sector_count  = FUZZ_SECTOR_COUNT;
+
+    uint8_t        flags  = size > 0 ? data[0] : 0;
+    size_t         n      = size > 1 ? data[1] : 0;
+    const uint8_t* script = data + 2;
+    if (size < 2 || n > size - 2)
+        n = size > 2 ? size - 2 : 0;
+    size_t         image_len = size > 2 + n ? size - 2 - n : 0;
+    const uint8_t* image     = script + n;
+
+    cfg.mapped = flags & 0x01;
+    nkv_sim_init(&cfg, g_mem);
+    memcpy(g_mem, image, image_len < FUZZ_IMAGE_SIZE ? image_len : FUZZ_IMAGE_SIZE);
+
+    fuzz_mount(flags);
+    for (size_t i = 0; i + 1 < n; i += 2)
+        fuzz_op(script[i], script[i + 1], flags);
+
+    fuzz_mount(flags);
+    for (uint8_t k = 0; k < FUZZ_KEYS; k++)
+        fuzz_op(FUZZ_OP_GET, (uint8_t) (k | 0x80), flags);
+    fuzz_op(FUZZ_OP_TLV_ITER, 0, flags);
+}
+
+#ifdef NKV_FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (!g_mem)
+        g_mem = (uint8_t*) malloc(FUZZ_IMAGE_SIZE);
+    fuzz_one(data, size);
+    return 0;
+}
+
+#else /* 独立程序 */
+
+static uint32_t g_rng;
+
+static uint32_t fuzz_rand(void)
+{
+    /* xorshift32：各平台序列一致 */
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+/* 种子镜像：用正常负载写满各类条目(普通、TLV、批量、大值、删除标记)并经历扇区切换与GC */
+static void fuzz_make_seed(uint8_t* image)
+{
+    nkv_sim_cfg_t cfg = nkv_sim_spi_nor;
+    cfg.sector_size   = FUZZ_SECTOR_SIZE;
+    cfg.sector_count  = FUZZ_SECTOR_COUNT;
+    nkv_sim_init(&cfg, g_mem);
+    fuzz_mount(0);
+    for (uint32_t i = 0; i < 60; i++)
+    {
+        fuzz_op(FUZZ_OP_SET, (uint8_t) (i * 7), 0);
+        fuzz_op(FUZZ_OP_TLV_SET, (uint8_t) (i * 5 + 16), 0);
+        if (i % 5 == 0)
+            fuzz_op(FUZZ_OP_DEL, (uint8_t) i, 0);
+        if (i % 9 == 0)
+            fuzz_op(FUZZ_OP_BATCH, (uint8_t) i, 0);
+        if (i % 20 == 1)
+            fuzz_op(FUZZ_OP_STREAM, (uint8_t) i, 0);
+    }
+    memcpy(image, g_mem, FUZZ_IMAGE_SIZE);
+}
+
+/* 变异：随机翻转字节、改写扇区头、在条目对齐位置伪造条目头(合法状态字 + 任意长度字段)、把一段区域改回擦除态 */
+static void fuzz_mutate(uint8_t* image)
+{
+    static const uint16_t states[] = {NKV_STATE_WRITING, NKV_STATE_VALID, NKV_STATE_PRE_DEL, NKV_STATE_DELETED};
+    uint32_t              rounds   = 1 + fuzz_rand() % 8;
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        uint32_t pos = fuzz_rand() % FUZZ_IMAGE_SIZE;
+        switch (fuzz_rand() % 5)
+        {
+        case 0:
+            image[pos] ^= (uint8_t) (1u << (fuzz_rand() % 8));
+            break;
+
+        case 1:
+            image[pos] = (uint8_t) fuzz_rand();
+            break;
+
+        case 2:
+        {
+            uint16_t st = states[fuzz_rand() % 4];
+            pos &= ~3u;
+            if (pos + NKV_HEADER_SIZE > FUZZ_IMAGE_SIZE)
+                break;
+            image[pos]     = (uint8_t) st;
+            image[pos + 1] = (uint8_t) (st >> 8);
+            image[pos + 2] = (uint8_t) fuzz_rand(); /* key_len */
+            image[pos + 3] = (uint8_t) fuzz_rand(); /* val_len */
+            if (fuzz_rand() & 1)
+                image[pos + 5] = (uint8_t) (0xFC + fuzz_rand() % 4); /* 批量/提交/大值标志 */
+            break;
+        }
+
+        case 3:
+            /* 扇区头：魔数、格式、序号与擦除次数 */
+            image[pos / FUZZ_SECTOR_SIZE * FUZZ_SECTOR_SIZE + fuzz_rand() % 16] = (uint8_t) fuzz_rand();
+            break;
+
+        default:
+        {
+            uint32_t len = 1 + fuzz_rand() % 64;
+            if (len > FUZZ_IMAGE_SIZE - pos)
+                len = FUZZ_IMAGE_SIZE - pos;
+            memset(image + pos, 0xFF, len);
+            break;
+        }
+        }
+    }
+}
+
+static int fuzz_file(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    static uint8_t data[2 + 255 + FUZZ_IMAGE_SIZE];
+    size_t         size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    fuzz_one(data, size);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t runs = 2000, seed = 1;
+    int      files = 0, ret = 0;
+
+    g_mem = (uint8_t*) malloc(FUZZ_IMAGE_SIZE);
+    if (!g_mem)
+        return 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--runs") && i + 1 < argc)
+            runs = (uint32_t) strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = (uint32_t) strtoul(argv[++i], NULL, 0);
+        else
+        {
+            ret |= fuzz_file(argv[i]);
+            files++;
+        }
+    }
+    if (files)
+    {
+        free(g_mem);
+        return ret;
+    }
+
+    /* 输入 = {flags, 脚本长度, 脚本, 镜像} */
+    static uint8_t seed_image[FUZZ_IMAGE_SIZE];
+    static uint8_t input[2 + 64 + FUZZ_IMAGE_SIZE];
+    fuzz_make_seed(seed_image);
+    g_rng = seed ? seed : 1;
+    for (uint32_t r = 0; r < runs; r++)
+    {
+        input[0] = (uint8_t) fuzz_rand();
+        input[1] = 64;
+        for (uint32_t i = 0; i < 64; i++)
+            input[2 + i] = (uint8_t) fuzz_rand();
+        memcpy(input + 2 + 64, seed_image, FUZZ_IMAGE_SIZE);
+        fuzz_mutate(input + 2 + 64);
+        fuzz_one(input, sizeof(input));
+    }
+    printf("NanoKV fuzz: %u runs passed (seed %u)\n", (unsigned) runs, (unsigned) seed);
+    free(g_mem);
+    return 0;
+}
+
+#endif /* NKV_FUZZ_LIBFUZZER */
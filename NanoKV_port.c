@@ -44,6 +44,19 @@ static const nkv_flash_ops_t g_flash_ops = {
     .read         = flash_read_impl,
     .write        = flash_write_impl,
     .erase        = flash_erase_impl,
+    .crc16        = NULL, /* STM32F4硬件CRC单元仅支持CRC32，使用软件引擎 */
+    .clock_us     = NULL, /* 可接入DWT周期计数器换算的微秒时钟，启用按时间的后台预算与耗时统计 */
+#if NKV_THREAD_SAFE
+    .lock         = NULL, /* 裸机单线程无需加锁，RTOS下可接入互斥量 */
+    .unlock       = NULL,
+#endif
+#if NKV_ZERO_COPY
+    .map          = (const uint8_t*) NKV_FLASH_BASE, /* 片内Flash可直接按地址读取 */
+#endif
+#if NKV_ASYNC_FLASH
+    .write_async  = NULL, /* 片内Flash编程期间总线停顿，退化为阻塞写入；外挂SPI Flash可接入DMA+完成中断 */
+    .erase_async  = NULL,
+#endif
     .base         = NKV_FLASH_BASE,
     .sector_size  = NKV_SECTOR_SIZE,
     .sector_count = NKV_SECTOR_COUNT,
@@ -87,8 +100,19 @@ nkv_err_t nkv_init(void)
     return NKV_OK;
 }
 
-/* 维护任务 */
-void nkv_task(void)
+/* 维护任务：在空闲时周期调用，budget 限制本次执行的工作量(NULL=做完全部待处理工作) */
+void nkv_task(const nkv_budget_t* budget)
 {
-    /* 可添加定期维护任务 */
+#if NKV_ASYNC_FLASH
+    if (nkv_async_poll()) /* 异步作业进行中，等待驱动完成后再做后台工作 */
+        return;
+#endif
+#if NKV_BACKGROUND_GC
+    nkv_background(budget); /* 写缓冲超时落盘、增量GC、空闲扇区预擦除 */
+#elif NKV_WRITE_BUFFER
+    (void) budget;
+    nkv_wbuf_tick(); /* 写缓冲超时落盘，最长滞留时间 = NKV_WBUF_FLUSH_TICKS x 调用周期 */
+#else
+    (void) budget;
+#endif
 }
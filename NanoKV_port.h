@@ -16,8 +16,8 @@ extern "C"
 
 
     /* 初始化函数 */
-    nkv_err_t nkv_init(void); /* 初始化NanoKV */
-    void      nkv_task(void); /* 维护任务(可选) */
+    nkv_err_t nkv_init(void);                     /* 初始化NanoKV */
+    void      nkv_task(const nkv_budget_t* budget); /* 维护任务(可选)，budget=NULL不限 */
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,218 @@
+﻿/**
+ * @file NanoKV_sim.c
+ * @brief NanoKV Flash模拟器实现
+ * @note 耗时模型只累计Flash忙时间，同一操作序列在任何主机上得到相同结果
+ */
+
+#include "NanoKV_sim.h"
+
+#include <string.h>
+
+
+/* STM32F407：片内Flash经ART加速器读取约6ns/字节；x32并行编程每字16us；128KB扇区擦除典型1s */
+const nkv_sim_cfg_t nkv_sim_stm32f4 = {
+    .name         = "stm32f4",
+    .base         = 0x08080000,
+    .sector_size  = 128 * 1024,
+    .sector_count = 4,
+    .align        = 4,
+    .mapped       = 1,
+    .page_size    = 4,
+    .read_op_ns   = 0,
+    .read_byte_ns = 6,
+    .prog_op_ns   = 16000,
+    .prog_byte_ns = 0,
+    .erase_us     = 1000000,
+};
+
+/* W25Q系列类SPI NOR(50MHz单线)：读命令+地址约1us，每字节160ns；页编程典型0.7ms；4KB扇区擦除典型45ms */
+const nkv_sim_cfg_t nkv_sim_spi_nor = {
+    .name         = "spi-nor",
+    .base         = 0,
+    .sector_size  = 4 * 1024,
+    .sector_count = 16,
+    .align        = 4, /* 器件可按字节编程，NanoKV要求状态字(2字节)原子写入 */
+    .mapped       = 0,
+    .page_size    = 256,
+    .read_op_ns   = 1000,
+    .read_byte_ns = 160,
+    .prog_op_ns   = 700000,
+    .prog_byte_ns = 160,
+    .erase_us     = 45000,
+};
+
+static nkv_sim_cfg_t    g_cfg;
+static uint8_t*         g_mem;
+static nkv_sim_stats_t  g_stats;
+static uint64_t         g_now_ns;    /* 模拟时钟 */
+static uint32_t         g_cut_after; /* 距掉电还剩的 write/erase 次数，0=不注入 */
+static uint8_t          g_power_off;
+static nkv_sim_fault_fn g_cut_fn;
+
+static void sim_busy(uint64_t ns)
+{
+    g_now_ns += ns;
+    g_stats.busy_ns += ns;
+}
+
+/* 每次 write/erase 前调用：返回1表示本次操作被掉电打断(只完成一半)，2表示已掉电 */
+static int sim_power_check(void)
+{
+    if (g_power_off)
+        return 2;
+    if (g_cut_after && --g_cut_after == 0)
+    {
+        g_power_off = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static void sim_power_lost(void)
+{
+    if (g_cut_fn)
+        g_cut_fn();
+}
+
+/* 地址换算为存储区偏移，越界返回 -1 */
+static int64_t sim_offset(uint32_t addr, uint32_t len)
+{
+    uint32_t size = g_cfg.sector_size * g_cfg.sector_count;
+    if (!g_mem || addr < g_cfg.base || addr - g_cfg.base > size || len > size - (addr - g_cfg.base))
+        return -1;
+    return addr - g_cfg.base;
+}
+
+static int sim_read(uint32_t addr, uint8_t* buf, uint32_t len)
+{
+    int64_t off = sim_offset(addr, len);
+    if (off < 0)
+        return -1;
+    g_stats.read_ops++;
+    g_stats.read_bytes += len;
+    sim_busy(g_cfg.read_op_ns + (uint64_t) g_cfg.read_byte_ns * len);
+    memcpy(buf, g_mem + off, len);
+    return 0;
+}
+
+/* NOR编程只能把1变为0：写入结果为原内容与数据按位与，按页拆分为多次编程操作 */
+static int sim_write(uint32_t addr, const uint8_t* buf, uint32_t len)
+{
+    int64_t off = sim_offset(addr, len);
+    if (off < 0)
+        return -1;
+    int cut = sim_power_check();
+    if (cut == 2)
+        return -1;
+    if (cut)
+        len /= 2;
+    if (g_cfg.align > 1 && ((addr | len) & (g_cfg.align - 1)) != 0 && !cut)
+        g_stats.align_errors++;
+    g_stats.write_calls++;
+
+    uint32_t done = 0;
+    while (done < len)
+    {
+        uint32_t n = len - done;
+        if (g_cfg.page_size)
+        {
+            uint32_t room = g_cfg.page_size - (uint32_t) ((off + done) % g_cfg.page_size);
+            if (n > room)
+                n = room;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint8_t* p = &g_mem[off + done + i];
+            if (buf[done + i] & ~*p)
+                g_stats.bit_errors++;
+            *p &= buf[done + i];
+        }
+        g_stats.prog_ops++;
+        sim_busy(g_cfg.prog_op_ns + (uint64_t) g_cfg.prog_byte_ns * n);
+        done += n;
+    }
+    g_stats.prog_bytes += len;
+    if (cut)
+    {
+        sim_power_lost();
+        return -1;
+    }
+    return 0;
+}
+
+static int sim_erase(uint32_t addr)
+{
+    int64_t off = sim_offset(addr, 1);
+    if (off < 0)
+        return -1;
+    int cut = sim_power_check();
+    if (cut == 2)
+        return -1;
+    uint32_t idx = (uint32_t) off / g_cfg.sector_size;
+    memset(g_mem + idx * g_cfg.sector_size, 0xFF, cut ? g_cfg.sector_size / 2 : g_cfg.sector_size);
+    g_stats.erases++;
+    g_stats.sector_erases[idx]++;
+    sim_busy((uint64_t) g_cfg.erase_us * 1000u);
+    if (cut)
+    {
+        sim_power_lost();
+        return -1;
+    }
+    return 0;
+}
+
+nkv_err_t nkv_sim_init(const nkv_sim_cfg_t* cfg, uint8_t* mem)
+{
+    if (!cfg || !mem || cfg->sector_count < 2 || cfg->sector_count > NKV_MAX_SECTORS || cfg->sector_size == 0 ||
+        cfg->align == 0 || (cfg->align & (cfg->align - 1)) != 0)
+        return NKV_ERR_INVALID;
+    g_cfg    = *cfg;
+    g_mem    = mem;
+    g_now_ns = 0;
+    nkv_sim_power_cut(0, NULL);
+    memset(&g_stats, 0, sizeof(g_stats));
+    memset(mem, 0xFF, cfg->sector_size * cfg->sector_count);
+    return NKV_OK;
+}
+
+void nkv_sim_ops(nkv_flash_ops_t* ops)
+{
+    memset(ops, 0, sizeof(*ops));
+    ops->read     = sim_read;
+    ops->write    = sim_write;
+    ops->erase    = sim_erase;
+    ops->clock_us = nkv_sim_clock_us;
+#if NKV_ZERO_COPY
+    ops->map = g_cfg.mapped ? g_mem : NULL;
+#endif
+    ops->base         = g_cfg.base;
+    ops->sector_size  = g_cfg.sector_size;
+    ops->sector_count = g_cfg.sector_count;
+    ops->align        = g_cfg.align;
+}
+
+void nkv_sim_stats(nkv_sim_stats_t* stats)
+{
+    if (stats)
+        *stats = g_stats;
+}
+
+void nkv_sim_stats_reset(void)
+{
+    uint32_t erases[NKV_MAX_SECTORS];
+    memcpy(erases, g_stats.sector_erases, sizeof(erases));
+    memset(&g_stats, 0, sizeof(g_stats));
+    memcpy(g_stats.sector_erases, erases, sizeof(erases));
+}
+
+uint32_t nkv_sim_clock_us(void)
+{
+    return (uint32_t) (g_now_ns / 1000u);
+}
+
+void nkv_sim_power_cut(uint32_t after, nkv_sim_fault_fn fn)
+{
+    g_cut_after = after;
+    g_cut_fn    = fn;
+    g_power_off = 0;
+}
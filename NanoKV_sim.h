@@ -0,0 +1,78 @@
+/**
+ * @file NanoKV_sim.h
+ * @brief NanoKV Flash模拟器
+ * @note 在主机上以RAM模拟NOR Flash：按位与编程、编程页拆分、扇区擦除计数与确定性耗时模型，
+ *       为测试和基准测试提供可复现、接近真实器件的 nkv_flash_ops_t 后端。仅用于主机，不参与目标板编译。
+ */
+
+#ifndef __NANOKV_SIM_H
+#define __NANOKV_SIM_H
+
+#include "NanoKV.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* 器件参数：几何尺寸与耗时模型(耗时单位为纳秒，便于表达片内Flash的亚微秒读取) */
+    typedef struct
+    {
+        const char* name;         /* 预设名称(报告用) */
+        uint32_t    base;         /* Flash基地址 */
+        uint32_t    sector_size;  /* 擦除扇区大小 */
+        uint8_t     sector_count; /* 扇区数量(不超过 NKV_MAX_SECTORS) */
+        uint8_t     align;        /* 编程对齐字节数 */
+        uint8_t     mapped;       /* 1=片内Flash可直接寻址(零拷贝读取不经过read，不计耗时) */
+        uint16_t    page_size;    /* 编程页大小：一次写入按页拆分为多次编程操作，0=不限 */
+        uint32_t    read_op_ns;   /* 每次读取事务的固定开销(命令、地址、空周期) */
+        uint32_t    read_byte_ns; /* 每读取1字节的耗时 */
+        uint32_t    prog_op_ns;   /* 每个编程页的固定耗时(写使能、命令与编程等待) */
+        uint32_t    prog_byte_ns; /* 每编程1字节的数据传输耗时 */
+        uint32_t    erase_us;     /* 擦除一个扇区的耗时 */
+    } nkv_sim_cfg_t;
+
+    /* 模拟器统计 */
+    typedef struct
+    {
+        uint32_t read_ops;                      /* 读取事务数 */
+        uint32_t read_bytes;                    /* 读取字节数 */
+        uint32_t write_calls;                   /* write 调用次数(按页拆分前) */
+        uint32_t prog_ops;                      /* 编程操作数(按页拆分后) */
+        uint32_t prog_bytes;                    /* 编程字节数 */
+        uint32_t erases;                        /* 擦除次数 */
+        uint32_t bit_errors;                    /* 试图把0编程为1的字节数(NOR无法实现，结果按位与) */
+        uint32_t align_errors;                  /* 地址或长度未按 align 对齐的编程次数 */
+        uint64_t busy_ns;                       /* 累计Flash忙时间 */
+        uint32_t sector_erases[NKV_MAX_SECTORS]; /* 各扇区擦除次数 */
+    } nkv_sim_stats_t;
+
+    /* 掉电回调：通常 longjmp 回测试框架，模拟CPU随掉电停止执行 */
+    typedef void (*nkv_sim_fault_fn)(void);
+
+    /* 器件预设 */
+    extern const nkv_sim_cfg_t nkv_sim_stm32f4;  /* STM32F4片内Flash：128KB扇区、x32字编程 */
+    extern const nkv_sim_cfg_t nkv_sim_spi_nor;  /* 通用SPI NOR(50MHz单线)：4KB扇区、256字节编程页 */
+
+    /*
+     * 模拟器为单例(flash ops回调不携带上下文)，mem 由调用者提供，大小 sector_size * sector_count。
+     * 初始化后 mem 全部为擦除态(0xFF)，统计与时钟清零；成功返回 NKV_OK。
+     */
+    nkv_err_t nkv_sim_init(const nkv_sim_cfg_t* cfg, uint8_t* mem);
+    void      nkv_sim_ops(nkv_flash_ops_t* ops);   /* 生成指向模拟器的 flash ops(含 clock_us 与 map) */
+    void      nkv_sim_stats(nkv_sim_stats_t* stats);
+    void      nkv_sim_stats_reset(void);            /* 清零计数与忙时间(不影响时钟与各扇区擦除次数) */
+    uint32_t  nkv_sim_clock_us(void);               /* 模拟时钟：只按Flash忙时间推进，CPU耗时不计入 */
+
+    /*
+     * 掉电注入：从调用时起第 after 次 write/erase(从1计)只完成一半即掉电——编程只写入前一半字节，
+     * 擦除只擦除扇区前一半，随后调用 fn。fn 返回时该操作返回失败，之后的 write/erase 全部失败，
+     * 直到再次调用本函数；after=0 恢复供电、关闭注入。存储内容保留，重新挂载即模拟重启。
+     */
+    void nkv_sim_power_cut(uint32_t after, nkv_sim_fault_fn fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __NANOKV_SIM_H */
@@ -5,12 +5,19 @@
  */
 
 #include "NanoKV.h"
+#include "NanoKV_sim.h"
 
+#include <setjmp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
+#if NKV_THREAD_SAFE && !defined(_WIN32)
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
 /* ==================== 计时工具 ==================== */
 
 #ifdef _WIN32
@@ -57,10 +64,21 @@ static double timer_elapsed_us(void)
 #define TEST_SECTOR_SIZE  (4 * 1024u) /* 每个扇区 4KB */
 #define TEST_SECTOR_COUNT 4u          /* 扇区数量 4 个 */
 #define TEST_FLASH_SIZE   (TEST_SECTOR_SIZE * TEST_SECTOR_COUNT)
+#define TEST_PROG_US      10    /* 模拟时钟：每编程4字节的耗时(us) */
+#define TEST_ERASE_US     20000 /* 模拟时钟：擦除一个扇区的耗时(us) */
 
 static uint8_t  g_flash[TEST_FLASH_SIZE];
-static uint32_t g_test_pass = 0;
-static uint32_t g_test_fail = 0;
+static uint32_t g_test_pass  = 0;
+static uint32_t g_test_fail  = 0;
+static uint32_t g_read_calls = 0; /* flash.read 调用次数 */
+static uint32_t g_read_bytes = 0; /* flash.read 读取字节数 */
+static uint32_t g_write_calls      = 0; /* flash.write 调用次数(编程操作数) */
+static uint32_t g_write_fail_after = 0; /* 非0时第N次之后的写入模拟掉电：只写入前半部分并返回失败 */
+static uint32_t g_sim_us           = 0; /* 模拟时钟(us)：按编程与擦除耗时推进，读取不计时 */
+static uint32_t g_erase_calls      = 0; /* flash.erase 调用次数 */
+#if NKV_THREAD_SAFE && !defined(_WIN32)
+static uint32_t g_write_delay_us = 0; /* 模拟Flash编程耗时(仅多线程测试使用) */
+#endif
 
 /* 性能统计 */
 typedef struct
@@ -113,6 +131,8 @@ static int mock_flash_read(uint32_t addr, uint8_t* buf, uint32_t len)
 {
     if (flash_range_check(addr, len) != 0)
         return -1;
+    g_read_calls++;
+    g_read_bytes += len;
     memcpy(buf, &g_flash[addr], len);
     return 0;
 }
@@ -121,6 +141,17 @@ static int mock_flash_write(uint32_t addr, const uint8_t* buf, uint32_t len)
 {
     if (flash_range_check(addr, len) != 0)
         return -1;
+#if NKV_THREAD_SAFE && !defined(_WIN32)
+    if (g_write_delay_us)
+        usleep(g_write_delay_us);
+#endif
+    if (g_write_fail_after && g_write_calls >= g_write_fail_after)
+    {
+        memcpy(&g_flash[addr], buf, len / 2);
+        return -1;
+    }
+    g_write_calls++;
+    g_sim_us += TEST_PROG_US * ((len + 3) / 4);
     memcpy(&g_flash[addr], buf, len);
     return 0;
 }
@@ -131,15 +162,36 @@ static int mock_flash_erase(uint32_t addr)
         return -1;
     uint32_t sector_index = addr / TEST_SECTOR_SIZE;
     uint32_t base         = sector_index * TEST_SECTOR_SIZE;
+    g_sim_us += TEST_ERASE_US;
+    g_erase_calls++;
     memset(&g_flash[base], 0xFF, TEST_SECTOR_SIZE);
     return 0;
 }
 
+static uint32_t mock_clock_us(void)
+{
+    return g_sim_us;
+}
+
 static void build_flash_ops(nkv_flash_ops_t* ops)
 {
     ops->read         = mock_flash_read;
     ops->write        = mock_flash_write;
     ops->erase        = mock_flash_erase;
+    ops->crc16        = NULL;
+    ops->clock_us     = mock_clock_us;
+#if NKV_ZERO_COPY
+    ops->map      = g_flash; /* 模拟片内Flash可直接寻址 */
+#endif
+#if NKV_ASYNC_FLASH
+    ops->write_async = NULL;
+    ops->erase_async = NULL;
+#endif
+#if NKV_THREAD_SAFE
+    ops->lock     = NULL;
+    ops->unlock   = NULL;
+    ops->lock_ctx = NULL;
+#endif
     ops->base         = 0;
     ops->sector_size  = TEST_SECTOR_SIZE;
     ops->sector_count = TEST_SECTOR_COUNT;
@@ -236,8 +288,8 @@ static void test_kv_defaults(void)
         {.key = "mode",       .value = &def_mode,       .len = sizeof(def_mode)      },
     };
 
-    nkv_set_defaults(defaults, sizeof(defaults) / sizeof(defaults[0]));
-    TEST_ASSERT(1, "nkv_set_defaults() called");
+    TEST_ASSERT(nkv_set_defaults(defaults, sizeof(defaults) / sizeof(defaults[0])) == NKV_OK,
+                "nkv_set_defaults() called");
 
     /* 未写入时，使用 get_default 获取默认值 */
     uint32_t  brightness = 0;
@@ -318,8 +370,8 @@ static void test_tlv_defaults(void)
         {.type = 0x21, .value = &def_interval,    .len = sizeof(def_interval)   },
     };
 
-    nkv_tlv_set_defaults(tlv_defaults, sizeof(tlv_defaults) / sizeof(tlv_defaults[0]));
-    TEST_ASSERT(1, "nkv_tlv_set_defaults() called");
+    TEST_ASSERT(nkv_tlv_set_defaults(tlv_defaults, sizeof(tlv_defaults) / sizeof(tlv_defaults[0])) == NKV_OK,
+                "nkv_tlv_set_defaults() called");
 
     /* 未写入时获取默认值 */
     uint8_t   sensor_mode = 0;
@@ -460,7 +512,7 @@ static void test_incremental_gc(void)
     printf("\n=== 8. 增量 GC 测试 ===\n");
 
     /* 写入大量数据以触发 GC */
-    char     key[16];
+    char     key[20];
     uint32_t val;
     for (int i = 0; i < 50; i++)
     {
@@ -767,10 +819,10 @@ static void test_incremental_gc_full(void)
     printf("  [INFO] sector_size=%u, sector_count=%u\n", (unsigned) inst->flash.sector_size, inst->flash.sector_count);
 
     /* 计算填满 3 个扇区所需的条目数 */
-    uint32_t entry_size         = 4 + 6 + 32 + 2; /* header + key + val + crc, aligned to 44 */
     uint32_t usable_space       = inst->flash.sector_size - 4;
     uint32_t entries_per_sector = usable_space / 48;           /* aligned entry size */
     uint32_t target_entries     = entries_per_sector * 3 + 10; /* 填满 3 扇区再多写一点 */
+    uint32_t key_space          = entries_per_sector * 3 / 2;  /* 有效数据约 1.5 扇区，其余写入成为垃圾 */
 
     printf("  [INFO] Target: ~%u entries to fill 3 sectors\n", (unsigned) target_entries);
 
@@ -786,7 +838,8 @@ static void test_incremental_gc_full(void)
 
     for (uint32_t i = 0; i < target_entries; i++)
     {
-        snprintf(key, sizeof(key), "gc3_%u", (unsigned) i);
+        snprintf(key, sizeof(key), "gc3_%u", (unsigned) (i % key_space));
+        val[0] = (uint8_t) i;
 
         timer_start();
         nkv_err_t err     = nkv_set(key, val, sizeof(val));
@@ -827,18 +880,21 @@ static void test_incremental_gc_full(void)
     printf("  [INFO] Estimated GC overhead: %.1fus\n", total_gc_time);
     PERF_ADD(gc, total_gc_time);
 
-    /* 验证数据完整性 */
+    TEST_ASSERT(write_count == (int) target_entries, "All writes succeed while GC reclaims garbage");
+
+    /* 验证数据完整性：每个键都应读到最后一次写入的值 */
     uint8_t read_val[32];
     uint8_t len;
     int     valid = 0;
-    for (int i = 0; i < write_count; i += 10)
+    for (uint32_t k = 0; k < key_space; k++)
     {
-        snprintf(key, sizeof(key), "gc3_%d", i);
-        if (nkv_get(key, read_val, sizeof(read_val), &len) == NKV_OK && len == 32)
+        uint32_t last = k + (write_count - 1 - k) / key_space * key_space;
+        snprintf(key, sizeof(key), "gc3_%u", (unsigned) k);
+        if (nkv_get(key, read_val, sizeof(read_val), &len) == NKV_OK && len == 32 && read_val[0] == (uint8_t) last)
             valid++;
     }
-    TEST_ASSERT(valid > 0, "Data integrity after 3-sector GC");
-    printf("  [INFO] Verified %d/%d sampled entries\n", valid, (write_count + 9) / 10);
+    TEST_ASSERT(valid == (int) key_space, "Data integrity after 3-sector GC");
+    printf("  [INFO] Verified %d/%u keys\n", valid, (unsigned) key_space);
 
     /* 应该触发过至少 1 次 GC */
     TEST_ASSERT(gc_trigger_cnt >= 1 || inst->sector_seq > 3, "GC should have triggered");
@@ -961,16 +1017,15 @@ static void test_power_fail_safety(void)
     nkv_set("pf_key2", &new_val, sizeof(new_val));
 
     /* 手动将其状态改为 PRE_DEL（模拟更新过程中掉电） */
-    nkv_entry_t dummy;
-    uint32_t    addr = 0;
+    uint32_t addr = 0;
     /* 查找最后写入的条目 */
     for (uint32_t off = 4; off < inst->write_offset; off += 4)
     {
-        uint16_t state;
+        uint16_t state = 0;
         mock_flash_read(off, (uint8_t*) &state, 2);
         if (state == 0xFFFC) /* VALID */
         {
-            uint8_t kl, vl;
+            uint8_t kl = 0, vl = 0;
             mock_flash_read(off + 2, &kl, 1);
             mock_flash_read(off + 3, &vl, 1);
             if (kl == 7) /* "pf_key2" */
@@ -1003,74 +1058,2823 @@ static void test_power_fail_safety(void)
     print_usage();
 }
 
-/* ==================== 主函数 ==================== */
-
-int main(void)
+/* 18. RAM 索引测试 */
+#if NKV_INDEX_ENABLE
+static void test_index(void)
 {
-    printf("========================================\n");
-    printf("   NanoKV 完整功能测试\n");
-    printf("========================================\n");
+    printf("\n=== 18. RAM 索引测试 ===\n");
 
-    /* 初始化计时器 */
-    timer_init();
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+
+    nkv_instance_t* inst = nkv_get_instance();
+    char            key[16];
+    uint32_t        val;
+    uint8_t         len;
+
+    for (uint32_t i = 0; i < 40; i++)
+    {
+        snprintf(key, sizeof(key), "idx%u", (unsigned) i);
+        val = i;
+        nkv_set(key, &val, sizeof(val));
+    }
+    uint8_t tlv = 0x5A;
+    nkv_tlv_set(0x60, &tlv, sizeof(tlv));
+    printf("  [INFO] Index used=%u, overflow=%u\n", inst->index.used, inst->index.overflow);
+    TEST_ASSERT(inst->index.used >= 41 && !inst->index.overflow, "Index holds all keys");
+
+    /* 未命中的键不应触发任何扇区扫描 */
+    g_read_calls = 0;
+    TEST_ASSERT(nkv_exists("absent_key") == 0, "nkv_exists(absent_key) == 0");
+    TEST_ASSERT(nkv_tlv_exists(0x61) == 0, "nkv_tlv_exists(0x61) == 0");
+    printf("  [INFO] Flash reads for 2 misses: %u\n", (unsigned) g_read_calls);
+    TEST_ASSERT(g_read_calls == 0, "Index miss costs no flash reads");
+
+    /* 命中只需读取条目本身 */
+    g_read_calls = 0;
+    TEST_ASSERT(nkv_exists("idx7") == 1, "nkv_exists(idx7) via index");
+    TEST_ASSERT(g_read_calls <= 2, "Index hit costs <= 2 flash reads");
+
+    nkv_del("idx3");
+    nkv_tlv_del(0x60);
+    TEST_ASSERT(nkv_exists("idx3") == 0 && nkv_tlv_exists(0x60) == 0, "Deleted entries not found via index");
+
+    /* 超出容量后回退扫描，结果仍然正确 */
+    for (uint32_t i = 40; i < NKV_INDEX_SIZE; i++)
+    {
+        snprintf(key, sizeof(key), "idx%u", (unsigned) i);
+        val = i;
+        nkv_set(key, &val, sizeof(val));
+    }
+    TEST_ASSERT(inst->index.overflow == 1, "Index overflow flagged when full");
+
+    int ok = 1;
+    for (uint32_t i = 0; i < NKV_INDEX_SIZE; i++)
+    {
+        snprintf(key, sizeof(key), "idx%u", (unsigned) i);
+        val           = 0xFFFFFFFF;
+        nkv_err_t err = nkv_get(key, &val, sizeof(val), &len);
+        if (i == 3 ? (err == NKV_OK) : (err != NKV_OK || val != i))
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "All keys correct after index overflow");
+
+    /* 重启后重建索引 */
+    nkv_internal_init(&ops);
+    nkv_scan();
+    ok = 1;
+    for (uint32_t i = 0; i < NKV_INDEX_SIZE; i++)
+    {
+        snprintf(key, sizeof(key), "idx%u", (unsigned) i);
+        val           = 0xFFFFFFFF;
+        nkv_err_t err = nkv_get(key, &val, sizeof(val), &len);
+        if (i == 3 ? (err == NKV_OK) : (err != NKV_OK || val != i))
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "All keys correct after index rebuild");
+
+    print_usage();
+}
+#endif
+
+/* 19. 启动挂载基准测试 */
+static void test_boot_benchmark(void)
+{
+    printf("\n=== 19. 启动挂载基准测试 ===\n");
 
-    /* 初始化模拟 Flash */
     memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+
+    /* 写出多扇区镜像：64 个键循环更新，使每个扇区都包含有效与过期条目（后台回收会保持空闲扇区） */
+    static uint8_t image[TEST_FLASH_SIZE];
+    char           key[16];
+    uint8_t        val[24];
+    memset(val, 0x3C, sizeof(val));
+
+    for (uint32_t i = 0; i < 600; i++)
+    {
+        snprintf(key, sizeof(key), "boot%u", (unsigned) (i % 64));
+        val[0] = (uint8_t) i;
+        nkv_set(key, val, sizeof(val));
+    }
+
+    uint8_t used = 0;
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        used += nkv_is_sector_valid(s);
+    TEST_ASSERT(used >= 2, "Built multi-sector image");
+
+    /* 先挂载一次写入版本键，使两条路径面对完全相同的镜像 */
+    nkv_internal_init(&ops);
+    nkv_scan();
+    memcpy(image, g_flash, sizeof(image));
+
+    const int runs = 20;
+    double    t_new = 0, t_old = 0;
+    uint32_t  calls_new = 0, calls_old = 0, bytes_new = 0, bytes_old = 0;
+    uint32_t  off_new = 0, off_old = 0;
+
+    for (int r = 0; r < runs; r++)
+    {
+        memcpy(g_flash, image, sizeof(image));
+        nkv_internal_init(&ops);
+        g_read_calls = g_read_bytes = 0;
+        timer_start();
+        nkv_scan();
+        t_new += timer_elapsed_us();
+        calls_new += g_read_calls;
+        bytes_new += g_read_bytes;
+        off_new = nkv_get_instance()->write_offset;
+
+        memcpy(g_flash, image, sizeof(image));
+        nkv_internal_init(&ops);
+        g_read_calls = g_read_bytes = 0;
+        timer_start();
+        nkv_scan_legacy();
+        t_old += timer_elapsed_us();
+        calls_old += g_read_calls;
+        bytes_old += g_read_bytes;
+        off_old = nkv_get_instance()->write_offset;
+    }
+
+    printf("  [PERF] single-pass mount: %.1fus, %u reads, %u bytes\n",
+           t_new / runs,
+           (unsigned) (calls_new / runs),
+           (unsigned) (bytes_new / runs));
+    printf("  [PERF] legacy mount:      %.1fus, %u reads, %u bytes\n",
+           t_old / runs,
+           (unsigned) (calls_old / runs),
+           (unsigned) (bytes_old / runs));
+
+    TEST_ASSERT(off_new == off_old, "Both mount paths agree on write offset");
+#if NKV_INDEX_ENABLE
+    /* 旧路径需额外一遍扫描重建索引，关闭索引时两者读取次数不具可比性 */
+    TEST_ASSERT(calls_new < calls_old, "Single-pass mount issues fewer flash reads");
+#endif
+    TEST_ASSERT(bytes_new / runs <= TEST_FLASH_SIZE + 64, "Single-pass mount reads partition at most once");
+
+    /* 挂载后数据完整 */
+    uint8_t   read_val[24];
+    uint8_t   len;
+    nkv_err_t err = nkv_get("boot23", read_val, sizeof(read_val), &len); /* 最后写入 i=599 */
+    TEST_ASSERT(err == NKV_OK && len == sizeof(val) && read_val[0] == (uint8_t) 599,
+                "Data readable after single-pass mount");
 
+    print_usage();
+}
+
+/* 20. 批量读取窗口测试 */
+static void test_read_window(void)
+{
+    printf("\n=== 20. 批量读取窗口测试 ===\n");
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
     nkv_flash_ops_t ops;
     build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
 
-    /* 初始化 NanoKV */
-    nkv_err_t err = nkv_internal_init(&ops);
-    printf("\nnkv_internal_init -> %d\n", err);
-    if (err != NKV_OK)
-        return -1;
+    /* 在同一扇区内写入大量短 TLV 条目 */
+    uint8_t val;
+    for (val = 1; val <= 100; val++)
+        nkv_tlv_set(val, &val, sizeof(val));
 
-    err = nkv_scan();
-    printf("nkv_scan -> %d\n", err);
-    if (err != NKV_OK)
-        return -1;
+    nkv_tlv_iter_t  iter;
+    nkv_tlv_entry_t info;
+    uint32_t        count = 0;
+    uint32_t        span  = nkv_get_instance()->write_offset; /* 迭代经过的字节数(含扇区头) */
+
+    g_read_calls = 0;
+    nkv_tlv_iter_init(&iter);
+    while (nkv_tlv_iter_next(&iter, &info))
+        count++;
+    printf("  [INFO] Iterated %u entries with %u flash reads (window=%u)\n",
+           (unsigned) count,
+           (unsigned) g_read_calls,
+           (unsigned) NKV_READ_WINDOW);
+    TEST_ASSERT(count == 100, "Iterator returns all TLV entries");
+    /* 窗口从条目边界开始填充，短条目下每次读取至少推进半个窗口；另有每个扇区一次扇区头读取 */
+    TEST_ASSERT(g_read_calls <= span / (NKV_READ_WINDOW / 2) + TEST_SECTOR_COUNT + 2,
+                "Iterator reads scale with bytes per window, not entries");
+
+    /* 迭代过程中写入新条目，窗口应失效并看到新数据 */
+    nkv_tlv_iter_init(&iter);
+    count = 0;
+    while (nkv_tlv_iter_next(&iter, &info))
+    {
+        if (count++ == 0)
+        {
+            val = 0x7F;
+            nkv_tlv_set(0x7F, &val, sizeof(val));
+        }
+    }
+    TEST_ASSERT(count == 101, "Iterator sees entries appended during iteration");
 
     print_usage();
+}
 
-    /* 运行所有测试 */
-    test_kv_basic();
-    test_kv_defaults();
-    test_tlv_basic();
-    test_tlv_defaults();
-    test_tlv_iterator();
-    test_tlv_history();
+/* 21. CRC 引擎测试 */
+static uint32_t g_hw_crc_calls = 0;
+
+static uint16_t mock_hw_crc16(uint16_t crc, const uint8_t* data, uint32_t len)
+{
+    g_hw_crc_calls++;
+    return nkv_crc16_bitwise(crc, data, len);
+}
+
+typedef uint16_t (*crc_kernel_t)(uint16_t, const uint8_t*, uint32_t);
+
+static void test_crc_engine(void)
+{
+    printf("\n=== 21. CRC 引擎测试 ===\n");
+
+    /* 标准校验值：CRC16/MODBUS("123456789") = 0x4B37 */
+    const uint8_t check[] = "123456789";
+    TEST_ASSERT(nkv_crc16(0xFFFF, check, 9) == 0x4B37, "nkv_crc16 check value 0x4B37");
+
+    static const struct
+    {
+        const char*  name;
+        crc_kernel_t fn;
+    } kernels[] = {
+        {"bitwise", nkv_crc16_bitwise},
+#if NKV_CRC_ENGINE >= 1
+        {"table",   nkv_crc16_table  },
+#endif
+#if NKV_CRC_ENGINE >= 2
+        {"slice4",  nkv_crc16_slice4 },
+#endif
+    };
+    const uint32_t kernel_count = sizeof(kernels) / sizeof(kernels[0]);
+
+    /* 各引擎对任意长度、分段计算结果一致 */
+    static uint8_t data[NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN];
+    for (uint32_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t) (i * 131 + 7);
+
+    int identical = 1;
+    for (uint32_t len = 0; len <= sizeof(data); len++)
+    {
+        uint16_t ref = nkv_crc16_bitwise(0xFFFF, data, len);
+        for (uint32_t k = 1; k < kernel_count; k++)
+        {
+            uint16_t split = kernels[k].fn(kernels[k].fn(0xFFFF, data, len / 3), data + len / 3, len - len / 3);
+            if (kernels[k].fn(0xFFFF, data, len) != ref || split != ref)
+                identical = 0;
+        }
+    }
+    TEST_ASSERT(identical, "All CRC engines bit-identical to MODBUS bitwise");
+
+    /* 吞吐量对比 */
+    static const uint32_t sizes[] = {8, 32, 64, 128, NKV_MAX_VALUE_LEN};
+    for (uint32_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); si++)
+    {
+        uint32_t len   = sizes[si];
+        uint32_t loops = 200000 / len + 1000;
+        printf("  [PERF] CRC %3u B:", (unsigned) len);
+        for (uint32_t k = 0; k < kernel_count; k++)
+        {
+            volatile uint16_t sink = 0;
+            timer_start();
+            for (uint32_t n = 0; n < loops; n++)
+                sink ^= kernels[k].fn(0xFFFF, data + (n & 7), len);
+            double us = timer_elapsed_us();
+            printf(" %s=%.1fMB/s", kernels[k].name, us > 0 ? (double) len * loops / us : 0.0);
+            (void) sink;
+        }
+        printf("\n");
+    }
+
+    /* 硬件CRC钩子：写入与校验读取都应经由钩子 */
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    ops.crc16 = mock_hw_crc16;
+    nkv_internal_init(&ops);
+    nkv_scan();
 
+    uint32_t val = 0xC0FFEE, read_val = 0;
+    uint8_t  len;
+    g_hw_crc_calls = 0;
+    nkv_set("hwcrc", &val, sizeof(val));
 #if NKV_CACHE_ENABLE
-    test_cache();
+    nkv_cache_clear();
 #endif
+    nkv_err_t err = nkv_get("hwcrc", &read_val, sizeof(read_val), &len);
+    TEST_ASSERT(err == NKV_OK && read_val == val, "Set/get through hardware CRC hook");
+    TEST_ASSERT(g_hw_crc_calls >= (NKV_VERIFY_ON_READ ? 2u : 1u), "Hardware CRC hook used");
 
-#if NKV_INCREMENTAL_GC
-    test_incremental_gc();
+    /* 钩子写入的镜像可由软件引擎挂载校验 */
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+    read_val = 0;
+    err      = nkv_get("hwcrc", &read_val, sizeof(read_val), &len);
+    TEST_ASSERT(err == NKV_OK && read_val == val, "Image written with hook readable by software engine");
+
+    print_usage();
+}
+
+/* 22. 多实例测试：同一块Flash划分为两个独立分区 */
+static nkv_instance_t g_hot;
+static nkv_instance_t g_cold;
+
+static void test_multi_instance(void)
+{
+    printf("\n=== 22. 多实例测试 ===\n");
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    ops.sector_count = TEST_SECTOR_COUNT / 2;
+    TEST_ASSERT(nkv_internal_init_ex(&g_hot, &ops) == NKV_OK, "Hot instance init");
+    ops.base = TEST_SECTOR_SIZE * (TEST_SECTOR_COUNT / 2);
+#if NKV_ZERO_COPY
+    ops.map = g_flash + ops.base;
 #endif
+    TEST_ASSERT(nkv_internal_init_ex(&g_cold, &ops) == NKV_OK, "Cold instance init");
+    TEST_ASSERT(nkv_scan_ex(&g_hot) == NKV_OK && nkv_scan_ex(&g_cold) == NKV_OK, "Both instances mount");
+
+    /* 同名键在两个实例中互不干扰 */
+    uint8_t v = 1, out = 0, len = 0;
+    nkv_set_ex(&g_hot, "mode", &v, 1);
+    v = 2;
+    nkv_set_ex(&g_cold, "mode", &v, 1);
+    nkv_set_ex(&g_cold, "cold_only", &v, 1);
+    nkv_get_ex(&g_hot, "mode", &out, 1, &len);
+    TEST_ASSERT(out == 1, "Hot instance keeps its own value");
+    nkv_get_ex(&g_cold, "mode", &out, 1, &len);
+    TEST_ASSERT(out == 2, "Cold instance keeps its own value");
+    TEST_ASSERT(!nkv_exists_ex(&g_hot, "cold_only"), "Keys do not leak across instances");
+
+    /* TLV默认值表属于实例 */
+    const nkv_tlv_default_t hot_defs[] = {NKV_TLV_DEF_U8(0x30, 0x5A)};
+    nkv_tlv_set_defaults_ex(&g_hot, hot_defs, NKV_TLV_DEFAULT_SIZE(hot_defs));
+    TEST_ASSERT(nkv_tlv_get_default_ex(&g_hot, 0x30, &out, 1, &len) == NKV_OK && out == 0x5A,
+                "TLV defaults registered on hot instance");
+    TEST_ASSERT(nkv_tlv_get_default_ex(&g_cold, 0x30, &out, 1, &len) == NKV_ERR_NOT_FOUND,
+                "TLV defaults not visible on cold instance");
+
+    /* 迭代器只遍历所属实例 */
+    nkv_tlv_set_ex(&g_cold, 0x31, &v, 1);
+    nkv_tlv_set_ex(&g_cold, 0x32, &v, 1);
+    nkv_tlv_iter_t  iter;
+    nkv_tlv_entry_t info;
+    uint32_t        count = 0;
+    nkv_tlv_iter_init_ex(&g_cold, &iter);
+    while (nkv_tlv_iter_next(&iter, &info))
+        count++;
+    TEST_ASSERT(count == 2, "Iterator walks only the cold instance");
+    TEST_ASSERT(!nkv_tlv_exists_ex(&g_hot, 0x31), "Cold TLV types absent from hot instance");
+
+    /* 格式化一个实例不影响另一个，重新挂载后数据仍在 */
+    nkv_format_ex(&g_hot);
+    TEST_ASSERT(!nkv_exists_ex(&g_hot, "mode"), "Format clears hot instance");
+    nkv_internal_init_ex(&g_cold, &ops);
+    nkv_scan_ex(&g_cold);
+    out = 0;
+    TEST_ASSERT(nkv_get_ex(&g_cold, "mode", &out, 1, &len) == NKV_OK && out == 2, "Cold instance survives remount");
+    TEST_ASSERT(nkv_get_instance() != &g_hot && nkv_get_instance() != &g_cold, "Default instance is separate");
+}
 
-#if NKV_TLV_RETENTION_ENABLE
-    test_tlv_retention();
+/* 23. 批量写入测试：批次大小不超过 NKV_BATCH_MAX */
+#if NKV_BATCH_MAX < 20
+    #define BATCH_KEYS NKV_BATCH_MAX
+#else
+    #define BATCH_KEYS 20
 #endif
 
-    test_alignment();
-    test_full_gc();
+static char             g_bkeys[BATCH_KEYS][8];
+static uint32_t         g_bvals[BATCH_KEYS];
+static nkv_batch_item_t g_bitems[BATCH_KEYS];
 
-#if NKV_INCREMENTAL_GC
-    test_incremental_gc_detail();
-#endif
+static void batch_fill(uint32_t gen)
+{
+    for (uint32_t i = 0; i < BATCH_KEYS; i++)
+    {
+        snprintf(g_bkeys[i], sizeof(g_bkeys[i]), "bk%02u", (unsigned) i);
+        g_bvals[i]          = gen * 1000 + i;
+        g_bitems[i].key     = g_bkeys[i];
+        g_bitems[i].value   = &g_bvals[i];
+        g_bitems[i].len     = sizeof(uint32_t);
+    }
+}
 
-    test_multi_keys();
+/* 所有键属于同一代时返回该代，否则返回0 */
+static uint32_t batch_generation(void)
+{
+    uint32_t gen = 0;
+    for (uint32_t i = 0; i < BATCH_KEYS; i++)
+    {
+        uint32_t v = 0;
+        uint8_t  len;
+        char     key[8];
+        snprintf(key, sizeof(key), "bk%02u", (unsigned) i);
+        if (nkv_get(key, &v, sizeof(v), &len) != NKV_OK || v % 1000 != i)
+            return 0;
+        if (i == 0)
+            gen = v / 1000;
+        else if (v / 1000 != gen)
+            return 0;
+    }
+    return gen;
+}
 
-    /* 新增测试 */
-    test_performance_benchmark();
+/* 扇区头魔数是否有效（两种存储格式均识别） */
+static uint8_t test_sector_magic(const uint8_t* sec)
+{
+    uint16_t magic = (uint16_t) (sec[0] | (sec[1] << 8));
+    return (magic == NKV_MAGIC || magic == NKV_MAGIC_V2 || magic == NKV_MAGIC_V1);
+}
 
-#if NKV_INCREMENTAL_GC
-    test_incremental_gc_full();
+/* 扇区内第一个条目的偏移：格式3扇区头含擦除次数 */
+static uint32_t test_sector_data(const uint8_t* sec)
+{
+    uint16_t magic = (uint16_t) (sec[0] | (sec[1] << 8));
+    return (magic == NKV_MAGIC) ? NKV_SECTOR_HDR_SIZE : NKV_SECTOR_HDR_V1;
+}
+
+/* 直接遍历Flash统计键的有效副本数 */
+static uint32_t count_valid_copies(const char* key)
+{
+    uint32_t n = 0, key_len = strlen(key);
+    for (uint32_t s = 0; s < TEST_SECTOR_COUNT; s++)
+    {
+        uint8_t* sec = &g_flash[s * TEST_SECTOR_SIZE];
+        if (!test_sector_magic(sec))
+            continue;
+        for (uint32_t off = test_sector_data(sec); off + NKV_HEADER_SIZE <= TEST_SECTOR_SIZE;)
+        {
+            nkv_entry_t e;
+            memcpy(&e, sec + off, NKV_HEADER_SIZE);
+            if (e.state == NKV_STATE_ERASED)
+                break;
+            if (e.state == NKV_STATE_VALID && e.key_len == key_len &&
+                memcmp(sec + off + NKV_HEADER_SIZE, key, key_len) == 0)
+                n++;
+            off += (NKV_HEADER_SIZE + e.key_len + e.val_len + NKV_CRC_SIZE + 3) & ~3u;
+        }
+    }
+    return n;
+}
+
+static void test_batch_write(void)
+{
+    printf("\n=== 23. 批量写入测试 ===\n");
+
+    static uint8_t  snapshot[TEST_FLASH_SIZE];
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+
+    /* 逐条写入的编程次数 */
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    batch_fill(1);
+    for (uint32_t i = 0; i < BATCH_KEYS; i++)
+        nkv_set(g_bkeys[i], &g_bvals[i], sizeof(uint32_t));
+    batch_fill(2);
+    g_write_calls = 0;
+    for (uint32_t i = 0; i < BATCH_KEYS; i++)
+        nkv_set(g_bkeys[i], &g_bvals[i], sizeof(uint32_t));
+    uint32_t single_ops = g_write_calls;
+
+    /* 批量写入的编程次数 */
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    batch_fill(1);
+    TEST_ASSERT(nkv_set_batch(g_bitems, BATCH_KEYS) == NKV_OK, "Batch insert");
+    TEST_ASSERT(batch_generation() == 1, "Batch insert readable");
+    memcpy(snapshot, g_flash, sizeof(g_flash));
+
+    batch_fill(2);
+    g_write_calls = 0;
+    TEST_ASSERT(nkv_set_batch(g_bitems, BATCH_KEYS) == NKV_OK, "Batch update");
+    uint32_t batch_ops = g_write_calls;
+    printf("  [PERF] update %u keys: %u program ops individually, %u as one batch\n",
+           (unsigned) BATCH_KEYS,
+           (unsigned) single_ops,
+           (unsigned) batch_ops);
+#if BATCH_KEYS >= 16
+    TEST_ASSERT(batch_ops * 4 <= single_ops, "Batch needs far fewer program operations");
+#else
+    /* 成员、提交记录、旧版本失效与注销提交记录各一次编程，小批次只要求不多于逐条写入 */
+    TEST_ASSERT(batch_ops <= single_ops, "Batch needs no more program operations");
 #endif
+    TEST_ASSERT(batch_generation() == 2, "Batch update readable");
+    TEST_ASSERT(count_valid_copies(g_bkeys[0]) == 1 && count_valid_copies(g_bkeys[BATCH_KEYS - 1]) == 1,
+                "Old versions invalidated");
 
-    test_version_sync();
-    test_power_fail_safety();
+    nkv_internal_init(&ops);
+    nkv_scan();
+    TEST_ASSERT(batch_generation() == 2, "Batch survives remount");
+
+    /* 参数检查 */
+    nkv_batch_item_t dup[2] = {{"dup", &g_bvals[0], 4}, {"dup", &g_bvals[1], 4}};
+    TEST_ASSERT(nkv_set_batch(dup, 2) == NKV_ERR_INVALID, "Duplicate keys rejected");
+    TEST_ASSERT(nkv_set_batch(g_bitems, 0) == NKV_ERR_INVALID, "Empty batch rejected");
+    TEST_ASSERT(!nkv_exists("dup"), "Rejected batch writes nothing");
+
+    /* 掉电注入：在第k次编程操作处掉电，重启后整批要么全部生效要么全部保持旧值 */
+    uint32_t ok = 1, old_seen = 0, new_seen = 0;
+    for (uint32_t k = 1; k <= batch_ops; k++)
+    {
+        memcpy(g_flash, snapshot, sizeof(g_flash));
+        nkv_internal_init(&ops);
+        nkv_scan();
+
+        g_write_calls      = 0;
+        g_write_fail_after = k;
+        nkv_set_batch(g_bitems, BATCH_KEYS);
+        g_write_fail_after = 0;
+
+        nkv_internal_init(&ops);
+        if (k & 1)
+            nkv_scan_legacy();
+        else
+            nkv_scan();
+
+        uint32_t gen = batch_generation();
+        if (gen == 1)
+            old_seen++;
+        else if (gen == 2)
+            new_seen++;
+        else
+            ok = 0;
+        if (count_valid_copies(g_bkeys[0]) != 1 || count_valid_copies(g_bkeys[BATCH_KEYS - 1]) != 1)
+            ok = 0;
+
+        /* 恢复后可继续正常写入 */
+        uint32_t v = 7, out = 0;
+        uint8_t  len;
+        nkv_set("bk_after", &v, sizeof(v));
+        if (nkv_get("bk_after", &out, sizeof(out), &len) != NKV_OK || out != 7)
+            ok = 0;
+    }
+    printf("  [INFO] %u power-loss points: %u rolled back, %u committed\n",
+           (unsigned) batch_ops,
+           (unsigned) old_seen,
+           (unsigned) new_seen);
+    TEST_ASSERT(ok, "Batch is all-or-nothing at every power-loss point");
+    TEST_ASSERT(old_seen > 0 && new_seen > 0, "Both rollback and roll-forward exercised");
+
+    print_usage();
+}
+
+/* 24. 缓存引擎测试 */
+#if NKV_CACHE_ENABLE
+    #define CE_KEYS 64
+
+static uint32_t g_ce_rng = 1;
+
+static uint32_t ce_rand(void)
+{
+    g_ce_rng = g_ce_rng * 1103515245u + 12345u;
+    return g_ce_rng >> 16;
+}
+
+/* 检查缓存内部一致性：有效项数、值块占用与链表可达性 */
+static int cache_consistent(const nkv_cache_t* c)
+{
+    uint32_t valid = 0, live = 0, linked = 0;
+    for (uint32_t i = 0; i < c->used; i++)
+    {
+        const nkv_cache_entry_t* e = &c->entries[i];
+        if (!e->valid)
+            continue;
+        valid++;
+        if (e->val_off + 3u + e->val_len > c->arena_top || c->arena[e->val_off] < e->val_len)
+            return 0;
+        live += 3u + c->arena[e->val_off];
+    }
+    for (uint32_t b = 0; b < NKV_CACHE_SIZE; b++)
+    {
+        for (uint16_t link = c->buckets[b]; link != 0; link = c->entries[link - 1].next)
+        {
+            if (++linked > NKV_CACHE_SIZE)
+                return 0;
+        }
+    }
+    return valid == c->count && linked == c->count && live == c->arena_live && c->arena_top <= NKV_CACHE_ARENA;
+}
+
+static void test_cache_engine(void)
+{
+    printf("\n=== 24. 缓存引擎测试 ===\n");
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_instance_t* inst = nkv_get_instance();
+
+    /* 随机读写与参考模型比对，覆盖淘汰、原地更新、扩容重分配与存储区整理（写入量控制在不触发全量GC的范围内） */
+    static uint8_t model[CE_KEYS][32];
+    static uint8_t model_len[CE_KEYS];
+    char           key[8];
+    uint8_t        buf[48], len;
+    uint32_t       ok = 1;
+
+    memset(model_len, 0, sizeof(model_len));
+    for (uint32_t n = 0; n < 2000; n++)
+    {
+        uint32_t k = ce_rand() % CE_KEYS;
+        snprintf(key, sizeof(key), "ce%02u", (unsigned) k);
+        if (ce_rand() % 8 == 0 || model_len[k] == 0)
+        {
+            model_len[k] = 1 + ce_rand() % sizeof(model[k]);
+            for (uint32_t i = 0; i < model_len[k]; i++)
+                model[k][i] = (uint8_t) ce_rand();
+            nkv_set(key, model[k], model_len[k]);
+        }
+        else if (nkv_get(key, buf, sizeof(buf), &len) != NKV_OK || len != model_len[k] ||
+                 memcmp(buf, model[k], len) != 0)
+        {
+            ok = 0;
+        }
+        if (!cache_consistent(&inst->cache))
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "Cached values match model across 2000 random operations");
+    TEST_ASSERT(inst->cache.count > 4, "Cache holds more than the old 4 entries");
+
+    /* 缓冲区不足时的截断读取不进入缓存 */
+    uint8_t small[2];
+    nkv_cache_clear();
+    nkv_get("ce00", small, sizeof(small), &len);
+    TEST_ASSERT(nkv_get("ce00", buf, sizeof(buf), &len) == NKV_OK && len == model_len[0] &&
+                    memcmp(buf, model[0], len) == 0,
+                "Truncated read does not poison the cache");
+
+    /* 热点键在大量一次性访问后仍驻留 */
+    nkv_cache_clear();
+    for (uint32_t r = 0; r < 20; r++)
+    {
+        for (uint32_t k = 0; k < 4; k++)
+        {
+            snprintf(key, sizeof(key), "ce%02u", (unsigned) k);
+            nkv_get(key, buf, sizeof(buf), &len);
+        }
+    }
+    for (uint32_t r = 0; r < 3; r++)
+    {
+        for (uint32_t k = 4; k < CE_KEYS; k++)
+        {
+            snprintf(key, sizeof(key), "ce%02u", (unsigned) k);
+            nkv_get(key, buf, sizeof(buf), &len);
+        }
+    }
+    nkv_cache_stats_t before, after;
+    nkv_cache_stats(&before);
+    for (uint32_t k = 0; k < 4; k++)
+    {
+        snprintf(key, sizeof(key), "ce%02u", (unsigned) k);
+        nkv_get(key, buf, sizeof(buf), &len);
+    }
+    nkv_cache_stats(&after);
+    TEST_ASSERT(after.hit_count - before.hit_count == 4, "Hot keys survive a scan of cold keys");
+
+    printf("  [INFO] %u entries cached, cache struct %u bytes (fixed-slot layout would need %u)\n",
+           (unsigned) inst->cache.count,
+           (unsigned) sizeof(nkv_cache_t),
+           (unsigned) (NKV_CACHE_SIZE * (NKV_MAX_KEY_LEN + NKV_MAX_VALUE_LEN + 8)));
+
+    print_usage();
+}
+#endif
+
+/* 25. 布隆过滤器与负缓存测试 */
+#if NKV_BLOOM_ENABLE
+static void test_bloom_filter(void)
+{
+    printf("\n=== 25. 布隆过滤器测试 ===\n");
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+
+    /* 写入足够多的键使其跨越多个扇区(启用索引时同时使索引溢出，未命中需回退扫描) */
+    uint8_t  val[32];
+    char     key[8];
+    uint32_t ok = 1;
+    for (uint32_t k = 0; k < 160; k++)
+    {
+        snprintf(key, sizeof(key), "bf%03u", (unsigned) k);
+        memset(val, (int) k, sizeof(val));
+        nkv_set(key, val, sizeof(val));
+    }
+
+    /* 重新挂载：过滤器由单遍扫描建立 */
+    nkv_internal_init(&ops);
+    nkv_scan();
+    #if NKV_CACHE_ENABLE
+    nkv_cache_clear();
+    #endif
+
+    uint8_t len;
+    for (uint32_t k = 0; k < 160; k++)
+    {
+        snprintf(key, sizeof(key), "bf%03u", (unsigned) k);
+        if (nkv_get(key, val, sizeof(val), &len) != NKV_OK || val[0] != (uint8_t) k)
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "All present keys still found (no false negatives)");
+
+    /* 查找不存在的键：大部分扇区被过滤器跳过 */
+    nkv_bloom_stats_t before, after;
+    nkv_bloom_stats(&before);
+    uint32_t reads  = g_read_calls;
+    uint32_t absent = 1;
+    for (uint32_t k = 0; k < 50; k++)
+    {
+        snprintf(key, sizeof(key), "nx%03u", (unsigned) k);
+        if (nkv_exists(key))
+            absent = 0;
+    }
+    nkv_bloom_stats(&after);
+    printf("  [PERF] 50 absent lookups: %u flash reads, %u sectors skipped, %u probed, %u false positives\n",
+           (unsigned) (g_read_calls - reads),
+           (unsigned) (after.skipped - before.skipped),
+           (unsigned) (after.probed - before.probed),
+           (unsigned) (after.false_pos - before.false_pos));
+    #if NKV_INDEX_ENABLE
+    TEST_ASSERT(nkv_get_instance()->index.overflow, "Index overflowed, absent keys fall back to scanning");
+    #endif
+    TEST_ASSERT(absent, "Absent keys reported absent");
+    TEST_ASSERT(after.skipped - before.skipped > 4 * (after.probed - before.probed),
+                "Bloom filters skip most sectors for absent keys");
+
+    /* 负缓存：重复查找最近的不存在键无需读取Flash */
+    reads = g_read_calls;
+    TEST_ASSERT(!nkv_exists("nx049") && g_read_calls - reads <= 1, "Repeated absent lookup served by negative cache");
+    nkv_bloom_stats(&after);
+    TEST_ASSERT(after.neg_hits > before.neg_hits, "Negative cache hit counted");
+
+    /* 写入后负缓存失效，TLV类型同样适用 */
+    uint32_t v = 42, out = 0;
+    nkv_set("nx049", &v, sizeof(v));
+    TEST_ASSERT(nkv_get("nx049", &out, sizeof(out), &len) == NKV_OK && out == 42, "Write evicts negative cache entry");
+    TEST_ASSERT(!nkv_tlv_exists(0x55) && !nkv_tlv_exists(0x55), "Absent TLV type cached as negative");
+    nkv_tlv_set(0x55, &v, sizeof(v));
+    TEST_ASSERT(nkv_tlv_exists(0x55), "TLV write evicts negative cache entry");
+
+    print_usage();
+}
+#endif
+
+#if NKV_WRITE_BUFFER
+/* 26. 写缓冲测试：暂存可见性、落盘时机、掉电语义与编程次数对比 */
+    #define WB_KEYS   16
+    #define WB_SETS   1000
+    #define WB_ROUNDS 4 /* 每轮写入后格式化，避免计入GC迁移 */
+
+static void wb_remount(void)
+{
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+}
+
+/* 每次落盘的暂存条目数(4字节值)：缓冲剩余空间放不下最小条目或达到 NKV_BATCH_MAX 时落盘 */
+static uint32_t wb_page_entries(void)
+{
+    uint32_t align = nkv_get_instance()->flash.align;
+    uint32_t entry = (NKV_HEADER_SIZE + 4 + sizeof(uint32_t) + NKV_CRC_SIZE + align - 1) & ~(align - 1);
+    uint32_t min   = (NKV_HEADER_SIZE + 1 + NKV_CRC_SIZE + align - 1) & ~(align - 1);
+    uint32_t n     = 1;
+    while (n < NKV_BATCH_MAX && (n + 1) * entry <= NKV_WBUF_SIZE && NKV_WBUF_SIZE - n * entry >= min)
+        n++;
+    return n;
+}
+
+/* 每轮 WB_SETS/WB_ROUNDS 次小写入，返回总编程次数；model 为各键最终值 */
+static uint32_t wb_run(uint8_t coalesce, uint32_t* model, uint32_t* mismatch)
+{
+    uint32_t total = 0;
+    *mismatch      = 0;
+    for (uint32_t round = 0; round < WB_ROUNDS; round++)
+    {
+        memset(g_flash, 0xFF, sizeof(g_flash));
+        wb_remount();
+        nkv_wbuf_enable(coalesce);
+        g_write_calls = 0;
+        for (uint32_t i = 0; i < WB_SETS / WB_ROUNDS; i++)
+        {
+            char key[8];
+            snprintf(key, sizeof(key), "wb%02u", (unsigned) (i % WB_KEYS));
+            model[i % WB_KEYS] = round * 100000u + i * 7u;
+            nkv_set(key, &model[i % WB_KEYS], sizeof(uint32_t));
+        }
+        nkv_flush();
+        total += g_write_calls;
+
+        wb_remount();
+        for (uint32_t k = 0; k < WB_KEYS; k++)
+        {
+            char     key[8];
+            uint32_t v = 0;
+            snprintf(key, sizeof(key), "wb%02u", (unsigned) k);
+            if (nkv_get(key, &v, sizeof(v), NULL) != NKV_OK || v != model[k])
+                (*mismatch)++;
+        }
+    }
+    return total;
+}
+
+static void test_write_buffer(void)
+{
+    printf("\n=== 26. 写缓冲测试 ===\n");
+
+    uint32_t v = 0, out = 0;
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    wb_remount();
+    TEST_ASSERT(nkv_wbuf_enable(1) == NKV_OK && nkv_wbuf_pending() == 0, "Write buffer enabled");
+
+    uint32_t page = wb_page_entries();
+    printf("  [INFO] %u-byte buffer stages %u small entries per flush\n", (unsigned) NKV_WBUF_SIZE, (unsigned) page);
+
+    /* 暂存的写入不编程Flash，但立即可读（缓冲须能同时暂存5个键） */
+    if (page > 5)
+    {
+        g_write_calls = 0;
+        for (v = 1; v <= 5; v++)
+        {
+            char key[4] = {'w', (char) ('a' + v - 1), 0};
+            nkv_set(key, &v, sizeof(v));
+        }
+        v = 9;
+        nkv_set("wb", &v, sizeof(v));
+        nkv_del("wc");
+        TEST_ASSERT(g_write_calls == 0 && nkv_wbuf_pending() == 5, "Small writes staged without programming");
+        TEST_ASSERT(nkv_get("wb", &out, sizeof(out), NULL) == NKV_OK && out == 9, "Staged update readable");
+        TEST_ASSERT(nkv_get("wc", &out, sizeof(out), NULL) == NKV_ERR_NOT_FOUND && !nkv_exists("wc"),
+                    "Staged delete hides key");
+        TEST_ASSERT(nkv_exists("we"), "Staged key exists");
+
+        /* 掉电：未落盘的暂存写入全部丢失 */
+        wb_remount();
+        TEST_ASSERT(!nkv_exists("wa") && !nkv_exists("wb"), "Unflushed writes lost on power loss");
+    }
+    else
+    {
+        printf("  [INFO] Buffer cannot stage 5 keys, staging visibility checks skipped\n");
+    }
+
+    /* nkv_flush 后持久 */
+    nkv_wbuf_enable(1);
+    v = 1;
+    nkv_set("wa", &v, sizeof(v));
+    v = 2;
+    nkv_set("wb", &v, sizeof(v));
+    g_write_calls = 0;
+    TEST_ASSERT(nkv_flush() == NKV_OK && nkv_wbuf_pending() == 0, "Explicit flush");
+    printf("  [INFO] flush of 2 staged keys: %u program ops\n", (unsigned) g_write_calls);
+    wb_remount();
+    TEST_ASSERT(nkv_get("wb", &out, sizeof(out), NULL) == NKV_OK && out == 2, "Flushed writes survive remount");
+
+    /* 超时落盘（单条暂存即落盘的缓冲不涉及） */
+    nkv_wbuf_enable(1);
+    v = 3;
+    nkv_set("wt", &v, sizeof(v));
+    if (page > 1)
+    {
+        for (uint32_t i = 1; i < NKV_WBUF_FLUSH_TICKS; i++)
+            nkv_wbuf_tick();
+        TEST_ASSERT(nkv_wbuf_pending() == 1, "Staged write held until timeout");
+        nkv_wbuf_tick();
+    }
+    TEST_ASSERT(nkv_wbuf_pending() == 0, "Timeout tick flushes");
+
+#if NKV_WBUF_SIZE - 8 <= NKV_MAX_VALUE_LEN
+    /* 超出缓冲容量的写入直接落盘，且排在已暂存的写入之后 */
+    uint8_t big[NKV_WBUF_SIZE - 8];
+    memset(big, 0x5A, sizeof(big));
+    v = 4;
+    nkv_set("wa", &v, sizeof(v));
+    nkv_set("wbig", big, sizeof(big));
+    TEST_ASSERT(nkv_wbuf_pending() == 0, "Oversized write flushes staged data first");
+#endif
+
+    /* 批量写入排在暂存写入之后 */
+    v = 5;
+    nkv_set("wa", &v, sizeof(v));
+    uint32_t         nv   = 6;
+    nkv_batch_item_t item = {"wa", &nv, sizeof(nv)};
+    nkv_set_batch(&item, 1);
+    wb_remount();
+    TEST_ASSERT(nkv_get("wa", &out, sizeof(out), NULL) == NKV_OK && out == 6, "Batch ordered after staged write");
+#if NKV_WBUF_SIZE - 8 <= NKV_MAX_VALUE_LEN
+    TEST_ASSERT(nkv_exists("wbig"), "Direct write survives remount");
+#endif
+    TEST_ASSERT(nkv_get("wt", &out, sizeof(out), NULL) == NKV_OK && out == 3, "Timed write survives remount");
+
+    /* 落盘失败保留暂存数据，恢复后重试 */
+    if (page > 1)
+    {
+        nkv_wbuf_enable(1);
+        v = 7;
+        nkv_set("wa", &v, sizeof(v));
+        g_write_fail_after = g_write_calls + 1;
+        TEST_ASSERT(nkv_flush() != NKV_OK && nkv_wbuf_pending() == 1, "Failed flush keeps staged data");
+        g_write_fail_after = 0;
+        TEST_ASSERT(nkv_get("wa", &out, sizeof(out), NULL) == NKV_OK && out == 7, "Staged value still readable");
+        TEST_ASSERT(nkv_flush() == NKV_OK, "Flush retried after failure");
+        wb_remount();
+        TEST_ASSERT(nkv_get("wa", &out, sizeof(out), NULL) == NKV_OK && out == 7, "Retried flush durable");
+    }
+
+    /* 编程次数对比 */
+    uint32_t model[WB_KEYS];
+    uint32_t bad_direct = 0, bad_coalesced = 0;
+    uint32_t direct    = wb_run(0, model, &bad_direct);
+    uint32_t coalesced = wb_run(1, model, &bad_coalesced);
+    printf("  [PERF] %u small sets: %u program ops direct, %u coalesced (%u-byte buffer)\n",
+           (unsigned) WB_SETS,
+           (unsigned) direct,
+           (unsigned) coalesced,
+           (unsigned) NKV_WBUF_SIZE);
+    TEST_ASSERT(bad_direct == 0 && bad_coalesced == 0, "All values correct after remount");
+    /* 每次落盘为成员、提交记录、旧版本失效与注销提交记录共4次编程，另加每轮末尾的 nkv_flush */
+    uint32_t expect = 4 * (WB_SETS / page + WB_ROUNDS);
+    TEST_ASSERT(coalesced <= expect, "Coalescing costs at most 4 program ops per flushed page");
+
+    nkv_wbuf_enable(0);
+    print_usage();
+}
+#endif
+
+/* 27. GC回收策略测试：扇区统计与Flash内容一致，冷热混合负载下比较各策略的写放大 */
+#define GS_COLD   150
+#define GS_HOT    8
+#define GS_WRITES 3000
+
+static uint32_t g_gs_rng = 7;
+
+static uint32_t gs_rand(void)
+{
+    g_gs_rng = g_gs_rng * 1103515245u + 12345u;
+    return g_gs_rng >> 16;
+}
+
+/* 直接遍历Flash重新统计各扇区有效/垃圾字节，与实例维护的计数比较，返回不一致的扇区数 */
+static uint32_t gs_check_sectors(void)
+{
+    nkv_instance_t* inst = nkv_get_instance();
+    uint32_t        bad  = 0;
+
+    for (uint32_t s = 0; s < TEST_SECTOR_COUNT; s++)
+    {
+        uint8_t* sec   = &g_flash[s * TEST_SECTOR_SIZE];
+        uint8_t  valid = test_sector_magic(sec);
+        uint32_t live = 0, dead = 0;
+
+        for (uint32_t off = test_sector_data(sec); valid && off + NKV_HEADER_SIZE <= TEST_SECTOR_SIZE;)
+        {
+            nkv_entry_t e;
+            memcpy(&e, sec + off, NKV_HEADER_SIZE);
+            if (e.state == NKV_STATE_ERASED)
+                break;
+            uint32_t size = (NKV_HEADER_SIZE + e.key_len + e.val_len + NKV_CRC_SIZE + 3) & ~3u;
+            if (e.state == NKV_STATE_DELETED)
+                dead += size;
+            else
+                live += size;
+            off += size;
+        }
+        if (inst->sectors[s].valid != valid || (valid && (inst->sectors[s].live != live || inst->sectors[s].dead != dead)))
+            bad++;
+    }
+    return bad;
+}
+
+/* 冷数据写入一次，之后 90% 的写入落在少量热键上；返回写放大，ok 记录写入/读回/统计是否全部正确 */
+static float gs_run(uint8_t policy, uint8_t* ok)
+{
+    static uint32_t model[GS_COLD + GS_HOT];
+    nkv_flash_ops_t ops;
+    nkv_gc_stats_t  st;
+    char            key[8];
+    uint8_t         val[32];
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_gc_set_policy(policy);
+    g_gs_rng = 7;
+
+    for (uint32_t i = 0; i < GS_COLD + GS_HOT + GS_WRITES; i++)
+    {
+        uint32_t k = (i < GS_COLD + GS_HOT) ? i : (gs_rand() % 10 == 0) ? gs_rand() % GS_COLD : GS_COLD + gs_rand() % GS_HOT;
+        model[k] = i;
+        memset(val, (uint8_t) k, sizeof(val));
+        memcpy(val, &model[k], sizeof(uint32_t));
+        snprintf(key, sizeof(key), "g%03u", (unsigned) k);
+        if (nkv_set(key, val, (k < GS_COLD) ? 32 : 8) != NKV_OK)
+            *ok = 0;
+        if (i % 500 == 0 && gs_check_sectors() != 0)
+            *ok = 0;
+    }
+    if (gs_check_sectors() != 0)
+        *ok = 0;
+    nkv_gc_stats(&st);
+
+    /* 重新挂载后统计与数据均应一致 */
+    nkv_internal_init(&ops);
+    nkv_scan();
+    if (gs_check_sectors() != 0)
+        *ok = 0;
+    for (uint32_t k = 0; k < GS_COLD + GS_HOT; k++)
+    {
+        uint32_t v = 0;
+        snprintf(key, sizeof(key), "g%03u", (unsigned) k);
+        if (nkv_get(key, &v, sizeof(v), NULL) != NKV_OK || v != model[k])
+            *ok = 0;
+    }
+
+    printf("  [PERF] GC policy %u: WA=%.2f, %u GC runs, %u erases, %u bytes migrated\n",
+           (unsigned) policy,
+           st.write_amp,
+           (unsigned) st.gc_runs,
+           (unsigned) st.erases,
+           (unsigned) st.gc_bytes);
+    return st.write_amp;
+}
+
+static void test_gc_policy(void)
+{
+    printf("\n=== 27. GC回收策略测试 ===\n");
+
+    uint8_t ok = 1;
+    float   wa_oldest = gs_run(NKV_GC_POLICY_OLDEST, &ok);
+    float   wa_greedy = gs_run(NKV_GC_POLICY_GREEDY, &ok);
+    float   wa_cb     = gs_run(NKV_GC_POLICY_COST_BENEFIT, &ok);
+
+    TEST_ASSERT(ok, "Writes, sector accounting and remount consistent under all policies");
+    TEST_ASSERT(wa_greedy <= wa_oldest && wa_cb <= wa_oldest, "Garbage-aware victim selection lowers write amplification");
+    TEST_ASSERT(nkv_gc_set_policy(NKV_GC_POLICY_COST_BENEFIT + 1) == NKV_ERR_INVALID, "Unknown policy rejected");
+
+    nkv_gc_stats_t st;
+    nkv_gc_stats_reset();
+    nkv_gc_stats(&st);
+    TEST_ASSERT(st.user_bytes == 0 && st.flash_bytes == 0 && st.write_amp == 0.0f, "Stats reset");
+
+    nkv_gc_set_policy(NKV_GC_POLICY);
+    print_usage();
+}
+
+/* 28. GC碰撞键测试：8位键哈希全部相同的键经多轮回收后不丢失、不重复 */
+#define CK_KEYS   48
+#define CK_ROUNDS 40
+
+/* 与格式1条目头中 key_hash 的计算方式一致 */
+static uint8_t ck_hash8(const char* key)
+{
+    uint16_t h = 0;
+    while (*key)
+        h = h * 31 + (uint8_t) *key++;
+    return (uint8_t) h;
+}
+
+/* 各键读回最后写入的值且Flash中只有一个有效副本，返回不符合的键数 */
+static uint32_t ck_verify(char (*keys)[12], const uint32_t* model)
+{
+    uint32_t bad = 0;
+    for (uint32_t k = 0; k < CK_KEYS; k++)
+    {
+        uint32_t v = 0;
+        if (nkv_get(keys[k], &v, sizeof(v), NULL) != NKV_OK || v != model[k] || count_valid_copies(keys[k]) != 1)
+            bad++;
+    }
+    return bad;
+}
+
+static void test_gc_collisions(void)
+{
+    printf("\n=== 28. GC碰撞键测试 ===\n");
+
+    static char     keys[CK_KEYS][12];
+    static uint32_t model[CK_KEYS];
+    uint32_t        n = 0;
+    for (uint32_t i = 0; n < CK_KEYS && i < 100000; i++)
+    {
+        snprintf(keys[n], sizeof(keys[n]), "ck%u", (unsigned) i);
+        if (ck_hash8(keys[n]) == 0x5A)
+            n++;
+    }
+    TEST_ASSERT(n == CK_KEYS, "Found keys sharing one 8-bit hash");
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    nkv_internal_init(&ops);
+    nkv_scan();
+
+    /* 反复更新全部碰撞键，写入量约为分区容量的数倍 */
+    uint8_t ok = 1;
+    uint8_t val[24];
+    memset(val, 0xC5, sizeof(val));
+    for (uint32_t r = 0; r < CK_ROUNDS; r++)
+    {
+        for (uint32_t k = 0; k < CK_KEYS; k++)
+        {
+            model[k] = r * CK_KEYS + k;
+            memcpy(val, &model[k], sizeof(uint32_t));
+            if (nkv_set(keys[k], val, sizeof(val)) != NKV_OK)
+                ok = 0;
+        }
+        if (r % 8 == 7 && ck_verify(keys, model) != 0)
+            ok = 0;
+    }
+
+    nkv_gc_stats_t st;
+    nkv_gc_stats(&st);
+    printf("  [INFO] %u colliding keys, %u sectors reclaimed\n", (unsigned) CK_KEYS, (unsigned) st.gc_runs);
+    TEST_ASSERT(ok && st.gc_runs > TEST_SECTOR_COUNT, "All colliding keys intact across repeated GC");
+
+    nkv_internal_init(&ops);
+    nkv_scan();
+    TEST_ASSERT(ck_verify(keys, model) == 0, "Colliding keys intact after remount");
+
+#if NKV_INCREMENTAL_GC
+    /* 只更新前一半键，使回收扇区中留有另一半键的有效条目；回收由手动步进推进并统计其Flash读取次数 */
+    uint32_t entries = 0, reads = 0, bytes = 0;
+    for (uint32_t i = 0; i < 1500; i++)
+    {
+        uint32_t k = i % (CK_KEYS / 2);
+        model[k] += CK_KEYS * CK_ROUNDS;
+        memcpy(val, &model[k], sizeof(uint32_t));
+        nkv_set(keys[k], val, sizeof(val));
+
+        g_read_calls = g_read_bytes = 0;
+        while (nkv_gc_active() && nkv_gc_step(1))
+            entries++;
+        reads += g_read_calls;
+        bytes += g_read_bytes;
+    }
+    printf("  [PERF] GC examined %u live entries: %.2f flash reads, %.0f bytes per entry\n",
+           (unsigned) entries,
+           entries ? (double) reads / entries : 0.0,
+           entries ? (double) bytes / entries : 0.0);
+    TEST_ASSERT(entries > 0 && reads <= entries * 3, "Constant flash reads per live entry");
+    TEST_ASSERT(ck_verify(keys, model) == 0, "Colliding keys intact after stepped GC");
+#endif
+
+    print_usage();
+}
+
+/* 29. 存储格式测试：旧格式分区可挂载并在回收中逐步升级；比较两种格式查找时的键名比较次数 */
+#define FM_KEYS 300
+
+/* 以指定格式写入 FM_KEYS 个键并逐一查找，返回每次查找的平均键名比较次数（含命中的一次） */
+static double fm_bench(const nkv_flash_ops_t* ops, uint8_t format, uint8_t* ok)
+{
+    nkv_instance_t* inst = nkv_get_instance();
+    char            key[8];
+    uint32_t        v;
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(ops);
+    inst->format = format;
+    nkv_scan();
+#if NKV_CACHE_ENABLE
+    nkv_cache_clear();
+#endif
+
+    for (v = 0; v < FM_KEYS; v++)
+    {
+        snprintf(key, sizeof(key), "f%03u", (unsigned) v);
+        if (nkv_set(key, &v, sizeof(v)) != NKV_OK)
+            *ok = 0;
+    }
+
+    inst->key_reads = 0;
+    for (uint32_t k = 0; k < FM_KEYS; k++)
+    {
+        snprintf(key, sizeof(key), "f%03u", (unsigned) k);
+        if (nkv_get(key, &v, sizeof(v), NULL) != NKV_OK || v != k)
+            *ok = 0;
+    }
+    return (double) inst->key_reads / FM_KEYS;
+}
+
+static void test_format_upgrade(void)
+{
+    printf("\n=== 29. 存储格式测试 ===\n");
+
+    nkv_instance_t* inst = nkv_get_instance();
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+
+    uint8_t ok     = 1;
+    double  per_v2 = fm_bench(&ops, NKV_FORMAT_V2, &ok);
+    double  per_v1 = fm_bench(&ops, NKV_FORMAT_V1, &ok);
+    printf("  [PERF] %u keys, key compares per lookup: format 1 = %.3f, format 2 = %.3f\n",
+           (unsigned) FM_KEYS,
+           per_v1,
+           per_v2);
+    TEST_ASSERT(ok, "Both formats store and find all keys");
+    TEST_ASSERT(per_v2 <= per_v1, "Wider hash needs no more key compares");
+
+    /* 新固件挂载旧格式镜像：数据可读，持续写入后旧格式扇区在回收中全部转为新格式 */
+    nkv_internal_init(&ops);
+    inst->format = NKV_FORMAT_V3; /* 扇区头大小也不同于格式1 */
+    nkv_scan();
+    uint8_t v1_mounted = (inst->sectors[inst->active_sector].format == NKV_FORMAT_V1);
+
+    uint32_t model[FM_KEYS];
+    char     key[8];
+    uint32_t v;
+    for (uint32_t k = 0; k < FM_KEYS; k++)
+    {
+        model[k] = k;
+        snprintf(key, sizeof(key), "f%03u", (unsigned) k);
+        if (nkv_get(key, &v, sizeof(v), NULL) != NKV_OK || v != k)
+            v1_mounted = 0;
+    }
+    TEST_ASSERT(v1_mounted, "Old-format partition mounts and reads back");
+
+    for (uint32_t i = 0; i < 2000; i++)
+    {
+        uint32_t k = (i * 7) % FM_KEYS;
+        model[k]   = 1000 + i;
+        snprintf(key, sizeof(key), "f%03u", (unsigned) k);
+        if (nkv_set(key, &model[k], sizeof(uint32_t)) != NKV_OK)
+            ok = 0;
+    }
+    uint8_t upgraded = 1;
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        if (inst->sectors[s].valid && inst->sectors[s].format != NKV_FORMAT_V3)
+            upgraded = 0;
+    TEST_ASSERT(ok && upgraded, "GC migrates old-format sectors to the new format");
+
+    nkv_internal_init(&ops);
+    nkv_scan();
+    for (uint32_t k = 0; k < FM_KEYS; k++)
+    {
+        snprintf(key, sizeof(key), "f%03u", (unsigned) k);
+        if (nkv_get(key, &v, sizeof(v), NULL) != NKV_OK || v != model[k])
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "Upgraded partition intact after remount");
+
+    print_usage();
+}
+
+/* 30. 大值测试：超过255字节的值流式写入/读取，GC整体迁移分块，掉电后不残留未完成的分块 */
+#if NKV_LARGE_VALUE
+typedef struct
+{
+    uint32_t seed;
+    uint32_t next;     /* 期望的下一段偏移 */
+    uint32_t mismatch; /* 偏移或数据不符的次数 */
+    uint32_t fail_at;  /* 非0时读到该偏移后回调返回失败 */
+} lv_ctx_t;
+
+static uint8_t lv_byte(uint32_t seed, uint32_t off)
+{
+    return (uint8_t) (off * 131u + seed * 7u + (off >> 8));
+}
+
+static int lv_fill(void* ctx, uint32_t offset, uint8_t* buf, uint16_t len)
+{
+    lv_ctx_t* c = (lv_ctx_t*) ctx;
+    if (c->fail_at && offset >= c->fail_at)
+        return -1;
+    for (uint16_t i = 0; i < len; i++)
+        buf[i] = lv_byte(c->seed, offset + i);
+    return 0;
+}
+
+static int lv_check(void* ctx, uint32_t offset, uint8_t* buf, uint16_t len)
+{
+    lv_ctx_t* c = (lv_ctx_t*) ctx;
+    if (offset != c->next)
+        c->mismatch++;
+    for (uint16_t i = 0; i < len; i++)
+        if (buf[i] != lv_byte(c->seed, offset + i))
+            c->mismatch++;
+    c->next = offset + len;
+    return 0;
+}
+
+/* 流式读回并按生成规则逐字节比较 */
+static uint8_t lv_verify(const char* key, uint32_t seed, uint32_t total)
+{
+    lv_ctx_t c   = {.seed = seed};
+    uint32_t len = 0;
+    return nkv_get_stream(key, lv_check, &c, &len) == NKV_OK && len == total && c.next == total && c.mismatch == 0;
+}
+
+static nkv_err_t lv_write(const char* key, uint32_t seed, uint32_t total)
+{
+    lv_ctx_t c = {.seed = seed};
+    return nkv_set_stream(key, total, lv_fill, &c);
+}
+
+/* 直接遍历Flash统计有效的大值分块数 */
+static uint32_t lv_valid_chunks(void)
+{
+    uint32_t n = 0;
+    for (uint32_t s = 0; s < TEST_SECTOR_COUNT; s++)
+    {
+        uint8_t* sec = &g_flash[s * TEST_SECTOR_SIZE];
+        if (!test_sector_magic(sec))
+            continue;
+        for (uint32_t off = test_sector_data(sec); off + NKV_HEADER_SIZE <= TEST_SECTOR_SIZE;)
+        {
+            nkv_entry_t e;
+            memcpy(&e, sec + off, NKV_HEADER_SIZE);
+            if (e.state == NKV_STATE_ERASED)
+                break;
+            if (e.state == NKV_STATE_VALID && e.key_len == 0 && (e.reserved | 0xFC) == NKV_ENTRY_FLAG_LARGE)
+                n++;
+            off += (NKV_HEADER_SIZE + e.key_len + e.val_len + NKV_CRC_SIZE + 3) & ~3u;
+        }
+    }
+    return n;
+}
+
+    #define LV_CHUNKS(len) (((len) + NKV_LARGE_CHUNK - 1) / NKV_LARGE_CHUNK)
+
+static void test_large_value(void)
+{
+    printf("\n=== 30. 大值测试 ===\n");
+
+    static uint8_t  snapshot[TEST_FLASH_SIZE];
+    nkv_flash_ops_t ops;
+    nkv_gc_stats_t  st;
+    build_flash_ops(&ops);
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+
+    /* 基本读写 */
+    TEST_ASSERT(lv_write("cert", 1, 2000) == NKV_OK, "Stream write of a 2000-byte value");
+    TEST_ASSERT(lv_verify("cert", 1, 2000), "Stream read returns every byte in order");
+
+    uint8_t  prefix[64];
+    uint8_t  len   = 0;
+    uint32_t total = 0;
+    TEST_ASSERT(nkv_get("cert", prefix, sizeof(prefix), &len) == NKV_OK && len == sizeof(prefix) &&
+                    prefix[0] == lv_byte(1, 0) && prefix[63] == lv_byte(1, 63),
+                "nkv_get returns the value prefix");
+    TEST_ASSERT(nkv_get_stream("cert", NULL, NULL, &total) == NKV_OK && total == 2000, "Length query reads no chunks");
+    TEST_ASSERT(nkv_exists("cert") && !nkv_exists("cer"), "Large value visible to nkv_exists");
+
+    uint32_t small = 42;
+    lv_ctx_t c     = {.seed = 0};
+    nkv_set("small", &small, sizeof(small));
+    TEST_ASSERT(nkv_get_stream("small", NULL, NULL, &total) == NKV_OK && total == sizeof(small),
+                "Stream read also serves ordinary values");
+
+    /* 覆盖写入与删除：旧分块随旧头条目删除 */
+    TEST_ASSERT(lv_write("cert", 2, 1000) == NKV_OK && lv_verify("cert", 2, 1000), "Overwrite with a shorter value");
+    TEST_ASSERT(lv_valid_chunks() == LV_CHUNKS(1000) && gs_check_sectors() == 0,
+                "Old chunks released with the old head");
+    TEST_ASSERT(lv_write("tmp", 3, 700) == NKV_OK && nkv_del("tmp") == NKV_OK && !nkv_exists("tmp") &&
+                    lv_valid_chunks() == LV_CHUNKS(1000),
+                "Delete releases all chunks");
+
+    /* 参数检查与中止 */
+    TEST_ASSERT(lv_write("huge", 4, TEST_SECTOR_SIZE) == NKV_ERR_NO_SPACE, "Value larger than a sector rejected");
+    c.seed    = 5;
+    c.fail_at = 500;
+    TEST_ASSERT(nkv_set_stream("cert", 1500, lv_fill, &c) == NKV_ERR_INVALID, "Aborting callback fails the write");
+    TEST_ASSERT(lv_verify("cert", 2, 1000) && lv_valid_chunks() == LV_CHUNKS(1000) && gs_check_sectors() == 0,
+                "Aborted write leaves the old value and no chunks");
+
+    /* GC：小键持续更新使大值所在扇区被多次回收，分块与头条目整体迁移 */
+    uint8_t ok = (lv_write("table", 6, 1500) == NKV_OK);
+    nkv_gc_stats_reset();
+    for (uint32_t i = 0; i < 1500; i++)
+    {
+        char     key[8];
+        uint32_t v = i;
+        snprintf(key, sizeof(key), "lk%02u", (unsigned) (i % 40));
+        if (nkv_set(key, &v, sizeof(v)) != NKV_OK)
+            ok = 0;
+        if (i % 300 == 150 && lv_write("table", 7 + i, 1500) != NKV_OK)
+            ok = 0;
+        if (i % 100 == 0 && !lv_verify("cert", 2, 1000))
+            ok = 0;
+    }
+    nkv_gc_stats(&st);
+    printf("  [INFO] %u sectors reclaimed with large values present\n", (unsigned) st.gc_runs);
+    TEST_ASSERT(ok && st.gc_runs >= 3, "Large values survive repeated GC");
+    TEST_ASSERT(lv_verify("table", 7 + 1350, 1500) && gs_check_sectors() == 0 &&
+                    lv_valid_chunks() == LV_CHUNKS(1000) + LV_CHUNKS(1500),
+                "Chunks migrated as a unit without leftovers");
+
+    nkv_internal_init(&ops);
+    nkv_scan();
+    TEST_ASSERT(lv_verify("cert", 2, 1000) && lv_verify("table", 7 + 1350, 1500) && gs_check_sectors() == 0,
+                "Large values intact after remount");
+
+    #if NKV_WRITE_BUFFER
+    /* 经写缓冲批量落盘的普通值替换大值 */
+    nkv_wbuf_enable(1);
+    nkv_set("cert", &small, sizeof(small));
+    nkv_set("table", &small, sizeof(small));
+    TEST_ASSERT(nkv_get_stream("cert", NULL, NULL, &total) == NKV_OK && total == sizeof(small),
+                "Staged value shadows the large value");
+    nkv_wbuf_enable(0);
+    TEST_ASSERT(lv_valid_chunks() == 0 && gs_check_sectors() == 0, "Batch overwrite releases large values");
+    TEST_ASSERT(lv_write("cert", 2, 1000) == NKV_OK && lv_write("table", 8, 1500) == NKV_OK, "Large values restored");
+    #endif
+
+    /* 掉电注入：在第k次编程操作处掉电，重启后要么是完整的旧值，要么是完整的新值，且不残留分块 */
+    memcpy(snapshot, g_flash, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    g_write_calls = 0;
+    lv_write("cert", 9, 1500);
+    uint32_t write_ops = g_write_calls;
+
+    uint32_t old_seen = 0, new_seen = 0;
+    ok = 1;
+    for (uint32_t k = 1; k <= write_ops; k++)
+    {
+        memcpy(g_flash, snapshot, sizeof(g_flash));
+        nkv_internal_init(&ops);
+        nkv_scan();
+
+        g_write_calls      = 0;
+        g_write_fail_after = k;
+        lv_write("cert", 9, 1500);
+        g_write_fail_after = 0;
+
+        nkv_internal_init(&ops);
+        if (k & 1)
+            nkv_scan_legacy();
+        else
+            nkv_scan();
+
+        if (lv_verify("cert", 2, 1000))
+            old_seen++;
+        else if (lv_verify("cert", 9, 1500))
+            new_seen++;
+        else
+            ok = 0;
+        /* 单遍挂载清理所有扇区的残留分块；旧路径只检查活动扇区，旧扇区中的残留留待回收 */
+        total           = 0;
+        nkv_get_stream("cert", NULL, NULL, &total);
+        uint32_t chunks = lv_valid_chunks(), expect = LV_CHUNKS(total) + LV_CHUNKS(1500);
+        if ((k & 1) ? chunks < expect : chunks != expect)
+            ok = 0;
+        if (gs_check_sectors() != 0)
+            ok = 0;
+        if (lv_write("after", 10, 600) != NKV_OK || !lv_verify("after", 10, 600))
+            ok = 0;
+    }
+    printf("  [INFO] %u power-loss points: %u rolled back, %u committed\n",
+           (unsigned) write_ops,
+           (unsigned) old_seen,
+           (unsigned) new_seen);
+    TEST_ASSERT(ok, "Large write is all-or-nothing at every power-loss point");
+    TEST_ASSERT(old_seen > 0 && new_seen > 0, "Both rollback and roll-forward exercised");
+
+    print_usage();
+}
+#endif
+
+#if NKV_ZERO_COPY
+/* 31. 零拷贝读取测试：模拟层以 g_flash 作为映射的Flash */
+static void test_zero_copy(void)
+{
+    printf("\n=== 31. 零拷贝读取测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    nkv_gc_stats_t  st;
+    nkv_ref_t       ref, old;
+    build_flash_ops(&ops);
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+
+    const char v1[] = "mapped-value-1";
+    const char v2[] = "mapped-value-2!";
+    nkv_set("zc", v1, sizeof(v1));
+
+    uint32_t reads = g_read_calls;
+    TEST_ASSERT(nkv_get_ref("zc", &ref) == NKV_OK && ref.len == sizeof(v1) && memcmp(ref.data, v1, sizeof(v1)) == 0,
+                "Reference returns the stored value");
+    TEST_ASSERT(ref.data > g_flash && ref.data < g_flash + TEST_FLASH_SIZE, "Reference points into mapped flash");
+    printf("  [INFO] flash.read calls for one get_ref: %u\n", (unsigned) (g_read_calls - reads));
+    TEST_ASSERT(nkv_ref_valid(&ref), "Fresh reference is valid");
+    TEST_ASSERT(nkv_get_ref("nx", &ref) == NKV_ERR_NOT_FOUND, "Missing key reports NOT_FOUND");
+
+    /* 覆盖写不擦除扇区：旧引用仍有效且内容不变 */
+    nkv_get_ref("zc", &old);
+    nkv_set("zc", v2, sizeof(v2));
+    TEST_ASSERT(nkv_ref_valid(&old) && memcmp(old.data, v1, sizeof(v1)) == 0, "Overwrite keeps old reference intact");
+    TEST_ASSERT(nkv_get_ref("zc", &ref) == NKV_OK && ref.len == sizeof(v2) && memcmp(ref.data, v2, sizeof(v2)) == 0,
+                "New reference sees the new value");
+
+    uint8_t buf[32];
+    uint8_t len = 0;
+    TEST_ASSERT(nkv_get("zc", buf, sizeof(buf), &len) == NKV_OK && len == sizeof(v2) && memcmp(buf, v2, len) == 0,
+                "nkv_get reads through the mapping");
+
+    #if NKV_VERIFY_ON_READ
+    uint8_t* p    = (uint8_t*) ref.data;
+    uint8_t  save = p[0];
+    p[0] ^= 0x01;
+    TEST_ASSERT(nkv_get_ref("zc", &old) == NKV_ERR_CRC, "Corrupted value rejected by in-place CRC check");
+    p[0] = save;
+    #endif
+
+    #if NKV_WRITE_BUFFER
+    nkv_wbuf_enable(1);
+    nkv_set("staged", v1, sizeof(v1));
+    TEST_ASSERT(nkv_get_ref("staged", &old) == NKV_OK && nkv_wbuf_pending() == 0 &&
+                    memcmp(old.data, v1, sizeof(v1)) == 0,
+                "Staged value flushed before taking a reference");
+    nkv_wbuf_enable(0);
+    #endif
+
+    #if NKV_LARGE_VALUE
+    lv_write("big", 3, 600);
+    TEST_ASSERT(nkv_get_ref("big", &old) == NKV_ERR_INVALID, "Large value has no contiguous reference");
+    #endif
+
+    /* 回收擦除扇区后引用失效 */
+    nkv_gc_stats(&st);
+    uint32_t erases = st.erases;
+    uint32_t n      = 0;
+    for (char k[8]; st.erases == erases && n < 2000; n++)
+    {
+        snprintf(k, sizeof(k), "f%u", (unsigned) (n % 16));
+        nkv_set(k, &n, sizeof(n));
+        nkv_gc_stats(&st);
+    }
+    TEST_ASSERT(st.erases > erases && !nkv_ref_valid(&ref), "Erase invalidates outstanding references");
+    TEST_ASSERT(nkv_get_ref("zc", &ref) == NKV_OK && nkv_ref_valid(&ref) && memcmp(ref.data, v2, sizeof(v2)) == 0,
+                "Reference taken again after GC");
+
+    /* 不可映射的Flash */
+    ops.map = NULL;
+    nkv_internal_init(&ops);
+    nkv_scan();
+    TEST_ASSERT(nkv_get_ref("zc", &ref) == NKV_ERR_INVALID, "Unmapped flash rejects get_ref");
+    TEST_ASSERT(nkv_get("zc", buf, sizeof(buf), &len) == NKV_OK && memcmp(buf, v2, sizeof(v2)) == 0,
+                "Unmapped flash still reads through flash.read");
+}
+#endif
+
+#if NKV_BACKGROUND_GC && NKV_LATENCY_STATS
+/* 后台维护测试负载：count 次覆盖写，every>0 时每 every 次写入后按预算调用一次 nkv_background */
+static void bg_workload(uint32_t count, uint32_t every, const nkv_budget_t* budget)
+{
+    char     key[8];
+    uint32_t val[4];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        snprintf(key, sizeof(key), "bg%02u", (unsigned) (i % 40));
+        val[0] = val[1] = val[2] = val[3] = i;
+        nkv_set(key, val, sizeof(val));
+        if (every && (i + 1) % every == 0)
+            nkv_background(budget);
+    }
+}
+
+/* 32. 后台维护测试：nkv_background 按预算推进回收与预擦除，nkv_set 尾延迟下降 */
+static void test_background(void)
+{
+    printf("\n=== 32. 后台维护测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    nkv_latency_t   inl, bg;
+    nkv_gc_stats_t  st;
+    build_flash_ops(&ops);
+
+    /* 不调用后台任务：回收与擦除都发生在写入中 */
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_latency_reset();
+    bg_workload(1500, 0, NULL);
+    nkv_latency_stats(&inl);
+    nkv_gc_stats(&st);
+    uint32_t inline_runs = st.gc_runs;
+
+    /* 每4次写入给后台8个工作单元 */
+    nkv_budget_t budget = {.ops = 8};
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_latency_reset();
+    bg_workload(1500, 4, &budget);
+    nkv_latency_stats(&bg);
+    nkv_gc_stats(&st);
+
+    printf("  [INFO] inline:     p50=%uus p99=%uus max=%uus, %u GC runs\n",
+           (unsigned) nkv_latency_percentile(&inl, 50),
+           (unsigned) nkv_latency_percentile(&inl, 99),
+           (unsigned) inl.max_us,
+           (unsigned) inline_runs);
+    printf("  [INFO] background: p50=%uus p99=%uus max=%uus, %u GC runs\n",
+           (unsigned) nkv_latency_percentile(&bg, 50),
+           (unsigned) nkv_latency_percentile(&bg, 99),
+           (unsigned) bg.max_us,
+           (unsigned) st.gc_runs);
+    TEST_ASSERT(inl.count == 1500 && bg.count == 1500, "Every nkv_set recorded in the histogram");
+    TEST_ASSERT(inl.max_us >= TEST_ERASE_US, "Inline GC puts sector erases on the write path");
+    #if NKV_INCREMENTAL_GC
+    TEST_ASSERT(st.gc_runs > 0 && bg.max_us < TEST_ERASE_US, "Background GC keeps erases out of nkv_set");
+    #endif
+    TEST_ASSERT(nkv_latency_percentile(&bg, 99) <= nkv_latency_percentile(&inl, 99), "p99 no worse with background GC");
+
+    uint32_t val[4] = {0};
+    uint8_t  len    = 0;
+    uint8_t  ok     = 1;
+    for (uint32_t k = 0; k < 40; k++)
+    {
+        char key[8];
+        snprintf(key, sizeof(key), "bg%02u", (unsigned) k);
+        if (nkv_get(key, val, sizeof(val), &len) != NKV_OK || val[0] != (1499 - k) / 40 * 40 + k)
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "All keys hold their latest value");
+
+    /* 操作数与时间预算 */
+    bg_workload(200, 0, NULL);
+    nkv_gc_stats(&st);
+    uint32_t erases = st.erases;
+    budget          = (nkv_budget_t) {.ops = 1};
+    uint8_t more    = nkv_background(&budget);
+    nkv_gc_stats(&st);
+    TEST_ASSERT(!more || st.erases <= erases + 1, "One-unit budget does at most one erase");
+
+    uint32_t t0 = g_sim_us;
+    budget      = (nkv_budget_t) {.us = 300};
+    nkv_background(&budget);
+    TEST_ASSERT(g_sim_us - t0 < 300 + TEST_ERASE_US, "Time budget overshoots by at most one unit");
+
+    while (nkv_background(NULL))
+        ;
+    #if NKV_INCREMENTAL_GC
+    TEST_ASSERT(!nkv_gc_active(), "Unlimited budget drains pending GC");
+    #endif
+
+    /* 挂载后空闲扇区里的残留数据由后台预擦除 */
+    uint8_t junk = 0;
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        if (!nkv_is_sector_valid(s))
+        {
+            g_flash[s * TEST_SECTOR_SIZE + 100] = 0x00;
+            junk                                = s;
+        }
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_gc_stats_reset();
+    while (nkv_background(NULL))
+        ;
+    nkv_gc_stats(&st);
+    TEST_ASSERT(g_flash[junk * TEST_SECTOR_SIZE + 100] == 0xFF && st.erases >= 1, "Dirty free sector pre-erased");
+
+    #if NKV_WRITE_BUFFER
+    nkv_wbuf_enable(1);
+    nkv_set("bgw", val, sizeof(val));
+    for (uint8_t i = 0; i < NKV_WBUF_FLUSH_TICKS; i++)
+        nkv_background(NULL);
+    TEST_ASSERT(nkv_wbuf_pending() == 0, "Background call ages and flushes the write buffer");
+    nkv_wbuf_enable(0);
+    #endif
+
+    print_usage();
+}
+#endif
+
+#if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+/* 33. 预擦除扇区池测试：扇区切换只写扇区头，nkv_set 中不出现擦除 */
+static void test_spare_pool(void)
+{
+    printf("\n=== 33. 预擦除扇区池测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    nkv_gc_stats_t  st;
+    nkv_budget_t    budget = {.ops = 8};
+    build_flash_ops(&ops);
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+
+    uint32_t hot_erases = 0, max_us = 0, max_read = 0, rollovers = 0;
+    uint32_t prev_used = 0, used = 0, total = 0;
+    char     key[8];
+    uint32_t val[4];
+    for (uint32_t i = 0; i < 3000; i++)
+    {
+        /* 中途重新挂载：RAM中的擦除标记丢失，由后台重新确认 */
+        if (i == 1500)
+        {
+            nkv_internal_init(&ops);
+            nkv_scan();
+        }
+        snprintf(key, sizeof(key), "sp%02u", (unsigned) (i % 40));
+        val[0] = val[1] = val[2] = val[3] = i;
+
+        uint32_t erases = g_erase_calls, t0 = g_sim_us, rb = g_read_bytes;
+        nkv_set(key, val, sizeof(val));
+        hot_erases += g_erase_calls - erases;
+        if (g_sim_us - t0 > max_us)
+            max_us = g_sim_us - t0;
+        if (g_read_bytes - rb > max_read)
+            max_read = g_read_bytes - rb;
+
+        nkv_get_usage(&used, &total);
+        if (used < prev_used)
+            rollovers++;
+        prev_used = used;
+
+        if ((i + 1) % 4 == 0)
+            nkv_background(&budget);
+    }
+    nkv_gc_stats(&st);
+    printf("  [INFO] 3000 writes, %u rollovers, %u GC runs: worst nkv_set %uus, %u bytes read, %u erases\n",
+           (unsigned) rollovers,
+           (unsigned) st.gc_runs,
+           (unsigned) max_us,
+           (unsigned) max_read,
+           (unsigned) hot_erases);
+    TEST_ASSERT(rollovers >= 4 && st.gc_runs > 0, "Workload rolls over sectors repeatedly");
+    TEST_ASSERT(hot_erases == 0, "No erase inside nkv_set");
+    #if NKV_INDEX_ENABLE /* 无索引时查找本身会扫描扇区 */
+    TEST_ASSERT(max_read < TEST_SECTOR_SIZE / 2, "Rollover skips the whole-sector blank check");
+    #endif
+    TEST_ASSERT(max_us < TEST_ERASE_US, "Worst-case nkv_set bounded by programming time");
+
+    /* 回收完成只清零扇区头，擦除在后台进行 */
+    while (nkv_background(NULL))
+        ;
+    nkv_gc_stats(&st);
+    uint32_t runs = st.gc_runs;
+    for (uint32_t i = 0; st.gc_runs == runs && i < 2000; i++)
+    {
+        snprintf(key, sizeof(key), "sp%02u", (unsigned) (i % 40));
+        nkv_set(key, &i, sizeof(i));
+        nkv_gc_stats(&st);
+    }
+    int16_t retired = -1;
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        if (g_flash[s * TEST_SECTOR_SIZE] == 0x00 && g_flash[s * TEST_SECTOR_SIZE + 1] == 0x00)
+            retired = s;
+    TEST_ASSERT(st.gc_runs > runs && retired >= 0, "Reclaimed sector retired by clearing its header");
+
+    nkv_internal_init(&ops);
+    nkv_scan();
+    TEST_ASSERT(!nkv_is_sector_valid((uint8_t) retired), "Retired sector mounts as free");
+    uint32_t erases = g_erase_calls;
+    while (nkv_background(NULL))
+        ;
+    TEST_ASSERT(g_erase_calls > erases && g_flash[retired * TEST_SECTOR_SIZE] == 0xFF, "Background erases retired sector");
+
+    print_usage();
+}
+#endif
+
+#if NKV_ASYNC_FLASH
+/* 34. 异步Flash操作测试：模拟DMA驱动，提交后挂起，由 async_advance 完成 */
+static struct
+{
+    uint8_t            kind; /* 0=空闲, 1=编程, 2=擦除 */
+    uint32_t           addr;
+    const uint8_t*     buf;
+    uint32_t           len;
+    nkv_flash_done_fn  done;
+    void*              ctx;
+} g_aop;
+static uint32_t g_async_submits = 0;
+static uint32_t g_async_done    = 0;
+static uint32_t g_async_waits   = 0; /* 读取等待挂起操作完成的次数 */
+static nkv_err_t g_async_err    = NKV_ERR_INVALID;
+
+static int mock_write_async(uint32_t addr, const uint8_t* buf, uint32_t len, nkv_flash_done_fn done, void* ctx)
+{
+    if (g_aop.kind || flash_range_check(addr, len) != 0)
+        return -1;
+    g_aop.kind = 1;
+    g_aop.addr = addr;
+    g_aop.buf  = buf; /* DMA直接读取调用者缓冲区，完成前须保持有效 */
+    g_aop.len  = len;
+    g_aop.done = done;
+    g_aop.ctx  = ctx;
+    g_async_submits++;
+    return 0;
+}
+
+static int mock_erase_async(uint32_t addr, nkv_flash_done_fn done, void* ctx)
+{
+    if (g_aop.kind || addr >= TEST_FLASH_SIZE)
+        return -1;
+    g_aop.kind = 2;
+    g_aop.addr = addr;
+    g_aop.done = done;
+    g_aop.ctx  = ctx;
+    g_async_submits++;
+    return 0;
+}
+
+/* 完成挂起的操作并在"中断"中回调，返回0=没有挂起的操作 */
+static uint8_t async_advance(void)
+{
+    uint8_t kind = g_aop.kind;
+    if (!kind)
+        return 0;
+    g_aop.kind = 0;
+    int ret    = (kind == 1) ? mock_flash_write(g_aop.addr, g_aop.buf, g_aop.len) : mock_flash_erase(g_aop.addr);
+    g_aop.done(g_aop.ctx, ret);
+    return 1;
+}
+
+/* 读取前等待挂起的编程/擦除完成，与真实驱动轮询忙状态位一致 */
+static int mock_read_async(uint32_t addr, uint8_t* buf, uint32_t len)
+{
+    if (async_advance())
+        g_async_waits++;
+    return mock_flash_read(addr, buf, len);
+}
+
+/* 挂起的编程只写入前半部分后掉电 */
+static void async_cut(void)
+{
+    if (g_aop.kind == 1)
+        memcpy(&g_flash[g_aop.addr], g_aop.buf, g_aop.len / 2);
+    g_aop.kind = 0;
+}
+
+static void async_cb(void* ctx, nkv_err_t err)
+{
+    (void) ctx;
+    g_async_done++;
+    g_async_err = err;
+}
+
+static void async_run(void)
+{
+    while (nkv_async_poll())
+        async_advance();
+}
+
+static void test_async_flash(void)
+{
+    printf("\n=== 34. 异步Flash操作测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    uint32_t        v1 = 0x11111111, v2 = 0x22222222, out = 0;
+    build_flash_ops(&ops);
+    ops.read        = mock_read_async;
+    ops.write_async = mock_write_async;
+    ops.erase_async = mock_erase_async;
+    memset(&g_aop, 0, sizeof(g_aop));
+
+    /* 同步参照：相同操作序列的Flash镜像与编程次数 */
+    static uint8_t ref[TEST_FLASH_SIZE];
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_set("ak", &v1, sizeof(v1));
+    uint32_t w0 = g_write_calls;
+    nkv_set("ak", &v2, sizeof(v2));
+    uint32_t sync_writes = g_write_calls - w0;
+    memcpy(ref, g_flash, sizeof(ref));
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_set("ak", &v1, sizeof(v1));
+    w0 = g_write_calls;
+
+    g_async_done = 0;
+    TEST_ASSERT(nkv_set_async("ak", &v2, sizeof(v2), async_cb, NULL) == NKV_OK && g_aop.kind == 1,
+                "nkv_set_async returns with programming pending");
+    TEST_ASSERT(nkv_set("bk", &v1, sizeof(v1)) == NKV_ERR_BUSY && nkv_del("ak") == NKV_ERR_BUSY,
+                "Other writes rejected while job pending");
+    /* 默认值同步与重新挂载同样写入/重建状态，不能与挂起的编程重叠 */
+    static const uint32_t      dv     = 0x33333333;
+    static const nkv_default_t defs[] = {{"dk", &dv, sizeof(dv)}};
+    TEST_ASSERT(nkv_set_defaults(defs, NKV_DEFAULT_SIZE(defs)) == NKV_ERR_BUSY && nkv_scan() == NKV_ERR_BUSY,
+                "Defaults and rescan rejected while job pending");
+    TEST_ASSERT(nkv_async_poll() == 1 && g_async_done == 0, "Poll does not advance until driver completes");
+
+    /* 逐步完成：VALID 编程完成前读取旧值 */
+    uint8_t steps = 0, old_seen = 1;
+    while (nkv_async_poll())
+    {
+        out = 0;
+        nkv_get("ak", &out, sizeof(out), NULL);
+        if (steps < 3 && out != v1)
+            old_seen = 0;
+        async_advance();
+        steps++;
+    }
+    out = 0;
+    nkv_get("ak", &out, sizeof(out), NULL);
+    TEST_ASSERT(old_seen && out == v2, "Readers see old value until VALID is programmed");
+    TEST_ASSERT(g_async_done == 1 && g_async_err == NKV_OK, "Completion callback called once");
+    TEST_ASSERT(steps == sync_writes && g_write_calls - w0 == sync_writes, "Same number of program ops as nkv_set");
+    TEST_ASSERT(memcmp(ref, g_flash, sizeof(ref)) == 0, "Flash image identical to synchronous write");
+    TEST_ASSERT(nkv_set("bk", &v1, sizeof(v1)) == NKV_OK, "Writes accepted after job completes");
+    out = 0;
+    TEST_ASSERT(nkv_set_defaults(defs, NKV_DEFAULT_SIZE(defs)) == NKV_OK &&
+                    nkv_get("dk", &out, sizeof(out), NULL) == NKV_OK && out == dv &&
+                    nkv_get("ak", &out, sizeof(out), NULL) == NKV_OK && out == v2,
+                "Defaults synced after job completes, async value intact");
+    nkv_set_defaults(NULL, 0);
+
+    /* 在每个编程步骤掉电：重新挂载后读到旧值或新值 */
+    uint8_t recovered = 1;
+    for (uint8_t cut = 0; cut < sync_writes; cut++)
+    {
+        memset(g_flash, 0xFF, sizeof(g_flash));
+        nkv_internal_init(&ops);
+        nkv_scan();
+        nkv_set("ak", &v1, sizeof(v1));
+        nkv_set_async("ak", &v2, sizeof(v2), NULL, NULL);
+        for (uint8_t i = 0; i < cut && nkv_async_poll(); i++)
+            async_advance();
+        async_cut();
+
+        nkv_internal_init(&ops);
+        nkv_scan();
+        out = 0;
+        if (nkv_get("ak", &out, sizeof(out), NULL) != NKV_OK || (out != v1 && out != v2))
+            recovered = 0;
+    }
+    TEST_ASSERT(recovered, "Power loss at every async step recovers old or new value");
+
+    #if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+    /* 异步回收：擦除提交后立即返回，不占用调用者时间 */
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    char     key[8];
+    uint32_t val[4];
+    for (uint32_t i = 0; i < 600; i++)
+    {
+        snprintf(key, sizeof(key), "ag%02u", (unsigned) (i % 20));
+        val[0] = val[1] = val[2] = val[3] = i;
+        nkv_set(key, val, sizeof(val));
+    }
+    nkv_gc_stats_t st;
+    nkv_gc_stats(&st);
+    uint32_t runs = st.gc_runs, erases = g_erase_calls, max_us = 0;
+    g_async_done  = 0;
+    TEST_ASSERT(nkv_gc_async(async_cb, NULL) == NKV_OK, "nkv_gc_async submitted");
+    for (;;)
+    {
+        uint32_t t0   = g_sim_us;
+        uint8_t  busy = nkv_async_poll();
+        if (g_sim_us - t0 > max_us)
+            max_us = g_sim_us - t0;
+        if (!busy)
+            break;
+        async_advance();
+    }
+    nkv_gc_stats(&st);
+    printf("  [INFO] async GC: %u erases, worst poll %uus\n", (unsigned) (g_erase_calls - erases), (unsigned) max_us);
+    TEST_ASSERT(g_async_done == 1 && g_async_err == NKV_OK && st.gc_runs > runs, "Async GC completes a cycle");
+    TEST_ASSERT(g_erase_calls > erases && max_us < TEST_ERASE_US, "Erases run asynchronously");
+
+    uint8_t ok = 1;
+    for (uint32_t k = 0; k < 20; k++)
+    {
+        snprintf(key, sizeof(key), "ag%02u", (unsigned) k);
+        memset(val, 0, sizeof(val));
+        if (nkv_get(key, val, sizeof(val), NULL) != NKV_OK || val[0] != 580 + k)
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "Data intact after async GC");
+    #endif
+
+    async_run();
+    printf("  [INFO] %u reads waited for a pending flash operation\n", (unsigned) g_async_waits);
+    print_usage();
+}
+#endif
+
+/* 35. 磨损均衡测试：擦除次数持久化，冷数据扇区搬迁，擦除次数差保持在阈值附近 */
+#define WL_COLD 40
+
+static void test_wear_leveling(void)
+{
+    printf("\n=== 35. 磨损均衡测试 ===\n");
+
+    nkv_instance_t* inst = nkv_get_instance();
+    nkv_flash_ops_t ops;
+    nkv_wear_t      wear;
+    nkv_gc_stats_t  st;
+    build_flash_ops(&ops);
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_gc_set_policy(NKV_GC_POLICY_GREEDY); /* 贪心策略从不回收几乎全是有效数据的冷扇区 */
+
+    /* 冷数据写满大部分扇区后不再修改，之后只改写两个热键 */
+    char    key[8];
+    uint8_t val[80];
+    for (uint32_t k = 0; k < WL_COLD; k++)
+    {
+        snprintf(key, sizeof(key), "wc%02u", (unsigned) k);
+        memset(val, (int) k, sizeof(val));
+        nkv_set(key, val, sizeof(val));
+    }
+    uint8_t ok = 1;
+    for (uint32_t i = 0; i < 60000; i++)
+    {
+        uint32_t hot[4] = {i, i, i, i};
+        if (nkv_set((i & 1) ? "wh1" : "wh0", hot, sizeof(hot)) != NKV_OK)
+            ok = 0;
+    #if NKV_BACKGROUND_GC
+        if ((i & 7) == 7)
+            nkv_background(NULL);
+    #endif
+    }
+
+    nkv_wear_stats(&wear);
+    nkv_gc_stats(&st);
+    printf("  [PERF] 60000 hot writes: erases min=%u max=%u total=%u, %u cold relocations\n",
+           (unsigned) wear.min_erases,
+           (unsigned) wear.max_erases,
+           (unsigned) wear.total_erases,
+           (unsigned) wear.relocations);
+    uint32_t sum = 0;
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        sum += nkv_sector_erase_count(s);
+    TEST_ASSERT(ok && wear.total_erases == st.erases && sum == wear.total_erases, "Per-sector erase counts add up");
+    #if NKV_INCREMENTAL_GC && NKV_WEAR_THRESHOLD
+    TEST_ASSERT(wear.relocations > 0 && wear.max_erases - wear.min_erases <= NKV_WEAR_THRESHOLD + 2,
+                "Cold sector relocated, erase spread bounded");
+    #endif
+    for (uint32_t k = 0; k < WL_COLD; k++)
+    {
+        snprintf(key, sizeof(key), "wc%02u", (unsigned) k);
+        memset(val, 0, sizeof(val));
+        if (nkv_get(key, val, sizeof(val), NULL) != NKV_OK || val[0] != k || val[79] != k)
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "Cold data intact");
+
+    #if NKV_FORMAT_VERSION == NKV_FORMAT_V3 /* 旧格式扇区头不记录擦除次数 */
+    /* 重新挂载：有效、作废与空闲扇区的擦除次数都从扇区头恢复 */
+    uint32_t before[TEST_SECTOR_COUNT];
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        before[s] = nkv_sector_erase_count(s);
+    nkv_internal_init(&ops);
+    nkv_scan();
+    uint8_t same = 1;
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        if (nkv_sector_erase_count(s) != before[s])
+            same = 0;
+    TEST_ASSERT(same, "Erase counts persist across remount");
+    #endif
+
+    /* 擦除完成后、记录次数前掉电：挂载时按最大值估计 */
+    int16_t free_idx = -1;
+    for (uint8_t s = 0; s < TEST_SECTOR_COUNT; s++)
+        if (!inst->sectors[s].valid)
+            free_idx = s;
+    memset(&g_flash[free_idx * TEST_SECTOR_SIZE], 0xFF, TEST_SECTOR_SIZE);
+    nkv_internal_init(&ops);
+    nkv_scan();
+    nkv_wear_stats(&wear);
+    TEST_ASSERT(free_idx >= 0 && nkv_sector_erase_count((uint8_t) free_idx) == wear.max_erases,
+                "Unrecorded count estimated from the most worn sector");
+
+    nkv_gc_set_policy(NKV_GC_POLICY);
+    print_usage();
+}
+
+#if NKV_OP_STATS
+static void test_op_stats(void)
+{
+    printf("\n=== 36. 操作统计测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    nkv_op_stats_t  op;
+    build_flash_ops(&ops);
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_internal_init(&ops);
+    g_sim_us = 0;
+    nkv_scan();
+    nkv_op_stats(&op);
+    TEST_ASSERT(op.scan_us == g_sim_us && op.write_calls > 0, "Mount scan counted and timed");
+
+    /* 覆盖写触发多轮GC，计数与模拟Flash自身统计逐项对照 */
+    uint32_t reads = g_read_calls, rbytes = g_read_bytes, writes = g_write_calls, erases = g_erase_calls;
+    nkv_op_stats_reset();
+    char    key[8];
+    uint8_t val[24];
+    uint8_t ok = 1;
+    memset(val, 0x5A, sizeof(val));
+    nkv_set("cold", val, sizeof(val)); /* 从不改写，每轮GC都需迁移 */
+    for (uint32_t i = 0; i < 1200; i++)
+    {
+        snprintf(key, sizeof(key), "os%02u", (unsigned) (i % 24));
+        memset(val, (int) i, sizeof(val));
+        if (nkv_set(key, val, sizeof(val)) != NKV_OK || nkv_get(key, val, sizeof(val), NULL) != NKV_OK)
+            ok = 0;
+        if (i % 50 == 49)
+            nkv_del(key);
+    }
+    nkv_op_stats(&op);
+    printf("  [INFO] reads=%u/%uB writes=%u/%uB erases=%u states=%u gc=%u/%u/%u switches=%u\n",
+           (unsigned) op.read_calls,
+           (unsigned) op.read_bytes,
+           (unsigned) op.write_calls,
+           (unsigned) op.write_bytes,
+           (unsigned) op.erase_calls,
+           (unsigned) op.state_writes,
+           (unsigned) op.gc_scanned,
+           (unsigned) op.gc_migrated,
+           (unsigned) op.gc_skipped,
+           (unsigned) op.sector_switches);
+    TEST_ASSERT(ok && op.scan_us != 0, "Workload completes, reset keeps scan time");
+    TEST_ASSERT(op.read_calls == g_read_calls - reads && op.read_bytes == g_read_bytes - rbytes, "Read counters match flash");
+    TEST_ASSERT(op.write_calls == g_write_calls - writes && op.erase_calls == g_erase_calls - erases,
+                "Program and erase counters match flash");
+    TEST_ASSERT(op.state_writes > 0 && op.state_writes < op.write_calls, "State rewrites counted");
+    TEST_ASSERT(op.sector_switches > 0 && op.gc_migrated > 0 && op.gc_migrated + op.gc_skipped == op.gc_scanned,
+                "GC entries split into migrated and skipped");
+    TEST_ASSERT(op.live_bytes > 0 && op.dead_bytes < TEST_FLASH_SIZE, "Live and dead bytes reported");
+
+    #if NKV_VERIFY_ON_READ
+    /* 篡改Flash中的值：读取返回CRC错误并计数 */
+    const uint8_t pat[] = "op-crc-probe";
+    nkv_set("crc", pat, sizeof(pat));
+        #if NKV_CACHE_ENABLE
+    nkv_cache_clear();
+        #endif
+    uint8_t* hit = NULL;
+    for (uint32_t a = 0; a + sizeof(pat) <= TEST_FLASH_SIZE && !hit; a++)
+        if (memcmp(&g_flash[a], pat, sizeof(pat)) == 0)
+            hit = &g_flash[a];
+    uint32_t crc_before = op.crc_errors;
+    if (hit)
+        hit[0] ^= 0x01;
+    TEST_ASSERT(hit && nkv_get("crc", val, sizeof(val), NULL) == NKV_ERR_CRC, "Corrupted value rejected");
+    nkv_op_stats(&op);
+    TEST_ASSERT(op.crc_errors == crc_before + 1, "CRC error counted");
+    if (hit)
+        hit[0] ^= 0x01;
+    #endif
+
+    nkv_op_stats_reset();
+    nkv_op_stats(&op);
+    TEST_ASSERT(op.read_calls == 0 && op.write_calls == 0 && op.gc_scanned == 0 && op.crc_errors == 0,
+                "Reset clears counters");
+}
+#endif
+
+/* 37. Flash模拟器：NOR编程语义、编程页拆分与耗时模型，各器件预设下的模拟耗时 */
+static nkv_instance_t g_sim_db;
+static uint8_t        g_sim_mem[512 * 1024];
+
+static void test_flash_sim(void)
+{
+    printf("\n=== 37. Flash模拟器测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    nkv_sim_stats_t st;
+    nkv_sim_cfg_t   cfg = nkv_sim_spi_nor;
+    TEST_ASSERT(nkv_sim_init(&cfg, g_sim_mem) == NKV_OK, "Simulator init");
+    nkv_sim_ops(&ops);
+
+    /* 编程只能清零位，跨页写入拆分为两次页编程 */
+    uint8_t a = 0x0F, b = 0xF0, out = 0;
+    uint8_t page[8];
+    memset(page, 0x55, sizeof(page));
+    ops.write(0, &a, 1);
+    ops.write(0, &b, 1);
+    ops.read(0, &out, 1);
+    nkv_sim_stats(&st);
+    TEST_ASSERT(out == 0x00 && st.bit_errors == 1 && st.align_errors == 2, "Programming ANDs, 0->1 reported");
+    nkv_sim_stats_reset();
+    ops.write(cfg.page_size - 4, page, sizeof(page));
+    nkv_sim_stats(&st);
+    TEST_ASSERT(st.prog_ops == 2 && st.busy_ns == 2ull * cfg.prog_op_ns + sizeof(page) * cfg.prog_byte_ns,
+                "Write split at page boundary and timed");
+    uint32_t t0 = nkv_sim_clock_us();
+    ops.erase(cfg.sector_size);
+    nkv_sim_stats(&st);
+    TEST_ASSERT(nkv_sim_clock_us() - t0 == cfg.erase_us && st.sector_erases[1] == 1 && st.sector_erases[0] == 0,
+                "Erase timed and counted per sector");
+    TEST_ASSERT(ops.write(cfg.sector_size * cfg.sector_count - 2, page, 4) != 0, "Out-of-range write rejected");
+
+    /* 各器件预设下运行同一负载：NanoKV 从不需要把0编程为1 */
+    const nkv_sim_cfg_t* presets[] = {&nkv_sim_stm32f4, &nkv_sim_spi_nor};
+    for (uint8_t p = 0; p < sizeof(presets) / sizeof(presets[0]); p++)
+    {
+        nkv_sim_init(presets[p], g_sim_mem);
+        nkv_sim_ops(&ops);
+        nkv_internal_init_ex(&g_sim_db, &ops);
+        nkv_scan_ex(&g_sim_db);
+        nkv_sim_stats_reset();
+
+        char     key[8];
+        uint32_t val[4];
+        uint8_t  ok = 1;
+        uint32_t n  = 3000, t = nkv_sim_clock_us();
+        for (uint32_t i = 0; i < n; i++)
+        {
+            snprintf(key, sizeof(key), "sim%02u", (unsigned) (i % 40));
+            val[0] = val[3] = i;
+            if (nkv_set_ex(&g_sim_db, key, val, sizeof(val)) != NKV_OK)
+                ok = 0;
+        }
+        uint32_t set_us = nkv_sim_clock_us() - t;
+        t               = nkv_sim_clock_us();
+        for (uint32_t i = n - 40; i < n; i++)
+        {
+            snprintf(key, sizeof(key), "sim%02u", (unsigned) (i % 40));
+            if (nkv_get_ex(&g_sim_db, key, val, sizeof(val), NULL) != NKV_OK || val[0] != i || val[3] != i)
+                ok = 0;
+        }
+        uint32_t get_us = nkv_sim_clock_us() - t;
+        nkv_sim_stats(&st);
+        printf("  [PERF] %-8s set %.1fus/op, get %.2fus/op, %u prog ops, %u erases\n",
+               presets[p]->name,
+               (double) set_us / n,
+               get_us / 40.0,
+               (unsigned) st.prog_ops,
+               (unsigned) st.erases);
+        TEST_ASSERT(ok && st.bit_errors == 0 && st.align_errors == 0, "Workload respects NOR programming rules");
+    }
+}
+
+/* 38. 掉电模糊测试：重放同一负载，依次在第N次 write/erase 中途掉电(半写/半擦)，重新挂载后与参考模型比对 */
+    #define PL_KEYS    10
+    #define PL_TYPES   3
+    #define PL_STEPS   400
+    #define PL_VAL_LEN 24
+    #define PL_BATCH   (NKV_BATCH_MAX < 3 ? NKV_BATCH_MAX : 3) /* 批量写入的键数 */
+
+typedef struct
+{
+    int32_t ver[PL_KEYS + PL_TYPES];  /* 已确认的版本，-1=不存在；后PL_TYPES项为TLV类型 */
+    int32_t next[PL_KEYS + PL_TYPES]; /* 进行中操作写入的版本(-1=删除)，-2=未涉及 */
+    uint8_t batch;                    /* 进行中的是批量写入(须全部生效或全部不生效) */
+} pl_model_t;
+
+static jmp_buf    g_pl_jmp;
+static pl_model_t g_pl;
+static uint8_t    g_pl_image[4 * 4096]; /* 刚挂载的空分区镜像，每轮从它开始 */
+
+static void pl_power_lost(void)
+{
+    longjmp(g_pl_jmp, 1);
+}
+
+static void pl_fill(uint8_t* val, uint8_t slot, int32_t ver)
+{
+    memcpy(val, &ver, sizeof(ver));
+    for (uint8_t i = sizeof(ver); i < PL_VAL_LEN; i++)
+        val[i] = (uint8_t) (ver * 29 + slot * 7 + i);
+}
+
+static void pl_key(char* key, uint8_t slot)
+{
+    snprintf(key, 8, "pl%u", (unsigned) slot);
+}
+
+/* 读取一个键/TLV类型的当前版本：-1=不存在，-3=读取出错或内容损坏 */
+static int32_t pl_read(uint8_t slot)
+{
+    uint8_t   val[PL_VAL_LEN], expect[PL_VAL_LEN];
+    uint8_t   len = 0;
+    char      key[8];
+    nkv_err_t err;
+    if (slot < PL_KEYS)
+    {
+        pl_key(key, slot);
+        err = nkv_get_ex(&g_sim_db, key, val, sizeof(val), &len);
+    }
+    else
+        err = nkv_tlv_get_ex(&g_sim_db, (uint8_t) (0x50 + slot - PL_KEYS), val, sizeof(val), &len);
+    if (err == NKV_ERR_NOT_FOUND)
+        return -1;
+    int32_t ver;
+    memcpy(&ver, val, sizeof(ver));
+    pl_fill(expect, slot, ver);
+    return (err == NKV_OK && len == PL_VAL_LEN && memcmp(val, expect, len) == 0) ? ver : -3;
+}
+
+/* 按固定种子生成的负载：单键写入、删除、多键批量写入、TLV写入与后台维护 */
+static void pl_workload(void)
+{
+    uint32_t rng = 12345;
+    uint8_t  val[PL_BATCH][PL_VAL_LEN];
+    char     key[PL_BATCH][8];
+    for (uint32_t step = 1; step <= PL_STEPS; step++)
+    {
+        rng          = rng * 1103515245u + 12345u;
+        uint32_t r   = (rng >> 16) % 100;
+        uint8_t  k   = (uint8_t) ((rng >> 8) % PL_KEYS);
+        int32_t  ver = (int32_t) step;
+        for (uint8_t i = 0; i < PL_KEYS + PL_TYPES; i++)
+            g_pl.next[i] = -2;
+        g_pl.batch = 0;
+
+        if (r < 65)
+        {
+            g_pl.next[k] = ver;
+            pl_key(key[0], k);
+            pl_fill(val[0], k, ver);
+            nkv_set_ex(&g_sim_db, key[0], val[0], PL_VAL_LEN);
+        }
+        else if (r < 75)
+        {
+            g_pl.next[k] = -1;
+            pl_key(key[0], k);
+            nkv_del_ex(&g_sim_db, key[0]);
+        }
+        else if (r < 85)
+        {
+            nkv_batch_item_t items[PL_BATCH];
+            g_pl.batch = 1;
+            for (uint8_t i = 0; i < PL_BATCH; i++)
+            {
+                uint8_t bk = (uint8_t) ((k + i * 3) % PL_KEYS);
+                g_pl.next[bk] = ver;
+                pl_key(key[i], bk);
+                pl_fill(val[i], bk, ver);
+                items[i].key   = key[i];
+                items[i].value = val[i];
+                items[i].len   = PL_VAL_LEN;
+            }
+            nkv_set_batch_ex(&g_sim_db, items, PL_BATCH);
+        }
+        else if (r < 95)
+        {
+            uint8_t slot     = (uint8_t) (PL_KEYS + step % PL_TYPES);
+            g_pl.next[slot] = ver;
+            pl_fill(val[0], slot, ver);
+            nkv_tlv_set_ex(&g_sim_db, (uint8_t) (0x50 + slot - PL_KEYS), val[0], PL_VAL_LEN);
+        }
+        else
+        {
+    #if NKV_BACKGROUND_GC
+            nkv_budget_t budget = {4, 0};
+            nkv_background_ex(&g_sim_db, &budget);
+    #endif
+        }
+
+        /* 操作完成：进行中的版本转为已确认 */
+        for (uint8_t i = 0; i < PL_KEYS + PL_TYPES; i++)
+            if (g_pl.next[i] != -2)
+                g_pl.ver[i] = g_pl.next[i];
+    }
+    for (uint8_t i = 0; i < PL_KEYS + PL_TYPES; i++)
+        g_pl.next[i] = -2;
+}
+
+/* 重新挂载后逐项比对：只允许已确认的版本，或被打断操作写入的版本(批量写入须整体一致) */
+static uint8_t pl_check(void)
+{
+    uint8_t applied = 0, kept = 0;
+    for (uint8_t i = 0; i < PL_KEYS + PL_TYPES; i++)
+    {
+        int32_t ver = pl_read(i);
+        if (ver == g_pl.ver[i] && ver == g_pl.next[i])
+            continue;
+        if (ver == g_pl.ver[i])
+            kept += (g_pl.next[i] != -2);
+        else if (g_pl.next[i] != -2 && ver == g_pl.next[i])
+            applied++;
+        else
+            return 0;
+    }
+    return !(g_pl.batch && applied && kept);
+}
+
+static void test_power_loss_fuzz(void)
+{
+    printf("\n=== 38. 掉电模糊测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    nkv_sim_stats_t st;
+    nkv_sim_cfg_t   cfg = nkv_sim_spi_nor;
+    cfg.sector_count    = sizeof(g_pl_image) / cfg.sector_size; /* 负载足以多次触发回收与扇区切换 */
+
+    /* 无掉电运行一次，得到总的 write/erase 次数 */
+    nkv_sim_init(&cfg, g_sim_mem);
+    nkv_sim_ops(&ops);
+    nkv_internal_init_ex(&g_sim_db, &ops);
+    nkv_scan_ex(&g_sim_db);
+    nkv_internal_init_ex(&g_sim_db, &ops); /* 再次挂载写入配置版本，之后挂载不再写入 */
+    nkv_scan_ex(&g_sim_db);
+    memcpy(g_pl_image, g_sim_mem, sizeof(g_pl_image));
+    memset(&g_pl, 0xFF, sizeof(g_pl));
+    nkv_sim_stats_reset();
+    pl_workload();
+    nkv_sim_stats(&st);
+    uint32_t total = st.write_calls + st.erases;
+    TEST_ASSERT(pl_check() && st.erases > 0, "Reference run matches model");
+
+    volatile uint32_t bad_mount = 0, bad_data = 0, bad_recover = 0, cuts = 0;
+    for (uint32_t n = 1; n <= total; n++)
+    {
+        nkv_sim_init(&cfg, g_sim_mem);
+        memcpy(g_sim_mem, g_pl_image, sizeof(g_pl_image));
+        nkv_internal_init_ex(&g_sim_db, &ops);
+        nkv_scan_ex(&g_sim_db);
+        memset(&g_pl, 0xFF, sizeof(g_pl));
+        if (setjmp(g_pl_jmp) == 0)
+        {
+            nkv_sim_power_cut(n, pl_power_lost);
+            pl_workload();
+            continue; /* 本轮负载的 write/erase 次数不足 n(不应发生) */
+        }
+        cuts++;
+
+        /* 重启：恢复供电，重新挂载 */
+        nkv_sim_power_cut(0, NULL);
+        nkv_sim_stats_reset();
+        if (nkv_internal_init_ex(&g_sim_db, &ops) != NKV_OK || nkv_scan_ex(&g_sim_db) != NKV_OK)
+        {
+            bad_mount++;
+            continue;
+        }
+        if (!pl_check())
+        {
+            bad_data++;
+            if (bad_data <= 3)
+                printf("  [INFO] inconsistent state after cut at flash op %u\n", (unsigned) n);
+            continue;
+        }
+
+        /* 恢复后仍可写入：所有键写入新版本，再次挂载后全部可读，且从不需要把0编程为1 */
+        for (uint8_t i = 0; i < PL_KEYS + PL_TYPES; i++)
+            g_pl.ver[i] = g_pl.next[i] = (g_pl.next[i] != -2) ? pl_read(i) : g_pl.ver[i];
+        uint8_t ok = 1;
+        for (uint8_t i = 0; i < PL_KEYS; i++)
+        {
+            char    key[8];
+            uint8_t val[PL_VAL_LEN];
+            pl_key(key, i);
+            pl_fill(val, i, 100000 + i);
+            g_pl.ver[i] = 100000 + i;
+            if (nkv_set_ex(&g_sim_db, key, val, PL_VAL_LEN) != NKV_OK)
+                ok = 0;
+        }
+        for (uint8_t i = 0; i < PL_KEYS + PL_TYPES; i++)
+            g_pl.next[i] = -2;
+        nkv_internal_init_ex(&g_sim_db, &ops);
+        nkv_scan_ex(&g_sim_db);
+        nkv_sim_stats(&st);
+        if (!ok || !pl_check() || st.bit_errors != 0)
+            bad_recover++;
+    }
+    printf("  [INFO] %u flash ops, %u power cuts: %u mount failures, %u inconsistent, %u not writable after recovery\n",
+           (unsigned) total,
+           (unsigned) cuts,
+           (unsigned) bad_mount,
+           (unsigned) bad_data,
+           (unsigned) bad_recover);
+    TEST_ASSERT(cuts == total, "Power cut injected at every write and erase");
+    TEST_ASSERT(bad_mount == 0, "Every interrupted image mounts");
+    TEST_ASSERT(bad_data == 0, "Only acknowledged or in-flight versions visible, batches atomic");
+    TEST_ASSERT(bad_recover == 0, "Store writable after recovery");
+}
+
+/* 在活动扇区写偏移处伪造条目头(及键名)，模拟损坏的Flash内容 */
+static uint32_t forge_entry(uint8_t key_len, uint8_t val_len, const char* key)
+{
+    nkv_entry_t e = {NKV_STATE_VALID, key_len, val_len, 0, NKV_ENTRY_FLAG_NONE};
+    uint32_t    off = (uint32_t) g_sim_db.active_sector * g_sim_db.flash.sector_size + g_sim_db.write_offset;
+    memcpy(&g_sim_mem[off], &e, sizeof(e));
+    memcpy(&g_sim_mem[off + sizeof(e)], key, strlen(key));
+    return g_sim_db.write_offset;
+}
+
+static void test_corrupt_entries(void)
+{
+    printf("\n=== 39. 损坏条目头测试 ===\n");
+
+    nkv_flash_ops_t ops;
+    nkv_sim_cfg_t   cfg = nkv_sim_spi_nor;
+    cfg.mapped          = 1; /* 零拷贝读取路径直接访问存储区 */
+    nkv_sim_init(&cfg, g_sim_mem);
+    nkv_sim_ops(&ops);
+    nkv_internal_init_ex(&g_sim_db, &ops);
+    nkv_scan_ex(&g_sim_db);
+    nkv_internal_init_ex(&g_sim_db, &ops); /* 再次挂载写入配置版本，之后挂载不再写入 */
+    nkv_scan_ex(&g_sim_db);
+
+    /* 写到活动扇区接近末尾 */
+    char     key[8];
+    uint8_t  val[32], out[NKV_MAX_VALUE_LEN], len = 0;
+    uint8_t  active = g_sim_db.active_sector, ok = 1;
+    uint16_t n      = 0;
+    memset(val, 0x3C, sizeof(val));
+    while (g_sim_db.write_offset < cfg.sector_size - 200 && g_sim_db.active_sector == active)
+    {
+        snprintf(key, sizeof(key), "c%u", (unsigned) n++);
+        nkv_set_ex(&g_sim_db, key, val, sizeof(val));
+    }
+
+    /* 长度越过扇区末尾：其后无法解析，扇区按已满处理，不建立索引、不越界读取 */
+    forge_entry(2, 255, "zz");
+    nkv_internal_init_ex(&g_sim_db, &ops);
+    nkv_scan_ex(&g_sim_db);
+    TEST_ASSERT(g_sim_db.write_offset == cfg.sector_size, "Entry crossing sector end ends the sector");
+    TEST_ASSERT(nkv_get_ex(&g_sim_db, "zz", out, sizeof(out), &len) == NKV_ERR_NOT_FOUND, "Truncated entry not indexed");
+    TEST_ASSERT(nkv_set_ex(&g_sim_db, "new", val, 8) == NKV_OK && g_sim_db.active_sector != active,
+                "Next write switches sector");
+
+    /* 键长超出上限但长度可用：按已删除条目整体跳过，之后的写入追加在其后 */
+    uint32_t at = forge_entry(40, 4, "long_key");
+    nkv_internal_init_ex(&g_sim_db, &ops);
+    nkv_scan_ex(&g_sim_db);
+    TEST_ASSERT(g_sim_db.write_offset == at + 52, "Oversized key_len skipped as one entry");
+    nkv_set_ex(&g_sim_db, "after", val, 4);
+    nkv_internal_init_ex(&g_sim_db, &ops);
+    nkv_scan_ex(&g_sim_db);
+    for (uint16_t i = 0; i < n; i++)
+    {
+        snprintf(key, sizeof(key), "c%u", (unsigned) i);
+        if (nkv_get_ex(&g_sim_db, key, out, sizeof(out), &len) != NKV_OK || len != sizeof(val) ||
+            memcmp(out, val, sizeof(val)) != 0)
+            ok = 0;
+    }
+    TEST_ASSERT(ok && nkv_exists_ex(&g_sim_db, "new") && nkv_exists_ex(&g_sim_db, "after"),
+                "Data around corrupt entries intact");
+}
+
+#if NKV_THREAD_SAFE && !defined(_WIN32)
+/* 40. 多线程压力测试：1个写线程 + 多个读线程共享一个实例 */
+    #define MT_READERS 3
+    #define MT_KEYS    6
+    #define MT_WRITES  1500
+    #define MT_VAL_LEN 24
+
+static nkv_instance_t  g_mt;
+static pthread_mutex_t g_mt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile int    g_mt_done;
+static volatile int    g_mt_in_write; /* 写线程正处于 nkv_set_ex 中 */
+static uint32_t        g_mt_reads[MT_READERS];
+static uint32_t        g_mt_overlap[MT_READERS]; /* 与写操作重叠完成的读取次数 */
+static uint32_t        g_mt_torn[MT_READERS];
+
+static void mt_lock(void* ctx)
+{
+    pthread_mutex_lock((pthread_mutex_t*) ctx);
+}
+
+static void mt_unlock(void* ctx)
+{
+    pthread_mutex_unlock((pthread_mutex_t*) ctx);
+}
+
+/* 值由版本号派生，读者可据此检测读到的值是否被撕裂 */
+static void mt_fill(uint8_t* val, uint32_t ver)
+{
+    memcpy(val, &ver, sizeof(ver));
+    for (uint8_t i = sizeof(ver); i < MT_VAL_LEN; i++)
+        val[i] = (uint8_t) (ver * 31u + i);
+}
+
+static int mt_check(const uint8_t* val)
+{
+    uint32_t ver;
+    memcpy(&ver, val, sizeof(ver));
+    for (uint8_t i = sizeof(ver); i < MT_VAL_LEN; i++)
+        if (val[i] != (uint8_t) (ver * 31u + i))
+            return 0;
+    return 1;
+}
+
+static void* mt_writer(void* arg)
+{
+    uint8_t val[MT_VAL_LEN];
+    char    key[8];
+    (void) arg;
+    for (uint32_t ver = 1; ver <= MT_WRITES; ver++)
+    {
+        snprintf(key, sizeof(key), "mt%u", (unsigned) (ver % MT_KEYS));
+        mt_fill(val, ver);
+        g_mt_in_write = 1;
+        nkv_set_ex(&g_mt, key, val, MT_VAL_LEN);
+        g_mt_in_write = 0;
+    }
+    g_mt_done = 1;
+    return NULL;
+}
+
+static void* mt_reader(void* arg)
+{
+    int     id = (int) (intptr_t) arg;
+    uint8_t val[MT_VAL_LEN];
+    char    key[8];
+    uint8_t len;
+    uint32_t n = (uint32_t) id;
+    while (!g_mt_done)
+    {
+        snprintf(key, sizeof(key), "mt%u", (unsigned) (n++ % MT_KEYS));
+        if (nkv_get_ex(&g_mt, key, val, sizeof(val), &len) != NKV_OK)
+            continue;
+        g_mt_reads[id]++;
+        if (len != MT_VAL_LEN || !mt_check(val))
+            g_mt_torn[id]++;
+        if (g_mt_in_write)
+            g_mt_overlap[id]++;
+    }
+    return NULL;
+}
+
+static void test_thread_stress(void)
+{
+    printf("\n=== 40. 多线程压力测试 ===\n");
+
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+    ops.lock     = mt_lock;
+    ops.unlock   = mt_unlock;
+    ops.lock_ctx = &g_mt_mutex;
+    nkv_internal_init_ex(&g_mt, &ops);
+    nkv_scan_ex(&g_mt);
+
+    /* 预先写入所有键，读者从第一次读取起即可命中 */
+    uint8_t val[MT_VAL_LEN];
+    char    key[8];
+    for (uint32_t k = 0; k < MT_KEYS; k++)
+    {
+        snprintf(key, sizeof(key), "mt%u", (unsigned) k);
+        mt_fill(val, k);
+        nkv_set_ex(&g_mt, key, val, MT_VAL_LEN);
+    }
+
+    g_mt_done        = 0;
+    g_write_delay_us = 20;
+    pthread_t writer, readers[MT_READERS];
+    for (int i = 0; i < MT_READERS; i++)
+        pthread_create(&readers[i], NULL, mt_reader, (void*) (intptr_t) i);
+    pthread_create(&writer, NULL, mt_writer, NULL);
+    pthread_join(writer, NULL);
+    for (int i = 0; i < MT_READERS; i++)
+        pthread_join(readers[i], NULL);
+    g_write_delay_us = 0;
+
+    uint32_t reads = 0, overlap = 0, torn = 0;
+    for (int i = 0; i < MT_READERS; i++)
+    {
+        reads += g_mt_reads[i];
+        overlap += g_mt_overlap[i];
+        torn += g_mt_torn[i];
+    }
+    printf("  [INFO] %u writes, %u reads (%u overlapped an in-flight write), %u torn\n",
+           (unsigned) MT_WRITES,
+           (unsigned) reads,
+           (unsigned) overlap,
+           (unsigned) torn);
+    TEST_ASSERT(torn == 0, "Concurrent readers never observe torn values");
+    TEST_ASSERT(overlap > 0, "Reads complete while a write holds the lock");
+
+    /* 结束后每个键均为最后写入的版本 */
+    uint8_t ok = 1, len;
+    for (uint32_t ver = MT_WRITES - MT_KEYS + 1; ver <= MT_WRITES; ver++)
+    {
+        uint32_t got = 0;
+        snprintf(key, sizeof(key), "mt%u", (unsigned) (ver % MT_KEYS));
+        if (nkv_get_ex(&g_mt, key, val, sizeof(val), &len) != NKV_OK || !mt_check(val))
+            ok = 0;
+        memcpy(&got, val, sizeof(got));
+        if (got != ver)
+            ok = 0;
+    }
+    TEST_ASSERT(ok, "Final values match the last write of each key");
+}
+#endif
+
+/* ==================== 主函数 ==================== */
+
+int main(void)
+{
+    printf("========================================\n");
+    printf("   NanoKV 完整功能测试\n");
+    printf("========================================\n");
+
+    /* 初始化计时器 */
+    timer_init();
+
+    /* 初始化模拟 Flash */
+    memset(g_flash, 0xFF, sizeof(g_flash));
+
+    nkv_flash_ops_t ops;
+    build_flash_ops(&ops);
+
+    /* 初始化 NanoKV */
+    nkv_err_t err = nkv_internal_init(&ops);
+    printf("\nnkv_internal_init -> %d\n", err);
+    if (err != NKV_OK)
+        return -1;
+
+    err = nkv_scan();
+    printf("nkv_scan -> %d\n", err);
+    if (err != NKV_OK)
+        return -1;
+
+    print_usage();
+
+    /* 运行所有测试 */
+    test_kv_basic();
+    test_kv_defaults();
+    test_tlv_basic();
+    test_tlv_defaults();
+    test_tlv_iterator();
+    test_tlv_history();
+
+#if NKV_CACHE_ENABLE
+    test_cache();
+#endif
+
+#if NKV_INCREMENTAL_GC
+    test_incremental_gc();
+#endif
+
+#if NKV_TLV_RETENTION_ENABLE
+    test_tlv_retention();
+#endif
+
+    test_alignment();
+    test_full_gc();
+
+#if NKV_INCREMENTAL_GC
+    test_incremental_gc_detail();
+#endif
+
+    test_multi_keys();
+
+    /* 新增测试 */
+    test_performance_benchmark();
+
+#if NKV_INCREMENTAL_GC
+    test_incremental_gc_full();
+#endif
+
+    test_version_sync();
+    test_power_fail_safety();
+
+#if NKV_INDEX_ENABLE
+    test_index();
+#endif
+
+    test_boot_benchmark();
+    test_read_window();
+    test_crc_engine();
+    test_multi_instance();
+    test_batch_write();
+
+#if NKV_CACHE_ENABLE
+    test_cache_engine();
+#endif
+#if NKV_BLOOM_ENABLE
+    test_bloom_filter();
+#endif
+#if NKV_WRITE_BUFFER
+    test_write_buffer();
+#endif
+    test_gc_policy();
+    test_gc_collisions();
+    test_format_upgrade();
+#if NKV_LARGE_VALUE
+    test_large_value();
+#endif
+#if NKV_ZERO_COPY
+    test_zero_copy();
+#endif
+#if NKV_BACKGROUND_GC && NKV_LATENCY_STATS
+    test_background();
+#endif
+#if NKV_BACKGROUND_GC && NKV_INCREMENTAL_GC
+    test_spare_pool();
+#endif
+#if NKV_ASYNC_FLASH
+    test_async_flash();
+#endif
+    test_wear_leveling();
+#if NKV_OP_STATS
+    test_op_stats();
+#endif
+    test_flash_sim();
+    test_power_loss_fuzz();
+    test_corrupt_entries();
+
+#if NKV_THREAD_SAFE && !defined(_WIN32)
+    test_thread_stress();
+#endif
 
     /* 打印性能统计 */
     print_perf_summary();